@@ -221,6 +221,36 @@ i_uid_read, [
 ])
 ]) # LIBCFS_I_UID_READ
 
+#
+# 2.6.37 added local_clock() in place of cpu_clock(smp_processor_id())
+#
+AC_DEFUN([LIBCFS_LOCAL_CLOCK], [
+LB_CHECK_COMPILE([if 'local_clock' exists],
+local_clock, [
+	#include <linux/sched.h>
+],[
+	local_clock();
+],[
+	AC_DEFINE(HAVE_LOCAL_CLOCK, 1, [local_clock exists])
+])
+]) # LIBCFS_LOCAL_CLOCK
+
+#
+# 2.6.38 x86 exports the CPUs sharing the last level cache
+#
+AC_DEFUN([LIBCFS_CPU_LLC_SHARED_MASK], [
+LB_CHECK_COMPILE([if 'cpu_llc_shared_mask' exists],
+cpu_llc_shared_mask, [
+	#include <linux/smp.h>
+	#include <asm/smp.h>
+],[
+	cpumask_weight(cpu_llc_shared_mask(0));
+],[
+	AC_DEFINE(HAVE_CPU_LLC_SHARED_MASK, 1,
+		[cpu_llc_shared_mask exists])
+])
+]) # LIBCFS_CPU_LLC_SHARED_MASK
+
 #
 # LIBCFS_SOCK_ALLOC_FILE
 #
@@ -319,6 +349,10 @@ LIBCFS_SYSCTL_CTLNAME
 LIBCFS_ADD_WAIT_QUEUE_EXCLUSIVE
 # 2.6.35
 LC_SK_SLEEP
+# 2.6.37
+LIBCFS_LOCAL_CLOCK
+# 2.6.38
+LIBCFS_CPU_LLC_SHARED_MASK
 # 2.6.39
 LIBCFS_DUMP_TRACE_ADDRESS
 # 2.6.40 fc15
@@ -119,6 +119,7 @@ static inline int __is_po2(unsigned long long val)
 
 /* libcfs tcpip */
 int libcfs_ipif_query(char *name, int *up, __u32 *ip, __u32 *mask);
+int libcfs_ipif_node(char *name);
 int libcfs_ipif_enumerate(char ***names);
 void libcfs_ipif_free_enumeration(char **names, int n);
 int libcfs_sock_listen(cfs_socket_t **sockp, __u32 ip, int port, int backlog);
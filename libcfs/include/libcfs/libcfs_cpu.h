@@ -59,6 +59,12 @@
  *
  *     The first character "N" means following numbers are numa ID
  *
+ *   . Or let libcfs derive them from the CPU topology: cpu_pattern="auto"
+ *     makes one partition per last level cache domain of each NUMA node,
+ *     keeping HTs of a core together, splitting large LLC domains and
+ *     merging tiny ones. LNet then binds NIs without explicit CPTs to the
+ *     partitions on the NUMA node of their interface.
+ *
  *   . NUMA allocators, CPU affinity threads are built over CPU partitions,
  *     instead of HW CPUs or HW nodes.
  *
@@ -118,6 +124,16 @@ struct cfs_cpt_table *cfs_cpt_table_alloc(unsigned int ncpt);
  * print string information of cpt-table
  */
 int cfs_cpt_table_print(struct cfs_cpt_table *cptab, char *buf, int len);
+/**
+ * print how the partitions of \a cptab were chosen
+ */
+int cfs_cpt_table_print_topology(struct cfs_cpt_table *cptab,
+				 char *buf, int len);
+/**
+ * are the partitions of \a cptab derived from the CPU topology, so none of
+ * them spans NUMA nodes
+ */
+int cfs_cpt_table_topology(struct cfs_cpt_table *cptab);
 /**
  * return total number of CPU partitions in \a cptab
  */
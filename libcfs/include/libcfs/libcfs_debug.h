@@ -55,6 +55,7 @@ extern unsigned int libcfs_console_max_delay;
 extern unsigned int libcfs_console_min_delay;
 extern unsigned int libcfs_console_backoff;
 extern unsigned int libcfs_debug_binary;
+extern unsigned int libcfs_debug_deferred;
 extern char libcfs_debug_file_path_arr[PATH_MAX];
 
 int libcfs_debug_mask2str(char *str, int size, int mask, int is_subsys);
@@ -84,6 +85,9 @@ struct ptldebug_header {
 
 
 #define PH_FLAG_FIRST_RECORD 1
+/* record holds a format ID and raw arguments instead of text, only seen in
+ * the trace pages of the kernel, never in dumped logs */
+#define PH_FLAG_DEFERRED     2
 
 /* Debugging subsystems (32 bits, non-overlapping) */
 #define S_UNDEFINED	0x00000001
@@ -186,6 +190,8 @@ struct libcfs_debug_msg_data {
         int                      msg_line;
         int                      msg_mask;
         cfs_debug_limit_state_t  *msg_cdls;
+        /* ID of the format last logged from here, see tracefmt.c */
+        __u32                    msg_fmt_id;
 };
 
 #define LIBCFS_DEBUG_MSG_DATA_INIT(data, mask, cdls)        \
@@ -204,6 +204,13 @@ enum cfs_hash_tag {
          * change on hash table is non-blocking
          */
         CFS_HASH_NBLK_CHANGE    = 1 << 13,
+	/**
+	 * lock-free cfs_hash_lookup() under RCU, bucket locks are only
+	 * taken by changes. Items must be freed after an RCU grace period
+	 * and ops::hs_get_rcu and ops::hs_put must be provided, see
+	 * cfs_hash_ops_t.
+	 */
+	CFS_HASH_RCU		= 1 << 14,
         /** NB, we typed hs_flags as  __u16, please change it
          * if you need to extend >=16 flags */
 };
@@ -218,6 +225,8 @@ enum cfs_hash_tag {
  *      hash-table with & without refcount
  *    . four lock modes
  *      nolock, one-spinlock, rw-bucket-lock, spin-bucket-lock
+ *    . RCU lookup
+ *      cfs_hash_lookup() of a bucket-locked hash can run without any lock
  *    . general operations
  *      lookup, add(add_tail or add_head), delete
  *    . rehash
@@ -249,6 +258,16 @@ enum cfs_hash_tag {
  * depending on whether the worker task has yet to transfer the object
  * to its new location in the table. Lookups and deletions need to search both
  * locations; additions must take care to only insert into the new bucket.
+ *
+ * RCU lookup:
+ * With CFS_HASH_RCU, cfs_hash_lookup() walks the hlist under rcu_read_lock()
+ * only. Items are added and removed with the RCU list primitives, and bucket
+ * tables replaced by rehash are freed after a grace period. Moving an item
+ * to another hlist (rehash, cfs_hash_rehash_key) can make a lock-free reader
+ * miss items, so movers bump hs_rcu_gen, and a lookup that misses while a
+ * move was in progress or completed is redone under the locks. Items can be
+ * reached by readers until a grace period after their removal, so users
+ * must free them with call_rcu() or after synchronize_rcu().
  */
 
 typedef struct cfs_hash {
@@ -297,6 +316,10 @@ typedef struct cfs_hash {
 	atomic_t		    hs_refcount;
 	/** rehash buckets-table */
 	cfs_hash_bucket_t         **hs_rehash_buckets;
+	/** # of threads moving items, CFS_HASH_RCU only */
+	atomic_t		    hs_rcu_movers;
+	/** changed when a move starts or ends, CFS_HASH_RCU only */
+	atomic_t		    hs_rcu_gen;
 #if CFS_HASH_DEBUG_LEVEL >= CFS_HASH_DEBUG_1
         /** serialize debug members */
 	spinlock_t			hs_dep_lock;
@@ -355,6 +378,13 @@ typedef struct cfs_hash_ops {
 	void *   (*hs_object)(struct hlist_node *hnode);
 	/** get refcount of item, always called with holding bucket-lock */
 	void     (*hs_get)(cfs_hash_t *hs, struct hlist_node *hnode);
+	/**
+	 * get refcount of item found by a lock-free lookup of a CFS_HASH_RCU
+	 * hash, called under rcu_read_lock() only. Returns 0 if no reference
+	 * can be taken that way (i.e. the item is being freed), the lookup is
+	 * then redone under the bucket-lock.
+	 */
+	int      (*hs_get_rcu)(cfs_hash_t *hs, struct hlist_node *hnode);
 	/** release refcount of item */
 	void     (*hs_put)(cfs_hash_t *hs, struct hlist_node *hnode);
 	/** release refcount of item, always called with holding bucket-lock */
@@ -471,6 +501,17 @@ cfs_hash_with_nblk_change(cfs_hash_t *hs)
         return (hs->hs_flags & CFS_HASH_NBLK_CHANGE) != 0;
 }
 
+static inline int
+cfs_hash_with_rcu(cfs_hash_t *hs)
+{
+#ifdef __KERNEL__
+	return (hs->hs_flags & CFS_HASH_RCU) != 0;
+#else
+	/* no RCU in userspace, lookups take the locks */
+	return 0;
+#endif
+}
+
 static inline int
 cfs_hash_is_exiting(cfs_hash_t *hs)
 {       /* cfs_hash_destroy is called */
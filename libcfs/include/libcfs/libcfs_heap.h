@@ -49,6 +49,14 @@
  * which is used by the heap as the binary predicate during its internal sorting
  * operations.
  *
+ * A heap created with \e CBH_FLAG_DARY is a 4-ary heap instead: the four
+ * children of a node are adjacent in one cacheline, so a sink examines them
+ * all for one cache miss and the tree is half as deep. Elements live in
+ * page-sized chunks found through two directory pages, which stay hot in
+ * cache. If the user provides cfs_binheap_ops_t::hop_key(), the key of every
+ * element is stored next to its pointer, so most comparisons don't
+ * dereference the elements at all.
+ *
  * The current implementation enforces no locking scheme, and so assumes the
  * user caters for locking between calls to insert, delete and lookup
  * operations. Since the only consumer for the data structure at this point
@@ -75,13 +83,33 @@ typedef struct {
 
 #define CBH_POISON	0xdeadbeef
 
+/** # children per node of a d-ary heap, 4 entries fill a cacheline */
+#define CBH_DARY	4
+#define CBH_DSHIFT	8
+#define CBH_DSIZE      (1 << CBH_DSHIFT)		    /* # entries per chunk */
+#define CBH_DMASK      (CBH_DSIZE - 1)
+#define CBH_DNOB       (CBH_DSIZE * sizeof(cfs_binheap_entry_t))
+
 /**
  * Binary heap flags.
  */
 enum {
 	CBH_FLAG_ATOMIC_GROW	= 1,
+	/** 4-ary heap with keys stored inline */
+	CBH_FLAG_DARY		= 2,
 };
 
+/**
+ * Element of a d-ary heap, the node and a copy of its key.
+ */
+typedef struct {
+	/** cfs_binheap_ops_t::hop_key() of the node, when it was inserted or
+	 * last relocated */
+	__u64			 che_key;
+	/** the node */
+	cfs_binheap_node_t	*che_node;
+} __attribute__((aligned(16))) cfs_binheap_entry_t;
+
 struct cfs_binheap;
 
 /**
@@ -129,6 +157,20 @@ typedef struct {
 	 */
 	int		(*hop_compare)(cfs_binheap_node_t *a,
 				       cfs_binheap_node_t *b);
+	/**
+	 * Returns the primary sort key of a node: nodes with lower keys are
+	 * closer to the root, hop_compare() only orders nodes with equal
+	 * keys. The key must not change while the node is in the heap, unless
+	 * cfs_binheap_relocate() is called for it.
+	 *
+	 * Implementing this operation is optional, and only used by heaps
+	 * created with \e CBH_FLAG_DARY.
+	 *
+	 * \param[in] e The node
+	 *
+	 * \retval the key of \a e
+	 */
+	__u64		(*hop_key)(cfs_binheap_node_t *e);
 } cfs_binheap_ops_t;
 
 /**
@@ -143,6 +185,8 @@ typedef struct cfs_binheap {
 	cfs_binheap_node_t   ***cbh_elements2;
 	/** single indirect */
 	cfs_binheap_node_t    **cbh_elements1;
+	/** d-ary heap: directory of directories of chunks */
+	cfs_binheap_entry_t  ***cbh_dir;
 	/** # elements referenced */
 	unsigned int		cbh_nelements;
 	/** high water mark */
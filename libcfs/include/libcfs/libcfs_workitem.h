@@ -43,7 +43,10 @@
  * - a workitem can be concurrent with other workitems but is strictly
  *   serialized with respect to itself.
  * - no CPU affinity, a workitem does not necessarily run on the same CPU
- *   that schedules it. However, this might change in the future.
+ *   that schedules it. A workitem scheduled by a scheduler thread is queued
+ *   for that thread, but idle threads of the same scheduler steal it, and
+ *   with the wi_cpt_steal module parameter set, so do idle threads of the
+ *   scheduler with the same name on other CPTs.
  * - if a workitem is scheduled again before it has a chance to run, it
  *   runs only once.
  * - if a workitem is scheduled while it runs, it runs again after it
@@ -101,6 +104,8 @@ void cfs_wi_schedule(struct cfs_wi_sched *sched, cfs_workitem_t *wi);
 int  cfs_wi_deschedule(struct cfs_wi_sched *sched, cfs_workitem_t *wi);
 void cfs_wi_exit(struct cfs_wi_sched *sched, cfs_workitem_t *wi);
 
+int  cfs_wi_sched_print(char *buf, int len);
+
 int  cfs_wi_startup(void);
 void cfs_wi_shutdown(void);
 
@@ -63,6 +63,26 @@ struct cfs_cpu_partition {
 	nodemask_t			*cpt_nodemask;
 	/* spread rotor for NUMA allocator */
 	unsigned			cpt_spread_rotor;
+	/* the rest is only set by cfs_cpt_table_create_topology(): */
+	/* NUMA node of the partition */
+	int				cpt_node;
+	/* first CPU of the (first) LLC domain the partition is cut from */
+	int				cpt_llc;
+	/* # of small LLC domains merged into this partition */
+	int				cpt_nllc;
+	/* index of the partition and # of partitions of its LLC domain */
+	int				cpt_split;
+	int				cpt_nsplits;
+};
+
+/** how a CPU partition table was built */
+enum cfs_cpt_source {
+	/* even split of cpu_npartitions or the estimated # of partitions */
+	CFS_CPT_SRC_NPARTITIONS	= 0,
+	/* cpu_pattern given by the administrator */
+	CFS_CPT_SRC_PATTERN,
+	/* cpu_pattern="auto", from NUMA nodes, LLC domains and HTs */
+	CFS_CPT_SRC_TOPOLOGY,
 };
 
 /** descriptor for CPU partitions */
@@ -81,6 +101,8 @@ struct cfs_cpt_table {
 	cpumask_t			*ctb_cpumask;
 	/* all nodes in this partition table */
 	nodemask_t			*ctb_nodemask;
+	/* enum cfs_cpt_source */
+	int				ctb_source;
 };
 
 void cfs_cpu_core_siblings(int cpu, cpumask_t *mask);
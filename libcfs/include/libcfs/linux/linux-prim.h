@@ -106,6 +106,32 @@ static inline void __add_wait_queue_exclusive(wait_queue_head_t *q,
 }
 #endif /* HAVE___ADD_WAIT_QUEUE_EXCLUSIVE */
 
+#ifndef HAVE_LOCAL_CLOCK
+# define local_clock()	cpu_clock(smp_processor_id())
+#endif
+
+/**
+ * CPU time used by the current thread so far, in nsec. The scheduler only
+ * adds to sum_exec_runtime at ticks and context switches, so the time run
+ * since then is added from the clock it uses, with interrupts off so a tick
+ * cannot update both in between.
+ */
+static inline __u64 cfs_current_runtime_ns(void)
+{
+	unsigned long	flags;
+	__u64		runtime;
+	__u64		now;
+
+	local_irq_save(flags);
+	runtime = current->se.sum_exec_runtime;
+	now = local_clock();
+	if (now > current->se.exec_start)
+		runtime += now - current->se.exec_start;
+	local_irq_restore(flags);
+
+	return runtime;
+}
+
 /**
  * wait_queue_t of Linux (version < 2.6.34) is a FIFO list for exclusively
  * waiting threads, which is not always desirable because all threads will
@@ -0,0 +1,292 @@
+/*
+ * GPL HEADER START
+ *
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License version 2 for more details (a copy is included
+ * in the LICENSE file that accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; If not, see
+ * http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * GPL HEADER END
+ */
+/*
+ * This file is part of Lustre, http://www.lustre.org/
+ *
+ * libcfs/libcfs/cfs_hash_bench.c
+ *
+ * Micro-benchmark of cfs_hash_lookup(): for each bucket lock mode (spin,
+ * rw and spin + RCU lookup) fills a hash with \a nitems items, then runs
+ * 1, 2, 4, ... threads bound to different CPUs, up to all online CPUs,
+ * each doing \a nlookups lookups of random keys, and reports the number of
+ * lookups per second on the console.
+ */
+
+#define DEBUG_SUBSYSTEM S_LNET
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/kthread.h>
+
+#include <libcfs/libcfs.h>
+
+static int nitems = 65536;
+CFS_MODULE_PARM(nitems, "i", int, 0444,
+		"# items in the hash");
+
+static int nlookups = 1000000;
+CFS_MODULE_PARM(nlookups, "i", int, 0444,
+		"# lookups by each thread");
+
+struct hash_bench_item {
+	struct hlist_node	hbi_hnode;
+	__u64			hbi_key;
+	atomic_t		hbi_ref;
+};
+
+struct hash_bench_ctx {
+	cfs_hash_t		*hbc_hs;
+	atomic_t		hbc_ready;
+	atomic_t		hbc_running;
+	atomic_t		hbc_misses;
+	int			hbc_go;
+	struct completion	hbc_done;
+};
+
+static unsigned
+hash_bench_hash(cfs_hash_t *hs, const void *key, unsigned mask)
+{
+	return cfs_hash_u64_hash(*(__u64 *)key, mask);
+}
+
+static void *
+hash_bench_key(struct hlist_node *hnode)
+{
+	return &hlist_entry(hnode, struct hash_bench_item, hbi_hnode)->hbi_key;
+}
+
+static int
+hash_bench_keycmp(const void *key, struct hlist_node *hnode)
+{
+	return *(__u64 *)key == *(__u64 *)hash_bench_key(hnode);
+}
+
+static void *
+hash_bench_object(struct hlist_node *hnode)
+{
+	return hlist_entry(hnode, struct hash_bench_item, hbi_hnode);
+}
+
+static void
+hash_bench_get(cfs_hash_t *hs, struct hlist_node *hnode)
+{
+	atomic_inc(&((struct hash_bench_item *)
+		     hash_bench_object(hnode))->hbi_ref);
+}
+
+static int
+hash_bench_get_rcu(cfs_hash_t *hs, struct hlist_node *hnode)
+{
+	return atomic_inc_not_zero(&((struct hash_bench_item *)
+				     hash_bench_object(hnode))->hbi_ref);
+}
+
+static void
+hash_bench_put(cfs_hash_t *hs, struct hlist_node *hnode)
+{
+	atomic_dec(&((struct hash_bench_item *)
+		     hash_bench_object(hnode))->hbi_ref);
+}
+
+static cfs_hash_ops_t hash_bench_ops = {
+	.hs_hash	= hash_bench_hash,
+	.hs_key		= hash_bench_key,
+	.hs_keycmp	= hash_bench_keycmp,
+	.hs_object	= hash_bench_object,
+	.hs_get		= hash_bench_get,
+	.hs_get_rcu	= hash_bench_get_rcu,
+	.hs_put		= hash_bench_put,
+	.hs_put_locked	= hash_bench_put,
+};
+
+static int
+hash_bench_thread(void *arg)
+{
+	struct hash_bench_ctx	*ctx = arg;
+	struct hash_bench_item	*item;
+	__u64			 rnd = (unsigned long)current;
+	__u64			 key;
+	int			 i;
+
+	atomic_inc(&ctx->hbc_ready);
+	while (!ACCESS_ONCE(ctx->hbc_go))
+		cpu_relax();
+
+	for (i = 0; i < nlookups; i++) {
+		/* 64-bit LCG, good enough to spread keys */
+		rnd = rnd * 6364136223846793005ULL + 1442695040888963407ULL;
+		/* 32-bit modulo, 64-bit ones don't link on 32-bit arches */
+		key = (__u32)(rnd >> 32) % (__u32)nitems;
+
+		item = cfs_hash_lookup(ctx->hbc_hs, &key);
+		if (item == NULL) {
+			atomic_inc(&ctx->hbc_misses);
+			continue;
+		}
+		cfs_hash_put(ctx->hbc_hs, &item->hbi_hnode);
+	}
+
+	if (atomic_dec_and_test(&ctx->hbc_running))
+		complete(&ctx->hbc_done);
+	return 0;
+}
+
+static int
+hash_bench_run_threads(const char *mode, cfs_hash_t *hs, int nthreads)
+{
+	struct hash_bench_ctx	 ctx;
+	struct task_struct	*task;
+	struct timeval		 start;
+	struct timeval		 end;
+	__u64			 usec;
+	__u64			 rate;
+	int			 cpu;
+	int			 n = 0;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.hbc_hs = hs;
+	atomic_set(&ctx.hbc_running, nthreads);
+	init_completion(&ctx.hbc_done);
+
+	for_each_online_cpu(cpu) {
+		if (n == nthreads)
+			break;
+
+		task = kthread_create(hash_bench_thread, &ctx,
+				      "hash_bench_%02d", n);
+		if (IS_ERR(task)) {
+			CERROR("Can't start thread %d: %ld\n", n,
+			       PTR_ERR(task));
+			/* let the started ones run to the end */
+			if (atomic_sub_and_test(nthreads - n,
+						&ctx.hbc_running))
+				complete(&ctx.hbc_done);
+			ctx.hbc_go = 1;
+			wait_for_completion(&ctx.hbc_done);
+			return PTR_ERR(task);
+		}
+		kthread_bind(task, cpu);
+		wake_up_process(task);
+		n++;
+	}
+
+	while (atomic_read(&ctx.hbc_ready) < nthreads)
+		cond_resched();
+
+	do_gettimeofday(&start);
+	smp_mb();
+	ctx.hbc_go = 1;
+	wait_for_completion(&ctx.hbc_done);
+	do_gettimeofday(&end);
+
+	usec = (end.tv_sec - start.tv_sec) * 1000000ULL +
+	       end.tv_usec - start.tv_usec;
+	rate = (__u64)nthreads * nlookups * 1000000ULL;
+	do_div(rate, max_t(__u64, usec, 1));
+
+	LCONSOLE_INFO("%-4s %3d threads: "LPU64" lookups/s, %d misses\n",
+		      mode, nthreads, rate, atomic_read(&ctx.hbc_misses));
+	return 0;
+}
+
+static int
+hash_bench_run(const char *mode, unsigned flags,
+	       struct hash_bench_item *items)
+{
+	cfs_hash_t	*hs;
+	unsigned	 bits = 0;
+	int		 ncpus = num_online_cpus();
+	int		 rc = 0;
+	int		 i;
+
+	while ((1 << bits) < nitems && bits < CFS_HASH_BITS_MAX - 1)
+		bits++;
+	bits = max_t(unsigned, bits, CFS_HASH_BKT_BITS);
+
+	/* sized for nitems, so it's never rehashed while measuring */
+	hs = cfs_hash_create("hash_bench", bits, bits + 1, CFS_HASH_BKT_BITS,
+			     0, CFS_HASH_MIN_THETA, CFS_HASH_MAX_THETA,
+			     &hash_bench_ops, flags | CFS_HASH_REHASH);
+	if (hs == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < nitems; i++) {
+		items[i].hbi_key = i;
+		/* the reference of the hash, which cfs_hash_add() doesn't
+		 * take, hash_bench_get_rcu() fails on unreferenced items */
+		atomic_set(&items[i].hbi_ref, 1);
+		INIT_HLIST_NODE(&items[i].hbi_hnode);
+		cfs_hash_add(hs, &items[i].hbi_key, &items[i].hbi_hnode);
+	}
+
+	for (i = 1; rc == 0; i = min(i * 2, ncpus)) {
+		rc = hash_bench_run_threads(mode, hs, i);
+		if (i == ncpus)
+			break;
+	}
+
+	for (i = 0; i < nitems; i++)
+		cfs_hash_del(hs, &items[i].hbi_key, &items[i].hbi_hnode);
+	cfs_hash_putref(hs);
+
+	/* no lock-free reader can be left on the items */
+	synchronize_rcu();
+	return rc;
+}
+
+static int __init
+hash_bench_init(void)
+{
+	struct hash_bench_item	*items;
+	int			 rc;
+
+	if (nitems <= 0 || nlookups < 0) {
+		CERROR("Invalid nitems %d or nlookups %d\n",
+		       nitems, nlookups);
+		return -EINVAL;
+	}
+
+	LIBCFS_ALLOC(items, sizeof(*items) * nitems);
+	if (items == NULL)
+		return -ENOMEM;
+
+	rc = hash_bench_run("spin", CFS_HASH_SPIN_BKTLOCK, items);
+	if (rc == 0)
+		rc = hash_bench_run("rw", CFS_HASH_RW_BKTLOCK, items);
+	if (rc == 0)
+		rc = hash_bench_run("rcu", CFS_HASH_SPIN_BKTLOCK |
+					   CFS_HASH_RCU, items);
+
+	LIBCFS_FREE(items, sizeof(*items) * nitems);
+	return rc;
+}
+
+static void __exit
+hash_bench_exit(void)
+{
+}
+
+MODULE_DESCRIPTION("libcfs hash lookup benchmark");
+MODULE_LICENSE("GPL");
+
+module_init(hash_bench_init);
+module_exit(hash_bench_exit);
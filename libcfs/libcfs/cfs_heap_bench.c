@@ -0,0 +1,194 @@
+/*
+ * GPL HEADER START
+ *
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License version 2 for more details (a copy is included
+ * in the LICENSE file that accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; If not, see
+ * http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * GPL HEADER END
+ */
+/*
+ * This file is part of Lustre, http://www.lustre.org/
+ *
+ * libcfs/libcfs/cfs_heap_bench.c
+ *
+ * Micro-benchmark of cfs_binheap: for 1k, 10k, 100k ... up to \a nmax
+ * elements, inserts that many elements with random keys into a binary heap
+ * and into a 4-ary heap (CBH_FLAG_DARY), pops them all, and reports the
+ * number of inserts and pops per second of either on the console. The
+ * elements are ordered like NRS requests, by a key and a sequence number.
+ */
+
+#define DEBUG_SUBSYSTEM S_LNET
+
+#include <linux/module.h>
+#include <linux/init.h>
+
+#include <libcfs/libcfs.h>
+
+static int nmax = 1000000;
+CFS_MODULE_PARM(nmax, "i", int, 0444,
+		"max # elements in the heap");
+
+struct heap_bench_item {
+	cfs_binheap_node_t	hbi_node;
+	__u64			hbi_key;
+	__u64			hbi_seq;
+};
+
+static int
+heap_bench_compare(cfs_binheap_node_t *e1, cfs_binheap_node_t *e2)
+{
+	struct heap_bench_item *i1;
+	struct heap_bench_item *i2;
+
+	i1 = container_of(e1, struct heap_bench_item, hbi_node);
+	i2 = container_of(e2, struct heap_bench_item, hbi_node);
+
+	if (i1->hbi_key < i2->hbi_key)
+		return 1;
+	else if (i1->hbi_key > i2->hbi_key)
+		return 0;
+
+	return i1->hbi_seq < i2->hbi_seq;
+}
+
+static __u64
+heap_bench_key(cfs_binheap_node_t *e)
+{
+	return container_of(e, struct heap_bench_item, hbi_node)->hbi_key;
+}
+
+static cfs_binheap_ops_t heap_bench_ops = {
+	.hop_enter	= NULL,
+	.hop_exit	= NULL,
+	.hop_compare	= heap_bench_compare,
+	.hop_key	= heap_bench_key,
+};
+
+static __u64
+heap_bench_rate(int n, struct timeval *start, struct timeval *end)
+{
+	__u64 usec;
+	__u64 rate;
+
+	usec = (end->tv_sec - start->tv_sec) * 1000000ULL +
+	       end->tv_usec - start->tv_usec;
+	rate = (__u64)n * 1000000ULL;
+	do_div(rate, max_t(__u64, usec, 1));
+	return rate;
+}
+
+static int
+heap_bench_run(const char *mode, unsigned flags,
+	       struct heap_bench_item *items, int n)
+{
+	cfs_binheap_t		*h;
+	struct heap_bench_item	*item;
+	struct timeval		 start;
+	struct timeval		 mid;
+	struct timeval		 end;
+	__u64			 prev = 0;
+	int			 rc = 0;
+	int			 i;
+
+	/* start small, so growing the heap is measured too */
+	h = cfs_binheap_create(&heap_bench_ops, flags, 0, NULL,
+			       cfs_cpt_table, CFS_CPT_ANY);
+	if (h == NULL)
+		return -ENOMEM;
+
+	do_gettimeofday(&start);
+	for (i = 0; i < n; i++) {
+		rc = cfs_binheap_insert(h, &items[i].hbi_node);
+		if (rc != 0) {
+			CERROR("%s: insert %d failed: %d\n", mode, i, rc);
+			goto out;
+		}
+	}
+
+	do_gettimeofday(&mid);
+	for (i = 0; i < n; i++) {
+		item = container_of(cfs_binheap_remove_root(h),
+				    struct heap_bench_item, hbi_node);
+		if (item->hbi_key < prev) {
+			CERROR("%s: popped "LPU64" after "LPU64"\n",
+			       mode, item->hbi_key, prev);
+			rc = -EINVAL;
+			goto out;
+		}
+		prev = item->hbi_key;
+	}
+	do_gettimeofday(&end);
+
+	LCONSOLE_INFO("%-6s %8d elements: "LPU64" inserts/s, "
+		      LPU64" pops/s\n", mode, n,
+		      heap_bench_rate(n, &start, &mid),
+		      heap_bench_rate(n, &mid, &end));
+ out:
+	cfs_binheap_destroy(h);
+	return rc;
+}
+
+static int __init
+heap_bench_init(void)
+{
+	struct heap_bench_item	*items;
+	__u64			 rnd = 1;
+	int			 rc = 0;
+	int			 n;
+	int			 i;
+
+	if (nmax <= 0) {
+		CERROR("Invalid nmax %d\n", nmax);
+		return -EINVAL;
+	}
+
+	LIBCFS_ALLOC(items, sizeof(*items) * nmax);
+	if (items == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < nmax; i++) {
+		__u64 key;
+
+		/* 64-bit LCG, keys collide like NRS rounds do */
+		rnd = rnd * 6364136223846793005ULL + 1442695040888963407ULL;
+		key = rnd >> 32;
+		items[i].hbi_key = do_div(key, nmax / 4 + 1);
+		items[i].hbi_seq = i;
+	}
+
+	for (n = min(1000, nmax); rc == 0; n = min(n * 10, nmax)) {
+		rc = heap_bench_run("binary", 0, items, n);
+		if (rc == 0)
+			rc = heap_bench_run("4-ary", CBH_FLAG_DARY, items, n);
+		if (n == nmax)
+			break;
+	}
+
+	LIBCFS_FREE(items, sizeof(*items) * nmax);
+	return rc;
+}
+
+static void __exit
+heap_bench_exit(void)
+{
+}
+
+MODULE_DESCRIPTION("libcfs binary heap benchmark");
+MODULE_LICENSE("GPL");
+
+module_init(heap_bench_init);
+module_exit(heap_bench_exit);
@@ -105,9 +105,16 @@
  * - better hash iteration:
  *   Now we support both locked iteration & lockless iteration of hash
  *   table. Also, user can break the iteration by return 1 in callback.
+ *
+ * - RCU lookup (CFS_HASH_RCU):
+ *   cfs_hash_lookup() doesn't touch any lock, so read-mostly tables don't
+ *   bounce a lock cacheline between CPUs; see cfs_hash_rcu_lookup().
  */
 
 #include <libcfs/libcfs.h>
+#ifdef __KERNEL__
+#include <linux/rculist.h>
+#endif
 
 #if CFS_HASH_DEBUG_LEVEL >= CFS_HASH_DEBUG_1
 static unsigned int warn_on_depth = 8;
@@ -240,6 +247,49 @@ cfs_hash_lock_setup(cfs_hash_t *hs)
         }
 }
 
+/*
+ * hlist changes of a CFS_HASH_RCU hash must not break the hlist walk of
+ * lock-free readers
+ */
+static inline void
+cfs_hash_hlist_add_head(cfs_hash_t *hs, struct hlist_node *hnode,
+			struct hlist_head *hhead)
+{
+#ifdef __KERNEL__
+	if (cfs_hash_with_rcu(hs)) {
+		hlist_add_head_rcu(hnode, hhead);
+		return;
+	}
+#endif
+	hlist_add_head(hnode, hhead);
+}
+
+static inline void
+cfs_hash_hlist_add_after(cfs_hash_t *hs, struct hlist_node *prev,
+			 struct hlist_node *hnode)
+{
+#ifdef __KERNEL__
+	if (cfs_hash_with_rcu(hs)) {
+		hlist_add_after_rcu(prev, hnode);
+		return;
+	}
+#endif
+	hlist_add_after(prev, hnode);
+}
+
+static inline void
+cfs_hash_hlist_del_init(cfs_hash_t *hs, struct hlist_node *hnode)
+{
+#ifdef __KERNEL__
+	if (cfs_hash_with_rcu(hs)) {
+		/* keep hnode->next for readers still on it */
+		hlist_del_init_rcu(hnode);
+		return;
+	}
+#endif
+	hlist_del_init(hnode);
+}
+
 /**
  * Simple hash head without depth tracking
  * new element is always added to head of hlist
@@ -266,7 +316,7 @@ static int
 cfs_hash_hh_hnode_add(cfs_hash_t *hs, cfs_hash_bd_t *bd,
 		      struct hlist_node *hnode)
 {
-	hlist_add_head(hnode, cfs_hash_hh_hhead(hs, bd));
+	cfs_hash_hlist_add_head(hs, hnode, cfs_hash_hh_hhead(hs, bd));
 	return -1; /* unknown depth */
 }
 
@@ -274,7 +324,7 @@ static int
 cfs_hash_hh_hnode_del(cfs_hash_t *hs, cfs_hash_bd_t *bd,
 		      struct hlist_node *hnode)
 {
-	hlist_del_init(hnode);
+	cfs_hash_hlist_del_init(hs, hnode);
 	return -1; /* unknown depth */
 }
 
@@ -308,7 +358,7 @@ cfs_hash_hd_hnode_add(cfs_hash_t *hs, cfs_hash_bd_t *bd,
 {
 	cfs_hash_head_dep_t *hh = container_of(cfs_hash_hd_hhead(hs, bd),
 					       cfs_hash_head_dep_t, hd_head);
-	hlist_add_head(hnode, &hh->hd_head);
+	cfs_hash_hlist_add_head(hs, hnode, &hh->hd_head);
 	return ++hh->hd_depth;
 }
 
@@ -318,7 +368,7 @@ cfs_hash_hd_hnode_del(cfs_hash_t *hs, cfs_hash_bd_t *bd,
 {
 	cfs_hash_head_dep_t *hh = container_of(cfs_hash_hd_hhead(hs, bd),
 					       cfs_hash_head_dep_t, hd_head);
-	hlist_del_init(hnode);
+	cfs_hash_hlist_del_init(hs, hnode);
 	return --hh->hd_depth;
 }
 
@@ -354,9 +404,9 @@ cfs_hash_dh_hnode_add(cfs_hash_t *hs, cfs_hash_bd_t *bd,
 					    cfs_hash_dhead_t, dh_head);
 
 	if (dh->dh_tail != NULL) /* not empty */
-		hlist_add_after(dh->dh_tail, hnode);
+		cfs_hash_hlist_add_after(hs, dh->dh_tail, hnode);
 	else /* empty list */
-		hlist_add_head(hnode, &dh->dh_head);
+		cfs_hash_hlist_add_head(hs, hnode, &dh->dh_head);
 	dh->dh_tail = hnode;
 	return -1; /* unknown depth */
 }
@@ -372,7 +422,7 @@ cfs_hash_dh_hnode_del(cfs_hash_t *hs, cfs_hash_bd_t *bd,
 		dh->dh_tail = (hnd->pprev == &dh->dh_head.first) ? NULL :
 			      container_of(hnd->pprev, struct hlist_node, next);
 	}
-	hlist_del_init(hnd);
+	cfs_hash_hlist_del_init(hs, hnd);
 	return -1; /* unknown depth */
 }
 
@@ -409,9 +459,9 @@ cfs_hash_dd_hnode_add(cfs_hash_t *hs, cfs_hash_bd_t *bd,
 						cfs_hash_dhead_dep_t, dd_head);
 
 	if (dh->dd_tail != NULL) /* not empty */
-		hlist_add_after(dh->dd_tail, hnode);
+		cfs_hash_hlist_add_after(hs, dh->dd_tail, hnode);
 	else /* empty list */
-		hlist_add_head(hnode, &dh->dd_head);
+		cfs_hash_hlist_add_head(hs, hnode, &dh->dd_head);
 	dh->dd_tail = hnode;
 	return ++dh->dd_depth;
 }
@@ -427,7 +477,7 @@ cfs_hash_dd_hnode_del(cfs_hash_t *hs, cfs_hash_bd_t *bd,
 		dh->dd_tail = (hnd->pprev == &dh->dd_head.first) ? NULL :
 			      container_of(hnd->pprev, struct hlist_node, next);
 	}
-	hlist_del_init(hnd);
+	cfs_hash_hlist_del_init(hs, hnd);
 	return --dh->dd_depth;
 }
 
@@ -1053,6 +1103,11 @@ cfs_hash_create(char *name, unsigned cur_bits, unsigned max_bits,
                      (flags & CFS_HASH_NO_LOCK) == 0));
         LASSERT(ergo((flags & CFS_HASH_REHASH_KEY) != 0,
                       ops->hs_keycpy != NULL));
+	LASSERT(ergo((flags & CFS_HASH_RCU) != 0,
+		     (flags & (CFS_HASH_RW_BKTLOCK |
+			       CFS_HASH_SPIN_BKTLOCK)) != 0 &&
+		     (flags & (CFS_HASH_NO_LOCK | CFS_HASH_NO_BKTLOCK)) == 0 &&
+		     ops->hs_get_rcu != NULL && ops->hs_put != NULL));
 
         len = (flags & CFS_HASH_BIGNAME) == 0 ?
               CFS_HASH_NAME_LEN : CFS_HASH_BIGNAME_LEN;
@@ -1065,6 +1120,8 @@ cfs_hash_create(char *name, unsigned cur_bits, unsigned max_bits,
 
 	atomic_set(&hs->hs_refcount, 1);
 	atomic_set(&hs->hs_count, 0);
+	atomic_set(&hs->hs_rcu_movers, 0);
+	atomic_set(&hs->hs_rcu_gen, 0);
 
 	cfs_hash_lock_setup(hs);
 	cfs_hash_hlist_setup(hs);
@@ -1209,14 +1266,41 @@ cfs_hash_rehash_bits(cfs_hash_t *hs)
  * don't allow inline rehash if:
  * - user wants non-blocking change (add/del) on hash table
  * - too many elements
+ * - old bucket-tables have to wait for RCU readers
  */
 static inline int
 cfs_hash_rehash_inline(cfs_hash_t *hs)
 {
-	return !cfs_hash_with_nblk_change(hs) &&
+	return !cfs_hash_with_nblk_change(hs) && !cfs_hash_with_rcu(hs) &&
 	       atomic_read(&hs->hs_count) < CFS_HASH_LOOP_HOG;
 }
 
+/*
+ * Moving items between hlists can make lock-free readers of a CFS_HASH_RCU
+ * hash skip items, see cfs_hash_rcu_lookup().
+ */
+static void
+cfs_hash_rcu_move_begin(cfs_hash_t *hs)
+{
+	if (!cfs_hash_with_rcu(hs))
+		return;
+
+	atomic_inc(&hs->hs_rcu_movers);
+	atomic_inc(&hs->hs_rcu_gen);
+	smp_mb();
+}
+
+static void
+cfs_hash_rcu_move_end(cfs_hash_t *hs)
+{
+	if (!cfs_hash_with_rcu(hs))
+		return;
+
+	smp_mb();
+	atomic_inc(&hs->hs_rcu_gen);
+	atomic_dec(&hs->hs_rcu_movers);
+}
+
 /**
  * Add item @hnode to libcfs hash @hs using @key.  The registered
  * ops->hs_get function will be called when the item is added.
@@ -1362,6 +1446,75 @@ EXPORT_SYMBOL(cfs_hash_del_key);
  * when when finished with the object.  If the @key was not found
  * in the hash @hs NULL is returned.
  */
+#ifdef __KERNEL__
+/**
+ * Lock-free lookup of @key in CFS_HASH_RCU hash @hs, returns 1 and the
+ * object with a reference in @objp if found, 0 if not found, or -EAGAIN if
+ * the lookup has to be redone under the locks because it raced with moving
+ * of items or couldn't reference the item.
+ */
+static int
+cfs_hash_rcu_lookup(cfs_hash_t *hs, const void *key, void **objp)
+{
+	cfs_hash_bucket_t	**bkts;
+	cfs_hash_bd_t		bd;
+	struct hlist_head	*hhead;
+	struct hlist_node	*hnode;
+	unsigned int		bits;
+	unsigned int		index;
+	int			gen;
+	int			rc = 0;
+
+	rcu_read_lock();
+	gen = atomic_read(&hs->hs_rcu_gen);
+	smp_rmb();
+	if (atomic_read(&hs->hs_rcu_movers) != 0) {
+		rc = -EAGAIN;
+		goto out;
+	}
+
+	bits = ACCESS_ONCE(hs->hs_cur_bits);
+	bkts = rcu_dereference(hs->hs_buckets);
+	/* bits and bucket-table must be of the same generation */
+	smp_rmb();
+	if (atomic_read(&hs->hs_rcu_gen) != gen) {
+		rc = -EAGAIN;
+		goto out;
+	}
+
+	index = cfs_hash_id(hs, key, (1U << bits) - 1);
+	bd.bd_bucket = bkts[index & ((1U << (bits - hs->hs_bkt_bits)) - 1)];
+	bd.bd_offset = index >> (bits - hs->hs_bkt_bits);
+	hhead = cfs_hash_bd_hhead(hs, &bd);
+
+	for (hnode = rcu_dereference(hhead->first); hnode != NULL;
+	     hnode = rcu_dereference(hnode->next)) {
+		if (!cfs_hash_keycmp(hs, key, hnode))
+			continue;
+
+		if (!CFS_HOP(hs, get_rcu)(hs, hnode)) {
+			rc = -EAGAIN;
+			goto out;
+		}
+		rc = 1;
+		break;
+	}
+
+	/* a mover could have taken us off the hlist, or changed the key */
+	smp_rmb();
+	if (atomic_read(&hs->hs_rcu_gen) != gen) {
+		if (rc == 1)
+			cfs_hash_put(hs, hnode);
+		rc = -EAGAIN;
+	} else if (rc == 1) {
+		*objp = cfs_hash_object(hs, hnode);
+	}
+ out:
+	rcu_read_unlock();
+	return rc;
+}
+#endif
+
 void *
 cfs_hash_lookup(cfs_hash_t *hs, const void *key)
 {
@@ -1369,6 +1522,12 @@ cfs_hash_lookup(cfs_hash_t *hs, const void *key)
 	struct hlist_node     *hnode;
         cfs_hash_bd_t         bds[2];
 
+#ifdef __KERNEL__
+	if (cfs_hash_with_rcu(hs) &&
+	    cfs_hash_rcu_lookup(hs, key, &obj) != -EAGAIN)
+		return obj;
+#endif
+
         cfs_hash_lock(hs, 0);
         cfs_hash_dual_bd_get_and_lock(hs, key, bds, 0);
 
@@ -1891,6 +2050,7 @@ cfs_hash_rehash_worker(cfs_workitem_t *wi)
         unsigned int        new_size;
         int                 bsize;
         int                 count = 0;
+        int                 rcu;
         int                 rc = 0;
         int                 i;
 
@@ -1931,6 +2091,7 @@ cfs_hash_rehash_worker(cfs_workitem_t *wi)
         }
 
         LASSERT(hs->hs_rehash_buckets == NULL);
+        cfs_hash_rcu_move_begin(hs);
         hs->hs_rehash_buckets = bkts;
 
         rc = 0;
@@ -1942,6 +2103,7 @@ cfs_hash_rehash_worker(cfs_workitem_t *wi)
                                 break;
                         /* it's shrinking, need free new bkt-table */
                         hs->hs_rehash_buckets = NULL;
+                        cfs_hash_rcu_move_end(hs);
                         old_size = new_size;
                         new_size = CFS_HASH_NBKT(hs);
                         goto out;
@@ -1962,19 +2124,31 @@ cfs_hash_rehash_worker(cfs_workitem_t *wi)
         hs->hs_rehash_count++;
 
         bkts = hs->hs_buckets;
+#ifdef __KERNEL__
+        rcu_assign_pointer(hs->hs_buckets, hs->hs_rehash_buckets);
+#else
         hs->hs_buckets = hs->hs_rehash_buckets;
+#endif
         hs->hs_rehash_buckets = NULL;
 
         hs->hs_cur_bits = hs->hs_rehash_bits;
+        cfs_hash_rcu_move_end(hs);
  out:
         hs->hs_rehash_bits = 0;
 	if (rc == -ESRCH) /* never be scheduled again */
 		cfs_wi_exit(cfs_sched_rehash, wi);
         bsize = cfs_hash_bkt_size(hs);
+        rcu = cfs_hash_with_rcu(hs);
         cfs_hash_unlock(hs, 1);
         /* can't refer to @hs anymore because it could be destroyed */
-        if (bkts != NULL)
+        if (bkts != NULL) {
+#ifdef __KERNEL__
+		/* lock-free readers can still walk the old buckets */
+		if (rcu)
+			synchronize_rcu();
+#endif
                 cfs_hash_buckets_free(bkts, bsize, new_size, old_size);
+	}
         if (rc != 0)
                 CDEBUG(D_INFO, "early quit of of rehashing: %d\n", rc);
 	/* return 1 only if cfs_wi_exit is called */
@@ -2014,6 +2188,7 @@ void cfs_hash_rehash_key(cfs_hash_t *hs, const void *old_key,
         cfs_hash_bd_order(&bds[0], &bds[1]);
 
         cfs_hash_multi_bd_lock(hs, bds, 3, 1);
+        cfs_hash_rcu_move_begin(hs);
         if (likely(old_bds[1].bd_bucket == NULL)) {
                 cfs_hash_bd_move_locked(hs, &old_bds[0], &new_bd, hnode);
         } else {
@@ -2023,6 +2198,7 @@ void cfs_hash_rehash_key(cfs_hash_t *hs, const void *old_key,
         /* overwrite key inside locks, otherwise may screw up with
          * other operations, i.e: rehash */
         cfs_hash_keycpy(hs, hnode, new_key);
+        cfs_hash_rcu_move_end(hs);
 
         cfs_hash_multi_bd_unlock(hs, bds, 3, 1);
         cfs_hash_unlock(hs, 0);
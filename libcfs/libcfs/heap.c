@@ -37,17 +37,284 @@
 
 #include <libcfs/libcfs.h>
 
-#define CBH_ALLOC(ptr, h)						\
+#define CBH_ALLOC_NOB(ptr, h, nob)					\
 do {									\
 	if ((h)->cbh_flags & CBH_FLAG_ATOMIC_GROW)			\
 		LIBCFS_CPT_ALLOC_GFP((ptr), h->cbh_cptab, h->cbh_cptid,	\
-				     CBH_NOB, GFP_ATOMIC);		\
+				     (nob), GFP_ATOMIC);		\
 	else								\
 		LIBCFS_CPT_ALLOC((ptr), h->cbh_cptab, h->cbh_cptid,	\
-				 CBH_NOB);				\
+				 (nob));				\
 } while (0)
 
-#define CBH_FREE(ptr)	LIBCFS_FREE(ptr, CBH_NOB)
+#define CBH_ALLOC(ptr, h)	CBH_ALLOC_NOB(ptr, h, CBH_NOB)
+#define CBH_FREE(ptr)		LIBCFS_FREE(ptr, CBH_NOB)
+#define CBH_DFREE(ptr)		LIBCFS_FREE(ptr, CBH_DNOB)
+
+/*
+ * D-ary heap.
+ *
+ * Element \a idx is stored in slot (idx + CBH_DARY - 1), so that the children
+ * CBH_DARY * idx + 1 ... CBH_DARY * (idx + 1) of element \a idx occupy slots
+ * CBH_DARY * (idx + 1) ... CBH_DARY * (idx + 2) - 1: they are aligned on a
+ * group of CBH_DARY slots, i.e. share one cacheline and never straddle two
+ * chunks. cfs_binheap_t::cbh_hwm counts allocated slots.
+ */
+
+/** number of elements a d-ary heap can hold without growing */
+static inline unsigned int
+cfs_dheap_capacity(cfs_binheap_t *h)
+{
+	return h->cbh_hwm == 0 ? 0 : h->cbh_hwm - (CBH_DARY - 1);
+}
+
+static inline cfs_binheap_entry_t *
+cfs_dheap_entry(cfs_binheap_t *h, unsigned int idx)
+{
+	unsigned int slot = idx + CBH_DARY - 1;
+
+	return &h->cbh_dir[slot >> (CBH_DSHIFT + CBH_SHIFT)]
+			  [(slot >> CBH_DSHIFT) & CBH_MASK]
+			  [slot & CBH_DMASK];
+}
+
+/**
+ * Allocates one more chunk of a d-ary heap, and the directory pages it needs.
+ *
+ * \param[in] h The heap
+ *
+ * \retval 0	   Successfully grew the heap
+ * \retval -ENOMEM OOM error, or the heap is full
+ */
+static int
+cfs_dheap_grow(cfs_binheap_t *h)
+{
+	unsigned int	      chunk = h->cbh_hwm >> CBH_DSHIFT;
+	cfs_binheap_entry_t **dir;
+	cfs_binheap_entry_t  *frag;
+
+	LASSERT((h->cbh_hwm & CBH_DMASK) == 0);
+
+	if (chunk >= CBH_SIZE * CBH_SIZE)
+		return -ENOMEM;
+
+	if (h->cbh_dir == NULL) {
+		CBH_ALLOC(h->cbh_dir, h);
+		if (h->cbh_dir == NULL)
+			return -ENOMEM;
+	}
+
+	/* directories are zeroed, cfs_dheap_destroy() stops on NULL */
+	dir = h->cbh_dir[chunk >> CBH_SHIFT];
+	if (dir == NULL) {
+		CBH_ALLOC(dir, h);
+		if (dir == NULL)
+			return -ENOMEM;
+		h->cbh_dir[chunk >> CBH_SHIFT] = dir;
+	}
+
+	CBH_ALLOC_NOB(frag, h, CBH_DNOB);
+	if (frag == NULL)
+		return -ENOMEM;
+
+	dir[chunk & CBH_MASK] = frag;
+	h->cbh_hwm += CBH_DSIZE;
+	return 0;
+}
+
+static void
+cfs_dheap_destroy(cfs_binheap_t *h)
+{
+	int idx0;
+	int idx1;
+
+	if (h->cbh_dir == NULL)
+		return;
+
+	for (idx0 = 0; idx0 < CBH_SIZE && h->cbh_dir[idx0] != NULL; idx0++) {
+		for (idx1 = 0;
+		     idx1 < CBH_SIZE && h->cbh_dir[idx0][idx1] != NULL; idx1++)
+			CBH_DFREE(h->cbh_dir[idx0][idx1]);
+
+		CBH_FREE(h->cbh_dir[idx0]);
+	}
+
+	CBH_FREE(h->cbh_dir);
+}
+
+/**
+ * Ordering of two d-ary heap entries: by their inline keys, and by
+ * cfs_binheap_ops_t::hop_compare() if the keys are equal.
+ *
+ * \retval 1 Entry a < entry b
+ * \retval 0 Entry a > entry b
+ */
+static inline int
+cfs_dheap_less(cfs_binheap_t *h, cfs_binheap_entry_t *a,
+	       cfs_binheap_entry_t *b)
+{
+	if (a->che_key != b->che_key)
+		return a->che_key < b->che_key;
+
+	return h->cbh_ops->hop_compare(a->che_node, b->che_node);
+}
+
+/**
+ * Moves element \a idx of a d-ary heap towards the root.
+ *
+ * \retval 1 The position of the element was changed at least once
+ * \retval 0 The position of the element was not changed
+ */
+static int
+cfs_dheap_bubble(cfs_binheap_t *h, unsigned int idx)
+{
+	cfs_binheap_entry_t  e = *cfs_dheap_entry(h, idx);
+	cfs_binheap_entry_t *parent;
+	unsigned int	     parent_idx;
+	int		     did_sth = 0;
+
+	while (idx > 0) {
+		parent_idx = (idx - 1) / CBH_DARY;
+		parent = cfs_dheap_entry(h, parent_idx);
+		LINVRNT(parent->che_node->chn_index == parent_idx);
+
+		if (cfs_dheap_less(h, parent, &e))
+			break;
+
+		parent->che_node->chn_index = idx;
+		*cfs_dheap_entry(h, idx) = *parent;
+		idx = parent_idx;
+		did_sth = 1;
+	}
+
+	e.che_node->chn_index = idx;
+	*cfs_dheap_entry(h, idx) = e;
+
+	return did_sth;
+}
+
+/**
+ * Moves element \a idx of a d-ary heap towards the last level of the tree.
+ *
+ * \retval 1 The position of the element was changed at least once
+ * \retval 0 The position of the element was not changed
+ */
+static int
+cfs_dheap_sink(cfs_binheap_t *h, unsigned int idx)
+{
+	unsigned int	     n = h->cbh_nelements;
+	cfs_binheap_entry_t  e = *cfs_dheap_entry(h, idx);
+	cfs_binheap_entry_t *child;
+	cfs_binheap_entry_t *best;
+	unsigned int	     child_idx;
+	unsigned int	     best_idx;
+	unsigned int	     last_idx;
+	int		     did_sth = 0;
+
+	while (1) {
+		child_idx = idx * CBH_DARY + 1;
+		if (child_idx >= n)
+			break;
+
+		/* all the children are in the same chunk */
+		child = cfs_dheap_entry(h, child_idx);
+		last_idx = min(child_idx + CBH_DARY, n);
+
+		best = child;
+		best_idx = child_idx;
+		for (child++, child_idx++; child_idx < last_idx;
+		     child++, child_idx++) {
+			if (cfs_dheap_less(h, child, best)) {
+				best = child;
+				best_idx = child_idx;
+			}
+		}
+
+		LINVRNT(best->che_node->chn_index == best_idx);
+
+		if (cfs_dheap_less(h, &e, best))
+			break;
+
+		best->che_node->chn_index = idx;
+		*cfs_dheap_entry(h, idx) = *best;
+		idx = best_idx;
+		did_sth = 1;
+	}
+
+	e.che_node->chn_index = idx;
+	*cfs_dheap_entry(h, idx) = e;
+
+	return did_sth;
+}
+
+static void
+cfs_dheap_relocate(cfs_binheap_t *h, unsigned int idx)
+{
+	if (!cfs_dheap_bubble(h, idx))
+		cfs_dheap_sink(h, idx);
+}
+
+static inline __u64
+cfs_dheap_key(cfs_binheap_t *h, cfs_binheap_node_t *e)
+{
+	return h->cbh_ops->hop_key != NULL ? h->cbh_ops->hop_key(e) : 0;
+}
+
+static int
+cfs_dheap_insert(cfs_binheap_t *h, cfs_binheap_node_t *e)
+{
+	unsigned int	     new_idx = h->cbh_nelements;
+	cfs_binheap_entry_t *new;
+	int		     rc;
+
+	if (new_idx == cfs_dheap_capacity(h)) {
+		rc = cfs_dheap_grow(h);
+		if (rc != 0)
+			return rc;
+	}
+
+	if (h->cbh_ops->hop_enter) {
+		rc = h->cbh_ops->hop_enter(h, e);
+		if (rc != 0)
+			return rc;
+	}
+
+	new = cfs_dheap_entry(h, new_idx);
+	new->che_key = cfs_dheap_key(h, e);
+	new->che_node = e;
+	e->chn_index = new_idx;
+	h->cbh_nelements++;
+
+	cfs_dheap_bubble(h, new_idx);
+
+	return 0;
+}
+
+static void
+cfs_dheap_remove(cfs_binheap_t *h, cfs_binheap_node_t *e)
+{
+	unsigned int	     n = h->cbh_nelements;
+	unsigned int	     cur_idx = e->chn_index;
+	cfs_binheap_entry_t *cur;
+
+	LASSERT(cur_idx != CBH_POISON);
+	LASSERT(cur_idx < n);
+
+	cur = cfs_dheap_entry(h, cur_idx);
+	LASSERT(cur->che_node == e);
+
+	n--;
+	h->cbh_nelements = n;
+	if (cur_idx != n) {
+		*cur = *cfs_dheap_entry(h, n);
+		cur->che_node->chn_index = cur_idx;
+		cfs_dheap_relocate(h, cur_idx);
+	}
+
+	e->chn_index = CBH_POISON;
+	if (h->cbh_ops->hop_exit)
+		h->cbh_ops->hop_exit(h, e);
+}
 
 /**
  * Grows the capacity of a binary heap so that it can handle a larger number of
@@ -65,6 +332,9 @@ cfs_binheap_grow(cfs_binheap_t *h)
 	cfs_binheap_node_t  **frag2;
 	int hwm = h->cbh_hwm;
 
+	if (h->cbh_flags & CBH_FLAG_DARY)
+		return cfs_dheap_grow(h);
+
 	/* need a whole new chunk of pointers */
 	LASSERT((h->cbh_hwm & CBH_MASK) == 0);
 
@@ -180,7 +450,8 @@ cfs_binheap_create(cfs_binheap_ops_t *ops, unsigned int flags,
 	h->cbh_cptab	  = cptab;
 	h->cbh_cptid	  = cptid;
 
-	while (h->cbh_hwm < count) { /* preallocate */
+	while ((flags & CBH_FLAG_DARY ? cfs_dheap_capacity(h) :
+					h->cbh_hwm) < count) { /* preallocate */
 		if (cfs_binheap_grow(h) != 0) {
 			cfs_binheap_destroy(h);
 			return NULL;
@@ -210,6 +481,12 @@ cfs_binheap_destroy(cfs_binheap_t *h)
 
 	LASSERT(h != NULL);
 
+	if (h->cbh_flags & CBH_FLAG_DARY) {
+		cfs_dheap_destroy(h);
+		LIBCFS_FREE(h, sizeof(*h));
+		return;
+	}
+
 	n = h->cbh_hwm;
 
 	if (n > 0) {
@@ -284,6 +561,9 @@ cfs_binheap_find(cfs_binheap_t *h, unsigned int idx)
 	if (idx >= h->cbh_nelements)
 		return NULL;
 
+	if (h->cbh_flags & CBH_FLAG_DARY)
+		return cfs_dheap_entry(h, idx)->che_node;
+
 	return *cfs_binheap_pointer(h, idx);
 }
 EXPORT_SYMBOL(cfs_binheap_find);
@@ -412,6 +692,9 @@ cfs_binheap_insert(cfs_binheap_t *h, cfs_binheap_node_t *e)
 	unsigned int	     new_idx = h->cbh_nelements;
 	int		     rc;
 
+	if (h->cbh_flags & CBH_FLAG_DARY)
+		return cfs_dheap_insert(h, e);
+
 	if (new_idx == h->cbh_hwm) {
 		rc = cfs_binheap_grow(h);
 		if (rc != 0)
@@ -449,6 +732,11 @@ cfs_binheap_remove(cfs_binheap_t *h, cfs_binheap_node_t *e)
 	cfs_binheap_node_t **cur_ptr;
 	cfs_binheap_node_t  *last;
 
+	if (h->cbh_flags & CBH_FLAG_DARY) {
+		cfs_dheap_remove(h, e);
+		return;
+	}
+
 	LASSERT(cur_idx != CBH_POISON);
 	LASSERT(cur_idx < n);
 
@@ -482,6 +770,15 @@ EXPORT_SYMBOL(cfs_binheap_remove);
 void
 cfs_binheap_relocate(cfs_binheap_t *h, cfs_binheap_node_t *e)
 {
+	if (h->cbh_flags & CBH_FLAG_DARY) {
+		cfs_binheap_entry_t *cur = cfs_dheap_entry(h, e->chn_index);
+
+		LINVRNT(cur->che_node == e);
+		cur->che_key = cfs_dheap_key(h, e);
+		cfs_dheap_relocate(h, e->chn_index);
+		return;
+	}
+
 	if (!cfs_binheap_bubble(h, e))
 		cfs_binheap_sink(h, e);
 }
@@ -89,6 +89,27 @@ cfs_cpt_table_print(struct cfs_cpt_table *cptab, char *buf, int len)
 }
 EXPORT_SYMBOL(cfs_cpt_table_print);
 
+int
+cfs_cpt_table_print_topology(struct cfs_cpt_table *cptab, char *buf, int len)
+{
+	int	rc;
+
+	rc = snprintf(buf, len, "%d\t: single CPU\n", 0);
+	len -= rc;
+	if (len <= 0)
+		return -EFBIG;
+
+	return rc;
+}
+EXPORT_SYMBOL(cfs_cpt_table_print_topology);
+
+int
+cfs_cpt_table_topology(struct cfs_cpt_table *cptab)
+{
+	return 0;
+}
+EXPORT_SYMBOL(cfs_cpt_table_topology);
+
 int
 cfs_cpt_number(struct cfs_cpt_table *cptab)
 {
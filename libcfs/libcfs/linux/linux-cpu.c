@@ -58,6 +58,9 @@ CFS_MODULE_PARM(cpu_npartitions, "i", int, 0444, "# of CPU partitions");
  * i.e: "N 0[0,1] 1[2,3]" the first character 'N' means numbers in bracket
  *       are NUMA node ID, number before bracket is CPU partition ID.
  *
+ * i.e: "auto" derives partitions from NUMA nodes, last level caches and
+ *       HTs, see cfs_cpt_table_create_topology().
+ *
  * NB: If user specified cpu_pattern, cpu_npartitions will be ignored
  */
 static char	*cpu_pattern = "";
@@ -133,6 +136,40 @@ cfs_node_to_cpumask(int node, cpumask_t *mask)
 }
 EXPORT_SYMBOL(cfs_node_to_cpumask);
 
+/* return number of cores with HTs in \a mask */
+static int
+cfs_cpu_ncores(cpumask_t *mask)
+{
+	int	ncores = 0;
+	int	cpu;
+
+	mutex_lock(&cpt_data.cpt_mutex);
+
+	for_each_cpu_mask(cpu, *mask) {
+		/* count each core by its first HT in the mask */
+		cfs_cpu_ht_siblings(cpu, cpt_data.cpt_cpumask);
+		cpus_and(*cpt_data.cpt_cpumask, *cpt_data.cpt_cpumask, *mask);
+		if (cpu == first_cpu(*cpt_data.cpt_cpumask))
+			ncores++;
+	}
+
+	mutex_unlock(&cpt_data.cpt_mutex);
+
+	return ncores;
+}
+
+/* return cpumask of CPUs sharing the last level cache with \a cpu */
+static void
+cfs_cpu_llc_siblings(int cpu, cpumask_t *mask)
+{
+#ifdef HAVE_CPU_LLC_SHARED_MASK
+	cpumask_copy(mask, cpu_llc_shared_mask(cpu));
+	if (!cpumask_test_cpu(cpu, mask))
+#endif
+		/* no LLC information, assume the socket shares it */
+		cfs_cpu_core_siblings(cpu, mask);
+}
+
 void
 cfs_cpt_table_free(struct cfs_cpt_table *cptab)
 {
@@ -265,6 +302,78 @@ cfs_cpt_table_print(struct cfs_cpt_table *cptab, char *buf, int len)
 }
 EXPORT_SYMBOL(cfs_cpt_table_print);
 
+int
+cfs_cpt_table_print_topology(struct cfs_cpt_table *cptab, char *buf, int len)
+{
+	static const char *sources[] = {
+		[CFS_CPT_SRC_NPARTITIONS]	= "cpu_npartitions",
+		[CFS_CPT_SRC_PATTERN]		= "cpu_pattern",
+		[CFS_CPT_SRC_TOPOLOGY]		= "topology",
+	};
+	char	*tmp = buf;
+	int	rc;
+	int	i;
+	int	j;
+
+	rc = snprintf(tmp, len, "source: %s\n", sources[cptab->ctb_source]);
+	tmp += rc;
+	len -= rc;
+	if (len <= 0)
+		return -EFBIG;
+
+	for (i = 0; i < cptab->ctb_nparts; i++) {
+		struct cfs_cpu_partition *part = &cptab->ctb_parts[i];
+
+		rc = snprintf(tmp, len, "%d\t: ", i);
+		tmp += rc;
+		len -= rc;
+		if (len <= 0)
+			return -EFBIG;
+
+		if (cptab->ctb_source != CFS_CPT_SRC_TOPOLOGY) {
+			rc = snprintf(tmp, len, "nodes");
+			for_each_node_mask(j, *part->cpt_nodemask) {
+				tmp += rc;
+				len -= rc;
+				if (len <= 0)
+					return -EFBIG;
+				rc = snprintf(tmp, len, " %d", j);
+			}
+		} else if (part->cpt_nllc > 1) {
+			rc = snprintf(tmp, len, "node %d, %d small LLCs from "
+				      "cpu %d", part->cpt_node, part->cpt_nllc,
+				      part->cpt_llc);
+		} else {
+			rc = snprintf(tmp, len, "node %d, LLC of cpu %d, "
+				      "part %d of %d", part->cpt_node,
+				      part->cpt_llc, part->cpt_split + 1,
+				      part->cpt_nsplits);
+		}
+		tmp += rc;
+		len -= rc;
+		if (len <= 0)
+			return -EFBIG;
+
+		rc = snprintf(tmp, len, ", %d cores, %d cpus\n",
+			      cfs_cpu_ncores(part->cpt_cpumask),
+			      cpus_weight(*part->cpt_cpumask));
+		tmp += rc;
+		len -= rc;
+		if (len <= 0)
+			return -EFBIG;
+	}
+
+	return tmp - buf;
+}
+EXPORT_SYMBOL(cfs_cpt_table_print_topology);
+
+int
+cfs_cpt_table_topology(struct cfs_cpt_table *cptab)
+{
+	return cptab->ctb_source == CFS_CPT_SRC_TOPOLOGY;
+}
+EXPORT_SYMBOL(cfs_cpt_table_topology);
+
 int
 cfs_cpt_number(struct cfs_cpt_table *cptab)
 {
@@ -982,6 +1091,7 @@ cfs_cpt_table_create_pattern(char *pattern)
 		str = cfs_trimwhite(bracket + 1);
 	}
 
+	cptab->ctb_source = CFS_CPT_SRC_PATTERN;
 	return cptab;
 
  failed:
@@ -989,6 +1099,153 @@ cfs_cpt_table_create_pattern(char *pattern)
 	return NULL;
 }
 
+/**
+ * Split \a group, CPUs of NUMA node \a node from \a nllc LLC domains, the
+ * first one of CPU \a llc, into partitions of about \a weight CPUs of whole
+ * cores, starting from partition \a cpt of \a cptab. If \a cptab is NULL
+ * only count them.
+ *
+ * \retval	# of partitions, or negative error
+ */
+static int
+cfs_cpt_topology_split(struct cfs_cpt_table *cptab, int cpt, cpumask_t *group,
+		       int weight, int node, int llc, int nllc)
+{
+	int	ncpus = cpus_weight(*group);
+	int	ht = cfs_cpu_ht_nsiblings(first_cpu(*group));
+	int	nsplits;
+	int	rc;
+	int	i;
+
+	nsplits = max(1, (ncpus + weight / 2) / weight);
+	nsplits = min(nsplits, cfs_cpu_ncores(group));
+	if (cptab == NULL)
+		return nsplits;
+
+	for (i = 0; i < nsplits; i++) {
+		struct cfs_cpu_partition *part = &cptab->ctb_parts[cpt + i];
+		int			  n;
+
+		/* the last partition takes what is left */
+		n = max(1, roundup(cpus_weight(*group) / (nsplits - i), ht));
+		rc = cfs_cpt_choose_ncpus(cptab, cpt + i, group, n);
+		if (rc < 0)
+			return rc;
+
+		part->cpt_node	  = node;
+		part->cpt_llc	  = llc;
+		part->cpt_nllc	  = nllc;
+		part->cpt_split	  = i;
+		part->cpt_nsplits = nsplits;
+	}
+	return nsplits;
+}
+
+/**
+ * Make partitions of the CPUs of each NUMA node sharing a last level cache.
+ * LLC domains smaller than CPT_WEIGHT_MIN CPUs are merged with the next
+ * ones of the same node, larger ones are split into partitions of about
+ * \a weight CPUs. If \a cptab is NULL only count the partitions.
+ *
+ * \retval	# of partitions, or negative error
+ */
+static int
+cfs_cpt_topology_walk(struct cfs_cpt_table *cptab, int weight)
+{
+	cpumask_t	*node_mask;
+	cpumask_t	*group;
+	cpumask_t	*llc;
+	int		ncpt = 0;
+	int		node;
+	int		rc = 0;
+
+	LIBCFS_ALLOC(node_mask, cpumask_size());
+	LIBCFS_ALLOC(group, cpumask_size());
+	LIBCFS_ALLOC(llc, cpumask_size());
+	if (node_mask == NULL || group == NULL || llc == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for_each_online_node(node) {
+		cfs_node_to_cpumask(node, node_mask);
+
+		while (!cpus_empty(*node_mask)) {
+			int	first = first_cpu(*node_mask);
+			int	nllc = 0;
+
+			cpus_clear(*group);
+			while (!cpus_empty(*node_mask) &&
+			       cpus_weight(*group) < CPT_WEIGHT_MIN) {
+				/* some BIOSes report LLCs spanning nodes */
+				cfs_cpu_llc_siblings(first_cpu(*node_mask),
+						     llc);
+				cpus_and(*llc, *llc, *node_mask);
+				cpus_or(*group, *group, *llc);
+				cpus_andnot(*node_mask, *node_mask, *llc);
+				nllc++;
+			}
+
+			rc = cfs_cpt_topology_split(cptab, ncpt, group, weight,
+						    node, first, nllc);
+			if (rc < 0)
+				goto out;
+			ncpt += rc;
+		}
+	}
+	rc = ncpt;
+ out:
+	if (node_mask != NULL)
+		LIBCFS_FREE(node_mask, cpumask_size());
+	if (group != NULL)
+		LIBCFS_FREE(group, cpumask_size());
+	if (llc != NULL)
+		LIBCFS_FREE(llc, cpumask_size());
+	return rc;
+}
+
+/**
+ * Build CPU partitions from the CPU topology instead of splitting CPUs
+ * evenly: a partition never spans NUMA nodes or last level caches and
+ * keeps the HTs of a core together, so threads of a partition share their
+ * cache and memory. The partition weight aimed at is the one of the number
+ * of partitions cfs_cpt_num_estimate() suggests.
+ */
+static struct cfs_cpt_table *
+cfs_cpt_table_create_topology(void)
+{
+	struct cfs_cpt_table	*cptab;
+	int			weight;
+	int			ncpt;
+	int			rc;
+
+	weight = max_t(int, CPT_WEIGHT_MIN,
+		       num_online_cpus() / cfs_cpt_num_estimate());
+
+	ncpt = cfs_cpt_topology_walk(NULL, weight);
+	if (ncpt <= 0) {
+		CERROR("Failed to scan CPU topology: %d\n", ncpt);
+		return NULL;
+	}
+
+	cptab = cfs_cpt_table_alloc(ncpt);
+	if (cptab == NULL) {
+		CERROR("Failed to allocate CPU map(%d)\n", ncpt);
+		return NULL;
+	}
+
+	cptab->ctb_source = CFS_CPT_SRC_TOPOLOGY;
+	rc = cfs_cpt_topology_walk(cptab, weight);
+	if (rc != ncpt) {
+		CERROR("Expect %d CPU partitions but got %d, "
+		       "CPU hotplug/unplug while setting?\n", ncpt, rc);
+		cfs_cpt_table_free(cptab);
+		return NULL;
+	}
+
+	return cptab;
+}
+
 #ifdef CONFIG_HOTPLUG_CPU
 static int
 cfs_cpu_notify(struct notifier_block *self, unsigned long action, void *hcpu)
@@ -1065,7 +1322,14 @@ cfs_cpu_init(void)
 	register_hotcpu_notifier(&cfs_cpu_notifier);
 #endif
 
-	if (*cpu_pattern != 0) {
+	if (strcmp(cpu_pattern, "auto") == 0) {
+		cfs_cpt_table = cfs_cpt_table_create_topology();
+		if (cfs_cpt_table == NULL) {
+			CERROR("Failed to create cptab from CPU topology\n");
+			goto failed;
+		}
+
+	} else if (*cpu_pattern != 0) {
 		cfs_cpt_table = cfs_cpt_table_create_pattern(cpu_pattern);
 		if (cfs_cpt_table == NULL) {
 			CERROR("Failed to create cptab from pattern %s\n",
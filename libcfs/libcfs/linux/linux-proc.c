@@ -331,28 +331,36 @@ proc_fail_loc(struct ctl_table *table, int write, void __user *buffer,
 	return rc;
 }
 
-static int __proc_cpt_table(void *data, int write,
-			    loff_t pos, void *buffer, int nob)
+static int cfs_cpt_print_table(char *buf, int len)
+{
+	LASSERT(cfs_cpt_table != NULL);
+	return cfs_cpt_table_print(cfs_cpt_table, buf, len);
+}
+
+static int cfs_cpt_print_topology(char *buf, int len)
+{
+	LASSERT(cfs_cpt_table != NULL);
+	return cfs_cpt_table_print_topology(cfs_cpt_table, buf, len);
+}
+
+static int proc_buf_print(int (*print)(char *, int),
+			  loff_t pos, void *buffer, int nob)
 {
 	char *buf = NULL;
 	int   len = 4096;
 	int   rc  = 0;
 
-	if (write)
-		return -EPERM;
-
-	LASSERT(cfs_cpt_table != NULL);
-
 	while (1) {
 		LIBCFS_ALLOC(buf, len);
 		if (buf == NULL)
 			return -ENOMEM;
 
-		rc = cfs_cpt_table_print(cfs_cpt_table, buf, len);
+		rc = print(buf, len);
 		if (rc >= 0)
 			break;
 
 		LIBCFS_FREE(buf, len);
+		buf = NULL;
 		if (rc == -EFBIG) {
 			len <<= 1;
 			continue;
@@ -372,6 +380,15 @@ static int __proc_cpt_table(void *data, int write,
 	return rc;
 }
 
+static int __proc_cpt_table(void *data, int write,
+			    loff_t pos, void *buffer, int nob)
+{
+	if (write)
+		return -EPERM;
+
+	return proc_buf_print(cfs_cpt_print_table, pos, buffer, nob);
+}
+
 static int
 proc_cpt_table(struct ctl_table *table, int write, void __user *buffer,
 	       size_t *lenp, loff_t *ppos)
@@ -380,6 +397,40 @@ proc_cpt_table(struct ctl_table *table, int write, void __user *buffer,
 				     __proc_cpt_table);
 }
 
+static int __proc_cpt_topology(void *data, int write,
+			       loff_t pos, void *buffer, int nob)
+{
+	if (write)
+		return -EPERM;
+
+	return proc_buf_print(cfs_cpt_print_topology, pos, buffer, nob);
+}
+
+static int
+proc_cpt_topology(struct ctl_table *table, int write, void __user *buffer,
+		  size_t *lenp, loff_t *ppos)
+{
+	return lprocfs_call_handler(table->data, write, ppos, buffer, lenp,
+				     __proc_cpt_topology);
+}
+
+static int __proc_wi_stats(void *data, int write,
+			   loff_t pos, void *buffer, int nob)
+{
+	if (write)
+		return -EPERM;
+
+	return proc_buf_print(cfs_wi_sched_print, pos, buffer, nob);
+}
+
+static int
+proc_wi_stats(struct ctl_table *table, int write, void __user *buffer,
+	      size_t *lenp, loff_t *ppos)
+{
+	return lprocfs_call_handler(table->data, write, ppos, buffer, lenp,
+				     __proc_wi_stats);
+}
+
 static struct ctl_table lnet_table[] = {
 	/*
 	 * NB No .strategy entries have been provided since sysctl(8) prefers
@@ -409,6 +460,14 @@ static struct ctl_table lnet_table[] = {
 		.mode		= 0644,
 		.proc_handler	= &proc_dobitmasks,
 	},
+	{
+		INIT_CTL_NAME
+		.procname	= "debug_deferred",
+		.data		= &libcfs_debug_deferred,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dobitmasks,
+	},
 	{
 		INIT_CTL_NAME
 		.procname	= "console_ratelimit",
@@ -453,6 +512,20 @@ static struct ctl_table lnet_table[] = {
 		.mode		= 0444,
 		.proc_handler	= &proc_cpt_table,
 	},
+	{
+		INIT_CTL_NAME
+		.procname	= "cpu_partition_topology",
+		.maxlen		= 128,
+		.mode		= 0444,
+		.proc_handler	= &proc_cpt_topology,
+	},
+	{
+		INIT_CTL_NAME
+		.procname	= "workitem_stats",
+		.maxlen		= 128,
+		.mode		= 0444,
+		.proc_handler	= &proc_wi_stats,
+	},
 	{
 		INIT_CTL_NAME
 		.procname	= "upcall",
@@ -40,6 +40,7 @@
 
 #include <linux/if.h>
 #include <linux/in.h>
+#include <linux/netdevice.h>
 #include <linux/file.h>
 /* For sys_open & sys_close */
 #include <linux/syscalls.h>
@@ -172,6 +173,25 @@ libcfs_ipif_query (char *name, int *up, __u32 *ip, __u32 *mask)
 
 EXPORT_SYMBOL(libcfs_ipif_query);
 
+/* return NUMA node of the device of interface \a name, -1 if unknown */
+int
+libcfs_ipif_node(char *name)
+{
+	struct net_device	*dev;
+	int			node = -1;
+
+	dev = dev_get_by_name(&init_net, name);
+	if (dev == NULL)
+		return -1;
+
+	if (dev->dev.parent != NULL)
+		node = dev_to_node(dev->dev.parent);
+	dev_put(dev);
+
+	return node;
+}
+EXPORT_SYMBOL(libcfs_ipif_node);
+
 int
 libcfs_ipif_enumerate (char ***namesp)
 {
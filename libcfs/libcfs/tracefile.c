@@ -166,6 +166,7 @@ cfs_trace_get_tage_try(struct cfs_trace_cpu_data *tcd, unsigned long len)
 		}
 
 		tage->used = 0;
+		tage->deferred = 0;
 		tage->cpu = smp_processor_id();
 		tage->type = tcd->tcd_type;
 		list_add_tail(&tage->linkage, &tcd->tcd_pages);
@@ -237,11 +238,79 @@ static struct cfs_trace_page *cfs_trace_get_tage(struct cfs_trace_cpu_data *tcd,
         if (tcd->tcd_cur_pages > 0) {
                 tage = cfs_tage_from_list(tcd->tcd_pages.next);
                 tage->used = 0;
+		tage->deferred = 0;
                 cfs_tage_to_tail(tage, &tcd->tcd_pages);
         }
         return tage;
 }
 
+/*
+ * Store the message as a deferred record: the header, file and function
+ * as in a text record, then the format ID and the raw arguments instead of
+ * the text, see tracefmt.c.
+ *
+ * Return 0 if the message can't be deferred and must be formatted.
+ */
+static int cfs_trace_vmsg_deferred(struct cfs_trace_cpu_data *tcd,
+				   struct ptldebug_header *header,
+				   struct libcfs_debug_msg_data *msgdata,
+				   const char *file, int depth, int known_size,
+				   const char *format, va_list args)
+{
+	struct cfs_trace_fmt	*fmt;
+	struct cfs_trace_page	*tage;
+	__u16			 lens[CFS_TRACE_FMT_MAX_ARGS];
+	char			*debug_buf;
+	va_list			 ap;
+	int			 needed;
+
+	/*
+	 * XXX nikita: do NOT call portals_debug_msg() (CDEBUG/ENTRY/EXIT)
+	 * from here: this will lead to infinite recursion.
+	 */
+
+	if (msgdata->msg_fn == NULL)
+		return 0;
+
+	fmt = cfs_trace_fmt_get(msgdata, format);
+	if (fmt == NULL)
+		return 0;
+
+	va_copy(ap, args);
+	needed = cfs_trace_fmt_size(fmt, ap, lens);
+	va_end(ap);
+
+	tage = cfs_trace_get_tage(tcd, known_size + needed);
+	if (tage == NULL)
+		return 0;
+
+	header->ph_flags |= PH_FLAG_DEFERRED;
+	header->ph_len = known_size + needed;
+
+	debug_buf = (char *)page_address(tage->page) + tage->used;
+	memcpy(debug_buf, header, sizeof(*header));
+	debug_buf += sizeof(*header);
+
+	memset(debug_buf, '.', depth);
+	debug_buf += depth;
+
+	strcpy(debug_buf, file);
+	debug_buf += strlen(file) + 1;
+
+	strcpy(debug_buf, msgdata->msg_fn);
+	debug_buf += strlen(msgdata->msg_fn) + 1;
+
+	va_copy(ap, args);
+	cfs_trace_fmt_pack(fmt, ap, lens, debug_buf);
+	va_end(ap);
+
+	tage->used += header->ph_len;
+	tage->deferred = 1;
+	__LASSERT(tage->used <= PAGE_CACHE_SIZE);
+
+	return 1;
+}
+
 int libcfs_debug_msg(struct libcfs_debug_msg_data *msgdata,
                      const char *format, ...)
 {
@@ -307,6 +376,16 @@ int libcfs_debug_vmsg2(struct libcfs_debug_msg_data *msgdata,
         if (libcfs_debug_binary)
                 known_size += sizeof(header);
 
+	/* defer formatting of messages which only go to the trace pages */
+	if ((mask & libcfs_debug_deferred) != 0 &&
+	    (mask & libcfs_printk) == 0 && libcfs_debug_binary &&
+	    format1 != NULL && format2 == NULL &&
+	    cfs_trace_vmsg_deferred(tcd, &header, msgdata, file, depth,
+				    known_size, format1, args)) {
+		cfs_trace_put_tcd(tcd);
+		return 1;
+	}
+
         /*/
          * '2' used because vsnprintf return real size required for output
          * _without_ terminating NULL.
@@ -655,7 +734,19 @@ void cfs_trace_debug_print(void)
                         p += strlen(fn) + 1;
                         len = hdr->ph_len - (int)(p - (char *)hdr);
 
-                        cfs_print_to_console(hdr, D_EMERG, p, len, file, fn);
+			if (hdr->ph_flags & PH_FLAG_DEFERRED) {
+				char *buf = cfs_trace_get_console_buffer();
+				int   nob;
+
+				nob = cfs_trace_fmt_decode(p, len, buf,
+						CFS_TRACE_CONSOLE_BUFFER_SIZE);
+				cfs_print_to_console(hdr, D_EMERG, buf, nob,
+						     file, fn);
+				cfs_trace_put_console_buffer(buf);
+			} else {
+				cfs_print_to_console(hdr, D_EMERG, p, len,
+						     file, fn);
+			}
 
                         p += len;
                 }
@@ -665,16 +756,83 @@ void cfs_trace_debug_print(void)
 	}
 }
 
+/*
+ * Decode the deferred record \a hdr into a text record in \a buf of \a size
+ * bytes, return the length of the text record.
+ */
+static int cfs_trace_decode_record(struct ptldebug_header *hdr,
+				   char *buf, int size)
+{
+	struct ptldebug_header	*out = (struct ptldebug_header *)buf;
+	char			*p = (char *)(hdr + 1);
+	int			 prefix;
+
+	p += strlen(p) + 1;	/* nesting dots and file */
+	p += strlen(p) + 1;	/* function */
+	prefix = p - (char *)hdr;
+
+	memcpy(buf, hdr, prefix);
+	out->ph_len = prefix + cfs_trace_fmt_decode(p, hdr->ph_len - prefix,
+						    buf + prefix,
+						    size - prefix);
+	out->ph_flags &= ~PH_FLAG_DEFERRED;
+	return out->ph_len;
+}
+
+/*
+ * Write the records of \a tage to \a filp at \a pos, decoding deferred
+ * records to text in \a scratch of CFS_TRACE_SCRATCH_SIZE bytes. Return the
+ * number of bytes of the page written out, as filp_write() does.
+ */
+static int cfs_trace_write_page(struct file *filp, struct cfs_trace_page *tage,
+				loff_t *pos, char *scratch)
+{
+	struct ptldebug_header	*hdr;
+	char			*p = page_address(tage->page);
+	char			*end = p + tage->used;
+	int			 nob = 0;
+	int			 rc;
+
+	if (!tage->deferred)
+		return filp_write(filp, p, tage->used, pos);
+
+	while (p < end) {
+		hdr = (struct ptldebug_header *)p;
+		if (hdr->ph_flags & PH_FLAG_DEFERRED) {
+			nob += cfs_trace_decode_record(hdr, scratch + nob,
+						       PAGE_CACHE_SIZE);
+		} else {
+			memcpy(scratch + nob, p, hdr->ph_len);
+			nob += hdr->ph_len;
+		}
+		p += hdr->ph_len;
+
+		if (nob < PAGE_CACHE_SIZE && p < end)
+			continue;
+
+		rc = filp_write(filp, scratch, nob, pos);
+		if (rc != nob)
+			return rc < 0 ? rc : -EIO;
+		nob = 0;
+	}
+	return tage->used;
+}
+
 int cfs_tracefile_dump_all_pages(char *filename)
 {
 	struct page_collection	pc;
 	struct file		*filp;
 	struct cfs_trace_page	*tage;
 	struct cfs_trace_page	*tmp;
+	char			*scratch;
 	int rc;
 
 	DECL_MMSPACE;
 
+	scratch = kmalloc(CFS_TRACE_SCRATCH_SIZE, GFP_KERNEL);
+	if (scratch == NULL)
+		return -ENOMEM;
+
 	cfs_tracefile_write_lock();
 
 	filp = filp_open(filename, O_CREAT|O_EXCL|O_WRONLY|O_LARGEFILE, 0600);
@@ -700,8 +858,8 @@ int cfs_tracefile_dump_all_pages(char *filename)
 
                 __LASSERT_TAGE_INVARIANT(tage);
 
-		rc = filp_write(filp, page_address(tage->page),
-				tage->used, filp_poff(filp));
+		rc = cfs_trace_write_page(filp, tage, filp_poff(filp),
+					  scratch);
 		if (rc != (int)tage->used) {
 			printk(KERN_WARNING "wanted to write %u but wrote "
 			       "%d\n", tage->used, rc);
@@ -720,6 +878,7 @@ close:
 	filp_close(filp, NULL);
 out:
 	cfs_tracefile_write_unlock();
+	kfree(scratch);
 	return rc;
 }
 
@@ -1011,8 +1170,8 @@ static int tracefiled(void *arg)
 			else if (f_pos > (off_t)filp_size(filp))
 				f_pos = filp_size(filp);
 
-			rc = filp_write(filp, page_address(tage->page),
-					tage->used, &f_pos);
+			rc = cfs_trace_write_page(filp, tage, &f_pos,
+						  tctl->tctl_scratch);
 			if (rc != (int)tage->used) {
 				printk(KERN_WARNING "wanted to write %u "
 				       "but wrote %d\n", tage->used, rc);
@@ -1082,7 +1241,15 @@ int cfs_trace_start_thread(void)
 	init_waitqueue_head(&tctl->tctl_waitq);
 	atomic_set(&tctl->tctl_shutdown, 0);
 
+	tctl->tctl_scratch = kmalloc(CFS_TRACE_SCRATCH_SIZE, GFP_KERNEL);
+	if (tctl->tctl_scratch == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
 	if (IS_ERR(kthread_run(tracefiled, tctl, "ktracefiled"))) {
+		kfree(tctl->tctl_scratch);
+		tctl->tctl_scratch = NULL;
 		rc = -ECHILD;
 		goto out;
 	}
@@ -1104,6 +1271,8 @@ void cfs_trace_stop_thread(void)
 		       "Lustre: shutting down debug daemon thread...\n");
 		atomic_set(&tctl->tctl_shutdown, 1);
 		wait_for_completion(&tctl->tctl_stop);
+		kfree(tctl->tctl_scratch);
+		tctl->tctl_scratch = NULL;
 		thread_running = 0;
 	}
 	mutex_unlock(&cfs_trace_thread_mutex);
@@ -1168,6 +1337,7 @@ static void cfs_trace_cleanup(void)
 	trace_cleanup_on_all_cpus();
 
 	cfs_tracefile_fini_arch();
+	cfs_trace_fmt_fini();
 }
 
 void cfs_tracefile_exit(void)
@@ -217,6 +217,8 @@ struct tracefiled_ctl {
 	wait_queue_head_t	tctl_waitq;
 	pid_t			tctl_pid;
 	atomic_t		tctl_shutdown;
+	/* buffer to decode deferred records in, CFS_TRACE_SCRATCH_SIZE */
+	char			*tctl_scratch;
 };
 
 /*
@@ -246,8 +248,63 @@ struct cfs_trace_page {
 	 * type(context) of this page
 	 */
 	unsigned short		type;
+	/*
+	 * whether the page holds deferred records, which must be decoded
+	 * to text when written out
+	 */
+	unsigned int		deferred;
+};
+
+/*
+ * buffer used to write out a page with deferred records: the decoded records
+ * of a page are flushed whenever more than a page is buffered, and a single
+ * record never decodes to more than a page
+ */
+#define CFS_TRACE_SCRATCH_SIZE	(2 * PAGE_CACHE_SIZE)
+
+/* max # of arguments of a deferred message, '*' widths included */
+#define CFS_TRACE_FMT_MAX_ARGS	16
+/* max # of bytes of a %s argument stored in a deferred record */
+#define CFS_TRACE_FMT_STR_MAX	256
+
+/* how an argument of a deferred message is fetched and stored */
+enum cfs_trace_fmt_arg {
+	CFS_TFA_INT	= 0,
+	CFS_TFA_LONG,
+	CFS_TFA_LLONG,
+	CFS_TFA_PTR,
+	CFS_TFA_STR,
 };
 
+/**
+ * A registered format of debug messages, see tracefmt.c.
+ */
+struct cfs_trace_fmt {
+	/* next format in the same hash chain */
+	struct cfs_trace_fmt	*tf_next;
+	/* format string of the call site, only compared, never read */
+	const char		*tf_key;
+	/* ID stored in deferred records */
+	__u32			 tf_id;
+	/* # of arguments, -1 if messages can't be deferred */
+	int			 tf_nargs;
+	/* enum cfs_trace_fmt_arg of each argument */
+	unsigned char		 tf_args[CFS_TRACE_FMT_MAX_ARGS];
+	/* precision of %s arguments: -1 for none, -2 if given by the previous
+	 * ('*') argument */
+	short			 tf_prec[CFS_TRACE_FMT_MAX_ARGS];
+	/* copy of the format string */
+	char			 tf_fmt[0];
+};
+
+void cfs_trace_fmt_fini(void);
+struct cfs_trace_fmt *cfs_trace_fmt_get(struct libcfs_debug_msg_data *msgdata,
+					const char *format);
+int cfs_trace_fmt_size(struct cfs_trace_fmt *fmt, va_list args, __u16 *lens);
+void cfs_trace_fmt_pack(struct cfs_trace_fmt *fmt, va_list args,
+			const __u16 *lens, char *buf);
+int cfs_trace_fmt_decode(const char *body, int len, char *buf, int size);
+
 extern void cfs_set_ptldebug_header(struct ptldebug_header *header,
                                     struct libcfs_debug_msg_data *m,
                                     unsigned long stack);
@@ -0,0 +1,572 @@
+/*
+ * GPL HEADER START
+ *
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License version 2 for more details (a copy is included
+ * in the LICENSE file that accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; If not, see
+ * http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * GPL HEADER END
+ */
+/*
+ * This file is part of Lustre, http://www.lustre.org/
+ *
+ * libcfs/libcfs/tracefmt.c
+ *
+ * Deferred formatting of debug messages.
+ *
+ * Messages of the debug masks in libcfs_debug_deferred aren't vsnprintf()ed
+ * into the trace pages: libcfs_debug_vmsg2() only stores the ID of their
+ * format and their raw arguments, and the text is made when the pages are
+ * written out by "lctl dk" or the debug daemon, or printed on LBUG.
+ *
+ * Formats are registered on first use. The registry keeps a copy of each
+ * format string, so records can be decoded after the module which logged
+ * them is unloaded, and the ID is cached in the msgdata of the call site.
+ * At most CFS_TRACE_FMT_STR_MAX bytes of %s arguments are copied into the
+ * record. Formats with kernel %p extensions, %n or too many arguments can't
+ * be deferred, their messages are formatted at once as before.
+ *
+ * NB: nothing here may log with CDEBUG, it's called from the debug code.
+ */
+
+#define DEBUG_SUBSYSTEM S_LNET
+#define LUSTRE_TRACEFILE_PRIVATE
+
+#include <libcfs/libcfs.h>
+#include "tracefile.h"
+
+/* registered formats by ID, in chunks allocated on demand */
+#define CFS_TRACE_FMT_CHUNK	1024
+#define CFS_TRACE_FMT_CHUNKS	64
+#define CFS_TRACE_FMT_ID_MAX	(CFS_TRACE_FMT_CHUNK * CFS_TRACE_FMT_CHUNKS)
+
+/* registered formats by format pointer */
+#define CFS_TRACE_FMT_HASH_BITS	10
+
+/* stored length of a NULL %s argument */
+#define CFS_TRACE_FMT_STR_NULL	((__u16)~0)
+
+static struct cfs_trace_fmt **cfs_trace_fmt_chunks[CFS_TRACE_FMT_CHUNKS];
+static struct cfs_trace_fmt *cfs_trace_fmt_hash[1 << CFS_TRACE_FMT_HASH_BITS];
+/* protects registration, lookups by ID are lockless */
+static DEFINE_SPINLOCK(cfs_trace_fmt_lock);
+/* ID 0 is never used, so a zeroed msgdata has no format cached */
+static __u32 cfs_trace_fmt_next_id = 1;
+
+/* a conversion specification of a format string */
+struct cfs_trace_spec {
+	/* length, the '%' excluded */
+	int	ts_len;
+	/* width and precision are given by arguments */
+	int	ts_width_star;
+	int	ts_prec_star;
+	/* literal precision, -1 if none */
+	int	ts_prec;
+	/* enum cfs_trace_fmt_arg of the value, -1 for "%%" */
+	int	ts_arg;
+};
+
+/**
+ * Parse the conversion specification following a '%' at \a p.
+ *
+ * \retval 0		\a spec is filled
+ * \retval -EINVAL	the conversion can't be deferred
+ */
+static int cfs_trace_fmt_spec(const char *p, struct cfs_trace_spec *spec)
+{
+	const char *s = p;
+	int	    arg = CFS_TFA_INT;
+
+	memset(spec, 0, sizeof(*spec));
+	spec->ts_prec = -1;
+
+	if (*s == '%') {
+		spec->ts_arg = -1;
+		spec->ts_len = 1;
+		return 0;
+	}
+
+	while (*s != '\0' && strchr("-+ #0", *s) != NULL)
+		s++;
+
+	if (*s == '*') {
+		spec->ts_width_star = 1;
+		s++;
+	} else {
+		while (isdigit(*s))
+			s++;
+	}
+
+	if (*s == '.') {
+		s++;
+		if (*s == '*') {
+			spec->ts_prec_star = 1;
+			s++;
+		} else {
+			spec->ts_prec = 0;
+			while (isdigit(*s)) {
+				if (spec->ts_prec < CFS_TRACE_FMT_STR_MAX)
+					spec->ts_prec = spec->ts_prec * 10 +
+							*s - '0';
+				s++;
+			}
+		}
+	}
+
+	switch (*s) {
+	case 'h':
+		if (*++s == 'h')
+			s++;
+		break;
+	case 'l':
+		arg = CFS_TFA_LONG;
+		if (*++s == 'l') {
+			arg = CFS_TFA_LLONG;
+			s++;
+		}
+		break;
+	case 'L':
+	case 'q':
+		arg = CFS_TFA_LLONG;
+		s++;
+		break;
+	case 'z':
+	case 'Z':
+	case 't':
+		/* size_t and ptrdiff_t are passed like long */
+		arg = CFS_TFA_LONG;
+		s++;
+		break;
+	}
+
+	switch (*s) {
+	case 'd':
+	case 'i':
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X':
+	case 'c':
+		break;
+	case 's':
+		if (arg != CFS_TFA_INT)
+			return -EINVAL;
+		arg = CFS_TFA_STR;
+		break;
+	case 'p':
+		/* %pX extensions dereference the pointer */
+		if (arg != CFS_TFA_INT || isalnum(s[1]))
+			return -EINVAL;
+		arg = CFS_TFA_PTR;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	spec->ts_arg = arg;
+	spec->ts_len = s + 1 - p;
+	return 0;
+}
+
+/* fill the argument list of \a fmt, tf_nargs is -1 if it can't be deferred */
+static void cfs_trace_fmt_parse(struct cfs_trace_fmt *fmt)
+{
+	struct cfs_trace_spec	 spec;
+	const char		*p = fmt->tf_fmt;
+	int			 n = 0;
+
+	fmt->tf_nargs = -1;
+	while ((p = strchr(p, '%')) != NULL) {
+		if (cfs_trace_fmt_spec(++p, &spec) != 0)
+			return;
+
+		p += spec.ts_len;
+		if (spec.ts_arg < 0)
+			continue;
+
+		if (n + spec.ts_width_star + spec.ts_prec_star >=
+		    CFS_TRACE_FMT_MAX_ARGS)
+			return;
+
+		if (spec.ts_width_star) {
+			fmt->tf_args[n] = CFS_TFA_INT;
+			fmt->tf_prec[n++] = -1;
+		}
+		if (spec.ts_prec_star) {
+			fmt->tf_args[n] = CFS_TFA_INT;
+			fmt->tf_prec[n++] = -1;
+		}
+		fmt->tf_args[n] = spec.ts_arg;
+		fmt->tf_prec[n++] = spec.ts_prec_star ? -2 : spec.ts_prec;
+	}
+	fmt->tf_nargs = n;
+}
+
+static struct cfs_trace_fmt *cfs_trace_fmt_find(__u32 id)
+{
+	struct cfs_trace_fmt **chunk;
+
+	if (id == 0 || id >= CFS_TRACE_FMT_ID_MAX)
+		return NULL;
+
+	chunk = ACCESS_ONCE(cfs_trace_fmt_chunks[id / CFS_TRACE_FMT_CHUNK]);
+	if (chunk == NULL)
+		return NULL;
+
+	/* pairs with smp_wmb() in cfs_trace_fmt_register() */
+	smp_read_barrier_depends();
+	return ACCESS_ONCE(chunk[id % CFS_TRACE_FMT_CHUNK]);
+}
+
+static struct cfs_trace_fmt *cfs_trace_fmt_register(const char *format)
+{
+	struct cfs_trace_fmt	**head;
+	struct cfs_trace_fmt	**chunk;
+	struct cfs_trace_fmt	 *fmt;
+	unsigned long		  flags;
+	__u32			  id;
+
+	head = &cfs_trace_fmt_hash[cfs_hash_u64_hash((unsigned long)format,
+				ARRAY_SIZE(cfs_trace_fmt_hash) - 1)];
+
+	spin_lock_irqsave(&cfs_trace_fmt_lock, flags);
+	/* the same string may be logged from many call sites, but after a
+	 * module reload another one may live at the same address */
+	for (fmt = *head; fmt != NULL; fmt = fmt->tf_next) {
+		if (fmt->tf_key == format && strcmp(fmt->tf_fmt, format) == 0)
+			goto out;
+	}
+
+	id = cfs_trace_fmt_next_id;
+	if (id >= CFS_TRACE_FMT_ID_MAX)
+		goto out;
+
+	chunk = cfs_trace_fmt_chunks[id / CFS_TRACE_FMT_CHUNK];
+	if (chunk == NULL) {
+		chunk = kzalloc(sizeof(*chunk) * CFS_TRACE_FMT_CHUNK,
+				GFP_ATOMIC | __GFP_NOWARN);
+		if (chunk == NULL)
+			goto out;
+		smp_wmb();
+		cfs_trace_fmt_chunks[id / CFS_TRACE_FMT_CHUNK] = chunk;
+	}
+
+	fmt = kmalloc(sizeof(*fmt) + strlen(format) + 1,
+		      GFP_ATOMIC | __GFP_NOWARN);
+	if (fmt == NULL)
+		goto out;
+
+	fmt->tf_key = format;
+	fmt->tf_id = id;
+	strcpy(fmt->tf_fmt, format);
+	cfs_trace_fmt_parse(fmt);
+
+	fmt->tf_next = *head;
+	*head = fmt;
+	cfs_trace_fmt_next_id++;
+
+	/* lockless cfs_trace_fmt_find() must see an initialized format */
+	smp_wmb();
+	chunk[id % CFS_TRACE_FMT_CHUNK] = fmt;
+out:
+	spin_unlock_irqrestore(&cfs_trace_fmt_lock, flags);
+	return fmt;
+}
+
+/**
+ * Get the registered format \a format logged from \a msgdata.
+ *
+ * \retval NULL		messages of \a format can't be deferred
+ */
+struct cfs_trace_fmt *cfs_trace_fmt_get(struct libcfs_debug_msg_data *msgdata,
+					const char *format)
+{
+	struct cfs_trace_fmt *fmt;
+
+	/* a call site almost always logs the same format */
+	fmt = cfs_trace_fmt_find(msgdata->msg_fmt_id);
+	if (fmt == NULL || fmt->tf_key != format) {
+		fmt = cfs_trace_fmt_register(format);
+		if (fmt == NULL)
+			return NULL;
+		msgdata->msg_fmt_id = fmt->tf_id;
+	}
+
+	return fmt->tf_nargs < 0 ? NULL : fmt;
+}
+
+/**
+ * Size of the record body of \a args, the format ID included. The lengths
+ * of string arguments are returned in \a lens, so that strings changing
+ * under us can't make cfs_trace_fmt_pack() overflow the record.
+ */
+int cfs_trace_fmt_size(struct cfs_trace_fmt *fmt, va_list args, __u16 *lens)
+{
+	const char *str;
+	int	    size = sizeof(__u32);
+	int	    star = 0;
+	int	    max;
+	int	    i;
+
+	for (i = 0; i < fmt->tf_nargs; i++) {
+		switch (fmt->tf_args[i]) {
+		case CFS_TFA_INT:
+			/* remembered in case it's the precision of a %s */
+			star = va_arg(args, int);
+			size += sizeof(int);
+			break;
+		case CFS_TFA_LONG:
+			(void)va_arg(args, long);
+			size += sizeof(long);
+			break;
+		case CFS_TFA_LLONG:
+			(void)va_arg(args, long long);
+			size += sizeof(long long);
+			break;
+		case CFS_TFA_PTR:
+			(void)va_arg(args, void *);
+			size += sizeof(void *);
+			break;
+		case CFS_TFA_STR:
+			str = va_arg(args, const char *);
+			size += sizeof(__u16);
+			if (str == NULL) {
+				lens[i] = CFS_TRACE_FMT_STR_NULL;
+				break;
+			}
+
+			max = CFS_TRACE_FMT_STR_MAX;
+			if (fmt->tf_prec[i] == -2 && star >= 0)
+				max = min(max, star);
+			else if (fmt->tf_prec[i] >= 0)
+				max = min_t(int, max, fmt->tf_prec[i]);
+
+			lens[i] = strnlen(str, max);
+			size += lens[i];
+			break;
+		}
+	}
+	return size;
+}
+
+/**
+ * Store the format ID and \a args into the record body \a buf, of the size
+ * returned by cfs_trace_fmt_size() for the same arguments.
+ */
+void cfs_trace_fmt_pack(struct cfs_trace_fmt *fmt, va_list args,
+			const __u16 *lens, char *buf)
+{
+	const char *str;
+	long long   ll;
+	void	   *ptr;
+	long	    l;
+	int	    n;
+	int	    i;
+
+	memcpy(buf, &fmt->tf_id, sizeof(fmt->tf_id));
+	buf += sizeof(fmt->tf_id);
+
+	for (i = 0; i < fmt->tf_nargs; i++) {
+		switch (fmt->tf_args[i]) {
+		case CFS_TFA_INT:
+			n = va_arg(args, int);
+			memcpy(buf, &n, sizeof(n));
+			buf += sizeof(n);
+			break;
+		case CFS_TFA_LONG:
+			l = va_arg(args, long);
+			memcpy(buf, &l, sizeof(l));
+			buf += sizeof(l);
+			break;
+		case CFS_TFA_LLONG:
+			ll = va_arg(args, long long);
+			memcpy(buf, &ll, sizeof(ll));
+			buf += sizeof(ll);
+			break;
+		case CFS_TFA_PTR:
+			ptr = va_arg(args, void *);
+			memcpy(buf, &ptr, sizeof(ptr));
+			buf += sizeof(ptr);
+			break;
+		case CFS_TFA_STR:
+			str = va_arg(args, const char *);
+			memcpy(buf, &lens[i], sizeof(lens[i]));
+			buf += sizeof(lens[i]);
+			if (lens[i] != CFS_TRACE_FMT_STR_NULL) {
+				memcpy(buf, str, lens[i]);
+				buf += lens[i];
+			}
+			break;
+		}
+	}
+}
+
+/* fetch \a size bytes of the record body into \a val */
+static int cfs_trace_fmt_take(const char **body, const char *end,
+			      void *val, int size)
+{
+	if (end - *body < size)
+		return -EINVAL;
+
+	memcpy(val, *body, size);
+	*body += size;
+	return 0;
+}
+
+/**
+ * Format the deferred record body \a body of \a len bytes into \a buf of
+ * \a size bytes.
+ *
+ * \retval	length of the text, the terminating NUL excluded
+ */
+int cfs_trace_fmt_decode(const char *body, int len, char *buf, int size)
+{
+	const char		*end = body + len;
+	struct cfs_trace_fmt	*fmt;
+	struct cfs_trace_spec	 spec;
+	const char		*p;
+	const char		*q;
+	const char		*s;
+	char			 conv[64];
+	char			 str[CFS_TRACE_FMT_STR_MAX + 1];
+	long long		 ll;
+	void			*ptr;
+	long			 l;
+	__u32			 id = 0;
+	__u16			 slen;
+	int			 nob = 0;
+	int			 cnob;
+	int			 n;
+	int			 rc;
+
+	__LASSERT(size > 1);
+
+	if (cfs_trace_fmt_take(&body, end, &id, sizeof(id)) != 0)
+		goto bad;
+
+	fmt = cfs_trace_fmt_find(id);
+	if (fmt == NULL || fmt->tf_nargs < 0)
+		goto bad;
+
+	for (p = fmt->tf_fmt; *p != '\0' && nob < size - 1; p = q) {
+		q = strchr(p, '%');
+		if (q == NULL)
+			q = p + strlen(p);
+
+		n = min_t(int, q - p, size - 1 - nob);
+		memcpy(buf + nob, p, n);
+		nob += n;
+		if (*q == '\0' || nob == size - 1)
+			break;
+
+		/* registered, so it parses */
+		cfs_trace_fmt_spec(q + 1, &spec);
+		if (spec.ts_arg < 0) {
+			buf[nob++] = '%';
+			q += 2;
+			continue;
+		}
+
+		if (spec.ts_len + 2 * 12 >= sizeof(conv))
+			goto bad;
+
+		/* copy the conversion, with '*' replaced by the value */
+		conv[0] = '%';
+		cnob = 1;
+		for (s = q + 1, q = s + spec.ts_len; s < q; s++) {
+			if (*s != '*') {
+				conv[cnob++] = *s;
+				continue;
+			}
+			if (cfs_trace_fmt_take(&body, end, &n, sizeof(n)) != 0)
+				goto bad;
+			cnob += snprintf(conv + cnob, sizeof(conv) - cnob,
+					 "%d", n);
+		}
+		conv[cnob] = '\0';
+
+		switch (spec.ts_arg) {
+		case CFS_TFA_INT:
+			if (cfs_trace_fmt_take(&body, end, &n, sizeof(n)) != 0)
+				goto bad;
+			rc = snprintf(buf + nob, size - nob, conv, n);
+			break;
+		case CFS_TFA_LONG:
+			if (cfs_trace_fmt_take(&body, end, &l, sizeof(l)) != 0)
+				goto bad;
+			rc = snprintf(buf + nob, size - nob, conv, l);
+			break;
+		case CFS_TFA_LLONG:
+			if (cfs_trace_fmt_take(&body, end,
+					       &ll, sizeof(ll)) != 0)
+				goto bad;
+			rc = snprintf(buf + nob, size - nob, conv, ll);
+			break;
+		case CFS_TFA_PTR:
+			if (cfs_trace_fmt_take(&body, end,
+					       &ptr, sizeof(ptr)) != 0)
+				goto bad;
+			rc = snprintf(buf + nob, size - nob, conv, ptr);
+			break;
+		case CFS_TFA_STR:
+		default:
+			if (cfs_trace_fmt_take(&body, end,
+					       &slen, sizeof(slen)) != 0)
+				goto bad;
+			if (slen == CFS_TRACE_FMT_STR_NULL) {
+				rc = snprintf(buf + nob, size - nob, conv,
+					      NULL);
+				break;
+			}
+			if (slen > CFS_TRACE_FMT_STR_MAX ||
+			    cfs_trace_fmt_take(&body, end, str, slen) != 0)
+				goto bad;
+			str[slen] = '\0';
+			rc = snprintf(buf + nob, size - nob, conv, str);
+			break;
+		}
+		nob += min(rc, size - 1 - nob);
+	}
+
+	/* a truncated message still ends the line */
+	if (nob == size - 1 && buf[nob - 1] != '\n')
+		buf[nob - 1] = '\n';
+	buf[nob] = '\0';
+	return nob;
+bad:
+	rc = snprintf(buf, size, "<undecodable trace record, format %u>\n", id);
+	return min(rc, size - 1);
+}
+
+void cfs_trace_fmt_fini(void)
+{
+	struct cfs_trace_fmt	*fmt;
+	int			 i;
+
+	for (i = 0; i < ARRAY_SIZE(cfs_trace_fmt_hash); i++) {
+		while ((fmt = cfs_trace_fmt_hash[i]) != NULL) {
+			cfs_trace_fmt_hash[i] = fmt->tf_next;
+			kfree(fmt);
+		}
+	}
+
+	for (i = 0; i < CFS_TRACE_FMT_CHUNKS; i++) {
+		if (cfs_trace_fmt_chunks[i] != NULL) {
+			kfree(cfs_trace_fmt_chunks[i]);
+			cfs_trace_fmt_chunks[i] = NULL;
+		}
+	}
+	cfs_trace_fmt_next_id = 1;
+}
@@ -45,6 +45,28 @@
 
 #define CFS_WS_NAME_LEN         16
 
+/*
+ * Steal workitems from the scheduler of another CPT, when it has more than
+ * this number of them queued and none of its own threads is idle. Running
+ * a workitem away from its CPT costs cache and NUMA locality, so it is only
+ * worth for a backlog deeper than this.
+ */
+static int wi_cpt_steal = 0;
+CFS_MODULE_PARM(wi_cpt_steal, "i", int, 0644,
+		"steal workitems of other CPTs beyond this queue depth, "
+		"0 to disable");
+
+/** per-thread run queue */
+struct cfs_wi_thread {
+	/** workitems queued for this thread, other threads of the same
+	 * scheduler take them from here when they have nothing to do */
+	struct list_head		wt_runq;
+#ifdef __KERNEL__
+	/** thread owning this queue, NULL until it has started */
+	struct task_struct		*wt_task;
+#endif
+};
+
 typedef struct cfs_wi_sched {
 	struct list_head		ws_list;	/* chain on global list */
 #ifdef __KERNEL__
@@ -53,8 +75,12 @@ typedef struct cfs_wi_sched {
 	/** where schedulers sleep */
 	wait_queue_head_t		ws_waitq;
 #endif
-	/** concurrent workitems */
-	struct list_head		ws_runq;
+	/** concurrent workitems, one queue per thread (one in userspace) */
+	struct cfs_wi_thread		*ws_threads;
+	/** number of queues in ws_threads */
+	int				ws_nqueues;
+	/** queue for the next workitem scheduled by a non-scheduler thread */
+	int				ws_next;
 	/** rescheduled running-workitems, a workitem can be rescheduled
 	 * while running in wi_action(), but we don't to execute it again
 	 * unless it returns from wi_action(), so we put it on ws_rerunq
@@ -67,6 +93,23 @@ typedef struct cfs_wi_sched {
 	int			ws_cpt;
 	/** number of scheduled workitems */
 	int			ws_nscheduled;
+	/** number of workitems on the per-thread queues */
+	int			ws_nqueued;
+	/** high-water mark of ws_nqueued */
+	int			ws_nqueued_max;
+	/** number of threads sleeping for workitems */
+	int			ws_nidle;
+	/** a loaded scheduler of another CPT asked us to steal from it */
+	int			ws_kicked;
+	/** threads of other schedulers running our workitems, protected by
+	 * cfs_wi_data::wi_glock */
+	int			ws_nforeign;
+	/** number of workitems run */
+	__u64			ws_nrun;
+	/** workitems run by a thread other than the one they were queued on */
+	__u64			ws_nsteal;
+	/** workitems run by a thread of another CPT */
+	__u64			ws_ncpt_steal;
 	/** started scheduler thread, protected by cfs_wi_data::wi_glock */
 	unsigned int		ws_nthreads:30;
 	/** shutting down, protected by cfs_wi_data::wi_glock */
@@ -110,7 +153,7 @@ cfs_wi_sched_cansleep(cfs_wi_sched_t *sched)
 		return 0;
 	}
 
-	if (!list_empty(&sched->ws_runq)) {
+	if (sched->ws_nqueued > 0 || sched->ws_kicked) {
 		cfs_wi_sched_unlock(sched);
 		return 0;
 	}
@@ -118,6 +161,19 @@ cfs_wi_sched_cansleep(cfs_wi_sched_t *sched)
 	return 1;
 }
 
+/** queue of the calling thread if it's a thread of \a sched, or NULL */
+static struct cfs_wi_thread *
+cfs_wi_sched_self(cfs_wi_sched_t *sched)
+{
+	int	i;
+
+	for (i = 0; i < sched->ws_nqueues; i++) {
+		if (sched->ws_threads[i].wt_task == current)
+			return &sched->ws_threads[i];
+	}
+	return NULL;
+}
+
 #else /* !__KERNEL__ */
 
 static inline void
@@ -132,8 +188,82 @@ cfs_wi_sched_unlock(cfs_wi_sched_t *sched)
 	spin_unlock(&cfs_wi_data.wi_glock);
 }
 
+static inline struct cfs_wi_thread *
+cfs_wi_sched_self(cfs_wi_sched_t *sched)
+{
+	return NULL;
+}
+
 #endif /* __KERNEL__ */
 
+/**
+ * Queue \a wi on the run queue \a wt of \a sched, or on the next queue in
+ * round-robin order if \a wt is NULL. Called with the scheduler locked.
+ */
+static void
+cfs_wi_enqueue(cfs_wi_sched_t *sched, struct cfs_wi_thread *wt,
+	       cfs_workitem_t *wi)
+{
+	if (wt == NULL) {
+		wt = &sched->ws_threads[sched->ws_next];
+		if (++sched->ws_next == sched->ws_nqueues)
+			sched->ws_next = 0;
+	}
+
+	list_add_tail(&wi->wi_list, &wt->wt_runq);
+	sched->ws_nqueued++;
+	if (sched->ws_nqueued > sched->ws_nqueued_max)
+		sched->ws_nqueued_max = sched->ws_nqueued;
+}
+
+/**
+ * Take the next workitem to run for the thread owning queue \a self: the
+ * oldest one on its own queue, or if that is empty the oldest one on the
+ * queue of another thread of \a sched. \a self is NULL for a thread which
+ * doesn't belong to \a sched. Called with the scheduler locked.
+ *
+ * \retval the workitem, marked as running, or NULL if nothing is queued
+ */
+static cfs_workitem_t *
+cfs_wi_dequeue(cfs_wi_sched_t *sched, struct cfs_wi_thread *self)
+{
+	struct cfs_wi_thread	*wt = self;
+	cfs_workitem_t		*wi;
+	int			i;
+
+	if (sched->ws_nqueued == 0)
+		return NULL;
+
+	if (wt == NULL || list_empty(&wt->wt_runq)) {
+		/* start after our own queue so thieves spread over victims */
+		i = self == NULL ? 0 : self - sched->ws_threads;
+		do {
+			if (++i == sched->ws_nqueues)
+				i = 0;
+			wt = &sched->ws_threads[i];
+		} while (list_empty(&wt->wt_runq));
+
+		if (self != NULL)
+			sched->ws_nsteal++;
+	}
+
+	wi = list_entry(wt->wt_runq.next, cfs_workitem_t, wi_list);
+	LASSERT(wi->wi_scheduled && !wi->wi_running);
+
+	list_del_init(&wi->wi_list);
+
+	LASSERT(sched->ws_nqueued > 0);
+	sched->ws_nqueued--;
+	LASSERT(sched->ws_nscheduled > 0);
+	sched->ws_nscheduled--;
+
+#ifdef __KERNEL__
+	wi->wi_running = 1;
+#endif
+	wi->wi_scheduled = 0;
+	return wi;
+}
+
 /* XXX:
  * 0. it only works when called from wi->wi_action.
  * 1. when it returns no one shall try to schedule the workitem.
@@ -153,6 +283,10 @@ cfs_wi_exit(struct cfs_wi_sched *sched, cfs_workitem_t *wi)
 		LASSERT(!list_empty(&wi->wi_list));
 		list_del_init(&wi->wi_list);
 
+		if (!wi->wi_running) {
+			LASSERT(sched->ws_nqueued > 0);
+			sched->ws_nqueued--;
+		}
 		LASSERT(sched->ws_nscheduled > 0);
 		sched->ws_nscheduled--;
 	}
@@ -190,6 +324,10 @@ cfs_wi_deschedule(struct cfs_wi_sched *sched, cfs_workitem_t *wi)
 		LASSERT(!list_empty(&wi->wi_list));
 		list_del_init(&wi->wi_list);
 
+		if (!wi->wi_running) {
+			LASSERT(sched->ws_nqueued > 0);
+			sched->ws_nqueued--;
+		}
 		LASSERT(sched->ws_nscheduled > 0);
 		sched->ws_nscheduled--;
 
@@ -203,16 +341,61 @@ cfs_wi_deschedule(struct cfs_wi_sched *sched, cfs_workitem_t *wi)
 }
 EXPORT_SYMBOL(cfs_wi_deschedule);
 
+#ifdef __KERNEL__
+
+/** can threads of \a sched steal the workitems of \a victim */
+static inline int
+cfs_wi_sched_is_peer(cfs_wi_sched_t *sched, cfs_wi_sched_t *victim)
+{
+	return victim != sched && !victim->ws_stopping &&
+	       sched->ws_cptab != NULL && victim->ws_cptab == sched->ws_cptab &&
+	       victim->ws_cpt != sched->ws_cpt &&
+	       strcmp(victim->ws_name, sched->ws_name) == 0;
+}
+
+/**
+ * All threads of \a sched are busy and it has a backlog of more than
+ * wi_cpt_steal workitems, wake up an idle thread of a scheduler of another
+ * CPT to steal from it.
+ */
+static void
+cfs_wi_sched_kick_peer(cfs_wi_sched_t *sched)
+{
+	cfs_wi_sched_t	*peer;
+
+	spin_lock(&cfs_wi_data.wi_glock);
+	list_for_each_entry(peer, &cfs_wi_data.wi_scheds, ws_list) {
+		if (!cfs_wi_sched_is_peer(peer, sched) || peer->ws_nidle == 0)
+			continue;
+
+		cfs_wi_sched_lock(peer);
+		peer->ws_kicked = 1;
+		cfs_wi_sched_unlock(peer);
+
+		wake_up(&peer->ws_waitq);
+		break;
+	}
+	spin_unlock(&cfs_wi_data.wi_glock);
+}
+
+#endif /* __KERNEL__ */
+
 /*
  * Workitem scheduled with (serial == 1) is strictly serialised not only with
  * itself, but also with others scheduled this way.
  *
  * Now there's only one static serialised queue, but in the future more might
  * be added, and even dynamic creation of serialised queues might be supported.
+ *
+ * A workitem scheduled by a thread of \a sched is queued for this thread,
+ * others are spread over the threads in round-robin order; idle threads
+ * steal the workitems queued for busy ones.
  */
 void
 cfs_wi_schedule(struct cfs_wi_sched *sched, cfs_workitem_t *wi)
 {
+	int	kick = 0;
+
 	LASSERT(!in_interrupt()); /* because we use plain spinlock */
 	LASSERT(!sched->ws_stopping);
 
@@ -224,9 +407,13 @@ cfs_wi_schedule(struct cfs_wi_sched *sched, cfs_workitem_t *wi)
 		wi->wi_scheduled = 1;
 		sched->ws_nscheduled++;
 		if (!wi->wi_running) {
-			list_add_tail(&wi->wi_list, &sched->ws_runq);
+			cfs_wi_enqueue(sched, cfs_wi_sched_self(sched), wi);
 #ifdef __KERNEL__
 			wake_up(&sched->ws_waitq);
+			/* only kick once the backlog crosses the threshold,
+			 * thieves keep stealing until it's below again */
+			kick = wi_cpt_steal > 0 && sched->ws_nidle == 0 &&
+			       sched->ws_nqueued == wi_cpt_steal + 1;
 #endif
 		} else {
 			list_add(&wi->wi_list, &sched->ws_rerunq);
@@ -235,16 +422,87 @@ cfs_wi_schedule(struct cfs_wi_sched *sched, cfs_workitem_t *wi)
 
 	LASSERT (!list_empty(&wi->wi_list));
 	cfs_wi_sched_unlock(sched);
+
+#ifdef __KERNEL__
+	if (kick)
+		cfs_wi_sched_kick_peer(sched);
+#endif
 	return;
 }
 EXPORT_SYMBOL(cfs_wi_schedule);
 
 #ifdef __KERNEL__
 
+/**
+ * Steal a workitem from the scheduler of another CPT which has more than
+ * wi_cpt_steal of them queued, and run it in the context of the calling
+ * thread of \a sched.
+ *
+ * \retval 1 a workitem has been run
+ * \retval 0 no scheduler of another CPT is loaded enough
+ */
+static int
+cfs_wi_steal_cpt(cfs_wi_sched_t *sched)
+{
+	cfs_wi_sched_t	*victim;
+	cfs_workitem_t	*wi = NULL;
+	int		rc;
+
+	spin_lock(&cfs_wi_data.wi_glock);
+	list_for_each_entry(victim, &cfs_wi_data.wi_scheds, ws_list) {
+		/* racy check, don't bother locking idle schedulers */
+		if (!cfs_wi_sched_is_peer(sched, victim) ||
+		    victim->ws_nqueued <= wi_cpt_steal)
+			continue;
+
+		/* never spin on a busy scheduler, we'd add to its load */
+		if (!spin_trylock(&victim->ws_lock))
+			continue;
+
+		if (victim->ws_nqueued > wi_cpt_steal) {
+			wi = cfs_wi_dequeue(victim, NULL);
+			victim->ws_ncpt_steal++;
+		}
+		cfs_wi_sched_unlock(victim);
+
+		if (wi != NULL) {
+			/* hold off cfs_wi_sched_destroy(victim) */
+			victim->ws_nforeign++;
+			break;
+		}
+	}
+	spin_unlock(&cfs_wi_data.wi_glock);
+
+	if (wi == NULL)
+		return 0;
+
+	rc = (*wi->wi_action) (wi);
+
+	cfs_wi_sched_lock(victim);
+	victim->ws_nrun++;
+	if (rc == 0) {
+		wi->wi_running = 0;
+		if (!list_empty(&wi->wi_list)) {
+			LASSERT(wi->wi_scheduled);
+			/* rescheduled while running, give it back */
+			list_del_init(&wi->wi_list);
+			cfs_wi_enqueue(victim, NULL, wi);
+			wake_up(&victim->ws_waitq);
+		}
+	}
+	cfs_wi_sched_unlock(victim);
+
+	spin_lock(&cfs_wi_data.wi_glock);
+	victim->ws_nforeign--;
+	spin_unlock(&cfs_wi_data.wi_glock);
+	return 1;
+}
+
 static int
 cfs_wi_scheduler (void *arg)
 {
 	struct cfs_wi_sched	*sched = (cfs_wi_sched_t *)arg;
+	struct cfs_wi_thread	*self;
 
 	cfs_block_allsigs();
 
@@ -258,38 +516,29 @@ cfs_wi_scheduler (void *arg)
 
 	LASSERT(sched->ws_starting == 1);
 	sched->ws_starting--;
+	LASSERT(sched->ws_nthreads < sched->ws_nqueues);
+	self = &sched->ws_threads[sched->ws_nthreads];
 	sched->ws_nthreads++;
 
 	spin_unlock(&cfs_wi_data.wi_glock);
 
 	cfs_wi_sched_lock(sched);
+	self->wt_task = current;
 
 	while (!sched->ws_stopping) {
 		int		nloops = 0;
 		int		rc;
 		cfs_workitem_t *wi;
 
-		while (!list_empty(&sched->ws_runq) &&
-		       nloops < CFS_WI_RESCHED) {
-			wi = list_entry(sched->ws_runq.next,
-					    cfs_workitem_t, wi_list);
-			LASSERT(wi->wi_scheduled && !wi->wi_running);
-
-			list_del_init(&wi->wi_list);
-
-			LASSERT(sched->ws_nscheduled > 0);
-			sched->ws_nscheduled--;
-
-                        wi->wi_running   = 1;
-                        wi->wi_scheduled = 0;
-
-
+		while (nloops < CFS_WI_RESCHED &&
+		       (wi = cfs_wi_dequeue(sched, self)) != NULL) {
                         cfs_wi_sched_unlock(sched);
                         nloops++;
 
                         rc = (*wi->wi_action) (wi);
 
                         cfs_wi_sched_lock(sched);
+			sched->ws_nrun++;
                         if (rc != 0) /* WI should be dead, even be freed! */
                                 continue;
 
@@ -299,11 +548,12 @@ cfs_wi_scheduler (void *arg)
 
 			LASSERT(wi->wi_scheduled);
 			/* wi is rescheduled, should be on rerunq now, we
-			 * move it to runq so it can run action now */
-			list_move_tail(&wi->wi_list, &sched->ws_runq);
+			 * move it to our runq so it can run action now */
+			list_del_init(&wi->wi_list);
+			cfs_wi_enqueue(sched, self, wi);
                 }
 
-		if (!list_empty(&sched->ws_runq)) {
+		if (sched->ws_nqueued > 0) {
 			cfs_wi_sched_unlock(sched);
 			/* don't sleep because some workitems still
 			 * expect me to come back soon */
@@ -312,12 +562,24 @@ cfs_wi_scheduler (void *arg)
 			continue;
 		}
 
+		sched->ws_kicked = 0;
+		if (wi_cpt_steal > 0) {
+			cfs_wi_sched_unlock(sched);
+			rc = cfs_wi_steal_cpt(sched);
+			cfs_wi_sched_lock(sched);
+			if (rc != 0)
+				continue;
+		}
+
+		sched->ws_nidle++;
 		cfs_wi_sched_unlock(sched);
 		rc = wait_event_interruptible_exclusive(sched->ws_waitq,
 				!cfs_wi_sched_cansleep(sched));
 		cfs_wi_sched_lock(sched);
+		sched->ws_nidle--;
         }
 
+	self->wt_task = NULL;
         cfs_wi_sched_unlock(sched);
 
 	spin_lock(&cfs_wi_data.wi_glock);
@@ -343,7 +605,7 @@ cfs_wi_check_events (void)
 
                 /** rerunq is always empty for userspace */
 		list_for_each_entry(tmp, &cfs_wi_data.wi_scheds, ws_list) {
-			if (!list_empty(&tmp->ws_runq)) {
+			if (tmp->ws_nqueued > 0) {
 				sched = tmp;
 				break;
 			}
@@ -352,15 +614,8 @@ cfs_wi_check_events (void)
 		if (sched == NULL)
 			break;
 
-		wi = list_entry(sched->ws_runq.next,
-				    cfs_workitem_t, wi_list);
-		list_del_init(&wi->wi_list);
-
-		LASSERT(sched->ws_nscheduled > 0);
-		sched->ws_nscheduled--;
-
-		LASSERT(wi->wi_scheduled);
-		wi->wi_scheduled = 0;
+		wi = cfs_wi_dequeue(sched, NULL);
+		sched->ws_nrun++;
 		spin_unlock(&cfs_wi_data.wi_glock);
 
 		n++;
@@ -375,6 +630,16 @@ cfs_wi_check_events (void)
 
 #endif
 
+static void
+cfs_wi_sched_free(struct cfs_wi_sched *sched)
+{
+	if (sched->ws_threads != NULL) {
+		LIBCFS_FREE(sched->ws_threads,
+			    sizeof(sched->ws_threads[0]) * sched->ws_nqueues);
+	}
+	LIBCFS_FREE(sched, sizeof(*sched));
+}
+
 void
 cfs_wi_sched_destroy(struct cfs_wi_sched *sched)
 {
@@ -401,11 +666,12 @@ cfs_wi_sched_destroy(struct cfs_wi_sched *sched)
 	{
 		int i = 2;
 
-		while (sched->ws_nthreads > 0) {
+		while (sched->ws_nthreads > 0 || sched->ws_nforeign > 0) {
 			CDEBUG(IS_PO2(++i) ? D_WARNING : D_NET,
 			       "waiting for %d threads of WI sched[%s] to "
-			       "terminate\n", sched->ws_nthreads,
-			       sched->ws_name);
+			       "terminate, %d running its workitems\n",
+			       sched->ws_nthreads, sched->ws_name,
+			       sched->ws_nforeign);
 
 			spin_unlock(&cfs_wi_data.wi_glock);
 			cfs_pause(cfs_time_seconds(1) / 20);
@@ -419,7 +685,7 @@ cfs_wi_sched_destroy(struct cfs_wi_sched *sched)
 #endif
 	LASSERT(sched->ws_nscheduled == 0);
 
-	LIBCFS_FREE(sched, sizeof(*sched));
+	cfs_wi_sched_free(sched);
 }
 EXPORT_SYMBOL(cfs_wi_sched_destroy);
 
@@ -428,6 +694,7 @@ cfs_wi_sched_create(char *name, struct cfs_cpt_table *cptab,
 		    int cpt, int nthrs, struct cfs_wi_sched **sched_pp)
 {
 	struct cfs_wi_sched	*sched;
+	int			i;
 
 	LASSERT(cfs_wi_data.wi_init);
 	LASSERT(!cfs_wi_data.wi_stopping);
@@ -451,10 +718,21 @@ cfs_wi_sched_create(char *name, struct cfs_cpt_table *cptab,
 	spin_lock_init(&sched->ws_lock);
 	init_waitqueue_head(&sched->ws_waitq);
 #endif
-	INIT_LIST_HEAD(&sched->ws_runq);
 	INIT_LIST_HEAD(&sched->ws_rerunq);
 	INIT_LIST_HEAD(&sched->ws_list);
 
+	/* userspace has no threads but still needs a queue */
+	sched->ws_nqueues = max(nthrs, 1);
+	LIBCFS_ALLOC(sched->ws_threads,
+		     sizeof(sched->ws_threads[0]) * sched->ws_nqueues);
+	if (sched->ws_threads == NULL) {
+		cfs_wi_sched_free(sched);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < sched->ws_nqueues; i++)
+		INIT_LIST_HEAD(&sched->ws_threads[i].wt_runq);
+
 #ifdef __KERNEL__
 	for (; nthrs > 0; nthrs--)  {
 		char			name[16];
@@ -508,6 +786,48 @@ cfs_wi_sched_create(char *name, struct cfs_cpt_table *cptab,
 }
 EXPORT_SYMBOL(cfs_wi_sched_create);
 
+/**
+ * Print queue depth and stealing counters of all schedulers into \a buf.
+ *
+ * \retval length of the output
+ * \retval -EFBIG \a buf of \a len bytes is too small
+ */
+int
+cfs_wi_sched_print(char *buf, int len)
+{
+	struct cfs_wi_sched	*sched;
+	char			*tmp = buf;
+	int			rc;
+
+	rc = snprintf(tmp, len, "%-15s %4s %7s %6s %10s %10s %10s %10s\n",
+		      "name", "cpt", "threads", "queued", "max_queued",
+		      "run", "steal", "cpt_steal");
+	if (rc >= len)
+		return -EFBIG;
+	tmp += rc;
+	len -= rc;
+
+	spin_lock(&cfs_wi_data.wi_glock);
+	list_for_each_entry(sched, &cfs_wi_data.wi_scheds, ws_list) {
+		rc = snprintf(tmp, len, "%-15s %4d %7d %6d %10d "
+			      "%10"LPF64"u %10"LPF64"u %10"LPF64"u\n",
+			      sched->ws_name, sched->ws_cpt,
+			      sched->ws_nthreads, sched->ws_nqueued,
+			      sched->ws_nqueued_max, sched->ws_nrun,
+			      sched->ws_nsteal, sched->ws_ncpt_steal);
+		if (rc >= len) {
+			rc = -EFBIG;
+			break;
+		}
+		tmp += rc;
+		len -= rc;
+	}
+	spin_unlock(&cfs_wi_data.wi_glock);
+
+	return rc < 0 ? rc : tmp - buf;
+}
+EXPORT_SYMBOL(cfs_wi_sched_print);
+
 int
 cfs_wi_startup(void)
 {
@@ -551,7 +871,7 @@ cfs_wi_shutdown (void)
 		sched = list_entry(cfs_wi_data.wi_scheds.next,
 				       struct cfs_wi_sched, ws_list);
 		list_del(&sched->ws_list);
-		LIBCFS_FREE(sched, sizeof(*sched));
+		cfs_wi_sched_free(sched);
 	}
 
 	cfs_wi_data.wi_stopping = 0;
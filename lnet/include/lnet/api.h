@@ -166,6 +166,10 @@ int LNetEQAlloc(unsigned int       count_in,
 		lnet_eq_handler_t  handler,
 		lnet_handle_eq_t  *handle_out);
 
+int LNetEQAllocBatch(unsigned int	     count_in,
+		     lnet_eq_batch_handler_t handler,
+		     lnet_handle_eq_t	    *handle_out);
+
 int LNetEQFree(lnet_handle_eq_t eventq_in);
 
 int LNetEQGet(lnet_handle_eq_t  eventq_in, 
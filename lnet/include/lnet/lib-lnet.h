@@ -693,6 +693,26 @@ lnet_nid2peerhash(lnet_nid_t nid)
 	return hash_long(nid, LNET_PEER_HASH_BITS);
 }
 
+/* monotonic time in microseconds, for measuring intervals only */
+static inline __u64
+lnet_time_usec(void)
+{
+#ifdef __KERNEL__
+	return ktime_to_us(ktime_get());
+#else
+	struct timeval tv;
+
+	cfs_fs_timeval(&tv);
+	return (__u64)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+static inline struct list_head *
+lnet_nid2railhash(lnet_nid_t nid)
+{
+	return &the_lnet.ln_rail_hash[hash_long(nid, LNET_RAIL_HASH_BITS)];
+}
+
 static inline struct list_head *
 lnet_net2rnethash(__u32 net)
 {
@@ -766,17 +786,18 @@ int lnet_islocalnet(__u32 net);
 
 void lnet_msg_attach_md(lnet_msg_t *msg, lnet_libmd_t *md,
 			unsigned int offset, unsigned int mlen);
-void lnet_msg_detach_md(lnet_msg_t *msg, int status);
+lnet_eq_t *lnet_msg_detach_md(lnet_msg_t *msg, int status);
 void lnet_build_unlink_event(lnet_libmd_t *md, lnet_event_t *ev);
 void lnet_build_msg_event(lnet_msg_t *msg, lnet_event_kind_t ev_type);
 void lnet_msg_commit(lnet_msg_t *msg, int cpt);
 void lnet_msg_decommit(lnet_msg_t *msg, int cpt, int status);
 
-void lnet_eq_enqueue_event(lnet_eq_t *eq, lnet_event_t *ev);
+int lnet_eq_enqueue_event(lnet_eq_t *eq, lnet_event_t *ev, int cpt);
+void lnet_eq_deliver(lnet_eq_t *eq, lnet_event_t *ev, int cpt);
 void lnet_prep_send(lnet_msg_t *msg, int type, lnet_process_id_t target,
                     unsigned int offset, unsigned int len);
 int lnet_send(lnet_nid_t nid, lnet_msg_t *msg, lnet_nid_t rtr_nid);
-void lnet_return_tx_credits_locked(lnet_msg_t *msg);
+void lnet_return_tx_credits_locked(lnet_msg_t *msg, int status);
 void lnet_return_rx_credits_locked(lnet_msg_t *msg);
 void lnet_schedule_blocked_locked(lnet_rtrbufpool_t *rbp);
 void lnet_drop_routed_msgs_locked(struct list_head *list, int cpt);
@@ -814,6 +835,14 @@ lnet_ptl_unsetopt(lnet_portal_t *ptl, int opt)
 }
 
 /* match-table functions */
+static inline struct list_head *
+lnet_mt_ignore_head(struct lnet_match_table *mtable)
+{
+	/* the extra entry after the hash buckets is for MEs with ignore bits */
+	return &mtable->mt_mhash[1U << mtable->mt_hash_bits];
+}
+
+void lnet_mt_grow_hash(struct lnet_match_table *mtable);
 struct list_head *lnet_mt_match_head(struct lnet_match_table *mtable,
 			       lnet_process_id_t id, __u64 mbits);
 struct lnet_match_table *lnet_mt_of_attach(unsigned int index,
@@ -962,6 +991,7 @@ void lnet_swap_pinginfo(lnet_ping_info_t *info);
 
 int lnet_parse_ip2nets(char **networksp, char *ip2nets);
 int lnet_parse_routes(char *route_str, int *im_a_router);
+int lnet_parse_rails(char *rail_str);
 int lnet_parse_networks(struct list_head *nilist, char *networks);
 int lnet_net_unique(__u32 net, struct list_head *nilist);
 
@@ -972,6 +1002,12 @@ void lnet_peer_tables_cleanup(lnet_ni_t *ni);
 void lnet_peer_tables_destroy(void);
 int lnet_peer_tables_create(void);
 void lnet_debug_peer(lnet_nid_t nid);
+int lnet_add_mrpeer(lnet_nid_t *nids, int nnids);
+void lnet_destroy_mrpeers(void);
+lnet_rail_t *lnet_find_rail(lnet_nid_t nid);
+lnet_nid_t lnet_rail_primary_nid(lnet_nid_t nid);
+lnet_rail_t *lnet_rail_select_locked(lnet_nid_t nid, int cpt);
+void lnet_rail_tx_done(lnet_rail_t *rl, int status);
 int lnet_get_peer_info(__u32 peer_index, __u64 *nid,
 		       char alivness[LNET_MAX_STR_LEN],
 		       __u32 *cpt_iter, __u32 *refcount,
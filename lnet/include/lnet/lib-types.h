@@ -209,6 +209,12 @@ typedef struct lnet_msg {
         unsigned int          msg_onactivelist:1; /* on the activelist */
 
         struct lnet_peer     *msg_txpeer;         /* peer I'm sending to */
+	/* rail of a multi-rail peer this message is sent on */
+	struct lnet_rail	*msg_rail;
+	/* time (usec) the message was handed to the LND */
+	__u64			msg_tx_start;
+	/* time (usec) a routed message asked for, then got a buffer */
+	__u64			msg_rtr_start;
         struct lnet_peer     *msg_rxpeer;         /* peer I received from */
 
         void                 *msg_private;
@@ -234,6 +240,24 @@ typedef struct lnet_libhandle {
 #define lh_entry(ptr, type, member) \
         ((type *)((char *)(ptr)-(char *)(&((type *)0)->member)))
 
+/* per-CPT event ring of a batched EQ, protected by lnet_res_lock. Each
+ * event gets a ticket, its sequence, and sits in slot (sequence & (size-1))
+ * of the ring; a slot is filled once its sequence is stored there. */
+struct lnet_eq_batch {
+	lnet_event_t		*eb_ring;	/* events not delivered yet */
+	unsigned int		eb_size;	/* # ring slots, power of 2 */
+	lnet_seq_t		eb_enq;		/* next ticket to hand out */
+	lnet_seq_t		eb_deq;		/* next ticket to deliver */
+	lnet_seq_t		eb_done;	/* tickets before are delivered */
+	int			eb_delivering;	/* a thread drains the ring */
+	int			eb_busy;	/* # in lnet_eq_deliver() */
+#ifdef __KERNEL__
+	/* threads waiting for a slot or for their event to be delivered */
+	wait_queue_head_t	eb_waitq;
+#endif
+	lnet_event_t		eb_vec[LNET_EQ_BATCH_SIZE];
+};
+
 typedef struct lnet_eq {
 	struct list_head	eq_list;
 	lnet_libhandle_t	eq_lh;
@@ -241,8 +265,10 @@ typedef struct lnet_eq {
 	lnet_seq_t		eq_deq_seq;
 	unsigned int		eq_size;
 	lnet_eq_handler_t	eq_callback;
+	lnet_eq_batch_handler_t	eq_batch_handler;
 	lnet_event_t		*eq_events;
 	int			**eq_refs;	/* percpt refcount for EQ */
+	struct lnet_eq_batch	**eq_batches;	/* percpt rings of batched EQ */
 } lnet_eq_t;
 
 typedef struct lnet_me {
@@ -481,6 +507,20 @@ typedef struct lnet_peer {
 	int			lp_txcredits;
 	/* low water mark */
 	int			lp_mintxcredits;
+	/* tx credit window, see lnet_peer_cwnd_update_locked() */
+	int			lp_cwnd;
+	/* tx credits still owed for shrinking the window */
+	int			lp_cwnd_debt;
+	/* sends completed since the window last grew */
+	int			lp_cwnd_acked;
+	/* smoothed LND send completion time (usec) */
+	__u64			lp_rtt_avg;
+	/* minimum send completion time seen (usec) */
+	__u64			lp_rtt_min;
+	/* when lp_rtt_min was last reset */
+	cfs_time_t		lp_rtt_min_stamp;
+	/* when the window was last cut (usec) */
+	__u64			lp_cwnd_cut;
 	/* # router credits */
 	int			lp_rtrcredits;
 	/* low water mark */
@@ -536,6 +576,44 @@ struct lnet_peer_table {
 	struct list_head	*pt_hash;	/* NID->peer hash */
 };
 
+/* max # NIDs of a multi-rail peer */
+#define LNET_MAX_RAILS		8
+/* multi-rail NID hash size */
+#define LNET_RAIL_HASH_BITS	6
+#define LNET_RAIL_HASH_SIZE	(1 << LNET_RAIL_HASH_BITS)
+
+/* one NID of a multi-rail peer */
+typedef struct lnet_rail {
+	/* chain on ln_rail_hash */
+	struct list_head	rl_hashlist;
+	/* peer this rail belongs to */
+	struct lnet_mrpeer	*rl_mrpeer;
+	/* NID of the peer on this rail */
+	lnet_nid_t		rl_nid;
+	/* # messages sent on this rail and not completed yet */
+	atomic_t		rl_inflight;
+	/* don't prefer this rail before then, set on send failure */
+	cfs_time_t		rl_down_until;
+	/* # messages sent on this rail */
+	__u64			rl_sent;
+	/* # sends failed on this rail */
+	__u64			rl_failed;
+} lnet_rail_t;
+
+/* a peer reachable through several NIDs on different local networks; the
+ * set of multi-rail peers is configured before the first send and stays
+ * unchanged until LNetNIFini(), so it can be looked up without locking */
+typedef struct lnet_mrpeer {
+	/* chain on ln_mrpeers */
+	struct list_head	mp_list;
+	/* sequence for round-robin */
+	unsigned int		mp_seq;
+	/* # rails */
+	int			mp_nrails;
+	/* rails, mp_rails[0] is the NID the peer is known by */
+	lnet_rail_t		mp_rails[LNET_MAX_RAILS];
+} lnet_mrpeer_t;
+
 /* peer aliveness is enabled only on routers for peers in a network where the
  * lnet_ni_t::ni_peertimeout has been set to a positive value */
 #define lnet_peer_aliveness_enabled(lp) (the_lnet.ln_routing != 0 && \
@@ -565,6 +643,9 @@ typedef struct {
 	__u32			lrn_net;
 } lnet_remotenet_t;
 
+/* # buckets of router buffer queue time histograms */
+#define LNET_RTR_HIST_BUCKETS	24
+
 typedef struct {
 	/* my free buffer pool */
 	struct list_head	rbp_bufs;
@@ -578,6 +659,16 @@ typedef struct {
 	int			rbp_credits;
 	/* low water mark */
 	int			rbp_mincredits;
+	/* # buffers configured, autoscaling works around it */
+	int			rbp_req_nbuffers;
+	/* low water mark since the last autoscaling scan */
+	int			rbp_scan_mincredits;
+	/* # consecutive scans the pool stayed mostly idle */
+	int			rbp_idle_scans;
+	/* time messages waited for a buffer, log2 usec buckets */
+	__u32			rbp_wait_hist[LNET_RTR_HIST_BUCKETS];
+	/* time buffers were held for forwarding, log2 usec buckets */
+	__u32			rbp_hold_hist[LNET_RTR_HIST_BUCKETS];
 } lnet_rtrbufpool_t;
 
 typedef struct {
@@ -641,8 +732,13 @@ struct lnet_match_info {
 #define LNET_MT_HASH_BITS		8
 #define LNET_MT_HASH_SIZE		(1 << LNET_MT_HASH_BITS)
 #define LNET_MT_HASH_MASK		(LNET_MT_HASH_SIZE - 1)
+/* the match hash of a unique portal doubles whenever it holds more than
+ * LNET_MT_HASH_LOAD MEs per bucket, up to 2^LNET_MT_HASH_BITS_MAX buckets */
+#define LNET_MT_HASH_BITS_MAX		16
+#define LNET_MT_HASH_LOAD		2
 /* we allocate (LNET_MT_HASH_SIZE + 1) entries for lnet_match_table::mt_hash,
- * the last entry is reserved for MEs with ignore-bits */
+ * the last entry is reserved for MEs with ignore-bits; the hash of wildcard
+ * portals never grows, so that entry is always LNET_MT_HASH_IGNORE there */
 #define LNET_MT_HASH_IGNORE		LNET_MT_HASH_SIZE
 /* __u64 has 2^6 bits, so need 2^(LNET_MT_HASH_BITS - LNET_MT_BITS_U64) which
  * is 4 __u64s as bit-map, and add an extra __u64 (only use one bit) for the
@@ -662,6 +758,8 @@ struct lnet_match_table {
 	/* bitmap to flag whether MEs on mt_hash are exhausted or not */
 	__u64			mt_exhausted[LNET_MT_EXHAUSTED_BMAP];
 	struct list_head	*mt_mhash;      /* matching hash */
+	unsigned int		mt_hash_bits;	/* mt_mhash has 2^bits buckets */
+	unsigned int		mt_nmes;	/* # MEs on this table */
 };
 
 /* these are only useful for wildcard portal */
@@ -798,6 +896,10 @@ typedef struct
 	__u64				ln_routers_version;
 	/* percpt router buffer pools */
 	lnet_rtrbufpool_t		**ln_rtrpools;
+	/* multi-rail peers */
+	struct list_head		ln_mrpeers;
+	/* NID->rail hash of multi-rail peers */
+	struct list_head		*ln_rail_hash;
 
 	lnet_handle_md_t		ln_ping_target_md;
 	lnet_handle_eq_t		ln_ping_target_eq;
@@ -504,6 +504,26 @@ typedef struct {
  */
 typedef void (*lnet_eq_handler_t)(lnet_event_t *event);
 #define LNET_EQ_HANDLER_NONE NULL
+
+/**
+ * Maximum number of events passed to a batched EQ handler at once.
+ */
+#define LNET_EQ_BATCH_SIZE	64
+
+/**
+ * Batched event queue handler function type.
+ *
+ * The handler of an EQ created by LNetEQAllocBatch() is given the events
+ * deposited into the EQ in vectors of up to LNET_EQ_BATCH_SIZE events, so it
+ * can process a burst of completions with a single round of its own locking
+ * and wakeups. Events of the same MD are always passed in the order they
+ * were deposited.
+ *
+ * The handler runs without any LNet lock held, but otherwise has the same
+ * restrictions as lnet_eq_handler_t: it must not block, must be reentrant,
+ * and must not call any LNet API functions.
+ */
+typedef void (*lnet_eq_batch_handler_t)(lnet_event_t *events, int nevents);
 /** @} lnet_eq */
 
 /** \addtogroup lnet_data
@@ -84,6 +84,8 @@ ksocknal_create_route (__u32 ipaddr, int port)
         route->ksnr_deleted = 0;
         route->ksnr_conn_count = 0;
         route->ksnr_share_count = 0;
+	memset(route->ksnr_nconns, 0, sizeof(route->ksnr_nconns));
+	route->ksnr_max_conns = *ksocknal_tunables.ksnd_conns_per_peer;
 
         return (route);
 }
@@ -358,6 +360,7 @@ ksocknal_associate_route_conn_locked(ksock_route_t *route, ksock_conn_t *conn)
         }
 
         route->ksnr_connected |= (1<<type);
+        route->ksnr_nconns[type]++;
         route->ksnr_conn_count++;
 
         /* Successful connection => further attempts can
@@ -1031,6 +1034,8 @@ ksocknal_create_conn (lnet_ni_t *ni, ksock_route_t *route,
         ksock_sched_t     *sched;
         ksock_hello_msg_t *hello;
 	int		   cpt;
+	int		   rx_cpu;
+	int		   ndup;
         ksock_tx_t        *tx;
         ksock_tx_t        *txtmp;
         int                rc;
@@ -1211,27 +1216,30 @@ ksocknal_create_conn (lnet_ni_t *ni, ksock_route_t *route,
                 goto failed_2;
         }
 
-	/* Refuse to duplicate an existing connection, unless this is a
-	 * loopback connection */
+	/* Refuse to duplicate an existing connection beyond the # allowed
+	 * for its type, unless this is a loopback connection */
 	if (conn->ksnc_ipaddr != conn->ksnc_myipaddr) {
+		ndup = 0;
 		list_for_each(tmp, &peer->ksnp_conns) {
 			conn2 = list_entry(tmp, ksock_conn_t, ksnc_list);
 
-                        if (conn2->ksnc_ipaddr != conn->ksnc_ipaddr ||
-                            conn2->ksnc_myipaddr != conn->ksnc_myipaddr ||
-                            conn2->ksnc_type != conn->ksnc_type)
-                                continue;
+			if (conn2->ksnc_ipaddr == conn->ksnc_ipaddr &&
+			    conn2->ksnc_myipaddr == conn->ksnc_myipaddr &&
+			    conn2->ksnc_type == conn->ksnc_type)
+				ndup++;
+		}
 
-                        /* Reply on a passive connection attempt so the peer
-                         * realises we're connected. */
-                        LASSERT (rc == 0);
-                        if (!active)
-                                rc = EALREADY;
+		if (ndup >= ksocknal_conns_per_type(conn->ksnc_type)) {
+			/* Reply on a passive connection attempt so the peer
+			 * realises we're connected. */
+			LASSERT(rc == 0);
+			if (!active)
+				rc = EALREADY;
 
-                        warn = "duplicate";
-                        goto failed_2;
-                }
-        }
+			warn = "duplicate";
+			goto failed_2;
+		}
+	}
 
         /* If the connection created by this route didn't bind to the IP
          * address the route connected to, the connection/route matching
@@ -1263,6 +1271,18 @@ ksocknal_create_conn (lnet_ni_t *ni, ksock_route_t *route,
         peer->ksnp_send_keepalive = 0;
         peer->ksnp_error = 0;
 
+	/* Prefer schedulers in the CPT of the CPU the NIC delivers this
+	 * socket's packets to, so RX processing stays cache-local */
+	rx_cpu = *ksocknal_tunables.ksnd_rx_affinity ?
+		 ksocknal_lib_rx_cpu(conn) : -1;
+	if (rx_cpu >= 0 && rx_cpu < NR_CPUS) {
+		int rx_cpt = cfs_cpt_of_cpu(lnet_cpt_table(), rx_cpu);
+
+		if (rx_cpt >= 0 &&
+		    ksocknal_data.ksnd_sched_info[rx_cpt]->ksi_nthreads > 0)
+			cpt = rx_cpt;
+	}
+
 	sched = ksocknal_choose_scheduler_locked(cpt);
         sched->kss_nconns++;
         conn->ksnc_scheduler = sched;
@@ -1413,8 +1433,6 @@ ksocknal_close_conn_locked (ksock_conn_t *conn, int error)
          * Caller holds ksnd_global_lock exclusively in irq context */
         ksock_peer_t      *peer = conn->ksnc_peer;
         ksock_route_t     *route;
-        ksock_conn_t      *conn2;
-	struct list_head  *tmp;
 
 	LASSERT(peer->ksnp_error == 0);
 	LASSERT(!conn->ksnc_closing);
@@ -1428,20 +1446,16 @@ ksocknal_close_conn_locked (ksock_conn_t *conn, int error)
 		/* dissociate conn from route... */
 		LASSERT(!route->ksnr_deleted);
 		LASSERT((route->ksnr_connected & (1 << conn->ksnc_type)) != 0);
+		LASSERT(route->ksnr_nconns[conn->ksnc_type] > 0);
 
-		conn2 = NULL;
-		list_for_each(tmp, &peer->ksnp_conns) {
-			conn2 = list_entry(tmp, ksock_conn_t, ksnc_list);
-
-			if (conn2->ksnc_route == route &&
-			    conn2->ksnc_type == conn->ksnc_type)
-				break;
-
-			conn2 = NULL;
-		}
-		if (conn2 == NULL)
+		if (--route->ksnr_nconns[conn->ksnc_type] == 0)
 			route->ksnr_connected &= ~(1 << conn->ksnc_type);
 
+		/* A limit learnt from the peer refusing a socket only holds
+		 * while the sockets it counted are alive; this one just went
+		 * so the peer has room again */
+		route->ksnr_max_conns = *ksocknal_tunables.ksnd_conns_per_peer;
+
 		conn->ksnc_route = NULL;
 
 #if 0		/* irrelevent with only eager routes */
@@ -39,6 +39,7 @@
 #define SOCKNAL_RESCHED         100             /* # scheduler loops before reschedule */
 #define SOCKNAL_INSANITY_RECONN 5000            /* connd is trying on reconn infinitely */
 #define SOCKNAL_ENOMEM_RETRY    CFS_TICK        /* jiffies between retries */
+#define SOCKNAL_CONNS_PER_PEER_MAX 16		/* max # bulk sockets per route */
 
 #define SOCKNAL_SINGLE_FRAG_TX      0           /* disable multi-fragment sends */
 #define SOCKNAL_SINGLE_FRAG_RX      0           /* disable multi-fragment receives */
@@ -108,6 +109,9 @@ typedef struct
         int              *ksnd_max_reconnectms; /* ...exponentially increasing to this */
         int              *ksnd_eager_ack;       /* make TCP ack eagerly? */
         int              *ksnd_typed_conns;     /* drive sockets by type? */
+	int		 *ksnd_conns_per_peer;	/* # bulk sockets per route */
+	int		 *ksnd_rx_affinity;	/* schedule conns on RX CPU? */
+	int		 *ksnd_tx_aggregate;	/* max bytes of small msgs per write */
         int              *ksnd_min_bulk;        /* smallest "large" message */
         int              *ksnd_tx_buffer_size;  /* socket tx buffer size */
         int              *ksnd_rx_buffer_size;  /* socket rx buffer size */
@@ -370,6 +374,10 @@ typedef struct ksock_route
         unsigned int          ksnr_deleted:1;   /* been removed from peer? */
         unsigned int          ksnr_share_count; /* created explicitly? */
         int                   ksnr_conn_count;  /* # conns established by this route */
+	/* # conns currently established by type */
+	unsigned char	      ksnr_nconns[SOCKLND_CONN_NTYPES];
+	/* max # conns of each bulk type */
+	int		      ksnr_max_conns;
 } ksock_route_t;
 
 #define SOCKNAL_KEEPALIVE_PING          1       /* cookie for keepalive ping */
@@ -457,6 +465,34 @@ ksocknal_route_mask(void)
                 (1 << SOCKLND_CONN_BULK_OUT));
 }
 
+/* max # connections of \a type between a pair of IP addresses */
+static inline int
+ksocknal_conns_per_type(int type)
+{
+	return type == SOCKLND_CONN_CONTROL ?
+	       1 : *ksocknal_tunables.ksnd_conns_per_peer;
+}
+
+/* connection types \a route wants (more) connections of */
+static inline int
+ksocknal_route_wanted(ksock_route_t *route)
+{
+	int	mask = ksocknal_route_mask();
+	int	wanted = 0;
+	int	type;
+
+	for (type = 0; type < SOCKLND_CONN_NTYPES; type++) {
+		if ((mask & (1 << type)) == 0)
+			continue;
+
+		if (route->ksnr_nconns[type] <
+		    MIN(ksocknal_conns_per_type(type), route->ksnr_max_conns))
+			wanted |= 1 << type;
+	}
+
+	return wanted;
+}
+
 static inline struct list_head *
 ksocknal_nid2peerlist (lnet_nid_t nid)
 {
@@ -624,7 +660,8 @@ extern void ksocknal_lib_reset_callback(cfs_socket_t *sock, ksock_conn_t *conn);
 extern void ksocknal_lib_push_conn (ksock_conn_t *conn);
 extern int ksocknal_lib_get_conn_addrs (ksock_conn_t *conn);
 extern int ksocknal_lib_setup_sock (cfs_socket_t *so);
-extern int ksocknal_lib_send_iov (ksock_conn_t *conn, ksock_tx_t *tx);
+extern int ksocknal_lib_send_iov(ksock_conn_t *conn, ksock_tx_t *tx,
+				 struct list_head *batch);
 extern int ksocknal_lib_send_kiov (ksock_conn_t *conn, ksock_tx_t *tx);
 extern void ksocknal_lib_eager_ack (ksock_conn_t *conn);
 extern int ksocknal_lib_recv_iov (ksock_conn_t *conn);
@@ -641,3 +678,4 @@ extern void ksocknal_lib_csum_tx(ksock_tx_t *tx);
 
 extern int ksocknal_lib_memory_pressure(ksock_conn_t *conn);
 extern int ksocknal_lib_bind_thread_to_cpu(int id);
+extern int ksocknal_lib_rx_cpu(ksock_conn_t *conn);
@@ -107,39 +107,59 @@ ksocknal_free_tx (ksock_tx_t *tx)
 	}
 }
 
+/* "consume" up to \a nob sent bytes of \a tx's iov; returns the # of
+ * bytes which belong to the txs following \a tx */
+static int
+ksocknal_consume_iov(ksock_tx_t *tx, int nob)
+{
+	struct iovec	*iov = tx->tx_iov;
+	int		used = MIN(nob, tx->tx_resid);
+
+	tx->tx_resid -= used;
+	nob -= used;
+
+	while (used != 0) {
+		LASSERT(tx->tx_niov > 0);
+
+		if (used < (int)iov->iov_len) {
+			iov->iov_base += used;
+			iov->iov_len -= used;
+			break;
+		}
+
+		used -= iov->iov_len;
+		tx->tx_iov = ++iov;
+		tx->tx_niov--;
+	}
+
+	return nob;
+}
+
 int
-ksocknal_send_iov (ksock_conn_t *conn, ksock_tx_t *tx)
+ksocknal_send_iov (ksock_conn_t *conn, ksock_tx_t *tx,
+		   struct list_head *batch)
 {
-        struct iovec  *iov = tx->tx_iov;
-        int    nob;
-        int    rc;
+	ksock_tx_t	*next;
+        int		nob;
+        int		rc;
 
         LASSERT (tx->tx_niov > 0);
 
-        /* Never touch tx->tx_iov inside ksocknal_lib_send_iov() */
-        rc = ksocknal_lib_send_iov(conn, tx);
+	/* Never touch tx->tx_iov inside ksocknal_lib_send_iov(), the txs
+	 * on \a batch are written in the same call */
+	rc = ksocknal_lib_send_iov(conn, tx, batch);
 
         if (rc <= 0)                            /* sent nothing? */
                 return (rc);
 
-        nob = rc;
-        LASSERT (nob <= tx->tx_resid);
-        tx->tx_resid -= nob;
-
-        /* "consume" iov */
-        do {
-                LASSERT (tx->tx_niov > 0);
+	nob = ksocknal_consume_iov(tx, rc);
 
-                if (nob < (int) iov->iov_len) {
-			iov->iov_base += nob;
-                        iov->iov_len -= nob;
-                        return (rc);
-                }
-
-                nob -= iov->iov_len;
-                tx->tx_iov = ++iov;
-                tx->tx_niov--;
-        } while (nob != 0);
+	list_for_each_entry(next, batch, tx_list) {
+		if (nob == 0)
+			break;
+		nob = ksocknal_consume_iov(next, nob);
+	}
+	LASSERT(nob == 0);
 
         return (rc);
 }
@@ -183,7 +203,8 @@ ksocknal_send_kiov (ksock_conn_t *conn, ksock_tx_t *tx)
 }
 
 int
-ksocknal_transmit (ksock_conn_t *conn, ksock_tx_t *tx)
+ksocknal_transmit (ksock_conn_t *conn, ksock_tx_t *tx,
+		   struct list_head *batch)
 {
         int      rc;
         int      bufnob;
@@ -206,7 +227,7 @@ ksocknal_transmit (ksock_conn_t *conn, ksock_tx_t *tx)
                         ksocknal_data.ksnd_enomem_tx--;
                         rc = -EAGAIN;
                 } else if (tx->tx_niov != 0) {
-                        rc = ksocknal_send_iov (conn, tx);
+                        rc = ksocknal_send_iov(conn, tx, batch);
                 } else {
                         rc = ksocknal_send_kiov (conn, tx);
                 }
@@ -502,14 +523,15 @@ ksocknal_uncheck_zc_req(ksock_tx_t *tx)
 }
 
 int
-ksocknal_process_transmit (ksock_conn_t *conn, ksock_tx_t *tx)
+ksocknal_process_transmit (ksock_conn_t *conn, ksock_tx_t *tx,
+			   struct list_head *batch)
 {
         int            rc;
 
         if (tx->tx_zc_capable && !tx->tx_zc_checked)
                 ksocknal_check_zc_req(tx);
 
-        rc = ksocknal_transmit (conn, tx);
+        rc = ksocknal_transmit(conn, tx, batch);
 
         CDEBUG (D_NET, "send(%d) %d\n", tx->tx_resid, rc);
 
@@ -589,7 +611,7 @@ ksocknal_launch_connection_locked (ksock_route_t *route)
 
         LASSERT (!route->ksnr_scheduled);
         LASSERT (!route->ksnr_connecting);
-        LASSERT ((ksocknal_route_mask() & ~route->ksnr_connected) != 0);
+        LASSERT (ksocknal_route_wanted(route) != 0);
 
         route->ksnr_scheduled = 1;              /* scheduling conn for connd */
         ksocknal_route_addref(route);           /* extra ref for connd */
@@ -619,6 +641,45 @@ ksocknal_launch_all_connections_locked (ksock_peer_t *peer)
         }
 }
 
+/*
+ * Move the txs which can be written in the same sendmsg() call as \a tx
+ * from the head of \a conn's tx queue to \a batch: unsent messages without
+ * page fragments, up to tx_aggregate bytes in all. Only messages already
+ * queued are merged, so aggregation never delays a send.
+ * Called holding kss_lock.
+ */
+static void
+ksocknal_aggregate_txs_locked(ksock_conn_t *conn, ksock_tx_t *tx,
+			      struct list_head *batch)
+{
+	ksock_tx_t	*next;
+	int		limit = *ksocknal_tunables.ksnd_tx_aggregate;
+	int		nob = tx->tx_resid;
+	int		niov = tx->tx_niov;
+
+	if (SOCKNAL_SINGLE_FRAG_TX || tx->tx_nkiov != 0 || nob >= limit)
+		return;
+
+	while (!list_empty(&conn->ksnc_tx_queue)) {
+		next = list_entry(conn->ksnc_tx_queue.next,
+				  ksock_tx_t, tx_list);
+
+		if (next->tx_nkiov != 0 ||
+		    next->tx_resid != next->tx_nob ||
+		    nob + next->tx_nob > limit ||
+		    niov + next->tx_niov > LNET_MAX_IOV)
+			break;
+
+		/* it can't carry a ZC-ACK once it leaves the queue */
+		if (conn->ksnc_tx_carrier == next)
+			ksocknal_next_tx_carrier(conn);
+
+		list_move_tail(&next->tx_list, batch);
+		nob += next->tx_nob;
+		niov += next->tx_niov;
+	}
+}
+
 ksock_conn_t *
 ksocknal_find_conn_locked(ksock_peer_t *peer, ksock_tx_t *tx, int nonblk)
 {
@@ -791,7 +852,7 @@ ksocknal_find_connectable_route_locked (ksock_peer_t *peer)
                         continue;
 
                 /* all route types connected ? */
-                if ((ksocknal_route_mask() & ~route->ksnr_connected) == 0)
+                if (ksocknal_route_wanted(route) == 0)
                         continue;
 
                 if (!(route->ksnr_retry_interval == 0 || /* first attempt */
@@ -1459,6 +1520,10 @@ int ksocknal_scheduler(void *arg)
 
 		if (!list_empty(&sched->kss_tx_conns)) {
 			struct list_head zlist = LIST_HEAD_INIT(zlist);
+			struct list_head batch = LIST_HEAD_INIT(batch);
+			struct list_head requeue = LIST_HEAD_INIT(requeue);
+			ksock_tx_t	 *next;
+			ksock_tx_t	 *tmp;
 
 			if (!list_empty(&sched->kss_zombie_noop_txs)) {
 				list_add(&zlist,
@@ -1483,6 +1548,9 @@ int ksocknal_scheduler(void *arg)
                         /* dequeue now so empty list => more to send */
 			list_del(&tx->tx_list);
 
+			/* write small messages queued behind it together */
+			ksocknal_aggregate_txs_locked(conn, tx, &batch);
+
                         /* Clear tx_ready in case send isn't complete.  Do
                          * it BEFORE we call process_transmit, since
                          * write_space can set it any time after we release
@@ -1496,18 +1564,34 @@ int ksocknal_scheduler(void *arg)
                                 ksocknal_txlist_done(NULL, &zlist, 0);
                         }
 
-                        rc = ksocknal_process_transmit(conn, tx);
+			rc = ksocknal_process_transmit(conn, tx, &batch);
 
                         if (rc == -ENOMEM || rc == -EAGAIN) {
-                                /* Incomplete send: replace tx on HEAD of tx_queue */
+                                /* Incomplete send: replace tx on HEAD of
+				 * tx_queue, followed by the (unsent) txs
+				 * aggregated with it */
 				spin_lock_bh(&sched->kss_lock);
 				list_add(&tx->tx_list,
 					     &conn->ksnc_tx_queue);
+				list_splice(&batch, &tx->tx_list);
 			} else {
 				/* Complete send; tx -ref */
 				ksocknal_tx_decref(tx);
 
+				/* complete aggregated txs sent in full, or
+				 * all of them on error; requeue the rest */
+				list_for_each_entry_safe(next, tmp, &batch,
+							 tx_list) {
+					list_del(&next->tx_list);
+					if (rc == 0 && next->tx_resid != 0)
+						list_add_tail(&next->tx_list,
+							      &requeue);
+					else
+						ksocknal_tx_decref(next);
+				}
+
 				spin_lock_bh(&sched->kss_lock);
+				list_splice(&requeue, &conn->ksnc_tx_queue);
                                 /* assume space for more */
                                 conn->ksnc_tx_ready = 1;
                         }
@@ -1863,7 +1947,7 @@ ksocknal_connect (ksock_route_t *route)
         route->ksnr_connecting = 1;
 
         for (;;) {
-                wanted = ksocknal_route_mask() & ~route->ksnr_connected;
+                wanted = ksocknal_route_wanted(route);
 
                 /* stop connecting if peer/route got closed under me, or
                  * route got connected while queued */
@@ -1884,6 +1968,11 @@ ksocknal_connect (ksock_route_t *route)
                 if (retry_later) /* needs reschedule */
                         break;
 
+		/* connect one socket of each type before adding more bulk
+		 * sockets */
+		if ((wanted & ~route->ksnr_connected) != 0)
+			wanted &= ~route->ksnr_connected;
+
                 if ((wanted & (1 << SOCKLND_CONN_ANY)) != 0) {
                         type = SOCKLND_CONN_ANY;
                 } else if ((wanted & (1 << SOCKLND_CONN_CONTROL)) != 0) {
@@ -1927,6 +2016,17 @@ ksocknal_connect (ksock_route_t *route)
                                libcfs_nid2str(peer->ksnp_id.nid));
 
 		write_lock_bh(&ksocknal_data.ksnd_global_lock);
+
+		if (rc == EALREADY && route->ksnr_nconns[type] > 0) {
+			/* The peer refused an extra bulk connection, it
+			 * allows fewer per peer than I do; stop asking
+			 * until one of this route's sockets closes */
+			route->ksnr_max_conns = route->ksnr_nconns[type];
+			retry_later = 0;
+			CDEBUG(D_NET, "peer %s: %d conns of type %d\n",
+			       libcfs_nid2str(peer->ksnp_id.nid),
+			       route->ksnr_max_conns, type);
+		}
         }
 
         route->ksnr_scheduled = 0;
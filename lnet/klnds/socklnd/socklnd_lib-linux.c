@@ -156,6 +156,33 @@ static struct ctl_table ksocknal_ctl_table[] = {
 		.proc_handler	= &proc_dointvec,
 		INIT_STRATEGY
 	},
+	{
+		INIT_CTL_NAME
+		.procname	= "conns_per_peer",
+		.data		= &ksocknal_tunables.ksnd_conns_per_peer,
+		.maxlen		= sizeof (int),
+		.mode		= 0444,
+		.proc_handler	= &proc_dointvec,
+		INIT_STRATEGY
+	},
+	{
+		INIT_CTL_NAME
+		.procname	= "tx_aggregate",
+		.data		= &ksocknal_tunables.ksnd_tx_aggregate,
+		.maxlen		= sizeof (int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec,
+		INIT_STRATEGY
+	},
+	{
+		INIT_CTL_NAME
+		.procname	= "rx_affinity",
+		.data		= &ksocknal_tunables.ksnd_rx_affinity,
+		.maxlen		= sizeof (int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec,
+		INIT_STRATEGY
+	},
 	{
 		INIT_CTL_NAME
 		.procname	= "min_bulk",
@@ -380,18 +407,26 @@ ksocknal_lib_zc_capable(ksock_conn_t *conn)
 	return ((caps & NETIF_F_SG) != 0 && (caps & NETIF_F_ALL_CSUM) != 0);
 }
 
-int
-ksocknal_lib_send_iov(ksock_conn_t *conn, ksock_tx_t *tx)
+static void
+ksocknal_lib_csum_first_tx(ksock_conn_t *conn, ksock_tx_t *tx)
 {
-	struct socket  *sock = conn->ksnc_sock;
-	int		nob;
-	int		rc;
-
 	if (*ksocknal_tunables.ksnd_enable_csum	       && /* checksum enabled */
 	    conn->ksnc_proto == &ksocknal_protocol_v2x && /* V2.x connection  */
 	    tx->tx_nob == tx->tx_resid		       && /* frist sending    */
 	    tx->tx_msg.ksm_csum == 0)			  /* not checksummed  */
 		ksocknal_lib_csum_tx(tx);
+}
+
+int
+ksocknal_lib_send_iov(ksock_conn_t *conn, ksock_tx_t *tx,
+		      struct list_head *batch)
+{
+	struct socket  *sock = conn->ksnc_sock;
+	ksock_tx_t     *next;
+	int		nob;
+	int		rc;
+
+	ksocknal_lib_csum_first_tx(conn, tx);
 
 	/* NB we can't trust socket ops to either consume our iovs
 	 * or leave them alone. */
@@ -413,6 +448,18 @@ ksocknal_lib_send_iov(ksock_conn_t *conn, ksock_tx_t *tx)
 			nob += scratchiov[i].iov_len;
 		}
 
+		/* append the small messages aggregated behind tx */
+		list_for_each_entry(next, batch, tx_list) {
+			int j;
+
+			ksocknal_lib_csum_first_tx(conn, next);
+			for (j = 0; j < next->tx_niov; j++, niov++) {
+				LASSERT(niov < LNET_MAX_IOV);
+				scratchiov[niov] = next->tx_iov[j];
+				nob += scratchiov[niov].iov_len;
+			}
+		}
+
 		if (!list_empty(&conn->ksnc_tx_queue) ||
 		    nob < tx->tx_resid)
 			msg.msg_flags |= MSG_MORE;
@@ -1092,3 +1139,14 @@ ksocknal_lib_memory_pressure(ksock_conn_t *conn)
 
 	return rc;
 }
+
+/* CPU the stack last received a packet of \a conn on, or -1 if unknown */
+int
+ksocknal_lib_rx_cpu(ksock_conn_t *conn)
+{
+#ifdef HAVE_SK_INCOMING_CPU
+	return conn->ksnc_sock->sk->sk_incoming_cpu;
+#else
+	return -1;
+#endif
+}
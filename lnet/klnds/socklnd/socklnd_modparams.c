@@ -71,6 +71,18 @@ static int typed_conns = 1;
 CFS_MODULE_PARM(typed_conns, "i", int, 0444,
                 "use different sockets for bulk");
 
+static int conns_per_peer = 1;
+CFS_MODULE_PARM(conns_per_peer, "i", int, 0444,
+		"# sockets of each bulk type per peer IP address");
+
+static int rx_affinity = 1;
+CFS_MODULE_PARM(rx_affinity, "i", int, 0644,
+		"schedule sockets near the CPU receiving their packets");
+
+static int tx_aggregate = (16 << 10);
+CFS_MODULE_PARM(tx_aggregate, "i", int, 0644,
+		"max bytes of small messages written together (0 to disable)");
+
 static int min_bulk = (1<<10);
 CFS_MODULE_PARM(min_bulk, "i", int, 0644,
                 "smallest 'large' message");
@@ -168,6 +180,9 @@ int ksocknal_tunables_init(void)
         ksocknal_tunables.ksnd_max_reconnectms    = &max_reconnectms;
         ksocknal_tunables.ksnd_eager_ack          = &eager_ack;
         ksocknal_tunables.ksnd_typed_conns        = &typed_conns;
+	ksocknal_tunables.ksnd_conns_per_peer	  = &conns_per_peer;
+	ksocknal_tunables.ksnd_rx_affinity	  = &rx_affinity;
+	ksocknal_tunables.ksnd_tx_aggregate	  = &tx_aggregate;
         ksocknal_tunables.ksnd_min_bulk           = &min_bulk;
         ksocknal_tunables.ksnd_tx_buffer_size     = &tx_buffer_size;
         ksocknal_tunables.ksnd_rx_buffer_size     = &rx_buffer_size;
@@ -214,6 +229,12 @@ int ksocknal_tunables_init(void)
         if (*ksocknal_tunables.ksnd_zc_min_payload < (2 << 10))
                 *ksocknal_tunables.ksnd_zc_min_payload = (2 << 10);
 
+	if (*ksocknal_tunables.ksnd_conns_per_peer < 1)
+		*ksocknal_tunables.ksnd_conns_per_peer = 1;
+	if (*ksocknal_tunables.ksnd_conns_per_peer > SOCKNAL_CONNS_PER_PEER_MAX)
+		*ksocknal_tunables.ksnd_conns_per_peer =
+			SOCKNAL_CONNS_PER_PEER_MAX;
+
         /* initialize platform-sepcific tunables */
         return ksocknal_lib_tunables_init();
 };
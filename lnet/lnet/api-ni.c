@@ -64,6 +64,10 @@ static char *routes = "";
 CFS_MODULE_PARM(routes, "s", charp, 0444,
                 "routes to non-local networks");
 
+static char *peer_rails = "";
+CFS_MODULE_PARM(peer_rails, "s", charp, 0444,
+		"NIDs of multi-rail peers");
+
 static int rnet_htable_size = LNET_REMOTE_NETS_HASH_DEFAULT;
 CFS_MODULE_PARM(rnet_htable_size, "i", int, 0444,
 		"size of remote network hash table");
@@ -78,6 +82,12 @@ lnet_get_routes(void)
         return routes;
 }
 
+static char *
+lnet_get_rails(void)
+{
+	return peer_rails;
+}
+
 static char *
 lnet_get_networks(void)
 {
@@ -125,6 +135,14 @@ lnet_get_routes(void)
         return (str == NULL) ? "" : str;
 }
 
+static char *
+lnet_get_rails(void)
+{
+	char *str = getenv("LNET_PEER_RAILS");
+
+	return (str == NULL) ? "" : str;
+}
+
 static char *
 lnet_get_networks (void)
 {
@@ -756,6 +774,7 @@ lnet_prepare(lnet_pid_t requested_pid)
 	INIT_LIST_HEAD(&the_lnet.ln_nis_cpt);
 	INIT_LIST_HEAD(&the_lnet.ln_nis_zombie);
 	INIT_LIST_HEAD(&the_lnet.ln_routers);
+	INIT_LIST_HEAD(&the_lnet.ln_mrpeers);
 
 	rc = lnet_create_remote_nets_table();
 	if (rc != 0)
@@ -1810,6 +1829,10 @@ LNetNIInit(lnet_pid_t requested_pid)
 	if (rc != 0)
 		goto failed2;
 
+	rc = lnet_parse_rails(lnet_get_rails());
+	if (rc != 0)
+		goto failed2;
+
 	rc = lnet_rtrpools_alloc(im_a_router);
 	if (rc != 0)
 		goto failed2;
@@ -1847,6 +1870,7 @@ failed3:
 failed2:
 	lnet_destroy_routes();
 	lnet_shutdown_lndnis();
+	lnet_destroy_mrpeers();
 failed1:
 	lnet_unprepare();
 failed0:
@@ -1893,6 +1917,7 @@ LNetNIFini()
                 lnet_acceptor_stop();
                 lnet_destroy_routes();
                 lnet_shutdown_lndnis();
+		lnet_destroy_mrpeers();
                 lnet_unprepare();
         }
 
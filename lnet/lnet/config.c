@@ -193,6 +193,61 @@ lnet_ni_alloc(__u32 net, struct cfs_expr_list *el, struct list_head *nilist)
 	return NULL;
 }
 
+#if defined(__KERNEL__) && defined(HAVE_LIBCFS_CPT)
+/**
+ * Bind \a ni, given no CPTs in "networks", to the CPTs on the NUMA node of
+ * its first interface, so the LND schedulers of the NI run on cores close
+ * to the NIC. Only done if the CPT table was built from the CPU topology,
+ * its partitions never span NUMA nodes then.
+ */
+static int
+lnet_ni_set_local_cpts(struct lnet_ni *ni)
+{
+	struct cfs_cpt_table	*cptab = lnet_cpt_table();
+	int			ncpts = 0;
+	int			node;
+	int			cpt;
+
+	LASSERT(ni->ni_cpts == NULL);
+
+	if (!cfs_cpt_table_topology(cptab))
+		return 0;
+
+	node = libcfs_ipif_node(ni->ni_interfaces[0]);
+	if (node < 0)
+		return 0;
+
+	for (cpt = 0; cpt < LNET_CPT_NUMBER; cpt++) {
+		if (node_isset(node, *cfs_cpt_nodemask(cptab, cpt)))
+			ncpts++;
+	}
+
+	if (ncpts == 0 || ncpts == LNET_CPT_NUMBER)
+		return 0;
+
+	LIBCFS_ALLOC(ni->ni_cpts, ncpts * sizeof(ni->ni_cpts[0]));
+	if (ni->ni_cpts == NULL)
+		return -ENOMEM;
+
+	ni->ni_ncpts = 0;
+	for (cpt = 0; cpt < LNET_CPT_NUMBER; cpt++) {
+		if (node_isset(node, *cfs_cpt_nodemask(cptab, cpt)))
+			ni->ni_cpts[ni->ni_ncpts++] = cpt;
+	}
+
+	LCONSOLE_INFO("%s: interface %s is on NUMA node %d, using its %d "
+		      "CPTs\n", libcfs_net2str(LNET_NIDNET(ni->ni_nid)),
+		      ni->ni_interfaces[0], node, ncpts);
+	return 0;
+}
+#else
+static int
+lnet_ni_set_local_cpts(struct lnet_ni *ni)
+{
+	return 0;
+}
+#endif
+
 int
 lnet_parse_networks(struct list_head *nilist, char *networks)
 {
@@ -239,6 +294,7 @@ lnet_parse_networks(struct list_head *nilist, char *networks)
 		char	*square = strchr(str, '[');
 		char	*iface;
 		int	niface;
+		int	local_cpts;
 		int	rc;
 
 		/* NB we don't check interface conflicts here; it's the LNDs
@@ -310,6 +366,7 @@ lnet_parse_networks(struct list_head *nilist, char *networks)
 		if (ni == NULL)
 			goto failed;
 
+		local_cpts = el == NULL;
 		if (el != NULL) {
 			cfs_expr_list_free(el);
 			el = NULL;
@@ -361,6 +418,9 @@ lnet_parse_networks(struct list_head *nilist, char *networks)
 			iface = comma;
 		} while (iface != NULL);
 
+		if (local_cpts && lnet_ni_set_local_cpts(ni) != 0)
+			goto failed;
+
 		str = bracket + 1;
 		comma = strchr(bracket + 1, ',');
 		if (comma != NULL) {
@@ -858,6 +918,95 @@ lnet_parse_routes (char *routes, int *im_a_router)
 	return rc;
 }
 
+static int
+lnet_parse_rail(char *str)
+{
+	/* static scratch buffer OK (single threaded) */
+	static char	cmd[LNET_SINGLE_TEXTBUF_NOB];
+
+	lnet_nid_t	nids[LNET_MAX_RAILS];
+	int		nnids = 0;
+	char		*sep = str;
+	char		*token = str;
+	int		rc;
+
+	/* save a copy of the string for error messages */
+	strncpy(cmd, str, sizeof(cmd));
+	cmd[sizeof(cmd) - 1] = '\0';
+
+	for (;;) {
+		/* scan for token start */
+		while (cfs_iswhite(*sep))
+			sep++;
+		if (*sep == 0)
+			break;
+
+		token = sep++;
+
+		/* scan for token end */
+		while (*sep != 0 && !cfs_iswhite(*sep))
+			sep++;
+		if (*sep != 0)
+			*sep++ = 0;
+
+		if (nnids == LNET_MAX_RAILS)
+			goto token_error;
+
+		nids[nnids] = libcfs_str2nid(token);
+		if (nids[nnids] == LNET_NID_ANY ||
+		    LNET_NETTYP(LNET_NIDNET(nids[nnids])) == LOLND)
+			goto token_error;
+		nnids++;
+	}
+
+	if (nnids == 0)
+		return 0;
+
+	rc = lnet_add_mrpeer(nids, nnids);
+	if (rc != 0) {
+		CERROR("Can't create multi-rail peer %s: %d\n", cmd, rc);
+		return rc;
+	}
+	return 0;
+
+token_error:
+	lnet_syntax("peer_rails", cmd, (int)(token - str), strlen(token));
+	return -EINVAL;
+}
+
+/**
+ * Parse the multi-rail peer list; peers are separated by ';', each is a
+ * whitespace separated list of its NIDs, the NID it is known by first, e.g.
+ * "10.0.0.2@o2ib 10.1.0.2@o2ib1; 10.0.0.3@o2ib 10.1.0.3@o2ib1".
+ */
+int
+lnet_parse_rails(char *rails)
+{
+	struct list_head	tbs;
+	struct lnet_text_buf	*ltb;
+	int			rc = 0;
+
+	INIT_LIST_HEAD(&tbs);
+
+	if (lnet_str2tbs_sep(&tbs, rails) < 0) {
+		CERROR("Error parsing peer rails\n");
+		rc = -EINVAL;
+	}
+
+	while (!list_empty(&tbs)) {
+		ltb = list_entry(tbs.next, struct lnet_text_buf, ltb_list);
+
+		if (rc == 0)
+			rc = lnet_parse_rail(ltb->ltb_text);
+
+		list_del(&ltb->ltb_list);
+		lnet_free_text_buf(ltb);
+	}
+
+	LASSERT(lnet_tbnob == 0);
+	return rc;
+}
+
 int
 lnet_match_network_token(char *token, int len, __u32 *ipaddrs, int nip)
 {
@@ -41,6 +41,39 @@
 #define DEBUG_SUBSYSTEM S_LNET
 #include <lnet/lib-lnet.h>
 
+static void
+lnet_eq_link(lnet_eq_t *eq, lnet_handle_eq_t *handle)
+{
+	/* MUST hold both exclusive lnet_res_lock */
+	lnet_res_lock(LNET_LOCK_EX);
+	/* NB: hold lnet_eq_wait_lock for EQ link/unlink, so we can do
+	 * both EQ lookup and poll event with only lnet_eq_wait_lock */
+	lnet_eq_wait_lock();
+
+	lnet_res_lh_initialize(&the_lnet.ln_eq_container, &eq->eq_lh);
+	list_add(&eq->eq_list, &the_lnet.ln_eq_container.rec_active);
+
+	lnet_eq_wait_unlock();
+	lnet_res_unlock(LNET_LOCK_EX);
+
+	lnet_eq2handle(handle, eq);
+}
+
+static void
+lnet_eq_batches_free(struct lnet_eq_batch **batches)
+{
+	struct lnet_eq_batch	*eb;
+	int			i;
+
+	cfs_percpt_for_each(eb, i, batches) {
+		if (eb->eb_ring != NULL) {
+			LIBCFS_FREE(eb->eb_ring,
+				    eb->eb_size * sizeof(lnet_event_t));
+		}
+	}
+	cfs_percpt_free(batches);
+}
+
 /**
  * Create an event queue that has room for \a count number of events.
  *
@@ -109,25 +142,15 @@ LNetEQAlloc(unsigned int count, lnet_eq_handler_t callback,
         eq->eq_enq_seq = 1;
         eq->eq_size = count;
         eq->eq_callback = callback;
+	eq->eq_batch_handler = NULL;
+	eq->eq_batches = NULL;
 
 	eq->eq_refs = cfs_percpt_alloc(lnet_cpt_table(),
 				       sizeof(*eq->eq_refs[0]));
 	if (eq->eq_refs == NULL)
 		goto failed;
 
-	/* MUST hold both exclusive lnet_res_lock */
-	lnet_res_lock(LNET_LOCK_EX);
-	/* NB: hold lnet_eq_wait_lock for EQ link/unlink, so we can do
-	 * both EQ lookup and poll event with only lnet_eq_wait_lock */
-	lnet_eq_wait_lock();
-
-	lnet_res_lh_initialize(&the_lnet.ln_eq_container, &eq->eq_lh);
-	list_add(&eq->eq_list, &the_lnet.ln_eq_container.rec_active);
-
-	lnet_eq_wait_unlock();
-	lnet_res_unlock(LNET_LOCK_EX);
-
-	lnet_eq2handle(handle, eq);
+	lnet_eq_link(eq, handle);
 	return 0;
 
 failed:
@@ -142,6 +165,100 @@ failed:
 }
 EXPORT_SYMBOL(LNetEQAlloc);
 
+/**
+ * Create an event queue whose events are passed to \a handler in batches.
+ *
+ * Events are queued in a ring per CPT, which is drained by the first thread
+ * that deposits an event into an empty ring: it passes the events to the
+ * handler in vectors of up to LNET_EQ_BATCH_SIZE events after dropping the
+ * LNet locks, while other threads only queue theirs. A burst of completions
+ * thus costs the handler a single round of its own locking. Events can't be
+ * retrieved with LNetEQGet(), LNetEQWait() or LNetEQPoll().
+ *
+ * Events that unlink their MD have been handled when the LNet call that
+ * deposited them returns, as for unbatched EQs. The depositing thread may
+ * wait for that, or for room in a full ring, so LNetMDUnlink(), LNetMEUnlink()
+ * and lnet_finalize() may sleep for MDs of a batched EQ.
+ *
+ * \param count The number of events each per-CPT ring can hold before the
+ * depositing thread has to wait for the handler. It will be rounded up to
+ * the next power of two, and to at least LNET_EQ_BATCH_SIZE.
+ * \param handler The handler function that gets the events.
+ * \param handle On successful return, this location will hold a handle for
+ * the newly created EQ.
+ *
+ * \retval 0       On success.
+ * \retval -EINVAL If \a handler is NULL.
+ * \retval -ENOMEM If memory for the EQ can't be allocated.
+ *
+ * \see lnet_eq_batch_handler_t for the discussion on handler semantics.
+ */
+int
+LNetEQAllocBatch(unsigned int count, lnet_eq_batch_handler_t handler,
+		 lnet_handle_eq_t *handle)
+{
+	struct lnet_eq_batch	*eb;
+	lnet_eq_t		*eq;
+	int			i;
+
+	LASSERT(the_lnet.ln_init);
+	LASSERT(the_lnet.ln_refcount > 0);
+
+	if (handler == NULL)
+		return -EINVAL;
+
+	count = cfs_power2_roundup(max_t(unsigned int, count,
+					 LNET_EQ_BATCH_SIZE));
+
+	eq = lnet_eq_alloc();
+	if (eq == NULL)
+		return -ENOMEM;
+
+	eq->eq_deq_seq = 1;
+	eq->eq_enq_seq = 1;
+	eq->eq_size = 0;
+	eq->eq_callback = LNET_EQ_HANDLER_NONE;
+	eq->eq_batch_handler = handler;
+	eq->eq_events = NULL;
+
+	eq->eq_refs = cfs_percpt_alloc(lnet_cpt_table(),
+				       sizeof(*eq->eq_refs[0]));
+	eq->eq_batches = cfs_percpt_alloc(lnet_cpt_table(),
+					  sizeof(*eq->eq_batches[0]));
+	if (eq->eq_refs == NULL || eq->eq_batches == NULL)
+		goto failed;
+
+	cfs_percpt_for_each(eb, i, eq->eq_batches) {
+		/* NB allocator has set all slot sequences to 0, the first
+		 * ticket is 1 so that no slot looks filled */
+		LIBCFS_CPT_ALLOC(eb->eb_ring, lnet_cpt_table(), i,
+				 count * sizeof(lnet_event_t));
+		if (eb->eb_ring == NULL)
+			goto failed;
+		eb->eb_size = count;
+		eb->eb_enq = 1;
+		eb->eb_deq = 1;
+		eb->eb_done = 1;
+#ifdef __KERNEL__
+		init_waitqueue_head(&eb->eb_waitq);
+#endif
+	}
+
+	lnet_eq_link(eq, handle);
+	return 0;
+
+failed:
+	if (eq->eq_batches != NULL)
+		lnet_eq_batches_free(eq->eq_batches);
+
+	if (eq->eq_refs != NULL)
+		cfs_percpt_free(eq->eq_refs);
+
+	lnet_eq_free(eq);
+	return -ENOMEM;
+}
+EXPORT_SYMBOL(LNetEQAllocBatch);
+
 /**
  * Release the resources associated with an event queue if it's idle;
  * otherwise do nothing and it's up to the user to try again.
@@ -159,6 +276,8 @@ LNetEQFree(lnet_handle_eq_t eqh)
 	lnet_event_t	*events = NULL;
 	int		**refs = NULL;
 	int		*ref;
+	struct lnet_eq_batch **batches = NULL;
+	struct lnet_eq_batch *eb;
 	int		rc = 0;
 	int		size = 0;
 	int		i;
@@ -188,10 +307,24 @@ LNetEQFree(lnet_handle_eq_t eqh)
 		goto out;
 	}
 
+	if (eq->eq_batches != NULL) {
+		cfs_percpt_for_each(eb, i, eq->eq_batches) {
+			if (eb->eb_busy == 0 && eb->eb_enq == eb->eb_deq)
+				continue;
+
+			CDEBUG(D_NET, "Event queue (%d: %lu) has undelivered "
+			       "events on destroy.\n", i,
+			       eb->eb_enq - eb->eb_deq);
+			rc = -EBUSY;
+			goto out;
+		}
+	}
+
 	/* stash for free after lock dropped */
 	events	= eq->eq_events;
 	size	= eq->eq_size;
 	refs	= eq->eq_refs;
+	batches	= eq->eq_batches;
 
 	lnet_res_lh_invalidate(&eq->eq_lh);
 	list_del(&eq->eq_list);
@@ -204,21 +337,193 @@ LNetEQFree(lnet_handle_eq_t eqh)
 		LIBCFS_FREE(events, size * sizeof(lnet_event_t));
 	if (refs != NULL)
 		cfs_percpt_free(refs);
+	if (batches != NULL)
+		lnet_eq_batches_free(batches);
 
 	return rc;
 }
 EXPORT_SYMBOL(LNetEQFree);
 
+/* move the next vector of filled slots from the ring to eb_vec */
+static int
+lnet_eq_batch_fill_locked(struct lnet_eq_batch *eb)
+{
+	lnet_event_t	*ev;
+	int		n = 0;
+
+	while (eb->eb_deq != eb->eb_enq && n < LNET_EQ_BATCH_SIZE) {
+		ev = &eb->eb_ring[eb->eb_deq & (eb->eb_size - 1)];
+		if (ev->sequence != eb->eb_deq)
+			break; /* its depositor waits for room in the ring */
+
+		eb->eb_vec[n++] = *ev;
+		eb->eb_deq++;
+	}
+	return n;
+}
+
+/* events whose depositor waits for them to be handled: callers of
+ * LNetMDUnlink() and LNetMEUnlink() rely on the unlink event being handled
+ * on return, as it is for unbatched EQs */
+static inline int
+lnet_eq_event_sync(lnet_event_t *ev)
+{
+	return ev->unlinked;
+}
+
+static void
+lnet_eq_batch_wakeup(struct lnet_eq_batch *eb)
+{
+#ifdef __KERNEL__
+	if (waitqueue_active(&eb->eb_waitq))
+		wake_up_all(&eb->eb_waitq);
+#endif
+}
+
+/* wait for lnet_eq_batch_wakeup(), resource lock \a cpt is dropped
+ * meanwhile */
+static void
+lnet_eq_batch_wait_locked(struct lnet_eq_batch *eb, int cpt)
+{
+#ifdef __KERNEL__
+	wait_queue_t	wl;
+
+	init_waitqueue_entry_current(&wl);
+	set_current_state(TASK_UNINTERRUPTIBLE);
+	add_wait_queue(&eb->eb_waitq, &wl);
+
+	lnet_res_unlock(cpt);
+	waitq_wait(&wl, TASK_UNINTERRUPTIBLE);
+	lnet_res_lock(cpt);
+
+	remove_wait_queue(&eb->eb_waitq, &wl);
+#else
+	LBUG(); /* lnet_eq_batch_enqueue_locked() delivers right away */
+#endif
+}
+
+/* pass the filled slots of the ring to the handler as its deliverer, until
+ * there is none left, \retval number of events delivered */
+static int
+lnet_eq_batch_drain_locked(lnet_eq_t *eq, struct lnet_eq_batch *eb, int cpt)
+{
+	int	total = 0;
+	int	n;
+
+	LASSERT(!eb->eb_delivering);
+	eb->eb_delivering = 1;
+
+	while ((n = lnet_eq_batch_fill_locked(eb)) > 0) {
+		lnet_res_unlock(cpt);
+		eq->eq_batch_handler(eb->eb_vec, n);
+		lnet_res_lock(cpt);
+
+		eb->eb_done += n;
+		total += n;
+		/* there is room in the ring, and events were handled */
+		lnet_eq_batch_wakeup(eb);
+	}
+
+	eb->eb_delivering = 0;
+	lnet_eq_batch_wakeup(eb);
+	return total;
+}
+
+static int
+lnet_eq_batch_enqueue_locked(lnet_eq_t *eq, lnet_event_t *ev, int cpt)
+{
+#ifdef __KERNEL__
+	struct lnet_eq_batch	*eb = eq->eq_batches[cpt];
+
+	ev->sequence = eb->eb_enq++;
+	if (ev->sequence - eb->eb_deq >= eb->eb_size) {
+		/* The handler can't keep up. The caller fills the slot once
+		 * there is room, without holding the resource lock, so that
+		 * no event is lost or passed ahead of an older one. */
+		eb->eb_busy++;
+		return 1;
+	}
+
+	eb->eb_ring[ev->sequence & (eb->eb_size - 1)] = *ev;
+	if (eb->eb_delivering && !lnet_eq_event_sync(ev))
+		return 0;
+
+	eb->eb_busy++;
+	return 1;
+#else
+	/* no concurrent depositors, events are passed one at a time */
+	eq->eq_batch_handler(ev, 1);
+	return 0;
+#endif
+}
+
+/**
+ * Finish depositing event \a ev into CPT \a cpt of batched EQ \a eq, once
+ * lnet_eq_enqueue_event() asked for it. Called without any LNet lock held;
+ * the EQ can't be freed before this returns.
+ *
+ * If the ring was full, this waits for room to queue \a ev. If no thread
+ * delivers the events of the ring, the caller becomes the deliverer and
+ * passes them to the handler until there is none left. If \a ev unlinks
+ * its MD, this returns only once \a ev has been handled, by the caller or
+ * by the deliverer. May sleep.
+ */
 void
-lnet_eq_enqueue_event(lnet_eq_t *eq, lnet_event_t *ev)
+lnet_eq_deliver(lnet_eq_t *eq, lnet_event_t *ev, int cpt)
+{
+	struct lnet_eq_batch	*eb = eq->eq_batches[cpt];
+	lnet_seq_t		seq = ev->sequence;
+	lnet_event_t		*slot = &eb->eb_ring[seq & (eb->eb_size - 1)];
+	int			queued;
+
+	lnet_res_lock(cpt);
+	LASSERT(eb->eb_busy > 0);
+
+	for (;;) {
+		queued = LNET_SEQ_GT(eb->eb_deq, seq) ||
+			 slot->sequence == seq;
+		if (!queued && seq - eb->eb_deq < eb->eb_size) {
+			/* the ring was full when \a ev was deposited */
+			*slot = *ev;
+			queued = 1;
+		}
+
+		if (!eb->eb_delivering &&
+		    lnet_eq_batch_drain_locked(eq, eb, cpt) > 0)
+			continue;
+
+		if (LNET_SEQ_GT(eb->eb_done, seq) ||
+		    (queued && !lnet_eq_event_sync(ev)))
+			break;
+
+		/* for room, or for the deliverer to handle \a ev */
+		lnet_eq_batch_wait_locked(eb, cpt);
+	}
+
+	eb->eb_busy--;
+	lnet_res_unlock(cpt);
+}
+
+/**
+ * Deposit event \a ev into \a eq. MUST be called with resource lock \a cpt
+ * held but w/o lnet_eq_wait_lock.
+ *
+ * \retval 1 if \a eq is batched and the caller must call lnet_eq_deliver()
+ * on \a ev after dropping the resource lock.
+ * \retval 0 otherwise.
+ */
+int
+lnet_eq_enqueue_event(lnet_eq_t *eq, lnet_event_t *ev, int cpt)
 {
-	/* MUST called with resource lock hold but w/o lnet_eq_wait_lock */
 	int index;
 
+	if (eq->eq_batch_handler != NULL)
+		return lnet_eq_batch_enqueue_locked(eq, ev, cpt);
+
 	if (eq->eq_size == 0) {
 		LASSERT(eq->eq_callback != LNET_EQ_HANDLER_NONE);
 		eq->eq_callback(ev);
-		return;
+		return 0;
 	}
 
 	lnet_eq_wait_lock();
@@ -245,6 +550,7 @@ lnet_eq_enqueue_event(lnet_eq_t *eq, lnet_event_t *ev)
 # endif
 #endif
 	lnet_eq_wait_unlock();
+	return 0;
 }
 
 int
@@ -424,6 +424,7 @@ LNetMDUnlink (lnet_handle_md_t mdh)
 {
 	lnet_event_t	ev;
 	lnet_libmd_t	*md;
+	lnet_eq_t	*eq = NULL;
 	int		cpt;
 
 	LASSERT(the_lnet.ln_init);
@@ -444,12 +445,16 @@ LNetMDUnlink (lnet_handle_md_t mdh)
 	 * unlinked. Otherwise, we enqueue an event now... */
 	if (md->md_eq != NULL && md->md_refcount == 0) {
 		lnet_build_unlink_event(md, &ev);
-		lnet_eq_enqueue_event(md->md_eq, &ev);
+		if (lnet_eq_enqueue_event(md->md_eq, &ev, cpt))
+			eq = md->md_eq;
 	}
 
         lnet_md_unlink(md);
 
 	lnet_res_unlock(cpt);
+
+	if (eq != NULL)
+		lnet_eq_deliver(eq, &ev, cpt);
 	return 0;
 }
 EXPORT_SYMBOL(LNetMDUnlink);
@@ -98,6 +98,8 @@ LNetMEAttach(unsigned int portal,
 	if (me == NULL)
 		return -ENOMEM;
 
+	lnet_mt_grow_hash(mtable);
+
 	lnet_res_lock(mtable->mt_cpt);
 
         me->me_portal = portal;
@@ -110,11 +112,12 @@ LNetMEAttach(unsigned int portal,
 	lnet_res_lh_initialize(the_lnet.ln_me_containers[mtable->mt_cpt],
 			       &me->me_lh);
 	if (ignore_bits != 0)
-		head = &mtable->mt_mhash[LNET_MT_HASH_IGNORE];
+		head = lnet_mt_ignore_head(mtable);
 	else
 		head = lnet_mt_match_head(mtable, match_id, match_bits);
 
 	me->me_pos = head - &mtable->mt_mhash[0];
+	mtable->mt_nmes++;
 	if (pos == LNET_INS_AFTER || pos == LNET_INS_LOCAL)
 		list_add_tail(&me->me_list, head);
 	else
@@ -189,6 +192,7 @@ LNetMEInsert(lnet_handle_me_t current_meh,
         }
 
 	new_me->me_pos = current_me->me_pos;
+	ptl->ptl_mtables[cpt]->mt_nmes++;
         new_me->me_portal = current_me->me_portal;
         new_me->me_match_id = match_id;
         new_me->me_match_bits = match_bits;
@@ -231,6 +235,7 @@ LNetMEUnlink(lnet_handle_me_t meh)
 	lnet_me_t	*me;
 	lnet_libmd_t	*md;
 	lnet_event_t	ev;
+	lnet_eq_t	*eq = NULL;
 	int		cpt;
 
 	LASSERT(the_lnet.ln_init);
@@ -250,13 +255,17 @@ LNetMEUnlink(lnet_handle_me_t meh)
 		md->md_flags |= LNET_MD_FLAG_ABORTED;
 		if (md->md_eq != NULL && md->md_refcount == 0) {
 			lnet_build_unlink_event(md, &ev);
-			lnet_eq_enqueue_event(md->md_eq, &ev);
+			if (lnet_eq_enqueue_event(md->md_eq, &ev, cpt))
+				eq = md->md_eq;
 		}
 	}
 
 	lnet_me_unlink(me);
 
 	lnet_res_unlock(cpt);
+
+	if (eq != NULL)
+		lnet_eq_deliver(eq, &ev, cpt);
 	return 0;
 }
 EXPORT_SYMBOL(LNetMEUnlink);
@@ -265,7 +274,10 @@ EXPORT_SYMBOL(LNetMEUnlink);
 void
 lnet_me_unlink(lnet_me_t *me)
 {
+	struct lnet_portal *ptl = the_lnet.ln_portals[me->me_portal];
+
 	list_del(&me->me_list);
+	ptl->ptl_mtables[lnet_cpt_of_cookie(me->me_lh.lh_cookie)]->mt_nmes--;
 
 	if (me->me_md != NULL) {
 		lnet_libmd_t *md = me->me_md;
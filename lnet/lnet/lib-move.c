@@ -51,6 +51,17 @@ static int local_nid_dist_zero = 1;
 CFS_MODULE_PARM(local_nid_dist_zero, "i", int, 0444,
                 "Reserved");
 
+/* The number of messages in flight to a peer is bounded by a window that
+ * adapts between peer_credits / adaptive_peer_credits and
+ * peer_credits * adaptive_peer_credits, see lnet_peer_cwnd_update_locked().
+ * 0 keeps it at peer_credits. */
+static int adaptive_peer_credits = 0;
+CFS_MODULE_PARM(adaptive_peer_credits, "i", int, 0644,
+		"max factor peer tx credits adapt by (0 to disable)");
+
+/* seconds before the minimum send completion time of a peer is re-sampled */
+#define LNET_PEER_RTT_MIN_AGE	30
+
 int
 lnet_fail_nid(lnet_nid_t nid, unsigned int threshold)
 {
@@ -909,6 +920,10 @@ lnet_post_send_locked(lnet_msg_t *msg, int do_send)
 		}
 	}
 
+	/* only the adaptive credit window needs the send time */
+	if (adaptive_peer_credits > 0)
+		msg->msg_tx_start = lnet_time_usec();
+
 	if (do_send) {
 		lnet_net_unlock(cpt);
 		lnet_ni_send(ni, msg);
@@ -917,6 +932,123 @@ lnet_post_send_locked(lnet_msg_t *msg, int do_send)
 	return LNET_CREDIT_OK;
 }
 
+static void
+lnet_peer_cwnd_grow_locked(lnet_peer_t *lp)
+{
+	lnet_msg_t	*msg;
+
+	lp->lp_cwnd++;
+	if (lp->lp_cwnd_debt > 0) {
+		/* cancels a credit still owed from shrinking */
+		lp->lp_cwnd_debt--;
+		return;
+	}
+
+	lp->lp_txcredits++;
+	if (lp->lp_txcredits <= 0) {
+		msg = list_entry(lp->lp_txq.next, lnet_msg_t, msg_list);
+		list_del(&msg->msg_list);
+
+		LASSERT(msg->msg_txpeer == lp);
+		LASSERT(msg->msg_tx_delayed);
+
+		(void) lnet_post_send_locked(msg, 1);
+	}
+}
+
+static void
+lnet_peer_cwnd_shrink_locked(lnet_peer_t *lp, int n)
+{
+	int	take = min(n, max(lp->lp_txcredits, 0));
+
+	/* Credits that are free now are taken away at once; the rest are
+	 * kept back as they are returned, so lp_txcredits only goes negative
+	 * for messages queued on lp_txq. */
+	lp->lp_cwnd -= n;
+	lp->lp_txcredits -= take;
+	lp->lp_cwnd_debt += n - take;
+}
+
+/**
+ * Adapt the tx credit window of the peer \a msg was sent to, from the time
+ * the LND took to complete it. The window grows by one credit for each full
+ * window of sends completed while it was in full use and completion times
+ * stayed close to the minimum seen; it is halved, at most once per smoothed
+ * completion time, when that exceeds twice the minimum (i.e. messages queue
+ * up somewhere on the path) or a send fails.
+ *
+ * \param lp The peer \a msg was sent to.
+ * \param msg The message being returned its peer tx credit.
+ * \param status Completion status of \a msg.
+ */
+static void
+lnet_peer_cwnd_update_locked(lnet_peer_t *lp, lnet_msg_t *msg, int status)
+{
+	int	factor = adaptive_peer_credits;
+	int	base = lp->lp_ni->ni_peertxcredits;
+	int	cwnd_min;
+	int	cwnd_max;
+	__u64	now;
+	__u64	rtt;
+
+	if (factor <= 0) {
+		/* disabled at runtime: drift back to peer_credits */
+		if (lp->lp_cwnd < base)
+			lnet_peer_cwnd_grow_locked(lp);
+		else if (lp->lp_cwnd > base)
+			lnet_peer_cwnd_shrink_locked(lp, 1);
+		return;
+	}
+
+	if (msg->msg_tx_start == 0) /* never made it to the LND */
+		return;
+
+	cwnd_min = max(base / factor, 1);
+	cwnd_max = base * factor;
+	now = lnet_time_usec();
+	rtt = now > msg->msg_tx_start ? now - msg->msg_tx_start : 1;
+
+	if (status == 0) {
+		if (lp->lp_rtt_min == 0 || rtt < lp->lp_rtt_min ||
+		    cfs_time_aftereq(cfs_time_current(),
+				     cfs_time_add(lp->lp_rtt_min_stamp,
+				     cfs_time_seconds(LNET_PEER_RTT_MIN_AGE)))) {
+			lp->lp_rtt_min = rtt;
+			lp->lp_rtt_min_stamp = cfs_time_current();
+		}
+
+		if (lp->lp_rtt_avg == 0)
+			lp->lp_rtt_avg = rtt;
+		else
+			lp->lp_rtt_avg = (lp->lp_rtt_avg * 7 + rtt) >> 3;
+
+		if (lp->lp_rtt_avg <= 2 * lp->lp_rtt_min) {
+			/* only a window in full use needs to grow */
+			if (lp->lp_txcredits > 0 || lp->lp_cwnd >= cwnd_max)
+				return;
+
+			if (++lp->lp_cwnd_acked >= lp->lp_cwnd) {
+				lp->lp_cwnd_acked = 0;
+				lnet_peer_cwnd_grow_locked(lp);
+			}
+			return;
+		}
+	}
+
+	if (lp->lp_cwnd <= cwnd_min ||
+	    now - lp->lp_cwnd_cut < lp->lp_rtt_avg)
+		return;
+
+	CDEBUG(D_NET, "%s: shrink tx window %d, rtt "LPU64"/"LPU64" usec, "
+	       "status %d\n", libcfs_nid2str(lp->lp_nid), lp->lp_cwnd,
+	       lp->lp_rtt_avg, lp->lp_rtt_min, status);
+
+	lp->lp_cwnd_acked = 0;
+	lp->lp_cwnd_cut = now;
+	lnet_peer_cwnd_shrink_locked(lp, lp->lp_cwnd -
+					 max(lp->lp_cwnd / 2, cwnd_min));
+}
+
 #ifdef __KERNEL__
 
 lnet_rtrbufpool_t *
@@ -939,6 +1071,14 @@ lnet_msg2bufpool(lnet_msg_t *msg)
 	return rbp;
 }
 
+static void
+lnet_rtr_hist_add(__u32 *hist, __u64 usec)
+{
+	int	idx = usec > 0xffffffffULL ? 33 : fls((unsigned int)usec);
+
+	hist[min(idx, LNET_RTR_HIST_BUCKETS - 1)]++;
+}
+
 int
 lnet_post_routed_recv_locked (lnet_msg_t *msg, int do_recv)
 {
@@ -949,6 +1089,7 @@ lnet_post_routed_recv_locked (lnet_msg_t *msg, int do_recv)
         lnet_peer_t         *lp = msg->msg_rxpeer;
         lnet_rtrbufpool_t   *rbp;
         lnet_rtrbuf_t       *rb;
+	__u64		     now;
 
         LASSERT (msg->msg_iov == NULL);
         LASSERT (msg->msg_kiov == NULL);
@@ -964,6 +1105,7 @@ lnet_post_routed_recv_locked (lnet_msg_t *msg, int do_recv)
 		LASSERT((lp->lp_rtrcredits < 0) ==
 			!list_empty(&lp->lp_rtrq));
 
+		msg->msg_rtr_start = lnet_time_usec();
                 msg->msg_peerrtrcredit = 1;
                 lp->lp_rtrcredits--;
                 if (lp->lp_rtrcredits < lp->lp_minrtrcredits)
@@ -985,6 +1127,8 @@ lnet_post_routed_recv_locked (lnet_msg_t *msg, int do_recv)
 		rbp->rbp_credits--;
 		if (rbp->rbp_credits < rbp->rbp_mincredits)
 			rbp->rbp_mincredits = rbp->rbp_credits;
+		if (rbp->rbp_credits < rbp->rbp_scan_mincredits)
+			rbp->rbp_scan_mincredits = rbp->rbp_credits;
 
 		if (rbp->rbp_credits < 0) {
 			/* must have checked eager_recv before here */
@@ -999,6 +1143,11 @@ lnet_post_routed_recv_locked (lnet_msg_t *msg, int do_recv)
 	rb = list_entry(rbp->rbp_bufs.next, lnet_rtrbuf_t, rb_list);
 	list_del(&rb->rb_list);
 
+	now = lnet_time_usec();
+	lnet_rtr_hist_add(rbp->rbp_wait_hist, now > msg->msg_rtr_start ?
+					      now - msg->msg_rtr_start : 0);
+	msg->msg_rtr_start = now;
+
         msg->msg_niov = rbp->rbp_npages;
         msg->msg_kiov = &rb->rb_kiov[0];
 
@@ -1015,7 +1164,7 @@ lnet_post_routed_recv_locked (lnet_msg_t *msg, int do_recv)
 #endif
 
 void
-lnet_return_tx_credits_locked(lnet_msg_t *msg)
+lnet_return_tx_credits_locked(lnet_msg_t *msg, int status)
 {
 	lnet_peer_t	*txpeer = msg->msg_txpeer;
 	lnet_msg_t	*msg2;
@@ -1053,17 +1202,25 @@ lnet_return_tx_credits_locked(lnet_msg_t *msg)
                 txpeer->lp_txqnob -= msg->msg_len + sizeof(lnet_hdr_t);
                 LASSERT (txpeer->lp_txqnob >= 0);
 
-                txpeer->lp_txcredits++;
-                if (txpeer->lp_txcredits <= 0) {
-			msg2 = list_entry(txpeer->lp_txq.next,
-                                              lnet_msg_t, msg_list);
-			list_del(&msg2->msg_list);
+		lnet_peer_cwnd_update_locked(txpeer, msg, status);
+		msg->msg_tx_start = 0;
 
-			LASSERT(msg2->msg_txpeer == txpeer);
-			LASSERT(msg2->msg_tx_delayed);
+		if (txpeer->lp_cwnd_debt > 0) {
+			/* the window shrank while this credit was taken */
+			txpeer->lp_cwnd_debt--;
+		} else {
+			txpeer->lp_txcredits++;
+			if (txpeer->lp_txcredits <= 0) {
+				msg2 = list_entry(txpeer->lp_txq.next,
+						  lnet_msg_t, msg_list);
+				list_del(&msg2->msg_list);
 
-                        (void) lnet_post_send_locked(msg2, 1);
-                }
+				LASSERT(msg2->msg_txpeer == txpeer);
+				LASSERT(msg2->msg_tx_delayed);
+
+				(void) lnet_post_send_locked(msg2, 1);
+			}
+		}
         }
 
         if (txpeer != NULL) {
@@ -1122,6 +1279,7 @@ lnet_return_rx_credits_locked(lnet_msg_t *msg)
 		/* give back global router credits */
 		lnet_rtrbuf_t     *rb;
 		lnet_rtrbufpool_t *rbp;
+		__u64		   now = lnet_time_usec();
 
 		/* NB If a msg ever blocks for a buffer in rbp_msgs, it stays
 		 * there until it gets one allocated, or aborts the wait
@@ -1136,6 +1294,10 @@ lnet_return_rx_credits_locked(lnet_msg_t *msg)
 
 		LASSERT(rbp == lnet_msg2bufpool(msg));
 
+		lnet_rtr_hist_add(rbp->rbp_hold_hist,
+				  now > msg->msg_rtr_start ?
+				  now - msg->msg_rtr_start : 0);
+
 		LASSERT((rbp->rbp_credits > 0) ==
 			!list_empty(&rbp->rbp_bufs));
 
@@ -1294,6 +1456,7 @@ lnet_send(lnet_nid_t src_nid, lnet_msg_t *msg, lnet_nid_t rtr_nid)
 	struct lnet_ni		*src_ni;
 	struct lnet_ni		*local_ni;
 	struct lnet_peer	*lp;
+	struct lnet_rail	*rail = NULL;
 	int			cpt;
 	int			cpt2;
 	int			rc;
@@ -1319,6 +1482,27 @@ lnet_send(lnet_nid_t src_nid, lnet_msg_t *msg, lnet_nid_t rtr_nid)
 		return -ESHUTDOWN;
 	}
 
+	if (rail == NULL && !msg->msg_routing && rtr_nid == LNET_NID_ANY) {
+		/* a multi-rail peer: the chosen rail determines both the
+		 * peer NID and the local NI to send on */
+		rail = lnet_rail_select_locked(dst_nid, cpt);
+		if (rail != NULL) {
+			src_nid = LNET_NID_ANY;
+			if (rail->rl_nid != dst_nid) {
+				dst_nid = rail->rl_nid;
+				msg->msg_target.nid = dst_nid;
+				msg->msg_hdr.dest_nid = cpu_to_le64(dst_nid);
+
+				cpt2 = lnet_cpt_of_nid_locked(dst_nid);
+				if (cpt2 != cpt) {
+					lnet_net_unlock(cpt);
+					cpt = cpt2;
+					goto again;
+				}
+			}
+		}
+	}
+
 	if (src_nid == LNET_NID_ANY) {
 		src_ni = NULL;
 	} else {
@@ -1358,6 +1542,14 @@ lnet_send(lnet_nid_t src_nid, lnet_msg_t *msg, lnet_nid_t rtr_nid)
 		if (!msg->msg_routing)
 			msg->msg_hdr.src_nid = cpu_to_le64(src_nid);
 
+		if (rail != NULL) {
+			/* released by lnet_msg_decommit_tx() */
+			LASSERT(msg->msg_rail == NULL);
+			msg->msg_rail = rail;
+			atomic_inc(&rail->rl_inflight);
+			rail->rl_sent++;
+		}
+
 		if (src_ni == the_lnet.ln_loni) {
 			/* No send credit hassles with LOLND */
 			lnet_net_unlock(cpt);
@@ -2003,7 +2195,8 @@ lnet_parse(lnet_ni_t *ni, lnet_hdr_t *hdr, lnet_nid_t from_nid,
 	} else {
 		/* convert common msg->hdr fields to host byteorder */
 		msg->msg_hdr.type	= type;
-		msg->msg_hdr.src_nid	= src_nid;
+		/* report all rails of a multi-rail peer as the same NID */
+		msg->msg_hdr.src_nid	= lnet_rail_primary_nid(src_nid);
 		msg->msg_hdr.src_pid	= le32_to_cpu(msg->msg_hdr.src_pid);
 		msg->msg_hdr.dest_nid	= dest_nid;
 		msg->msg_hdr.dest_pid	= dest_pid;
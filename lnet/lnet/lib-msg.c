@@ -215,7 +215,12 @@ lnet_msg_decommit_tx(lnet_msg_t *msg, int status)
 
 	counters->send_count++;
  out:
-	lnet_return_tx_credits_locked(msg);
+	if (msg->msg_rail != NULL) {
+		lnet_rail_tx_done(msg->msg_rail, status);
+		msg->msg_rail = NULL;
+	}
+
+	lnet_return_tx_credits_locked(msg, status);
 	msg->msg_tx_committed = 0;
 }
 
@@ -335,10 +340,12 @@ lnet_msg_attach_md(lnet_msg_t *msg, lnet_libmd_t *md,
 	lnet_md_deconstruct(md, &msg->msg_ev.md);
 }
 
-void
+/* returns the EQ to call lnet_eq_deliver() on after unlocking, if any */
+lnet_eq_t *
 lnet_msg_detach_md(lnet_msg_t *msg, int status)
 {
 	lnet_libmd_t	*md = msg->msg_md;
+	lnet_eq_t	*eq = NULL;
 	int		unlink;
 
 	/* Now it's safe to drop my caller's ref */
@@ -349,13 +356,16 @@ lnet_msg_detach_md(lnet_msg_t *msg, int status)
 	if (md->md_eq != NULL) {
 		msg->msg_ev.status   = status;
 		msg->msg_ev.unlinked = unlink;
-		lnet_eq_enqueue_event(md->md_eq, &msg->msg_ev);
+		if (lnet_eq_enqueue_event(md->md_eq, &msg->msg_ev,
+				lnet_cpt_of_cookie(md->md_lh.lh_cookie)))
+			eq = md->md_eq;
 	}
 
 	if (unlink)
 		lnet_md_unlink(md);
 
 	msg->msg_md = NULL;
+	return eq;
 }
 
 static int
@@ -467,11 +477,16 @@ lnet_finalize (lnet_ni_t *ni, lnet_msg_t *msg, int status)
         msg->msg_ev.status = status;
 
 	if (msg->msg_md != NULL) {
+		lnet_eq_t *eq;
+
 		cpt = lnet_cpt_of_cookie(msg->msg_md->md_lh.lh_cookie);
 
 		lnet_res_lock(cpt);
-		lnet_msg_detach_md(msg, status);
+		eq = lnet_msg_detach_md(msg, status);
 		lnet_res_unlock(cpt);
+
+		if (eq != NULL)
+			lnet_eq_deliver(eq, &msg->msg_ev, cpt);
 	}
 
  again:
@@ -366,11 +366,78 @@ lnet_mt_match_head(struct lnet_match_table *mtable,
 		unsigned long hash = mbits + id.nid + id.pid;
 
 		LASSERT(lnet_ptl_is_unique(ptl));
-		hash = hash_long(hash, LNET_MT_HASH_BITS);
+		hash = hash_long(hash, mtable->mt_hash_bits);
 		return &mtable->mt_mhash[hash];
 	}
 }
 
+/**
+ * Double the match hash of \a mtable if it belongs to a unique portal and
+ * holds more than LNET_MT_HASH_LOAD MEs per bucket, so that matching the
+ * unique match bits of e.g. ptlrpc replies and bulks stays O(1) however
+ * many of them are posted. Called without lnet_res_lock.
+ */
+void
+lnet_mt_grow_hash(struct lnet_match_table *mtable)
+{
+	struct list_head *mhash;
+	struct list_head *old;
+	lnet_me_t	 *me;
+	unsigned int	  bits = mtable->mt_hash_bits; /* read w/o lock */
+	unsigned int	  nold;
+	unsigned int	  i;
+
+	if (bits >= LNET_MT_HASH_BITS_MAX ||
+	    mtable->mt_nmes <= (LNET_MT_HASH_LOAD << bits))
+		return;
+
+	/* the exhausted bitmap of wildcard portals is sized for a fixed hash */
+	if (!lnet_ptl_is_unique(the_lnet.ln_portals[mtable->mt_portal]))
+		return;
+
+	bits++;
+	LIBCFS_CPT_ALLOC(mhash, lnet_cpt_table(), mtable->mt_cpt,
+			 sizeof(*mhash) * ((1U << bits) + 1));
+	if (mhash == NULL) /* keep the old hash, matching is just slower */
+		return;
+
+	for (i = 0; i < (1U << bits) + 1; i++)
+		INIT_LIST_HEAD(&mhash[i]);
+
+	lnet_res_lock(mtable->mt_cpt);
+	if (mtable->mt_hash_bits != bits - 1) { /* grown by someone else */
+		lnet_res_unlock(mtable->mt_cpt);
+		LIBCFS_FREE(mhash, sizeof(*mhash) * ((1U << bits) + 1));
+		return;
+	}
+
+	old = mtable->mt_mhash;
+	nold = 1U << mtable->mt_hash_bits;
+	mtable->mt_mhash = mhash;
+	mtable->mt_hash_bits = bits;
+
+	/* MEs with the same match bits and id keep their relative order */
+	for (i = 0; i < nold; i++) {
+		while (!list_empty(&old[i])) {
+			struct list_head *head;
+
+			me = list_entry(old[i].next, lnet_me_t, me_list);
+			head = lnet_mt_match_head(mtable, me->me_match_id,
+						  me->me_match_bits);
+			list_move_tail(&me->me_list, head);
+			me->me_pos = head - mtable->mt_mhash;
+		}
+	}
+	list_splice(&old[nold], lnet_mt_ignore_head(mtable));
+	lnet_res_unlock(mtable->mt_cpt);
+
+	CDEBUG(D_NET, "portal %d CPT %d: match hash grown to %u buckets "
+	       "for %u MEs\n", mtable->mt_portal, mtable->mt_cpt,
+	       1U << bits, mtable->mt_nmes);
+
+	LIBCFS_FREE(old, sizeof(*old) * (nold + 1));
+}
+
 int
 lnet_mt_match_md(struct lnet_match_table *mtable,
 		 struct lnet_match_info *info, struct lnet_msg *msg)
@@ -382,8 +449,8 @@ lnet_mt_match_md(struct lnet_match_table *mtable,
 	int			rc;
 
 	/* any ME with ignore bits? */
-	if (!list_empty(&mtable->mt_mhash[LNET_MT_HASH_IGNORE]))
-		head = &mtable->mt_mhash[LNET_MT_HASH_IGNORE];
+	if (!list_empty(lnet_mt_ignore_head(mtable)))
+		head = lnet_mt_ignore_head(mtable);
 	else
 		head = lnet_mt_match_head(mtable, info->mi_id, info->mi_mbits);
  again:
@@ -415,7 +482,7 @@ lnet_mt_match_md(struct lnet_match_table *mtable,
 			exhausted = 0;
 	}
 
-	if (exhausted == 0 && head == &mtable->mt_mhash[LNET_MT_HASH_IGNORE]) {
+	if (exhausted == 0 && head == lnet_mt_ignore_head(mtable)) {
 		head = lnet_mt_match_head(mtable, info->mi_id, info->mi_mbits);
 		goto again; /* re-check MEs w/o ignore-bits */
 	}
@@ -733,14 +800,16 @@ lnet_ptl_cleanup(struct lnet_portal *ptl)
 	cfs_percpt_for_each(mtable, i, ptl->ptl_mtables) {
 		struct list_head *mhash;
 		lnet_me_t	 *me;
+		int		  nhash;
 		int		  j;
 
 		if (mtable->mt_mhash == NULL) /* uninitialized match-table */
 			continue;
 
 		mhash = mtable->mt_mhash;
+		nhash = (1U << mtable->mt_hash_bits) + 1;
 		/* cleanup ME */
-		for (j = 0; j < LNET_MT_HASH_SIZE + 1; j++) {
+		for (j = 0; j < nhash; j++) {
 			while (!list_empty(&mhash[j])) {
 				me = list_entry(mhash[j].next,
 						lnet_me_t, me_list);
@@ -750,7 +819,7 @@ lnet_ptl_cleanup(struct lnet_portal *ptl)
 			}
 		}
 		/* the extra entry is for MEs with ignore bits */
-		LIBCFS_FREE(mhash, sizeof(*mhash) * (LNET_MT_HASH_SIZE + 1));
+		LIBCFS_FREE(mhash, sizeof(*mhash) * nhash);
 	}
 
 	cfs_percpt_free(ptl->ptl_mtables);
@@ -796,6 +865,7 @@ lnet_ptl_setup(struct lnet_portal *ptl, int index)
 		       sizeof(mtable->mt_exhausted[0]) *
 		       LNET_MT_EXHAUSTED_BMAP);
 		mtable->mt_mhash = mhash;
+		mtable->mt_hash_bits = LNET_MT_HASH_BITS;
 		for (j = 0; j < LNET_MT_HASH_SIZE + 1; j++)
 			INIT_LIST_HEAD(&mhash[j]);
 
@@ -0,0 +1,310 @@
+/*
+ * GPL HEADER START
+ *
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License version 2 for more details (a copy is included
+ * in the LICENSE file that accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; If not, see
+ * http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * GPL HEADER END
+ */
+/*
+ * This file is part of Lustre, http://www.lustre.org/
+ *
+ * lnet/lnet/lnet_eq_test.c
+ *
+ * Test of batched EQ delivery: \a nthreads threads each attach an MD of a
+ * batched EQ, PUT \a nputs messages to it over the loopback NI and unlink
+ * it, \a niters times, while the EQ handler spends \a handler_udelay usec
+ * on each batch so that events queue up and rings fill. Checks that the
+ * events of each MD are handled in order, that none is handled after the
+ * unlink event, and that the unlink event has been handled when
+ * LNetMDUnlink() or LNetMEUnlink() return. Loading fails if any check does.
+ */
+
+#define DEBUG_SUBSYSTEM S_LNET
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/kthread.h>
+#include <linux/delay.h>
+
+#include <lnet/lib-lnet.h>
+
+static int nthreads = 8;
+CFS_MODULE_PARM(nthreads, "i", int, 0444,
+		"# threads depositing events");
+
+static int niters = 2000;
+CFS_MODULE_PARM(niters, "i", int, 0444,
+		"# MDs attached and unlinked by each thread");
+
+static int nputs = 16;
+CFS_MODULE_PARM(nputs, "i", int, 0444,
+		"# PUTs to each MD");
+
+static int handler_udelay = 20;
+CFS_MODULE_PARM(handler_udelay, "i", int, 0444,
+		"usec the EQ handler spends on each batch");
+
+static int portal = MAX_PORTALS - 2;
+CFS_MODULE_PARM(portal, "i", int, 0444,
+		"portal to attach the MDs on, must be unused");
+
+#define EQ_TEST_MBITS_BASE	0x600000000ULL
+
+struct eq_test_thread {
+	struct completion	ett_done;
+	lnet_handle_md_t	ett_mdh;	/* MD being tested */
+	int			ett_id;
+	int			ett_puts;	/* PUT events handled */
+	int			ett_unlinked;	/* unlink event handled */
+	int			ett_rc;
+};
+
+static lnet_process_id_t	eq_test_self;
+static lnet_handle_eq_t		eq_test_eqh;
+static atomic_t			eq_test_errors;
+static char			eq_test_buf[8];
+
+static void
+eq_test_handler(lnet_event_t *events, int nevents)
+{
+	struct eq_test_thread	*t;
+	lnet_event_t		*ev;
+	int			i;
+
+	for (i = 0; i < nevents; i++) {
+		ev = &events[i];
+		t = ev->md.user_ptr;
+
+		if (!LNetHandleIsEqual(ev->md_handle, t->ett_mdh) ||
+		    t->ett_unlinked) {
+			CERROR("thread %d: event %d handled after unlink\n",
+			       t->ett_id, ev->type);
+			atomic_inc(&eq_test_errors);
+			continue;
+		}
+
+		if (ev->type == LNET_EVENT_PUT)
+			t->ett_puts++;
+
+		if (ev->unlinked) {
+			if (t->ett_puts != nputs) {
+				CERROR("thread %d: unlinked after %d PUTs\n",
+				       t->ett_id, t->ett_puts);
+				atomic_inc(&eq_test_errors);
+			}
+			t->ett_unlinked = 1;
+		}
+	}
+
+	if (handler_udelay > 0)
+		udelay(handler_udelay);
+}
+
+static int
+eq_test_iter(struct eq_test_thread *t, lnet_handle_md_t src, int iter)
+{
+	lnet_handle_me_t	meh;
+	lnet_md_t		md;
+	__u64			mbits;
+	int			rc;
+	int			i;
+
+	mbits = EQ_TEST_MBITS_BASE + (__u64)t->ett_id * niters + iter;
+	rc = LNetMEAttach(portal, eq_test_self, mbits, 0, LNET_UNLINK,
+			  LNET_INS_AFTER, &meh);
+	if (rc != 0)
+		return rc;
+
+	memset(&md, 0, sizeof(md));
+	md.start     = eq_test_buf;
+	md.length    = 0;
+	md.threshold = LNET_MD_THRESH_INF;
+	md.options   = LNET_MD_OP_PUT;
+	md.user_ptr  = t;
+	md.eq_handle = eq_test_eqh;
+
+	t->ett_puts = 0;
+	t->ett_unlinked = 0;
+	rc = LNetMDAttach(meh, md, LNET_UNLINK, &t->ett_mdh);
+	if (rc != 0) {
+		LNetMEUnlink(meh);
+		return rc;
+	}
+
+	for (i = 0; i < nputs; i++) {
+		rc = LNetPut(LNET_NID_ANY, src, LNET_NOACK_REQ, eq_test_self,
+			     portal, mbits, 0, 0);
+		if (rc != 0)
+			break;
+	}
+
+	/* unlink both ways, as ptlrpc does */
+	if (iter % 2 == 0)
+		LNetMDUnlink(t->ett_mdh);
+	else
+		LNetMEUnlink(meh);
+
+	if (rc != 0)
+		return rc;
+
+	if (!t->ett_unlinked) {
+		CERROR("thread %d: unlink event not handled on return\n",
+		       t->ett_id);
+		return -EIO;
+	}
+	return 0;
+}
+
+static int
+eq_test_thread(void *arg)
+{
+	struct eq_test_thread	*t = arg;
+	lnet_handle_md_t	src;
+	lnet_md_t		md;
+	int			rc;
+	int			i;
+
+	memset(&md, 0, sizeof(md));
+	md.start     = eq_test_buf;
+	md.length    = 0;
+	md.threshold = LNET_MD_THRESH_INF;
+	LNetInvalidateHandle(&md.eq_handle);
+
+	rc = LNetMDBind(md, LNET_UNLINK, &src);
+	if (rc != 0)
+		goto out;
+
+	for (i = 0; i < niters; i++) {
+		rc = eq_test_iter(t, src, i);
+		if (rc != 0) {
+			CERROR("thread %d: iteration %d failed: %d\n",
+			       t->ett_id, i, rc);
+			break;
+		}
+	}
+
+	LNetMDUnlink(src);
+out:
+	t->ett_rc = rc;
+	complete(&t->ett_done);
+	return 0;
+}
+
+static int
+eq_test_run(void)
+{
+	struct eq_test_thread	*threads;
+	struct task_struct	*task;
+	int			rc = 0;
+	int			n;
+	int			i;
+
+	for (i = 0; LNetGetId(i, &eq_test_self) == 0; i++) {
+		if (LNET_NETTYP(LNET_NIDNET(eq_test_self.nid)) == LOLND)
+			break;
+	}
+	if (LNET_NETTYP(LNET_NIDNET(eq_test_self.nid)) != LOLND) {
+		CERROR("No loopback NI\n");
+		return -ENOENT;
+	}
+
+	rc = LNetEQAllocBatch(0, eq_test_handler, &eq_test_eqh);
+	if (rc != 0) {
+		CERROR("Can't allocate batched EQ: %d\n", rc);
+		return rc;
+	}
+
+	LIBCFS_ALLOC(threads, sizeof(*threads) * nthreads);
+	if (threads == NULL) {
+		rc = -ENOMEM;
+		goto out_eq;
+	}
+
+	atomic_set(&eq_test_errors, 0);
+	for (n = 0; n < nthreads; n++) {
+		threads[n].ett_id = n;
+		init_completion(&threads[n].ett_done);
+
+		task = kthread_run(eq_test_thread, &threads[n],
+				   "lnet_eq_test_%d", n);
+		if (IS_ERR(task)) {
+			rc = PTR_ERR(task);
+			CERROR("Can't start thread %d: %d\n", n, rc);
+			break;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		wait_for_completion(&threads[i].ett_done);
+		if (rc == 0)
+			rc = threads[i].ett_rc;
+	}
+	LIBCFS_FREE(threads, sizeof(*threads) * nthreads);
+
+	if (rc == 0 && atomic_read(&eq_test_errors) != 0) {
+		CERROR("%d events handled out of order\n",
+		       atomic_read(&eq_test_errors));
+		rc = -EIO;
+	}
+	if (rc == 0)
+		LCONSOLE_INFO("%d threads attached and unlinked %d MDs each, "
+			      "%d PUTs to each\n", nthreads, niters, nputs);
+out_eq:
+	i = LNetEQFree(eq_test_eqh);
+	if (i != 0) {
+		/* every event was handled by the unlink of its MD */
+		CERROR("Can't free EQ: %d\n", i);
+		if (rc == 0)
+			rc = i;
+	}
+	return rc;
+}
+
+static int __init
+eq_test_init(void)
+{
+	int	rc;
+
+	if (nthreads <= 0 || niters <= 0 || nputs < 0 || portal < 0 ||
+	    portal >= MAX_PORTALS) {
+		CERROR("Invalid nthreads %d, niters %d, nputs %d or "
+		       "portal %d\n", nthreads, niters, nputs, portal);
+		return -EINVAL;
+	}
+
+	rc = LNetNIInit(LUSTRE_SRV_LNET_PID);
+	if (rc < 0) {
+		CERROR("LNetNIInit() failed: %d\n", rc);
+		return rc;
+	}
+
+	rc = eq_test_run();
+	LNetNIFini();
+
+	return rc;
+}
+
+static void __exit
+eq_test_exit(void)
+{
+}
+
+MODULE_DESCRIPTION("LNet batched EQ test");
+MODULE_LICENSE("GPL");
+
+module_init(eq_test_init);
+module_exit(eq_test_exit);
@@ -0,0 +1,184 @@
+/*
+ * GPL HEADER START
+ *
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License version 2 for more details (a copy is included
+ * in the LICENSE file that accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; If not, see
+ * http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * GPL HEADER END
+ */
+/*
+ * This file is part of Lustre, http://www.lustre.org/
+ *
+ * lnet/lnet/lnet_match_bench.c
+ *
+ * Micro-benchmark of ME/MD matching: attaches \a nmds MDs with distinct
+ * match bits on a unique portal, then PUTs \a nputs messages to itself over
+ * the loopback NI, each matching one of them, and reports the time per PUT
+ * on the console. Loading with nmds=16 and nmds=16384 shows how matching
+ * cost depends on the number of posted MDs.
+ */
+
+#define DEBUG_SUBSYSTEM S_LNET
+
+#include <linux/module.h>
+#include <linux/init.h>
+
+#include <lnet/lib-lnet.h>
+
+static int nmds = 16384;
+CFS_MODULE_PARM(nmds, "i", int, 0444,
+		"# MDs to attach");
+
+static int nputs = 200000;
+CFS_MODULE_PARM(nputs, "i", int, 0444,
+		"# PUTs matched against them");
+
+static int portal = MAX_PORTALS - 1;
+CFS_MODULE_PARM(portal, "i", int, 0444,
+		"portal to attach the MDs on, must be unused");
+
+/* match bits are spread like ptlrpc XIDs */
+#define MATCH_BENCH_MBITS_BASE	0x500000000ULL
+
+static char match_bench_buf[8];
+
+static int
+match_bench_self(lnet_process_id_t *id)
+{
+	int	i;
+
+	for (i = 0; LNetGetId(i, id) == 0; i++) {
+		if (LNET_NETTYP(LNET_NIDNET(id->nid)) == LOLND)
+			return 0;
+	}
+	return -ENOENT;
+}
+
+static int
+match_bench_run(void)
+{
+	lnet_handle_md_t *mdhs;
+	lnet_handle_md_t  src;
+	lnet_handle_me_t  meh;
+	lnet_process_id_t self;
+	lnet_md_t	  md;
+	__u64		  start;
+	__u64		  usec;
+	__u64		  nsec;
+	unsigned int	  mbits = 0;
+	int		  rc;
+	int		  i;
+	int		  n;
+
+	rc = match_bench_self(&self);
+	if (rc != 0) {
+		CERROR("No loopback NI: %d\n", rc);
+		return rc;
+	}
+
+	LIBCFS_ALLOC(mdhs, sizeof(*mdhs) * nmds);
+	if (mdhs == NULL)
+		return -ENOMEM;
+
+	memset(&md, 0, sizeof(md));
+	md.start     = match_bench_buf;
+	md.length    = 0;
+	md.threshold = LNET_MD_THRESH_INF;
+	md.options   = LNET_MD_OP_PUT;
+	LNetInvalidateHandle(&md.eq_handle);
+
+	for (n = 0; n < nmds; n++) {
+		rc = LNetMEAttach(portal, self, MATCH_BENCH_MBITS_BASE + n, 0,
+				  LNET_UNLINK, LNET_INS_AFTER, &meh);
+		if (rc != 0)
+			goto out;
+
+		rc = LNetMDAttach(meh, md, LNET_UNLINK, &mdhs[n]);
+		if (rc != 0) {
+			LNetMEUnlink(meh);
+			goto out;
+		}
+	}
+
+	md.options = 0;
+	rc = LNetMDBind(md, LNET_UNLINK, &src);
+	if (rc != 0)
+		goto out;
+
+	start = lnet_time_usec();
+	for (i = 0; i < nputs; i++) {
+		/* visit the MDs in an order unrelated to posting order */
+		rc = LNetPut(LNET_NID_ANY, src, LNET_NOACK_REQ, self, portal,
+			     MATCH_BENCH_MBITS_BASE + mbits, 0, 0);
+		mbits = (mbits + 7919) % nmds;
+		if (rc != 0)
+			break;
+	}
+	usec = lnet_time_usec() - start;
+
+	LNetMDUnlink(src);
+
+	if (rc != 0) {
+		CERROR("PUT %d failed: %d\n", i, rc);
+		goto out;
+	}
+
+	nsec = usec * 1000;
+	do_div(nsec, max(nputs, 1));
+	LCONSOLE_INFO("%d PUTs matched against %d MDs on portal %d: "
+		      LPU64" usec, "LPU64" nsec per PUT\n", nputs, nmds,
+		      portal, usec, nsec);
+ out:
+	while (--n >= 0)
+		LNetMDUnlink(mdhs[n]);
+
+	LIBCFS_FREE(mdhs, sizeof(*mdhs) * nmds);
+	return rc;
+}
+
+static int __init
+match_bench_init(void)
+{
+	int	rc;
+
+	if (nmds <= 0 || nputs < 0 || portal < 0 || portal >= MAX_PORTALS) {
+		CERROR("Invalid nmds %d, nputs %d or portal %d\n",
+		       nmds, nputs, portal);
+		return -EINVAL;
+	}
+
+	rc = LNetNIInit(LUSTRE_SRV_LNET_PID);
+	if (rc < 0) {
+		CERROR("LNetNIInit() failed: %d\n", rc);
+		return rc;
+	}
+
+	rc = match_bench_run();
+	LNetNIFini();
+
+	return rc;
+}
+
+static void __exit
+match_bench_exit(void)
+{
+}
+
+MODULE_DESCRIPTION("LNet ME/MD matching benchmark");
+MODULE_LICENSE("GPL");
+
+module_init(match_bench_init);
+module_exit(match_bench_exit);
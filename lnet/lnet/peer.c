@@ -340,7 +340,8 @@ lnet_nid2peer_locked(lnet_peer_t **lpp, lnet_nid_t nid, int cpt)
 	}
 
 	lp->lp_txcredits    =
-	lp->lp_mintxcredits = lp->lp_ni->ni_peertxcredits;
+	lp->lp_mintxcredits =
+	lp->lp_cwnd         = lp->lp_ni->ni_peertxcredits;
 	lp->lp_rtrcredits    =
 	lp->lp_minrtrcredits = lnet_peer_buffer_credits(lp->lp_ni);
 
@@ -378,11 +379,13 @@ lnet_debug_peer(lnet_nid_t nid)
         if (lnet_isrouter(lp) || lnet_peer_aliveness_enabled(lp))
                 aliveness = lp->lp_alive ? "up" : "down";
 
-        CDEBUG(D_WARNING, "%-24s %4d %5s %5d %5d %5d %5d %5d %ld\n",
+	CDEBUG(D_WARNING,
+	       "%-24s %4d %5s %5d %5d %5d %5d %5d %ld %d "LPU64"\n",
                libcfs_nid2str(lp->lp_nid), lp->lp_refcount,
                aliveness, lp->lp_ni->ni_peertxcredits,
                lp->lp_rtrcredits, lp->lp_minrtrcredits,
-               lp->lp_txcredits, lp->lp_mintxcredits, lp->lp_txqnob);
+               lp->lp_txcredits, lp->lp_mintxcredits, lp->lp_txqnob,
+	       lp->lp_cwnd, lp->lp_rtt_avg);
 
         lnet_peer_decref_locked(lp);
 
@@ -450,3 +453,208 @@ int lnet_get_peer_info(__u32 peer_index, __u64 *nid,
 
 	return found ? 0 : -ENOENT;
 }
+
+/* seconds a rail is avoided after a failed send */
+#define LNET_RAIL_DOWN_SECS	10
+
+/**
+ * Register a multi-rail peer, reachable through all of \a nids.
+ * nids[0] is the NID the peer is known by to LNet users: messages from any
+ * of its rails are reported as coming from nids[0], and messages to any of
+ * them are spread over all rails on local networks.
+ *
+ * Must be called before the first message is sent, see lnet_parse_rails().
+ *
+ * \retval 0 on success
+ * \retval -EINVAL if a NID is local, on the same network as another rail of
+ *	   the peer, or already registered
+ * \retval -ENOMEM on allocation failure
+ */
+int
+lnet_add_mrpeer(lnet_nid_t *nids, int nnids)
+{
+	lnet_mrpeer_t	*mp;
+	lnet_rail_t	*rl;
+	int		i;
+	int		j;
+
+	if (nnids < 2 || nnids > LNET_MAX_RAILS)
+		return -EINVAL;
+
+	for (i = 0; i < nnids; i++) {
+		if (lnet_islocalnid(nids[i]) || lnet_find_rail(nids[i]) != NULL)
+			return -EINVAL;
+
+		for (j = 0; j < i; j++) {
+			if (LNET_NIDNET(nids[j]) == LNET_NIDNET(nids[i]))
+				return -EINVAL;
+		}
+	}
+
+	if (the_lnet.ln_rail_hash == NULL) {
+		struct list_head *hash;
+
+		LIBCFS_ALLOC(hash, LNET_RAIL_HASH_SIZE * sizeof(*hash));
+		if (hash == NULL)
+			return -ENOMEM;
+
+		for (i = 0; i < LNET_RAIL_HASH_SIZE; i++)
+			INIT_LIST_HEAD(&hash[i]);
+		the_lnet.ln_rail_hash = hash;
+	}
+
+	LIBCFS_ALLOC(mp, sizeof(*mp));
+	if (mp == NULL)
+		return -ENOMEM;
+
+	mp->mp_nrails = nnids;
+	for (i = 0; i < nnids; i++) {
+		rl = &mp->mp_rails[i];
+		rl->rl_mrpeer = mp;
+		rl->rl_nid = nids[i];
+		atomic_set(&rl->rl_inflight, 0);
+		list_add_tail(&rl->rl_hashlist, lnet_nid2railhash(nids[i]));
+	}
+	list_add_tail(&mp->mp_list, &the_lnet.ln_mrpeers);
+
+	CDEBUG(D_NET, "Multi-rail peer %s has %d rails\n",
+	       libcfs_nid2str(nids[0]), nnids);
+	return 0;
+}
+
+void
+lnet_destroy_mrpeers(void)
+{
+	lnet_mrpeer_t	*mp;
+
+	while (!list_empty(&the_lnet.ln_mrpeers)) {
+		mp = list_entry(the_lnet.ln_mrpeers.next,
+				lnet_mrpeer_t, mp_list);
+		list_del(&mp->mp_list);
+		LIBCFS_FREE(mp, sizeof(*mp));
+	}
+
+	if (the_lnet.ln_rail_hash != NULL) {
+		LIBCFS_FREE(the_lnet.ln_rail_hash,
+			    LNET_RAIL_HASH_SIZE *
+			    sizeof(the_lnet.ln_rail_hash[0]));
+		the_lnet.ln_rail_hash = NULL;
+	}
+}
+
+lnet_rail_t *
+lnet_find_rail(lnet_nid_t nid)
+{
+	lnet_rail_t	*rl;
+
+	if (the_lnet.ln_rail_hash == NULL)
+		return NULL;
+
+	list_for_each_entry(rl, lnet_nid2railhash(nid), rl_hashlist) {
+		if (rl->rl_nid == nid)
+			return rl;
+	}
+	return NULL;
+}
+
+/**
+ * Returns the NID the peer owning \a nid is known by, or \a nid itself if
+ * it isn't a rail of a multi-rail peer.
+ */
+lnet_nid_t
+lnet_rail_primary_nid(lnet_nid_t nid)
+{
+	lnet_rail_t	*rl = lnet_find_rail(nid);
+
+	return rl == NULL ? nid : rl->rl_mrpeer->mp_rails[0].rl_nid;
+}
+
+/**
+ * Choose the rail to send to the multi-rail peer owning \a nid on.
+ *
+ * Rails on networks without a local NI are skipped. Rails which haven't
+ * failed recently are preferred, then the one with fewest messages in
+ * flight, then the one whose local NI has most send credits on \a cpt;
+ * remaining ties are broken round-robin. Rail counters are read without
+ * locking, which is inaccurate but harmless.
+ *
+ * \retval NULL if \a nid isn't a rail of a multi-rail peer, or no rail of
+ *	   it is on a local network
+ */
+lnet_rail_t *
+lnet_rail_select_locked(lnet_nid_t nid, int cpt)
+{
+	lnet_rail_t	*rl = lnet_find_rail(nid);
+	lnet_mrpeer_t	*mp;
+	lnet_rail_t	*best = NULL;
+	lnet_ni_t	*ni;
+	cfs_time_t	now = cfs_time_current();
+	unsigned int	seq;
+	int		best_up = 0;
+	int		best_inflight = 0;
+	int		best_credits = 0;
+	int		up;
+	int		inflight;
+	int		credits;
+	int		i;
+
+	if (rl == NULL)
+		return NULL;
+
+	mp = rl->rl_mrpeer;
+	seq = mp->mp_seq++;
+	for (i = 0; i < mp->mp_nrails; i++) {
+		rl = &mp->mp_rails[(seq + i) % mp->mp_nrails];
+
+		ni = lnet_net2ni_locked(LNET_NIDNET(rl->rl_nid), cpt);
+		if (ni == NULL)
+			continue;
+
+		credits = ni->ni_tx_queues[cpt]->tq_credits;
+		lnet_ni_decref_locked(ni, cpt);
+
+		up = rl->rl_down_until == 0 ||
+		     !cfs_time_before(now, rl->rl_down_until);
+		inflight = atomic_read(&rl->rl_inflight);
+
+		if (best != NULL) {
+			if (up != best_up) {
+				if (!up)
+					continue;
+			} else if (inflight != best_inflight) {
+				if (inflight > best_inflight)
+					continue;
+			} else if (credits <= best_credits) {
+				continue;
+			}
+		}
+
+		best = rl;
+		best_up = up;
+		best_inflight = inflight;
+		best_credits = credits;
+	}
+
+	return best;
+}
+
+/**
+ * Account completion of a send on \a rl; a failed send makes the rail
+ * less preferred for LNET_RAIL_DOWN_SECS.
+ */
+void
+lnet_rail_tx_done(lnet_rail_t *rl, int status)
+{
+	atomic_dec(&rl->rl_inflight);
+
+	if (status == 0) {
+		if (rl->rl_down_until != 0)
+			rl->rl_down_until = 0;
+		return;
+	}
+
+	rl->rl_failed++;
+	rl->rl_down_until = cfs_time_shift(LNET_RAIL_DOWN_SECS);
+	CDEBUG(D_NET, "Send to %s failed: %d\n",
+	       libcfs_nid2str(rl->rl_nid), status);
+}
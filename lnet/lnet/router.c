@@ -49,6 +49,19 @@ CFS_MODULE_PARM(small_router_buffers, "i", int, 0444,
 static int large_router_buffers;
 CFS_MODULE_PARM(large_router_buffers, "i", int, 0444,
 		"# of large messages to buffer in the router");
+/* Router buffer pools grow when they run low on free buffers and shrink back
+ * when they stay mostly idle, between 1/N and N times the configured size */
+static int router_buffers_autoscale = 0;
+CFS_MODULE_PARM(router_buffers_autoscale, "i", int, 0644,
+		"max factor router buffer pools autoscale by (0 to disable)");
+
+/* grow a pool by 1/4 when fewer than 1/8 of its buffers were left free */
+#define LNET_RTRPOOL_HIGH_WATER(n)	((n) / 8)
+/* shrink it when more than half of them stayed free ... */
+#define LNET_RTRPOOL_LOW_WATER(n)	((n) / 2)
+/* ... for this many router checker scans in a row */
+#define LNET_RTRPOOL_IDLE_SCANS		30
+
 static int peer_buffer_credits = 0;
 CFS_MODULE_PARM(peer_buffer_credits, "i", int, 0444,
                 "# router buffer credits per peer");
@@ -73,6 +86,7 @@ lnet_peer_buffer_credits(lnet_ni_t *ni)
 
 /* forward ref's */
 static int lnet_router_checker(void *);
+static void lnet_rtrpools_autoscale(void);
 #else
 
 int
@@ -1313,6 +1327,8 @@ rescan:
 
 		lnet_prune_rc_data(0); /* don't wait for UNLINK */
 
+		lnet_rtrpools_autoscale();
+
 		/* Call cfs_pause() here always adds 1 to load average
 		 * because kernel counts # active tasks as nr_running
 		 * + nr_uninterruptible. */
@@ -1391,7 +1407,7 @@ lnet_rtrpool_free_bufs(lnet_rtrbufpool_t *rbp, int cpt)
 	lnet_drop_routed_msgs_locked(&rbp->rbp_msgs, cpt);
 	list_splice_init(&rbp->rbp_bufs, &tmp);
 	rbp->rbp_nbuffers = rbp->rbp_credits = 0;
-	rbp->rbp_mincredits = 0;
+	rbp->rbp_mincredits = rbp->rbp_scan_mincredits = 0;
 	lnet_net_unlock(cpt);
 
 	/* Free buffers on the free list. */
@@ -1447,7 +1463,9 @@ lnet_rtrpool_adjust_bufs(lnet_rtrbufpool_t *rbp, int nbufs, int cpt)
 	list_splice_tail(&rb_list, &rbp->rbp_bufs);
 	rbp->rbp_nbuffers += num_buffers;
 	rbp->rbp_credits += num_buffers;
-	rbp->rbp_mincredits = rbp->rbp_credits;
+	/* The lowest credits seen stay as low relative to the pool size */
+	rbp->rbp_mincredits += num_buffers;
+	rbp->rbp_scan_mincredits += num_buffers;
 	/* We need to schedule blocked msg using the newly
 	 * added buffers. */
 	while (!list_empty(&rbp->rbp_bufs) &&
@@ -1468,6 +1486,116 @@ failed:
 	return -ENOMEM;
 }
 
+static void
+lnet_rtrpool_shrink_bufs(lnet_rtrbufpool_t *rbp, int nbufs, int cpt)
+{
+	struct list_head rb_list;
+	lnet_rtrbuf_t	*rb;
+
+	INIT_LIST_HEAD(&rb_list);
+
+	/* only free buffers are released, so no credit is owed */
+	lnet_net_lock(cpt);
+	while (nbufs-- > 0 && rbp->rbp_credits > 0) {
+		LASSERT(!list_empty(&rbp->rbp_bufs));
+		rb = list_entry(rbp->rbp_bufs.next, lnet_rtrbuf_t, rb_list);
+		list_move(&rb->rb_list, &rb_list);
+		rbp->rbp_credits--;
+		rbp->rbp_nbuffers--;
+		rbp->rbp_mincredits--;
+		rbp->rbp_scan_mincredits--;
+	}
+	lnet_net_unlock(cpt);
+
+	while (!list_empty(&rb_list)) {
+		rb = list_entry(rb_list.next, lnet_rtrbuf_t, rb_list);
+		list_del(&rb->rb_list);
+		lnet_destroy_rtrbuf(rb, rbp->rbp_npages);
+	}
+}
+
+/**
+ * Grow or shrink the router buffer pool \a rbp of CPT \a cpt according to
+ * the lowest number of free buffers it had since the last call.
+ */
+static void
+lnet_rtrpool_autoscale(lnet_rtrbufpool_t *rbp, int cpt)
+{
+	int	factor = router_buffers_autoscale;
+	int	nbuffers;
+	int	mincredits;
+	int	nmax;
+	int	nmin;
+	int	n;
+
+	lnet_net_lock(cpt);
+	nbuffers = rbp->rbp_nbuffers;
+	mincredits = rbp->rbp_scan_mincredits;
+	rbp->rbp_scan_mincredits = rbp->rbp_credits;
+	lnet_net_unlock(cpt);
+
+	if (nbuffers == 0 || rbp->rbp_req_nbuffers == 0)
+		return;
+
+	nmax = rbp->rbp_req_nbuffers * factor;
+	nmin = max(rbp->rbp_req_nbuffers / factor, 1);
+
+	if (mincredits <= LNET_RTRPOOL_HIGH_WATER(nbuffers)) {
+		rbp->rbp_idle_scans = 0;
+		n = min(max(nbuffers / 4, 1), nmax - nbuffers);
+		if (n <= 0)
+			return;
+
+		CDEBUG(D_NET, "CPT %d: grow %d page router buffers %d -> %d\n",
+		       cpt, rbp->rbp_npages, nbuffers, nbuffers + n);
+		(void)lnet_rtrpool_adjust_bufs(rbp, nbuffers + n, cpt);
+		return;
+	}
+
+	if (mincredits <= LNET_RTRPOOL_LOW_WATER(nbuffers)) {
+		rbp->rbp_idle_scans = 0;
+		return;
+	}
+
+	if (++rbp->rbp_idle_scans < LNET_RTRPOOL_IDLE_SCANS)
+		return;
+
+	rbp->rbp_idle_scans = 0;
+	n = min(mincredits / 2, nbuffers - nmin);
+	if (n <= 0)
+		return;
+
+	CDEBUG(D_NET, "CPT %d: shrink %d page router buffers %d -> %d\n",
+	       cpt, rbp->rbp_npages, nbuffers, nbuffers - n);
+	lnet_rtrpool_shrink_bufs(rbp, n, cpt);
+}
+
+/* called by the router checker every second */
+static void
+lnet_rtrpools_autoscale(void)
+{
+	lnet_rtrbufpool_t *rtrp;
+	int		   i;
+	int		   j;
+
+	if (router_buffers_autoscale <= 0 || !the_lnet.ln_routing)
+		return;
+
+	/* pools are reconfigured under ln_api_mutex, which is also held
+	 * while stopping this thread, so never block on it */
+	if (!mutex_trylock(&the_lnet.ln_api_mutex))
+		return;
+
+	if (the_lnet.ln_routing && the_lnet.ln_rtrpools != NULL) {
+		cfs_percpt_for_each(rtrp, i, the_lnet.ln_rtrpools) {
+			for (j = 0; j < LNET_NRBPOOLS; j++)
+				lnet_rtrpool_autoscale(&rtrp[j], i);
+		}
+	}
+
+	mutex_unlock(&the_lnet.ln_api_mutex);
+}
+
 void
 lnet_rtrpool_init(lnet_rtrbufpool_t *rbp, int npages)
 {
@@ -1605,6 +1733,7 @@ lnet_rtrpools_alloc(int im_a_router)
 
 	cfs_percpt_for_each(rtrp, i, the_lnet.ln_rtrpools) {
 		lnet_rtrpool_init(&rtrp[LNET_TINY_BUF_IDX], 0);
+		rtrp[LNET_TINY_BUF_IDX].rbp_req_nbuffers = nrb_tiny;
 		rc = lnet_rtrpool_adjust_bufs(&rtrp[LNET_TINY_BUF_IDX],
 					      nrb_tiny, i);
 		if (rc != 0)
@@ -1612,6 +1741,7 @@ lnet_rtrpools_alloc(int im_a_router)
 
 		lnet_rtrpool_init(&rtrp[LNET_SMALL_BUF_IDX],
 				  LNET_NRB_SMALL_PAGES);
+		rtrp[LNET_SMALL_BUF_IDX].rbp_req_nbuffers = nrb_small;
 		rc = lnet_rtrpool_adjust_bufs(&rtrp[LNET_SMALL_BUF_IDX],
 					      nrb_small, i);
 		if (rc != 0)
@@ -1619,6 +1749,7 @@ lnet_rtrpools_alloc(int im_a_router)
 
 		lnet_rtrpool_init(&rtrp[LNET_LARGE_BUF_IDX],
 				  LNET_NRB_LARGE_PAGES);
+		rtrp[LNET_LARGE_BUF_IDX].rbp_req_nbuffers = nrb_large;
 		rc = lnet_rtrpool_adjust_bufs(&rtrp[LNET_LARGE_BUF_IDX],
 					      nrb_large, i);
 		if (rc != 0)
@@ -1649,6 +1780,7 @@ lnet_rtrpools_adjust_helper(int tiny, int small, int large)
 		tiny_router_buffers = tiny;
 		nrb = lnet_nrb_tiny_calculate();
 		cfs_percpt_for_each(rtrp, i, the_lnet.ln_rtrpools) {
+			rtrp[LNET_TINY_BUF_IDX].rbp_req_nbuffers = nrb;
 			rc = lnet_rtrpool_adjust_bufs(&rtrp[LNET_TINY_BUF_IDX],
 						      nrb, i);
 			if (rc != 0)
@@ -1659,6 +1791,7 @@ lnet_rtrpools_adjust_helper(int tiny, int small, int large)
 		small_router_buffers = small;
 		nrb = lnet_nrb_small_calculate();
 		cfs_percpt_for_each(rtrp, i, the_lnet.ln_rtrpools) {
+			rtrp[LNET_SMALL_BUF_IDX].rbp_req_nbuffers = nrb;
 			rc = lnet_rtrpool_adjust_bufs(&rtrp[LNET_SMALL_BUF_IDX],
 						      nrb, i);
 			if (rc != 0)
@@ -1669,6 +1802,7 @@ lnet_rtrpools_adjust_helper(int tiny, int small, int large)
 		large_router_buffers = large;
 		nrb = lnet_nrb_large_calculate();
 		cfs_percpt_for_each(rtrp, i, the_lnet.ln_rtrpools) {
+			rtrp[LNET_LARGE_BUF_IDX].rbp_req_nbuffers = nrb;
 			rc = lnet_rtrpool_adjust_bufs(&rtrp[LNET_LARGE_BUF_IDX],
 						      nrb, i);
 			if (rc != 0)
@@ -433,9 +433,11 @@ proc_lnet_peers(struct ctl_table *table, int write, void __user *buffer,
 
         if (*ppos == 0) {
                 s += snprintf(s, tmpstr + tmpsiz - s,
-                              "%-24s %4s %5s %5s %5s %5s %5s %5s %5s %s\n",
+			      "%-24s %4s %5s %5s %5s %5s %5s %5s %5s %10s "
+			      "%5s %s\n",
                               "nid", "refs", "state", "last", "max",
-                              "rtr", "min", "tx", "min", "queue");
+			      "rtr", "min", "tx", "min", "queue",
+			      "cwnd", "rtt(us)");
                 LASSERT (tmpstr + tmpsiz - s > 0);
 
 		hoff++;
@@ -506,6 +508,8 @@ proc_lnet_peers(struct ctl_table *table, int write, void __user *buffer,
                         int        rtrcr     = peer->lp_rtrcredits;
                         int        minrtrcr  = peer->lp_minrtrcredits;
                         int        txqnob    = peer->lp_txqnob;
+			int        cwnd      = peer->lp_cwnd;
+			__u64      rtt       = peer->lp_rtt_avg;
 
                         if (lnet_isrouter(peer) ||
                             lnet_peer_aliveness_enabled(peer))
@@ -529,10 +533,11 @@ proc_lnet_peers(struct ctl_table *table, int write, void __user *buffer,
 			lnet_net_unlock(cpt);
 
                         s += snprintf(s, tmpstr + tmpsiz - s,
-                                      "%-24s %4d %5s %5d %5d %5d %5d %5d %5d %d\n",
+				      "%-24s %4d %5s %5d %5d %5d %5d %5d %5d "
+				      "%10d %5d "LPU64"\n",
                                       libcfs_nid2str(nid), nrefs, aliveness,
                                       lastalive, maxcr, rtrcr, minrtrcr, txcr,
-                                      mintxcr, txqnob);
+				      mintxcr, txqnob, cwnd, rtt);
                         LASSERT (tmpstr + tmpsiz - s > 0);
 
 		} else { /* peer is NULL */
@@ -633,6 +638,178 @@ proc_lnet_buffers(struct ctl_table *table, int write, void __user *buffer,
 				    __proc_lnet_buffers);
 }
 
+static int __proc_lnet_buffer_qtime(void *data, int write,
+				    loff_t pos, void *buffer, int nob)
+{
+	static const char *names[LNET_NRBPOOLS] = {"tiny", "small", "large"};
+	__u64		wait[LNET_RTR_HIST_BUCKETS];
+	__u64		hold[LNET_RTR_HIST_BUCKETS];
+	char		*s;
+	char		*tmpstr;
+	int		tmpsiz;
+	int		idx;
+	int		last;
+	int		len;
+	int		rc;
+	int		i;
+	int		j;
+
+	if (write) {
+		lnet_rtrbufpool_t *rbp;
+
+		if (the_lnet.ln_rtrpools == NULL)
+			return 0;
+
+		lnet_net_lock(LNET_LOCK_EX);
+		cfs_percpt_for_each(rbp, i, the_lnet.ln_rtrpools) {
+			for (idx = 0; idx < LNET_NRBPOOLS; idx++) {
+				memset(rbp[idx].rbp_wait_hist, 0,
+				       sizeof(rbp[idx].rbp_wait_hist));
+				memset(rbp[idx].rbp_hold_hist, 0,
+				       sizeof(rbp[idx].rbp_hold_hist));
+			}
+		}
+		lnet_net_unlock(LNET_LOCK_EX);
+		return 0;
+	}
+
+	tmpsiz = 64 * (LNET_NRBPOOLS * LNET_RTR_HIST_BUCKETS + 1);
+	LIBCFS_ALLOC(tmpstr, tmpsiz);
+	if (tmpstr == NULL)
+		return -ENOMEM;
+
+	s = tmpstr; /* points to current position in tmpstr[] */
+
+	s += snprintf(s, tmpstr + tmpsiz - s, "%-6s %10s %12s %12s\n",
+		      "pool", "usec", "wait", "hold");
+	LASSERT(tmpstr + tmpsiz - s > 0);
+
+	if (the_lnet.ln_rtrpools == NULL)
+		goto out; /* I'm not a router */
+
+	CLASSERT(LNET_NRBPOOLS == 3);
+
+	for (idx = 0; idx < LNET_NRBPOOLS; idx++) {
+		lnet_rtrbufpool_t *rbp;
+
+		memset(wait, 0, sizeof(wait));
+		memset(hold, 0, sizeof(hold));
+
+		lnet_net_lock(LNET_LOCK_EX);
+		cfs_percpt_for_each(rbp, i, the_lnet.ln_rtrpools) {
+			for (j = 0; j < LNET_RTR_HIST_BUCKETS; j++) {
+				wait[j] += rbp[idx].rbp_wait_hist[j];
+				hold[j] += rbp[idx].rbp_hold_hist[j];
+			}
+		}
+		lnet_net_unlock(LNET_LOCK_EX);
+
+		for (last = LNET_RTR_HIST_BUCKETS - 1; last > 0; last--) {
+			if (wait[last] != 0 || hold[last] != 0)
+				break;
+		}
+
+		/* bucket j counts times in [2^(j-1), 2^j) usec */
+		for (j = 0; j <= last; j++) {
+			s += snprintf(s, tmpstr + tmpsiz - s,
+				      "%-6s %10lu "LPU64" "LPU64"\n",
+				      names[idx],
+				      j == 0 ? 0UL : 1UL << (j - 1),
+				      wait[j], hold[j]);
+			LASSERT(tmpstr + tmpsiz - s > 0);
+		}
+	}
+
+ out:
+	len = s - tmpstr;
+
+	if (pos >= min_t(int, len, strlen(tmpstr)))
+		rc = 0;
+	else
+		rc = cfs_trace_copyout_string(buffer, nob,
+					      tmpstr + pos, NULL);
+
+	LIBCFS_FREE(tmpstr, tmpsiz);
+	return rc;
+}
+
+static int
+proc_lnet_buffer_qtime(struct ctl_table *table, int write,
+		       void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	return lprocfs_call_handler(table->data, write, ppos, buffer, lenp,
+				    __proc_lnet_buffer_qtime);
+}
+
+static int __proc_lnet_rails(void *data, int write,
+			     loff_t pos, void *buffer, int nob)
+{
+	lnet_mrpeer_t	*mp;
+	lnet_rail_t	*rl;
+	cfs_time_t	now = cfs_time_current();
+	char		*s;
+	char		*tmpstr;
+	int		tmpsiz = 80;
+	int		len;
+	int		rc;
+	int		i;
+
+	LASSERT(!write);
+
+	/* multi-rail peers don't change while LNet is up */
+	list_for_each_entry(mp, &the_lnet.ln_mrpeers, mp_list)
+		tmpsiz += 128 * mp->mp_nrails;
+
+	LIBCFS_ALLOC(tmpstr, tmpsiz);
+	if (tmpstr == NULL)
+		return -ENOMEM;
+
+	s = tmpstr; /* points to current position in tmpstr[] */
+
+	s += snprintf(s, tmpstr + tmpsiz - s,
+		      "%-24s %-24s %5s %8s %12s %8s\n",
+		      "peer", "rail", "state", "inflight", "sent", "failed");
+	LASSERT(tmpstr + tmpsiz - s > 0);
+
+	list_for_each_entry(mp, &the_lnet.ln_mrpeers, mp_list) {
+		for (i = 0; i < mp->mp_nrails; i++) {
+			char *state = "up";
+
+			rl = &mp->mp_rails[i];
+			if (rl->rl_down_until != 0 &&
+			    cfs_time_before(now, rl->rl_down_until))
+				state = "down";
+
+			s += snprintf(s, tmpstr + tmpsiz - s,
+				      "%-24s %-24s %5s %8d "LPU64" "LPU64"\n",
+				      libcfs_nid2str(mp->mp_rails[0].rl_nid),
+				      libcfs_nid2str(rl->rl_nid), state,
+				      atomic_read(&rl->rl_inflight),
+				      rl->rl_sent, rl->rl_failed);
+			LASSERT(tmpstr + tmpsiz - s > 0);
+		}
+	}
+
+	len = s - tmpstr;
+
+	if (pos >= min_t(int, len, strlen(tmpstr)))
+		rc = 0;
+	else
+		rc = cfs_trace_copyout_string(buffer, nob,
+					      tmpstr + pos, NULL);
+
+	LIBCFS_FREE(tmpstr, tmpsiz);
+	return rc;
+}
+
+static int
+proc_lnet_rails(struct ctl_table *table, int write, void __user *buffer,
+		size_t *lenp, loff_t *ppos)
+{
+	return lprocfs_call_handler(table->data, write, ppos, buffer, lenp,
+				    __proc_lnet_rails);
+}
+
 static int
 proc_lnet_nis(struct ctl_table *table, int write, void __user *buffer,
 	      size_t *lenp, loff_t *ppos)
@@ -897,12 +1074,24 @@ static struct ctl_table lnet_table[] = {
 		.mode		= 0444,
 		.proc_handler	= &proc_lnet_buffers,
 	},
+	{
+		INIT_CTL_NAME
+		.procname	= "buffer_qtime",
+		.mode		= 0644,
+		.proc_handler	= &proc_lnet_buffer_qtime,
+	},
 	{
 		INIT_CTL_NAME
 		.procname	= "nis",
 		.mode		= 0444,
 		.proc_handler	= &proc_lnet_nis,
 	},
+	{
+		INIT_CTL_NAME
+		.procname	= "rails",
+		.mode		= 0444,
+		.proc_handler	= &proc_lnet_rails,
+	},
 	{
 		INIT_CTL_NAME
 		.procname	= "portal_rotor",
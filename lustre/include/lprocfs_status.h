@@ -134,12 +134,18 @@ struct rename_stats {
  * squares (for multi-valued counter samples only). This allows
  * external computation of standard deviation, but involves a 64-bit
  * multiply per counter increment.
+ *
+ * LPROCFS_CNTR_HISTOGRAM indicates that the counter also keeps a per-CPU
+ * log2 histogram of its samples, in one of the histogram slots reserved with
+ * lprocfs_alloc_stats_hist(). It's updated without locking, like the rest of
+ * the per-CPU counter.
  */
 
 enum {
         LPROCFS_CNTR_EXTERNALLOCK = 0x0001,
         LPROCFS_CNTR_AVGMINMAX    = 0x0002,
         LPROCFS_CNTR_STDDEV       = 0x0004,
+	LPROCFS_CNTR_HISTOGRAM	  = 0x0008,
 
         /* counter data type */
         LPROCFS_TYPE_REGS         = 0x0100,
@@ -152,6 +158,8 @@ enum {
 
 struct lprocfs_counter_header {
 	unsigned int		lc_config;
+	/* histogram slot of a LPROCFS_CNTR_HISTOGRAM counter */
+	unsigned int		lc_hist;
 	const char		*lc_name;   /* must be static */
 	const char		*lc_units;  /* must be static */
 };
@@ -206,6 +214,14 @@ struct lprocfs_stats {
 	 * it is used to protect ls_biggest_alloc_num change */
 	spinlock_t			ls_lock;
 
+	/* # of histogram slots in each percpu area, and # of them in use */
+	unsigned short			ls_hist_num;
+	unsigned short			ls_hist_used;
+	/* chain on the list of stats in /proc/fs/lustre/stats_snapshot, and
+	 * the path of the stats file there */
+	struct list_head		ls_snapshot_list;
+	char				*ls_snapshot_path;
+
 	/* has ls_num of counter headers */
 	struct lprocfs_counter_header	*ls_cnt_header;
 	struct lprocfs_percpu		*ls_percpu[0];
@@ -337,6 +353,38 @@ static inline int opcode_offset(__u32 opc) {
 			    OPC_RANGE(OUT_UPDATE) + \
 			    OPC_RANGE(LFSCK))
 
+/**
+ * Phases of the latency of an RPC; each is tracked by a log2 histogram in
+ * usec per opcode, see struct lprocfs_rpc_lat.
+ */
+enum lprocfs_rpc_lat_phase {
+	/** in the request queue of a service, or in a client until sent */
+	RPC_LAT_WAIT = 0,
+	/** handling by a service, or the round trip seen by a client */
+	RPC_LAT_SERVICE,
+	/** bulk transfer driven by a service */
+	RPC_LAT_BULK,
+	/** from the reply until the transaction is committed */
+	RPC_LAT_COMMIT,
+	RPC_LAT_LAST
+};
+
+/**
+ * Latency histograms of all phases of one opcode, as seen by one CPU.
+ */
+struct lprocfs_rpc_lat_cpu {
+	unsigned long		rlc_buckets[RPC_LAT_LAST][OBD_HIST_MAX];
+};
+
+/**
+ * Per-opcode latency histograms of a service or an import. Each CPU only
+ * updates its own histograms, without locking, and readers sum them up.
+ */
+struct lprocfs_rpc_lat {
+	/** num_possible_cpus() histograms per opcode, allocated on first use */
+	struct lprocfs_rpc_lat_cpu	**rl_opc[LUSTRE_MAX_OPCODES];
+};
+
 #define EXTRA_MAX_OPCODES ((PTLRPC_LAST_CNTR - PTLRPC_FIRST_CNTR)  + \
                             OPC_RANGE(EXTRA))
 
@@ -398,14 +446,26 @@ static inline void s2dhms(struct dhms *ts, time_t secs)
 
 typedef void (*cntr_init_callback)(struct lprocfs_stats *stats);
 
+/* default cap of the memory used by the jobs of a target */
+#define JOBSTATS_MAX_MB_DEFAULT		64
+
+struct job_stat_list;
+
 struct obd_job_stats {
 	cfs_hash_t	       *ojs_hash;
-	struct list_head	ojs_list;
-	rwlock_t		ojs_lock; /* protect the obj_list */
+	struct job_stat_list  **ojs_lists;	/* per-CPT LRU lists of jobs */
 	cntr_init_callback	ojs_cntr_init_fn;
 	int			ojs_cntr_num;
 	int			ojs_cleanup_interval;
-	time_t			ojs_last_cleanup;
+	unsigned int		ojs_max_mb;	/* 0 means no cap */
+	int			ojs_entry_size;	/* estimated size of a job */
+	atomic_t		ojs_nentries;
+	wait_queue_head_t	ojs_cleanup_waitq;
+	struct completion	ojs_cleanup_done;
+	/* not bitfields, they are set by different threads */
+	int			ojs_cleanup_started;
+	int			ojs_cleanup_stop;
+	int			ojs_cleanup_kicked;
 };
 
 #ifdef LPROCFS
@@ -491,16 +551,28 @@ static inline void lprocfs_stats_unlock(struct lprocfs_stats *stats, int opc,
 	}
 }
 
+/* histograms follow the counters in each percpu area */
 static inline unsigned int
-lprocfs_stats_counter_size(struct lprocfs_stats *stats)
+lprocfs_stats_hist_offset(struct lprocfs_stats *stats)
 {
-	unsigned int percpusize;
+	unsigned int offset;
 
-	percpusize = offsetof(struct lprocfs_percpu, lp_cntr[stats->ls_num]);
+	offset = offsetof(struct lprocfs_percpu, lp_cntr[stats->ls_num]);
 
 	/* irq safe stats need lc_array_sum[1] */
 	if ((stats->ls_flags & LPROCFS_STATS_FLAG_IRQ_SAFE) != 0)
-		percpusize += stats->ls_num * sizeof(__s64);
+		offset += stats->ls_num * sizeof(__s64);
+
+	return offset;
+}
+
+static inline unsigned int
+lprocfs_stats_counter_size(struct lprocfs_stats *stats)
+{
+	unsigned int percpusize;
+
+	percpusize = lprocfs_stats_hist_offset(stats) +
+		     stats->ls_hist_num * OBD_HIST_MAX * sizeof(__u64);
 
 	if ((stats->ls_flags & LPROCFS_STATS_FLAG_NOPERCPU) == 0)
 		percpusize = L1_CACHE_ALIGN(percpusize);
@@ -522,6 +594,28 @@ lprocfs_stats_counter_get(struct lprocfs_stats *stats, unsigned int cpuid,
 	return cntr;
 }
 
+/* OBD_HIST_MAX log2 buckets of LPROCFS_CNTR_HISTOGRAM counter \a index */
+static inline __u64 *
+lprocfs_stats_hist_get(struct lprocfs_stats *stats, unsigned int cpuid,
+		       int index)
+{
+	unsigned int slot = stats->ls_cnt_header[index].lc_hist;
+
+	LASSERT(slot < stats->ls_hist_used);
+	return (void *)stats->ls_percpu[cpuid] +
+	       lprocfs_stats_hist_offset(stats) +
+	       slot * OBD_HIST_MAX * sizeof(__u64);
+}
+
+/* log2 bucket of \a amount, as lprocfs_oh_tally_log2() */
+static inline unsigned int lprocfs_hist_bucket(long amount)
+{
+	if (amount <= 1)
+		return 0;
+
+	return min_t(unsigned int, fls64(amount) - 1, OBD_HIST_MAX - 1);
+}
+
 /* Two optimized LPROCFS counter increment functions are provided:
  *     lprocfs_counter_incr(cntr, value) - optimized for by-one counters
  *     lprocfs_counter_add(cntr) - use for multi-valued counters
@@ -569,6 +663,9 @@ static inline __u64 lprocfs_stats_collector(struct lprocfs_stats *stats,
 
 extern struct lprocfs_stats *
 lprocfs_alloc_stats(unsigned int num, enum lprocfs_stats_flags flags);
+extern struct lprocfs_stats *
+lprocfs_alloc_stats_hist(unsigned int num, unsigned int nhist,
+			 enum lprocfs_stats_flags flags);
 extern void lprocfs_clear_stats(struct lprocfs_stats *stats);
 extern void lprocfs_free_stats(struct lprocfs_stats **stats);
 extern void lprocfs_init_ops_stats(int num_private_stats,
@@ -733,9 +830,31 @@ void lprocfs_oh_tally(struct obd_histogram *oh, unsigned int value);
 void lprocfs_oh_tally_log2(struct obd_histogram *oh, unsigned int value);
 void lprocfs_oh_clear(struct obd_histogram *oh);
 unsigned long lprocfs_oh_sum(struct obd_histogram *oh);
+unsigned long lprocfs_oh_log2_percentile(struct obd_histogram *oh,
+					 unsigned long tot,
+					 unsigned int permille);
+
+struct lprocfs_rpc_lat *lprocfs_rpc_lat_alloc(void);
+void lprocfs_rpc_lat_free(struct lprocfs_rpc_lat *lat);
+void lprocfs_rpc_lat_clear(struct lprocfs_rpc_lat *lat);
+void lprocfs_rpc_lat_collect(struct lprocfs_rpc_lat *lat, int idx,
+			     enum lprocfs_rpc_lat_phase phase,
+			     struct obd_histogram *oh);
+void lprocfs_rpc_lat_tally(struct lprocfs_rpc_lat *lat, __u32 opc,
+			   enum lprocfs_rpc_lat_phase phase, long usec);
 
 void lprocfs_stats_collect(struct lprocfs_stats *stats, int idx,
                            struct lprocfs_counter *cnt);
+void lprocfs_stats_collect_hist(struct lprocfs_stats *stats, int idx,
+				__u64 *buckets);
+
+size_t lprocfs_stats_snapshot_size(struct lprocfs_stats *stats,
+				   const char *path);
+size_t lprocfs_stats_snapshot_copy(struct lprocfs_stats *stats,
+				   const char *path, char *buf);
+void lprocfs_snapshot_header_init(struct lprocfs_snapshot_header *lsh,
+				  int nstats, size_t size, struct timeval *tv);
+extern struct file_operations lprocfs_stats_snapshot_fops;
 
 #ifdef HAVE_SERVER_SUPPORT
 /* lprocfs_status.c: recovery status */
@@ -842,6 +961,10 @@ int lprocfs_job_interval_seq_show(struct seq_file *m, void *data);
 ssize_t
 lprocfs_job_interval_seq_write(struct file *file, const char *buffer,
 				size_t count, loff_t *off);
+int lprocfs_job_max_mb_seq_show(struct seq_file *m, void *data);
+ssize_t
+lprocfs_job_max_mb_seq_write(struct file *file, const char *buffer,
+			     size_t count, loff_t *off);
 /* lproc_status.c */
 int lprocfs_recovery_time_soft_seq_show(struct seq_file *m, void *data);
 ssize_t lprocfs_recovery_time_soft_seq_write(struct file *file,
@@ -953,6 +1076,10 @@ static inline __u64 lc_read_helper(struct lprocfs_counter *lc,
 static inline struct lprocfs_stats *
 lprocfs_alloc_stats(unsigned int num, enum lprocfs_stats_flags flags)
 { return (struct lprocfs_stats *)1; }
+static inline struct lprocfs_stats *
+lprocfs_alloc_stats_hist(unsigned int num, unsigned int nhist,
+			 enum lprocfs_stats_flags flags)
+{ return (struct lprocfs_stats *)1; }
 static inline void lprocfs_clear_stats(struct lprocfs_stats *stats)
 { return; }
 static inline void lprocfs_free_stats(struct lprocfs_stats **stats)
@@ -1124,10 +1251,32 @@ static inline
 unsigned long lprocfs_oh_sum(struct obd_histogram *oh)
 { return 0; }
 static inline
+unsigned long lprocfs_oh_log2_percentile(struct obd_histogram *oh,
+					 unsigned long tot,
+					 unsigned int permille)
+{ return 0; }
+static inline
+struct lprocfs_rpc_lat *lprocfs_rpc_lat_alloc(void)
+{ return NULL; }
+static inline
+void lprocfs_rpc_lat_free(struct lprocfs_rpc_lat *lat)
+{ return; }
+static inline
+void lprocfs_rpc_lat_clear(struct lprocfs_rpc_lat *lat)
+{ return; }
+static inline
+void lprocfs_rpc_lat_tally(struct lprocfs_rpc_lat *lat, __u32 opc,
+			   enum lprocfs_rpc_lat_phase phase, long usec)
+{ return; }
+static inline
 void lprocfs_stats_collect(struct lprocfs_stats *stats, int idx,
                            struct lprocfs_counter *cnt)
 { return; }
 static inline
+void lprocfs_stats_collect_hist(struct lprocfs_stats *stats, int idx,
+				__u64 *buckets)
+{ return; }
+static inline
 __u64 lprocfs_stats_collector(struct lprocfs_stats *stats, int idx,
                                enum lprocfs_fields_flags field)
 { return (__u64)0; }
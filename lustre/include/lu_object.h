@@ -83,9 +83,9 @@ struct lprocfs_stats;
  *     count drops to 0, object is returned to cache. Cached objects still
  *     retain their identity (i.e., fid), and can be recovered from cache.
  *
- *     Objects are kept in the global LRU list, and lu_site_purge() function
- *     can be used to reclaim given number of unused objects from the tail of
- *     the LRU.
+ *     Objects are kept in per-CPT LRU lists, and lu_site_purge() function
+ *     can be used to reclaim given number of unused objects from the cold
+ *     ends of the LRUs.
  *
  * -# avoiding recursion.
  *
@@ -495,6 +495,12 @@ enum lu_object_header_flags {
 	 * Mark this object has already been taken out of cache.
 	 */
 	LU_OBJECT_UNHASHED = 1,
+	/**
+	 * Object was used again while on the LRU list. lu_site_purge() clears
+	 * it and gives the object another round on the list instead of
+	 * freeing it.
+	 */
+	LU_OBJECT_REFERENCED = 2,
 };
 
 enum lu_object_header_attr {
@@ -542,9 +548,14 @@ struct lu_object_header {
 	 */
 	struct hlist_node	loh_hash;
 	/**
-	 * Linkage into per-site LRU list. Protected by lu_site::ls_guard.
+	 * Linkage into per-site LRU list. Protected by lu_site_lru::lsl_lock
+	 * of lu_site::ls_lru[loh_lru_cpt].
 	 */
 	struct list_head	loh_lru;
+	/**
+	 * CPT of the LRU list the object is kept on, set on creation.
+	 */
+	int			loh_lru_cpt;
 	/**
 	 * Linkage into list of layers. Never modified once set (except lately
 	 * during object destruction). No locking is necessary.
@@ -559,19 +570,6 @@ struct lu_object_header {
 struct fld;
 
 struct lu_site_bkt_data {
-	/**
-	 * number of busy object on this bucket
-	 */
-	long			lsb_busy;
-	/**
-	 * LRU list, updated on each access to object. Protected by
-	 * bucket lock of lu_site::ls_obj_hash.
-	 *
-	 * "Cold" end of LRU is lu_site::ls_lru.next. Accessed object are
-	 * moved to the lu_site::ls_lru.prev (this is due to the non-existence
-	 * of list_for_each_entry_safe_reverse()).
-	 */
-	struct list_head	lsb_lru;
 	/**
 	 * Wait-queue signaled when an object in this site is ultimately
 	 * destroyed (lu_object_free()). It is used by lu_object_find() to
@@ -583,6 +581,27 @@ struct lu_site_bkt_data {
 	wait_queue_head_t	lsb_marche_funebre;
 };
 
+/**
+ * Per-CPT LRU list of unreferenced objects of a site.
+ *
+ * Objects are queued by the last lu_object_put() and aged in batches by
+ * lu_site_purge(): cache hits don't touch the list, so an object can stay
+ * queued while it's referenced again, and is dropped from the list by the
+ * next purge.
+ */
+struct lu_site_lru {
+	spinlock_t		lsl_lock;
+	/**
+	 * "Cold" end of LRU is lsl_list.next, objects are queued at
+	 * lsl_list.prev.
+	 */
+	struct list_head	lsl_list;
+	/**
+	 * number of objects on lsl_list
+	 */
+	long			lsl_nr;
+};
+
 enum {
         LU_SS_CREATED         = 0,
         LU_SS_CACHE_HIT,
@@ -608,8 +627,16 @@ struct lu_site {
          * objects hash table
          */
 	cfs_hash_t		*ls_obj_hash;
+	/**
+	 * per-CPT LRU lists, see struct lu_site_lru
+	 */
+	struct lu_site_lru	**ls_lru;
+	/**
+	 * wait-queues for dying objects, indexed by fid hash
+	 */
+	struct lu_site_bkt_data	*ls_bkts;
         /**
-         * index of bucket on hash table while purging
+         * index of LRU list to start with while purging
          */
 	int			ls_purge_start;
 	/**
@@ -644,15 +671,6 @@ struct lu_site {
 	struct seq_server_site	*ld_seq_site;
 };
 
-static inline struct lu_site_bkt_data *
-lu_site_bkt_from_fid(struct lu_site *site, struct lu_fid *fid)
-{
-        cfs_hash_bd_t bd;
-
-        cfs_hash_bd_get(site->ls_obj_hash, fid, &bd);
-        return cfs_hash_bd_extra_get(site->ls_obj_hash, &bd);
-}
-
 static inline struct seq_server_site *lu_site2seq(const struct lu_site *s)
 {
 	return s->ld_seq_site;
@@ -721,6 +739,8 @@ void lu_object_put_nocache(const struct lu_env *env, struct lu_object *o);
 void lu_object_unhash(const struct lu_env *env, struct lu_object *o);
 
 int lu_site_purge(const struct lu_env *env, struct lu_site *s, int nr);
+struct lu_site_bkt_data *lu_site_bkt_from_fid(struct lu_site *site,
+					      struct lu_fid *fid);
 
 void lu_site_print(const struct lu_env *env, struct lu_site *s, void *cookie,
                    lu_printer_t printer);
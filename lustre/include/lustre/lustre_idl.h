@@ -1150,6 +1150,8 @@ static inline void lustre_handle_copy(struct lustre_handle *tgt,
 	tgt->cookie = src->cookie;
 }
 
+extern void lustre_swab_lustre_handle(struct lustre_handle *lh);
+
 /* flags for lm_flags */
 #define MSGHDR_AT_SUPPORT               0x1
 #define MSGHDR_CKSUM_INCOMPAT18         0x2
@@ -1191,8 +1193,10 @@ struct ptlrpc_body_v3 {
 	__u64 pb_slv;
 	/* VBR: pre-versions */
 	__u64 pb_pre_versions[PTLRPC_NUM_VERSIONS];
+	/* for a replay, the transno of the previous one the client sent */
+	__u64 pb_prev_transno;
 	/* padding for future needs */
-	__u64 pb_padding[4];
+	__u64 pb_padding[3];
 	char  pb_jobid[JOBSTATS_JOBID_SIZE];
 };
 #define ptlrpc_body     ptlrpc_body_v3
@@ -1217,8 +1221,10 @@ struct ptlrpc_body_v2 {
         __u64 pb_slv;
         /* VBR: pre-versions */
         __u64 pb_pre_versions[PTLRPC_NUM_VERSIONS];
+	/* for a replay, the transno of the previous one the client sent */
+	__u64 pb_prev_transno;
         /* padding for future needs */
-        __u64 pb_padding[4];
+        __u64 pb_padding[3];
 };
 
 extern void lustre_swab_ptlrpc_body(struct ptlrpc_body *pb);
@@ -3436,6 +3442,9 @@ enum llog_flag {
 	LLOG_F_ZAP_WHEN_EMPTY	= 0x1,
 	LLOG_F_IS_CAT		= 0x2,
 	LLOG_F_IS_PLAIN		= 0x4,
+	/* catalog whose plain logs were appended to concurrently, records
+	 * aren't ordered across them, see llog_cat_set_slots() */
+	LLOG_F_MULTI_SLOT	= 0x8,
 };
 
 struct llog_log_hdr {
@@ -1257,6 +1257,55 @@ struct llapi_json_item_list {
 	struct llapi_json_item	*ljil_items;
 };
 
+/*
+ * Binary snapshot of all registered lprocfs stats files, as read from
+ * /proc/fs/lustre/stats_snapshot. It starts with a lprocfs_snapshot_header,
+ * followed by lsh_nstats blocks, each a lprocfs_snapshot_stats followed by
+ * its lss_ncounters lprocfs_snapshot_counter records. Every record is 8-byte
+ * aligned and carries its size, so readers can skip fields they don't know.
+ */
+#define LPROCFS_SNAPSHOT_MAGIC		0x4c505353	/* "LPSS" */
+#define LPROCFS_SNAPSHOT_VERSION	1
+
+struct lprocfs_snapshot_header {
+	__u32	lsh_magic;
+	__u32	lsh_version;
+	__u32	lsh_header_size;	/* sizeof(lprocfs_snapshot_header) */
+	__u32	lsh_stats_size;		/* sizeof(lprocfs_snapshot_stats) */
+	__u32	lsh_counter_size;	/* sizeof(lprocfs_snapshot_counter) */
+	__u32	lsh_hist_buckets;	/* # buckets of histogram counters */
+	__u32	lsh_nstats;		/* # stats blocks */
+	__u32	lsh_padding;
+	__u64	lsh_size;		/* size of the whole snapshot */
+	__u64	lsh_time_sec;		/* when it was taken */
+	__u64	lsh_time_usec;
+};
+
+struct lprocfs_snapshot_stats {
+	__u32	lss_size;		/* size of the block and its counters */
+	__u32	lss_ncounters;
+	__u32	lss_path_size;		/* size of lss_path, with padding */
+	__u32	lss_padding;
+	char	lss_path[0];		/* stats file, relative to /proc */
+};
+
+struct lprocfs_snapshot_counter {
+	__u32	lsc_size;		/* size of the record and its data */
+	__u32	lsc_config;		/* LPROCFS_CNTR_* | LPROCFS_TYPE_* */
+	__u32	lsc_index;		/* index of the counter in its stats */
+	__u32	lsc_names_size;		/* size of the names, with padding */
+	__s64	lsc_count;
+	__s64	lsc_min;
+	__s64	lsc_max;
+	__s64	lsc_sum;
+	__s64	lsc_sumsquare;
+	/* lsh_hist_buckets log2 buckets, if lsc_config has
+	 * LPROCFS_CNTR_HISTOGRAM (0x0008): bucket i counts the samples in
+	 * [2^i, 2^(i+1)), bucket 0 also those <= 0. They're followed by the
+	 * "name\0units\0" of the counter. */
+	__u64	lsc_data[0];
+};
+
 /** @} lustreuser */
 
 #endif /* _LUSTRE_USER_H */
@@ -213,6 +213,16 @@ struct obd_export {
 	cfs_time_t		exp_last_request_time;
 	/** On replay all requests waiting for replay are linked here */
 	struct list_head	exp_req_replay_queue;
+	/**
+	 * Number of requests of this export on obd_req_replay_queue,
+	 * protected by obd_recovery_task_lock
+	 */
+	int			exp_req_replay_queued;
+	/**
+	 * Last gap check which found the lowest queued replay of this
+	 * export, protected by obd_recovery_task_lock
+	 */
+	__u64			exp_req_replay_check;
 	/**
 	 * protects exp_flags, exp_outstanding_replies and the change
 	 * of exp_imp_reverse
@@ -78,6 +78,8 @@ struct ptlrpc_at_array {
         __u32            *paa_reqs_count; /** the count of reqs in each entry */
 };
 
+struct lprocfs_rpc_lat;
+
 #define IMP_AT_MAX_PORTALS 8
 struct imp_at {
         int                     iat_portal[IMP_AT_MAX_PORTALS];
@@ -232,6 +234,13 @@ struct obd_import {
         int                       imp_last_generation_checked;
         /** Last tranno we replayed */
         __u64                     imp_last_replay_transno;
+	/** Last transno sent for replay, may be ahead of the replayed one */
+	__u64			  imp_replay_sent_transno;
+	/**
+	 * Replays up to this transno were sent before a reconnect and have
+	 * to be marked as resent
+	 */
+	__u64			  imp_replay_resend_transno;
         /** Last transno committed on remote side */
         __u64                     imp_peer_committed_transno;
         /**
@@ -297,7 +306,9 @@ struct obd_import {
 				   * chouse new connection */
 				  imp_force_reconnect:1,
 				  /* import has tried to connect with server */
-				  imp_connect_tried:1;
+				  imp_connect_tried:1,
+				  /* server can't handle batched pings */
+				  imp_no_ping_batch:1;
         __u32                     imp_connect_op;
         struct obd_connect_data   imp_connect_data;
         __u64                     imp_connect_flags_orig;
@@ -310,6 +321,8 @@ struct obd_import {
 
         struct imp_at             imp_at;                 /* adaptive timeout data */
         time_t                    imp_last_reply_time;    /* for health check */
+	/** per-opcode RPC latency histograms */
+	struct lprocfs_rpc_lat	 *imp_rpc_lat;
 };
 
 /* import.c */
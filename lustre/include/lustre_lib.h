@@ -73,6 +73,8 @@ void target_stop_recovery_thread(struct obd_device *obd);
 void target_cleanup_recovery(struct obd_device *obd);
 int target_queue_recovery_request(struct ptlrpc_request *req,
                                   struct obd_device *obd);
+void target_replay_commit_add(struct obd_device *obd, __u64 transno);
+__u64 target_replay_committed(struct obd_device *obd, __u64 transno);
 int target_bulk_io(struct obd_export *exp, struct ptlrpc_bulk_desc *desc,
                    struct l_wait_info *lwi);
 #endif
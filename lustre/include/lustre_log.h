@@ -76,10 +76,20 @@ struct plain_handle_data {
 	struct llog_cookie	phd_cookie;
 };
 
+/* plain llog a catalog is appended to, see llog_cat_set_slots() */
+struct llog_cat_slot {
+	struct llog_handle     *lcs_current_log;/* currently open log */
+	struct llog_handle     *lcs_next_log;	/* llog to be used next */
+};
+
 struct cat_handle_data {
-	struct list_head	chd_head;
-	struct llog_handle     *chd_current_log;/* currently open log */
-	struct llog_handle     *chd_next_log;	/* llog to be used next */
+	struct list_head	 chd_head;
+	struct llog_cat_slot	*chd_slots;	/* &chd_slot unless set up
+						 * by llog_cat_set_slots() */
+	int			 chd_nslots;
+	struct llog_cat_slot	 chd_slot;
+	/* serializes the appends of new plain llogs to the catalog */
+	struct mutex		 chd_mutex;
 };
 
 static inline void logid_to_fid(struct llog_logid *id, struct lu_fid *fid)
@@ -174,6 +184,7 @@ struct llog_process_cat_data {
 };
 
 int llog_cat_close(const struct lu_env *env, struct llog_handle *cathandle);
+int llog_cat_set_slots(struct llog_handle *cathandle, int nslots);
 int llog_cat_add_rec(const struct lu_env *env, struct llog_handle *cathandle,
 		     struct llog_rec_hdr *rec, struct llog_cookie *reccookie,
 		     struct thandle *th);
@@ -190,6 +201,11 @@ int llog_cat_process_or_fork(const struct lu_env *env,
 			     void *data, int startcat, int startidx, bool fork);
 int llog_cat_process(const struct lu_env *env, struct llog_handle *cat_llh,
 		     llog_cb_t cb, void *data, int startcat, int startidx);
+/* key records are sorted by in llog_cat_process_sorted() */
+typedef __u64 (*llog_key_cb_t)(struct llog_rec_hdr *rec);
+int llog_cat_process_sorted(const struct lu_env *env,
+			    struct llog_handle *cat_llh, llog_cb_t cb,
+			    llog_key_cb_t key, void *data);
 int llog_cat_reverse_process(const struct lu_env *env,
 			     struct llog_handle *cat_llh, llog_cb_t cb,
 			     void *data);
@@ -383,6 +399,17 @@ static inline int llog_get_size(struct llog_handle *loghandle)
 	return 0;
 }
 
+/**
+ * Whether the records of catalog \a cathandle may be out of order across
+ * its plain logs, because several of them are or were appended to
+ * concurrently, possibly before the catalog was last opened.
+ */
+static inline bool llog_cat_is_multi_slot(struct llog_handle *cathandle)
+{
+	return cathandle->u.chd.chd_nslots > 1 ||
+	       (cathandle->lgh_hdr->llh_flags & LLOG_F_MULTI_SLOT);
+}
+
 static inline struct llog_ctxt *llog_ctxt_get(struct llog_ctxt *ctxt)
 {
 	atomic_inc(&ctxt->loc_refcount);
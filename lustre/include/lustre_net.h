@@ -659,6 +659,7 @@ struct ptlrpc_reply_state {
         unsigned long          rs_handled:1;  /* been handled yet? */
         unsigned long          rs_on_net:1;   /* reply_out_callback pending? */
         unsigned long          rs_prealloc:1; /* rs from prealloc list */
+        unsigned long          rs_pooled:1;   /* rs from svcpt rs pool */
         unsigned long          rs_committed:1;/* the transaction was committed
                                                  and the rs was dispatched
                                                  by ptlrpc_commit_replies */
@@ -668,6 +669,8 @@ struct ptlrpc_reply_state {
         __u32                  rs_opc;
         /** Transaction number */
         __u64                  rs_transno;
+	/** time the reply was sent, for commit latency */
+	struct timeval		rs_sent_time;
         /** xid */
         __u64                  rs_xid;
 	struct obd_export     *rs_export;
@@ -1691,6 +1694,7 @@ struct nrs_orr_req {
 /** @} ORR/TRR */
 
 #include <lustre_nrs_tbf.h>
+#include <lustre_nrs_edf.h>
 
 /**
  * NRS request
@@ -1737,6 +1741,10 @@ struct ptlrpc_nrs_request {
 		 * TBF request definition
 		 */
 		struct nrs_tbf_req	tbf;
+		/**
+		 * EDF request definition
+		 */
+		struct nrs_edf_req	edf;
 	} nr_u;
 	/**
 	 * Externally-registering policies may want to use this to allocate
@@ -1966,6 +1974,11 @@ struct ptlrpc_request {
         /* server-side... */
         /** request arrival time */
         struct timeval       rq_arrival_time;
+	/**
+	 * client-side latency accounting: time the request was queued for
+	 * sending, then time its reply arrived until it is committed
+	 */
+	struct timeval		rq_lat_stamp;
         /** separated reply state */
         struct ptlrpc_reply_state *rq_reply_state;
         /** incoming request buffer */
@@ -2505,6 +2518,8 @@ struct ptlrpc_service {
 	struct proc_dir_entry           *srv_procroot;
         /** Pointer to statistic data for this service */
         struct lprocfs_stats           *srv_stats;
+	/** per-opcode RPC latency histograms */
+	struct lprocfs_rpc_lat		*srv_rpc_lat;
         /** # hp per lp reqs to handle */
         int                             srv_hpreq_ratio;
         /** biggest request to receive */
@@ -2528,6 +2543,10 @@ struct ptlrpc_service {
         int                             srv_watchdog_factor;
         /** under unregister_service */
         unsigned                        srv_is_stopping:1;
+	/** adaptive thread controller is enabled */
+	int				srv_thrctl_enable;
+	/** queue wait target of the thread controller, in usec */
+	int				srv_thrctl_wait_target;
 
 	/** max # request buffers in history per partition */
 	int				srv_hist_nrqbds_cpt_max;
@@ -2545,6 +2564,93 @@ struct ptlrpc_service {
 	struct ptlrpc_service_part	*srv_parts[0];
 };
 
+/**
+ * Thread controller decisions, see ptlrpc_thrctl_check()
+ */
+enum ptlrpc_thrctl_decision {
+	PTLRPC_THRCTL_HOLD = 0,
+	PTLRPC_THRCTL_GROW,
+	PTLRPC_THRCTL_SHRINK,
+	/** queueing, but the CPUs are saturated and nobody waits on I/O */
+	PTLRPC_THRCTL_CPU_BOUND,
+};
+
+/**
+ * Adaptive thread controller state of a service partition.
+ *
+ * Request wait time, handling time and handler CPU time are summed over a
+ * sampling window; at the end of each window the target number of threads
+ * is raised when requests wait longer than the target and the handlers are
+ * not CPU bound, and lowered when threads idle.
+ */
+struct ptlrpc_thrctl {
+	/** serialize the fields below */
+	spinlock_t			tc_lock;
+	/** start of the current window, in nsec */
+	__u64				tc_window_start;
+	/** # requests handled in the current window */
+	__u64				tc_nreqs;
+	/** total queue wait of these requests, in usec */
+	__u64				tc_wait_sum;
+	/** total wall-clock handling time of these requests, in usec */
+	__u64				tc_handle_sum;
+	/** total handler CPU time of these requests, in usec */
+	__u64				tc_cpu_sum;
+	/** target # of threads */
+	int				tc_target;
+	/** average queue wait over the last window, in usec */
+	__u64				tc_last_wait;
+	/** average # of threads handling requests, x100 */
+	unsigned int			tc_last_busy;
+	/** average # of handling threads on a CPU, x100 */
+	unsigned int			tc_last_oncpu;
+	/** average # of handling threads blocked (in I/O, journal), x100 */
+	unsigned int			tc_last_blocked;
+	/** request rate over the last window, per second */
+	__u64				tc_last_rate;
+	/** last decision taken */
+	enum ptlrpc_thrctl_decision	tc_last_decision;
+	/** # windows that raised/lowered the target */
+	unsigned long			tc_ngrow;
+	unsigned long			tc_nshrink;
+	/** # threads stopped because the pool was over the target */
+	unsigned long			tc_nexited;
+};
+
+/**
+ * Per-partition caches of request descriptors and reply states.
+ *
+ * Descriptors of incoming requests are taken from and returned to this cache
+ * rather than the global slab, and reply states up to \a sp_rs_size bytes are
+ * recycled the same way; both are allocated on the CPT of the partition.
+ */
+struct ptlrpc_svc_pool {
+	/** serialize the fields below */
+	spinlock_t			sp_lock;
+	/** cached request descriptors */
+	struct list_head		sp_reqs;
+	/** # cached request descriptors */
+	int				sp_nreqs;
+	/** max # cached request descriptors */
+	int				sp_nreqs_max;
+	/** cached reply states */
+	struct list_head		sp_rss;
+	/** # cached reply states */
+	int				sp_nrss;
+	/** max # cached reply states */
+	int				sp_nrss_max;
+	/** size of a cached reply state */
+	int				sp_rs_size;
+	/** # request descriptors allocated from/past the cache */
+	unsigned long			sp_req_hits;
+	unsigned long			sp_req_misses;
+	/** # reply states allocated from/past the cache */
+	unsigned long			sp_rs_hits;
+	unsigned long			sp_rs_misses;
+	/** # reply states too large for the cache */
+	unsigned long			sp_rs_large;
+};
+
 /**
  * Definition of PortalRPC service partition data.
  * Although a service only has one instance of it right now, but we
@@ -2572,12 +2678,16 @@ struct ptlrpc_service_part {
 	int				scp_thr_nextid;
 	/** # of starting threads */
 	int				scp_nthrs_starting;
-	/** # of stopping threads, reserved for shrinking threads */
+	/** # of threads stopping because the pool is shrinking */
 	int				scp_nthrs_stopping;
 	/** # running threads */
 	int				scp_nthrs_running;
 	/** service threads list */
 	struct list_head		scp_threads;
+	/** adaptive thread controller */
+	struct ptlrpc_thrctl		scp_thrctl;
+	/** request descriptor and reply state caches */
+	struct ptlrpc_svc_pool		scp_pool;
 
 	/**
 	 * serialize the following fields, used for protecting
@@ -2601,6 +2711,17 @@ struct ptlrpc_service_part {
 	struct list_head		scp_req_incoming;
 	/** timeout before re-posting reqs, in tick */
 	cfs_duration_t			scp_rqbd_timeout;
+	/** # request buffers filled up in the current window */
+	int				scp_rqbd_filled;
+	/** start of the current arrival rate window, in seconds */
+	cfs_time_t			scp_rqbd_window;
+	/** # request buffers to keep posted, from the arrival rate */
+	int				scp_rqbd_want;
+	/** # request buffers filled up per second in the last window */
+	int				scp_rqbd_rate;
+	/** # request buffers allocated/freed on the fly */
+	unsigned long			scp_rqbd_ngrow;
+	unsigned long			scp_rqbd_nshrink;
 	/**
 	 * all threads sleep on this. This wait-queue is signalled when new
 	 * incoming request arrives and when difficult reply has to be handled.
@@ -3131,6 +3252,8 @@ int lustre_pack_reply_flags(struct ptlrpc_request *, int count, __u32 *lens,
 int lustre_shrink_msg(struct lustre_msg *msg, int segment,
                       unsigned int newlen, int move_data);
 void lustre_free_reply_state(struct ptlrpc_reply_state *rs);
+struct ptlrpc_reply_state *
+lustre_get_pool_rs(struct ptlrpc_request *req, int rs_size);
 int __lustre_unpack_msg(struct lustre_msg *m, int len);
 int lustre_msg_hdr_size(__u32 magic, int count);
 int lustre_msg_size(__u32 magic, int count, __u32 *lengths);
@@ -3161,6 +3284,7 @@ __u64 lustre_msg_get_last_xid(struct lustre_msg *msg);
 __u64 lustre_msg_get_last_committed(struct lustre_msg *msg);
 __u64 *lustre_msg_get_versions(struct lustre_msg *msg);
 __u64 lustre_msg_get_transno(struct lustre_msg *msg);
+__u64 lustre_msg_get_prev_transno(struct lustre_msg *msg);
 __u64 lustre_msg_get_slv(struct lustre_msg *msg);
 __u32 lustre_msg_get_limit(struct lustre_msg *msg);
 void lustre_msg_set_slv(struct lustre_msg *msg, __u64 slv);
@@ -3172,6 +3296,7 @@ __u32 lustre_msg_get_magic(struct lustre_msg *msg);
 __u32 lustre_msg_get_timeout(struct lustre_msg *msg);
 __u32 lustre_msg_get_service_time(struct lustre_msg *msg);
 char *lustre_msg_get_jobid(struct lustre_msg *msg);
+int ptlrpc_req_get_ugid(struct ptlrpc_request *req, __u32 *uid, __u32 *gid);
 __u32 lustre_msg_get_cksum(struct lustre_msg *msg);
 #if LUSTRE_VERSION_CODE < OBD_OCD_VERSION(2, 7, 53, 0)
 __u32 lustre_msg_calc_cksum(struct lustre_msg *msg, int compat18);
@@ -3185,6 +3310,7 @@ void lustre_msg_set_last_xid(struct lustre_msg *msg, __u64 last_xid);
 void lustre_msg_set_last_committed(struct lustre_msg *msg,__u64 last_committed);
 void lustre_msg_set_versions(struct lustre_msg *msg, __u64 *versions);
 void lustre_msg_set_transno(struct lustre_msg *msg, __u64 transno);
+void lustre_msg_set_prev_transno(struct lustre_msg *msg, __u64 transno);
 void lustre_msg_set_status(struct lustre_msg *msg, __u32 status);
 void lustre_msg_set_conn_cnt(struct lustre_msg *msg, __u32 conn_cnt);
 void ptlrpc_req_set_repsize(struct ptlrpc_request *req, int count, __u32 *sizes);
@@ -3498,6 +3624,7 @@ void ptlrpcd_decref(void);
  * @{
  */
 const char* ll_opcode2str(__u32 opcode);
+int ll_str2opcode(const char *ops);
 #ifdef LPROCFS
 void ptlrpc_lprocfs_register_obd(struct obd_device *obd);
 void ptlrpc_lprocfs_unregister_obd(struct obd_device *obd);
@@ -0,0 +1,187 @@
+/*
+ * GPL HEADER START
+ *
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 only,
+ * as published by the Free Software Foundation.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.  A copy is
+ * included in the COPYING file that accompanied this code.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * GPL HEADER END
+ */
+/*
+ *
+ * Network Request Scheduler (NRS) Earliest Deadline First (EDF) policy
+ *
+ */
+
+#ifndef _LUSTRE_NRS_EDF_H
+#define _LUSTRE_NRS_EDF_H
+#include <lustre_net.h>
+
+/* \name edf
+ *
+ * EDF policy
+ *
+ * RPCs are sorted into latency classes by jobid, uid, client NID or opcode;
+ * each class carries a queueing latency target, and requests are dispatched
+ * in order of their deadline, i.e. arrival time plus the target of the class
+ * they belong to.
+ *
+ * @{
+ */
+
+struct nrs_edf_head;
+
+#define MAX_EDF_NAME		(16)
+
+#define NEC_STOPPING		0x0000001
+#define NEC_DEFAULT		0x0000002
+
+/**
+ * Request attribute a latency class is matched against.
+ */
+enum nrs_edf_key {
+	NRS_EDF_KEY_ANY = 0,
+	NRS_EDF_KEY_JOBID,
+	NRS_EDF_KEY_NID,
+	NRS_EDF_KEY_UID,
+	NRS_EDF_KEY_OPCODE,
+};
+
+#define NRS_EDF_KEY_JOBID_STR	"jobid"
+#define NRS_EDF_KEY_NID_STR	"nid"
+#define NRS_EDF_KEY_UID_STR	"uid"
+#define NRS_EDF_KEY_OPCODE_STR	"opcode"
+
+/**
+ * An element of the id list of a jobid, uid or opcode class.
+ */
+struct nrs_edf_id {
+	struct list_head	ei_linkage;
+	/** Numerical value for uid and opcode classes. */
+	__u32			ei_num;
+	/** Jobid string for jobid classes. */
+	char		       *ei_str;
+};
+
+struct nrs_edf_class {
+	/** Resource object for requests of this class. */
+	struct ptlrpc_nrs_resource	 ec_res;
+	/** Name of the class. */
+	char				 ec_name[MAX_EDF_NAME];
+	/** Head belongs to. */
+	struct nrs_edf_head		*ec_head;
+	/** Linkage to head. */
+	struct list_head		 ec_linkage;
+	/** Request attribute this class matches on. */
+	enum nrs_edf_key		 ec_key;
+	/** Id list string of the class, as given by the user. */
+	char				*ec_ids_str;
+	/** Parsed jobid, uid or opcode list. */
+	struct list_head		 ec_ids;
+	/** Parsed NID list. */
+	struct list_head		 ec_nids;
+	/** Queueing latency target, in microseconds. */
+	__u64				 ec_target;
+	/** Flags of the class. */
+	__u32				 ec_flags;
+	/** Usage reference count taken on the class. */
+	atomic_t			 ec_ref;
+	/** # requests of this class currently queued. */
+	unsigned long			 ec_queued;
+	/** # requests of this class dispatched so far. */
+	unsigned long			 ec_dispatched;
+	/** # requests dispatched after their deadline had passed. */
+	unsigned long			 ec_missed;
+	/** Queue delay histogram, log2 buckets in microseconds. */
+	struct obd_histogram		 ec_delay_hist;
+};
+
+/**
+ * Private data structure for the EDF policy
+ */
+struct nrs_edf_head {
+	/**
+	 * Resource object for policy instance.
+	 */
+	struct ptlrpc_nrs_resource	 eh_res;
+	/**
+	 * List of classes, newest first.
+	 */
+	struct list_head		 eh_list;
+	/**
+	 * Lock to protect the list of classes.
+	 */
+	spinlock_t			 eh_class_lock;
+	/**
+	 * Default class; matches all requests not matched by another class.
+	 */
+	struct nrs_edf_class		*eh_default;
+	/**
+	 * Heap of queued requests, ordered by deadline.
+	 */
+	cfs_binheap_t			*eh_binheap;
+	/**
+	 * Sequence of requests; breaks ties between equal deadlines.
+	 */
+	__u64				 eh_sequence;
+};
+
+enum nrs_edf_cmd_type {
+	NRS_CTL_EDF_START_CLASS = 0,
+	NRS_CTL_EDF_STOP_CLASS,
+	NRS_CTL_EDF_CHANGE_TARGET,
+};
+
+struct nrs_edf_cmd {
+	enum nrs_edf_cmd_type	 ec_cmd;
+	char			*ec_name;
+	enum nrs_edf_key	 ec_key;
+	char			*ec_ids_str;
+	/** Queueing latency target, in microseconds. */
+	__u64			 ec_target;
+	__u32			 ec_class_flags;
+};
+
+struct nrs_edf_req {
+	/**
+	 * Absolute deadline of the request, in microseconds.
+	 */
+	__u64			er_deadline;
+	/**
+	 * Sequence of the request.
+	 */
+	__u64			er_sequence;
+};
+
+/**
+ * EDF policy operations.
+ */
+enum nrs_ctl_edf {
+	/**
+	 * Read the classes of an EDF policy.
+	 */
+	NRS_CTL_EDF_RD_CLASS = PTLRPC_NRS_CTL_1ST_POL_SPEC,
+	/**
+	 * Start, stop or change a class of an EDF policy.
+	 */
+	NRS_CTL_EDF_WR_CLASS,
+	/**
+	 * Read the queue delay histograms of an EDF policy.
+	 */
+	NRS_CTL_EDF_RD_STATS,
+};
+
+/** @} edf */
+#endif
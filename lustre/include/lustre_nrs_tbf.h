@@ -37,6 +37,11 @@
  *
  * TBF policy
  *
+ * Rules may be nested by naming a parent rule; the parent then also acts as
+ * an aggregate token bucket shared by all clients of its subtree. Clients
+ * that ran out of their own tokens may borrow from the aggregate buckets of
+ * their ancestors while these have tokens left unused by idle siblings.
+ *
  * @{
  */
 
@@ -48,6 +53,48 @@ struct nrs_tbf_jobid {
 	struct list_head tj_linkage;
 };
 
+/**
+ * An element of the opcode, uid or gid list of a generic rule condition.
+ */
+struct nrs_tbf_num {
+	__u32		 tn_num;
+	struct list_head tn_linkage;
+};
+
+/**
+ * Request fields a generic rule condition can be put on.
+ */
+enum nrs_tbf_field {
+	NRS_TBF_FIELD_NID,
+	NRS_TBF_FIELD_JOBID,
+	NRS_TBF_FIELD_OPCODE,
+	NRS_TBF_FIELD_UID,
+	NRS_TBF_FIELD_GID,
+};
+
+/**
+ * A condition of a generic rule, e.g. "opcode={mds_reint ldlm_enqueue}".
+ * A request matches a generic rule if it matches all of its conditions.
+ */
+struct nrs_tbf_cond {
+	enum nrs_tbf_field	tc_field;
+	/** NID list for NRS_TBF_FIELD_NID, nrs_tbf_jobid or nrs_tbf_num
+	 * list otherwise. */
+	struct list_head	tc_list;
+	struct list_head	tc_linkage;
+};
+
+/**
+ * Key of clients of the generic TBF type.
+ */
+struct nrs_tbf_key {
+	lnet_nid_t	tk_nid;
+	__u32		tk_opcode;
+	__u32		tk_uid;
+	__u32		tk_gid;
+	char		tk_jobid[JOBSTATS_JOBID_SIZE];
+};
+
 struct nrs_tbf_client {
 	/** Resource object for policy instance. */
 	struct ptlrpc_nrs_resource	 tc_res;
@@ -57,6 +104,8 @@ struct nrs_tbf_client {
 	lnet_nid_t			 tc_nid;
 	/** Jobid of the client. */
 	char				 tc_jobid[JOBSTATS_JOBID_SIZE];
+	/** Key of the client, for the generic type. */
+	struct nrs_tbf_key		 tc_key;
 	/** Reference number of the client. */
 	atomic_t			 tc_ref;
 	/** Likage to rule. */
@@ -75,8 +124,15 @@ struct nrs_tbf_client {
 	__u64				 tc_depth;
 	/** Time check-point. */
 	__u64				 tc_check_time;
+	/**
+	 * Time until which the client is held back because an ancestor
+	 * rule ran out of aggregate tokens.
+	 */
+	__u64				 tc_defer_until;
 	/** List of queued requests. */
 	struct list_head		 tc_list;
+	/** Number of queued requests. */
+	unsigned long			 tc_nqueued;
 	/** Node in binary heap. */
 	cfs_binheap_node_t		 tc_node;
 	/** Whether the client is in heap. */
@@ -110,6 +166,17 @@ struct nrs_tbf_rule {
 	struct list_head		 tr_jobids;
 	/** Jobid list string of the rule.*/
 	char				*tr_jobids_str;
+	/** Conditions of a generic rule. */
+	struct list_head		 tr_conds;
+	/** Condition string of a generic rule. */
+	char				*tr_conds_str;
+	/** Parent rule, NULL for top-level rules. */
+	struct nrs_tbf_rule		*tr_parent;
+	/**
+	 * Number of running rules which have this rule as parent; changed
+	 * under nrs_tbf_head::th_rule_lock, read under scp_req_lock.
+	 */
+	atomic_t			 tr_nchildren;
 	/** RPC/s limit. */
 	__u64				 tr_rpc_rate;
 	/** Time to wait for next token. */
@@ -124,6 +191,22 @@ struct nrs_tbf_rule {
 	atomic_t			 tr_ref;
 	/** Generation of the rule. */
 	__u64				 tr_generation;
+	/**
+	 * Aggregate token number of the subtree; only used while the rule
+	 * has children. Changed under scp_req_lock, and atomic so that
+	 * nrs_tbf_rule_dump() can read it without that lock.
+	 */
+	atomic_long_t			 tr_agg_ntoken;
+	/** Time check-point of the aggregate bucket. */
+	__u64				 tr_agg_check_time;
+	/** Number of queued requests of clients of this rule. */
+	unsigned long			 tr_nqueued;
+	/** Number of requests dispatched with a token of their own. */
+	unsigned long			 tr_dispatched;
+	/** Number of requests dispatched with borrowed tokens. */
+	unsigned long			 tr_borrowed;
+	/** Number of times a client was held back by an ancestor. */
+	unsigned long			 tr_deferred;
 };
 
 struct nrs_tbf_ops {
@@ -146,9 +229,11 @@ struct nrs_tbf_ops {
 
 #define NRS_TBF_TYPE_JOBID	"jobid"
 #define NRS_TBF_TYPE_NID	"nid"
+#define NRS_TBF_TYPE_GENERIC	"generic"
 #define NRS_TBF_TYPE_MAX_LEN	20
 #define NRS_TBF_FLAG_JOBID	0x0000001
 #define NRS_TBF_FLAG_NID	0x0000002
+#define NRS_TBF_FLAG_GENERIC	0x0000004
 
 struct nrs_tbf_bucket {
 	/**
@@ -234,6 +319,8 @@ struct nrs_tbf_cmd {
 	char			*tc_nids_str;
 	struct list_head	 tc_jobids;
 	char			*tc_jobids_str;
+	char			*tc_conds_str;
+	char			*tc_parent;
 	__u32			 tc_valid_types;
 	__u32			 tc_rule_flags;
 };
@@ -139,6 +139,7 @@ void req_layout_fini(void);
 #endif
 
 extern struct req_format RQF_OBD_PING;
+extern struct req_format RQF_OBD_PING_BATCH;
 extern struct req_format RQF_OBD_SET_INFO;
 extern struct req_format RQF_SEC_CTX;
 extern struct req_format RQF_OBD_IDX_READ;
@@ -324,6 +325,8 @@ extern struct req_msg_field RMF_OBD_ID;
 extern struct req_msg_field RMF_FID;
 extern struct req_msg_field RMF_NIOBUF_REMOTE;
 extern struct req_msg_field RMF_RCS;
+extern struct req_msg_field RMF_OBD_PING_HANDLES;
+extern struct req_msg_field RMF_OBD_PING_STATUS;
 extern struct req_msg_field RMF_FIEMAP_KEY;
 extern struct req_msg_field RMF_FIEMAP_VAL;
 extern struct req_msg_field RMF_OST_ID;
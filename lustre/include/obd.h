@@ -561,11 +561,38 @@ struct obd_notify_upcall {
         void *onu_owner;
 };
 
+/** Upper limit of threads replaying requests in parallel during recovery */
+#define TGT_REPLAY_THREADS_MAX	32
+
 struct target_recovery_data {
 	svc_handler_t		trd_recovery_handler;
 	pid_t			trd_processing_task;
 	struct completion	trd_starting;
 	struct completion	trd_finishing;
+	/* parallel request replay, protected by trd_replay_lock */
+	spinlock_t		trd_replay_lock;
+	/** replays dispatched and not completed yet, in transno order */
+	struct list_head	trd_replay_inflight;
+	/** dispatched replays with no outstanding dependency */
+	struct list_head	trd_replay_ready;
+	/** dispatched replays not committed yet, in transno order */
+	struct list_head	trd_replay_uncommitted;
+	/** highest transno committed while replays are uncommitted */
+	__u64			trd_replay_committed;
+	/** workers wait here for ready replays */
+	wait_queue_head_t	trd_replay_waitq;
+	/** dispatcher waits here for completed replays */
+	wait_queue_head_t	trd_replay_done_waitq;
+	struct completion	trd_replay_starting;
+	struct completion	trd_replay_finishing;
+	pid_t			trd_replay_tasks[TGT_REPLAY_THREADS_MAX];
+	int			trd_replay_nthreads;
+	int			trd_replay_inflight_count;
+	unsigned int		trd_replay_stopping:1;
+	/** # replays which had to wait for an earlier overlapping one */
+	__u64			trd_replay_dep_waits;
+	/** # replays which had to wait for all earlier ones */
+	__u64			trd_replay_barriers;
 };
 
 struct obd_llog_group {
@@ -656,6 +683,10 @@ struct obd_device {
 	__u64			obd_next_recovery_transno;
 	int			obd_replayed_requests;
 	int			obd_requests_queued_for_recovery;
+	/* number of clients with requests on obd_req_replay_queue */
+	int			obd_req_replay_queued_clients;
+	/* number of gap checks run by target_replay_gap() */
+	__u64			obd_req_replay_checks;
 	wait_queue_head_t	obd_next_transno_waitq;
 	/* protected by obd_recovery_task_lock */
 	struct timer_list	obd_recovery_timer;
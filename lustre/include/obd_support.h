@@ -122,6 +122,8 @@ int obd_alloc_fail(const void *ptr, const char *name, const char *type,
  * and there's no urgent need to evict a client just because it's idle, we
  * should be very conservative here. */
 #define PING_EVICT_TIMEOUT (PING_INTERVAL * 6)
+/* Max number of other targets on the same server a batched ping covers */
+#define PING_BATCH_MAX 64
 #define DISK_TIMEOUT 50          /* Beyond this we warn about disk speed */
 #define CONNECTION_SWITCH_MIN 5U /* Connection switching rate limiter */
  /* Max connect interval for nonresponsive servers; ~50s to avoid building up
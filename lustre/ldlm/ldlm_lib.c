@@ -1414,6 +1414,39 @@ static void target_finish_recovery(struct obd_device *obd)
         EXIT;
 }
 
+/**
+ * Account a request added to or removed from obd_req_replay_queue, so that
+ * the number of clients having replays queued is known even if clients send
+ * several replays at once. Called with obd_recovery_task_lock held.
+ */
+static void target_replay_queued_inc(struct obd_device *obd,
+				     struct obd_export *exp)
+{
+	obd->obd_requests_queued_for_recovery++;
+	if (exp->exp_req_replay_queued++ == 0)
+		obd->obd_req_replay_queued_clients++;
+}
+
+static void target_replay_queued_dec(struct obd_device *obd,
+				     struct obd_export *exp)
+{
+	LASSERT(exp->exp_req_replay_queued > 0);
+	obd->obd_requests_queued_for_recovery--;
+	if (--exp->exp_req_replay_queued == 0)
+		obd->obd_req_replay_queued_clients--;
+}
+
+/** Take all requests off obd_req_replay_queue, under obd_recovery_task_lock */
+static void target_replay_queue_splice(struct obd_device *obd,
+				       struct list_head *list)
+{
+	struct ptlrpc_request *req;
+
+	list_for_each_entry(req, &obd->obd_req_replay_queue, rq_list)
+		target_replay_queued_dec(obd, req->rq_export);
+	list_splice_init(&obd->obd_req_replay_queue, list);
+}
+
 static void abort_req_replay_queue(struct obd_device *obd)
 {
 	struct ptlrpc_request *req, *n;
@@ -1421,7 +1454,7 @@ static void abort_req_replay_queue(struct obd_device *obd)
 
 	INIT_LIST_HEAD(&abort_list);
 	spin_lock(&obd->obd_recovery_task_lock);
-	list_splice_init(&obd->obd_req_replay_queue, &abort_list);
+	target_replay_queue_splice(obd, &abort_list);
 	spin_unlock(&obd->obd_recovery_task_lock);
 	list_for_each_entry_safe(req, n, &abort_list, rq_list) {
                 DEBUG_REQ(D_WARNING, req, "aborted:");
@@ -1482,7 +1515,7 @@ void target_cleanup_recovery(struct obd_device *obd)
 
 	spin_lock(&obd->obd_recovery_task_lock);
 	target_cancel_recovery_timer(obd);
-	list_splice_init(&obd->obd_req_replay_queue, &clean_list);
+	target_replay_queue_splice(obd, &clean_list);
 	spin_unlock(&obd->obd_recovery_task_lock);
 
 	list_for_each_entry_safe(req, n, &clean_list, rq_list) {
@@ -1676,6 +1709,50 @@ static int check_for_clients(struct obd_device *obd)
 		obd->obd_max_recoverable_clients);
 }
 
+/**
+ * Check whether the replay of \a next_transno can't come any more.
+ *
+ * Clients may have a window of replays in flight, and a client's earlier
+ * replay may still be on its way while later ones are queued already. Each
+ * replay carries the transno of the replay its client sent before, so a
+ * client has nothing in flight below its lowest queued replay if that
+ * previous transno has been replayed, or skipped, already. Clients which
+ * don't send it replay one request at a time. A gap is certain once this
+ * holds for every client in request replay.
+ *
+ * Called with obd_recovery_task_lock held.
+ */
+static bool target_replay_gap(struct obd_device *obd, __u64 next_transno)
+{
+	struct ptlrpc_request	*req;
+	struct obd_export	*exp;
+	__u64			 check;
+	__u64			 prev;
+	int			 ready = 0;
+
+	if (obd->obd_req_replay_queued_clients == 0 ||
+	    obd->obd_req_replay_queued_clients !=
+	    atomic_read(&obd->obd_req_replay_clients))
+		return false;
+
+	/* the queue is sorted by transno, the first replay of each export
+	 * found is its lowest one */
+	check = ++obd->obd_req_replay_checks;
+	list_for_each_entry(req, &obd->obd_req_replay_queue, rq_list) {
+		exp = req->rq_export;
+		if (exp->exp_req_replay_check == check)
+			continue;
+		exp->exp_req_replay_check = check;
+
+		prev = lustre_msg_get_prev_transno(req->rq_reqmsg);
+		if (prev >= next_transno)
+			return false;
+		if (++ready == obd->obd_req_replay_queued_clients)
+			break;
+	}
+	return true;
+}
+
 static int check_for_next_transno(struct obd_device *obd)
 {
 	struct ptlrpc_request *req = NULL;
@@ -1711,8 +1788,7 @@ static int check_for_next_transno(struct obd_device *obd)
 	} else if (req_transno == next_transno) {
 		CDEBUG(D_HA, "waking for next ("LPD64")\n", next_transno);
 		wake_up = 1;
-	} else if (queue_len > 0 &&
-		   queue_len == atomic_read(&obd->obd_req_replay_clients)) {
+	} else if (target_replay_gap(obd, next_transno)) {
 		int d_lvl = D_HA;
 		/** handle gaps occured due to lost reply or VBR */
 		LASSERTF(req_transno >= next_transno,
@@ -1823,7 +1899,7 @@ static struct ptlrpc_request *target_next_replay_req(struct obd_device *obd)
 		req = list_entry(obd->obd_req_replay_queue.next,
 				     struct ptlrpc_request, rq_list);
 		list_del_init(&req->rq_list);
-		obd->obd_requests_queued_for_recovery--;
+		target_replay_queued_dec(obd, req->rq_export);
 		spin_unlock(&obd->obd_recovery_task_lock);
 	} else {
 		spin_unlock(&obd->obd_recovery_task_lock);
@@ -1934,42 +2010,518 @@ static void handle_recovery_req(struct ptlrpc_thread *thread,
 	EXIT;
 }
 
-static int target_recovery_thread(void *arg)
+/*
+ * Parallel request replay.
+ *
+ * The recovery thread still picks replays in transno order, but hands them
+ * to a pool of replay threads instead of executing them itself. A replay is
+ * only held back while an earlier replay touching the same objects, or coming
+ * from the same client, is in flight. Replays whose objects can't be told
+ * from the request are barriers and wait for all earlier replays.
+ */
+static int recovery_threads = 1;
+CFS_MODULE_PARM(recovery_threads, "i", int, 0644,
+		"number of threads replaying requests in parallel during "
+		"target recovery, 1 to replay serially");
+
+/** Number of dispatched replays allowed per replay thread */
+#define TGT_REPLAY_WINDOW	8
+/** Number of objects a replay is ordered on */
+#define TGT_REPLAY_FIDS		2
+
+struct target_replay {
+	/** linkage into trd_replay_inflight */
+	struct list_head	 tr_linkage;
+	/** linkage into trd_replay_ready */
+	struct list_head	 tr_ready;
+	/** linkage into trd_replay_uncommitted */
+	struct list_head	 tr_uncommitted;
+	struct ptlrpc_request	*tr_req;
+	__u64			 tr_transno;
+	struct lu_fid		 tr_fids[TGT_REPLAY_FIDS];
+	int			 tr_nfids;
+	/** # earlier replays in flight this one has to wait for */
+	int			 tr_deps;
+	/** # commit callbacks registered for tr_transno and not run yet */
+	int			 tr_commits;
+	unsigned int		 tr_barrier:1;
+	/** handled, and off trd_replay_inflight */
+	unsigned int		 tr_done:1;
+};
+
+/**
+ * Find the objects a replayed request modifies.
+ *
+ * Only metadata reintegration records name their objects by FID up front;
+ * everything else (opens, renames, updates, OST requests) is made a barrier.
+ * The record is not swabbed yet at this point, so swab a local copy.
+ */
+static void target_replay_keys(struct ptlrpc_request *req,
+			       struct target_replay *tr)
 {
-        struct lu_target *lut = arg;
-        struct obd_device *obd = lut->lut_obd;
-        struct ptlrpc_request *req;
-        struct target_recovery_data *trd = &obd->obd_recovery_data;
-        unsigned long delta;
-        struct lu_env *env;
-        struct ptlrpc_thread *thread = NULL;
-        int rc = 0;
-        ENTRY;
+	struct mdt_rec_reint	*rec;
+	__u32			 opc;
+	int			 i;
 
-	unshare_fs_struct();
-        OBD_ALLOC_PTR(thread);
-        if (thread == NULL)
-                RETURN(-ENOMEM);
-
-        OBD_ALLOC_PTR(env);
-        if (env == NULL) {
-                OBD_FREE_PTR(thread);
-                RETURN(-ENOMEM);
-        }
+	tr->tr_barrier = 1;
+	if (lustre_msg_get_opc(req->rq_reqmsg) != MDS_REINT)
+		return;
 
-        rc = lu_context_init(&env->le_ctx, LCT_MD_THREAD | LCT_DT_THREAD);
-        if (rc) {
-                OBD_FREE_PTR(thread);
-                OBD_FREE_PTR(env);
-                RETURN(rc);
-        }
+	rec = lustre_msg_buf(req->rq_reqmsg, REQ_REC_OFF, sizeof(*rec));
+	if (rec == NULL)
+		return;
+
+	opc = rec->rr_opcode;
+	tr->tr_fids[0] = rec->rr_fid1;
+	tr->tr_fids[1] = rec->rr_fid2;
+	if (ptlrpc_req_need_swab(req)) {
+		__swab32s(&opc);
+		lustre_swab_lu_fid(&tr->tr_fids[0]);
+		lustre_swab_lu_fid(&tr->tr_fids[1]);
+	}
+
+	switch (opc) {
+	case REINT_SETATTR:
+	case REINT_SETXATTR:
+		tr->tr_nfids = 1;
+		break;
+	case REINT_CREATE:
+	case REINT_LINK:
+	case REINT_UNLINK:
+	case REINT_RMENTRY:
+		/* parent (or link target directory) and child */
+		tr->tr_nfids = 2;
+		break;
+	default:
+		return;
+	}
+
+	for (i = 0; i < tr->tr_nfids; i++)
+		if (!fid_is_sane(&tr->tr_fids[i]))
+			return;
+
+	tr->tr_barrier = 0;
+}
+
+static bool target_replay_conflict(struct target_replay *a,
+				   struct target_replay *b)
+{
+	int i;
+	int j;
+
+	if (a->tr_barrier || b->tr_barrier)
+		return true;
+
+	/* keep the order of replays from one client, so that its last_rcvd
+	 * slot ends up with the last transno */
+	if (a->tr_req->rq_export == b->tr_req->rq_export)
+		return true;
+
+	for (i = 0; i < a->tr_nfids; i++)
+		for (j = 0; j < b->tr_nfids; j++)
+			if (lu_fid_eq(&a->tr_fids[i], &b->tr_fids[j]))
+				return true;
+	return false;
+}
+
+static int target_replay_room(struct target_recovery_data *trd)
+{
+	int rc;
+
+	spin_lock(&trd->trd_replay_lock);
+	rc = trd->trd_replay_inflight_count <
+	     trd->trd_replay_nthreads * TGT_REPLAY_WINDOW;
+	spin_unlock(&trd->trd_replay_lock);
+	return rc;
+}
+
+static int target_replay_idle(struct target_recovery_data *trd)
+{
+	int rc;
+
+	spin_lock(&trd->trd_replay_lock);
+	rc = trd->trd_replay_inflight_count == 0;
+	spin_unlock(&trd->trd_replay_lock);
+	return rc;
+}
+
+/** Wait until all dispatched replays are completed. */
+static void target_replay_drain(struct target_recovery_data *trd)
+{
+	wait_event(trd->trd_replay_done_waitq, target_replay_idle(trd));
+}
+
+/**
+ * Release a replayed request, once it has been handled.
+ */
+static void target_replay_complete(struct obd_device *obd,
+				   struct ptlrpc_request *req)
+{
+	target_exp_dequeue_req_replay(req);
+	target_request_copy_put(req);
+	spin_lock(&obd->obd_recovery_task_lock);
+	obd->obd_replayed_requests++;
+	spin_unlock(&obd->obd_recovery_task_lock);
+}
+
+/**
+ * Hand a replay over to the replay threads.
+ *
+ * \retval 0 replay is dispatched
+ * \retval 1 no replay threads are running, or out of memory; all earlier
+ *	     replays are completed and the caller has to handle \a req itself
+ */
+static int target_replay_dispatch(struct obd_device *obd,
+				  struct ptlrpc_request *req)
+{
+	struct target_recovery_data	*trd = &obd->obd_recovery_data;
+	struct target_replay		*tr;
+	struct target_replay		*iter;
+	ENTRY;
+
+	if (trd->trd_replay_nthreads == 0)
+		RETURN(1);
+
+	OBD_ALLOC_PTR(tr);
+	if (tr == NULL) {
+		target_replay_drain(trd);
+		RETURN(1);
+	}
+
+	tr->tr_req = req;
+	tr->tr_transno = lustre_msg_get_transno(req->rq_reqmsg);
+	INIT_LIST_HEAD(&tr->tr_ready);
+	target_replay_keys(req, tr);
+
+	wait_event(trd->trd_replay_done_waitq, target_replay_room(trd));
+
+	spin_lock(&trd->trd_replay_lock);
+	list_for_each_entry(iter, &trd->trd_replay_inflight, tr_linkage)
+		if (target_replay_conflict(iter, tr))
+			tr->tr_deps++;
+	list_add_tail(&tr->tr_linkage, &trd->trd_replay_inflight);
+	list_add_tail(&tr->tr_uncommitted, &trd->trd_replay_uncommitted);
+	trd->trd_replay_inflight_count++;
+	if (tr->tr_deps > 0) {
+		if (tr->tr_barrier)
+			trd->trd_replay_barriers++;
+		else
+			trd->trd_replay_dep_waits++;
+	} else {
+		list_add_tail(&tr->tr_ready, &trd->trd_replay_ready);
+	}
+	spin_unlock(&trd->trd_replay_lock);
+
+	if (tr->tr_deps == 0)
+		wake_up(&trd->trd_replay_waitq);
+	RETURN(0);
+}
+
+/**
+ * Retire a handled replay and release the later replays waiting for it.
+ */
+static void target_replay_finish(struct obd_device *obd,
+				 struct target_replay *tr)
+{
+	struct target_recovery_data	*trd = &obd->obd_recovery_data;
+	struct target_replay		*iter = tr;
+	int				 nready = 0;
+	int				 committed;
+
+	spin_lock(&trd->trd_replay_lock);
+	list_for_each_entry_continue(iter, &trd->trd_replay_inflight,
+				     tr_linkage) {
+		if (!target_replay_conflict(tr, iter))
+			continue;
+		LASSERT(iter->tr_deps > 0);
+		if (--iter->tr_deps == 0) {
+			list_add_tail(&iter->tr_ready, &trd->trd_replay_ready);
+			nready++;
+		}
+	}
+	list_del(&tr->tr_linkage);
+	trd->trd_replay_inflight_count--;
+	/* the replay holds back last_committed until it is committed, a
+	 * replay which committed nothing lets it catch up at the next commit */
+	tr->tr_done = 1;
+	committed = tr->tr_commits == 0;
+	if (committed)
+		list_del(&tr->tr_uncommitted);
+	spin_unlock(&trd->trd_replay_lock);
+
+	while (nready-- > 0)
+		wake_up(&trd->trd_replay_waitq);
+	wake_up(&trd->trd_replay_done_waitq);
+
+	target_replay_complete(obd, tr->tr_req);
+	if (committed)
+		OBD_FREE_PTR(tr);
+}
+
+/**
+ * Find the uncommitted replay of \a transno, called under trd_replay_lock.
+ */
+static struct target_replay *
+target_replay_find(struct target_recovery_data *trd, __u64 transno)
+{
+	struct target_replay *tr;
+
+	/* replays mostly commit in transno order, look from the oldest */
+	list_for_each_entry(tr, &trd->trd_replay_uncommitted, tr_uncommitted) {
+		if (tr->tr_transno == transno)
+			return tr;
+		if (tr->tr_transno > transno)
+			break;
+	}
+	return NULL;
+}
+
+/**
+ * Note that a commit callback is registered for \a transno.
+ *
+ * A replay stays uncommitted until all commit callbacks registered for its
+ * transno have run; see target_replay_committed().
+ */
+void target_replay_commit_add(struct obd_device *obd, __u64 transno)
+{
+	struct target_recovery_data	*trd = &obd->obd_recovery_data;
+	struct target_replay		*tr;
+
+	/* replays are added before they are handled */
+	if (transno == 0 || list_empty(&trd->trd_replay_uncommitted))
+		return;
+
+	spin_lock(&trd->trd_replay_lock);
+	tr = target_replay_find(trd, transno);
+	if (tr != NULL)
+		tr->tr_commits++;
+	spin_unlock(&trd->trd_replay_lock);
+}
+EXPORT_SYMBOL(target_replay_commit_add);
+
+/**
+ * Account for the commit of \a transno and return the last_committed to
+ * report.
+ *
+ * Parallel replays commit out of transno order. As long as a replay is not
+ * committed, a client must keep every request from that transno on for the
+ * next recovery, so last_committed is kept below the oldest uncommitted
+ * replay.
+ *
+ * \param[in] obd	target
+ * \param[in] transno	transno just committed
+ *
+ * \retval		highest transno known to be committed with all the
+ *			replayed transnos before it
+ */
+__u64 target_replay_committed(struct obd_device *obd, __u64 transno)
+{
+	struct target_recovery_data	*trd = &obd->obd_recovery_data;
+	struct target_replay		*tr;
+	struct target_replay		*done = NULL;
+
+	if (list_empty(&trd->trd_replay_uncommitted))
+		return transno;
+
+	spin_lock(&trd->trd_replay_lock);
+	tr = target_replay_find(trd, transno);
+	if (tr != NULL && tr->tr_commits > 0 && --tr->tr_commits == 0 &&
+	    tr->tr_done) {
+		list_del(&tr->tr_uncommitted);
+		done = tr;
+	}
+
+	if (transno > trd->trd_replay_committed)
+		trd->trd_replay_committed = transno;
+	transno = trd->trd_replay_committed;
+	if (!list_empty(&trd->trd_replay_uncommitted)) {
+		tr = list_entry(trd->trd_replay_uncommitted.next,
+				struct target_replay, tr_uncommitted);
+		if (transno >= tr->tr_transno)
+			transno = tr->tr_transno - 1;
+	}
+	spin_unlock(&trd->trd_replay_lock);
+
+	if (done != NULL)
+		OBD_FREE_PTR(done);
+	return transno;
+}
+EXPORT_SYMBOL(target_replay_committed);
+
+static struct target_replay *
+target_replay_next(struct target_recovery_data *trd)
+{
+	struct target_replay *tr = NULL;
+
+	spin_lock(&trd->trd_replay_lock);
+	if (!list_empty(&trd->trd_replay_ready)) {
+		tr = list_entry(trd->trd_replay_ready.next,
+				struct target_replay, tr_ready);
+		list_del_init(&tr->tr_ready);
+	}
+	spin_unlock(&trd->trd_replay_lock);
+	return tr;
+}
+
+static int target_replay_wakeup(struct target_recovery_data *trd)
+{
+	int rc;
+
+	spin_lock(&trd->trd_replay_lock);
+	rc = !list_empty(&trd->trd_replay_ready) || trd->trd_replay_stopping;
+	spin_unlock(&trd->trd_replay_lock);
+	return rc;
+}
+
+/**
+ * Set up a thread context for handling recovery requests outside of the
+ * ptlrpc service threads.
+ */
+static int target_recovery_thread_init(struct ptlrpc_thread **threadp)
+{
+	struct ptlrpc_thread	*thread;
+	struct lu_env		*env;
+	int			 rc;
+
+	OBD_ALLOC_PTR(thread);
+	if (thread == NULL)
+		return -ENOMEM;
+
+	OBD_ALLOC_PTR(env);
+	if (env == NULL) {
+		OBD_FREE_PTR(thread);
+		return -ENOMEM;
+	}
+
+	rc = lu_context_init(&env->le_ctx, LCT_MD_THREAD | LCT_DT_THREAD);
+	if (rc) {
+		OBD_FREE_PTR(thread);
+		OBD_FREE_PTR(env);
+		return rc;
+	}
 
-        thread->t_env = env;
-        thread->t_id = -1; /* force filter_iobuf_get/put to use local buffers */
-        env->le_ctx.lc_thread = thread;
+	thread->t_env = env;
+	thread->t_id = -1; /* force filter_iobuf_get/put to use local buffers */
+	env->le_ctx.lc_thread = thread;
 	tgt_io_thread_init(thread); /* init thread_big_cache for IO requests */
 	thread->t_watchdog = NULL;
 
+	*threadp = thread;
+	return 0;
+}
+
+static void target_recovery_thread_fini(struct ptlrpc_thread *thread)
+{
+	struct lu_env *env = thread->t_env;
+
+	lu_context_fini(&env->le_ctx);
+	tgt_io_thread_done(thread);
+	OBD_FREE_PTR(thread);
+	OBD_FREE_PTR(env);
+}
+
+static int target_replay_thread(void *arg)
+{
+	struct lu_target		*lut = arg;
+	struct obd_device		*obd = lut->lut_obd;
+	struct target_recovery_data	*trd = &obd->obd_recovery_data;
+	struct ptlrpc_thread		*thread;
+	struct target_replay		*tr;
+	int				 rc;
+	ENTRY;
+
+	unshare_fs_struct();
+	rc = target_recovery_thread_init(&thread);
+	if (rc != 0) {
+		complete(&trd->trd_replay_starting);
+		RETURN(rc);
+	}
+
+	spin_lock(&trd->trd_replay_lock);
+	trd->trd_replay_tasks[trd->trd_replay_nthreads++] = current_pid();
+	spin_unlock(&trd->trd_replay_lock);
+	complete(&trd->trd_replay_starting);
+
+	while (1) {
+		wait_event(trd->trd_replay_waitq, target_replay_wakeup(trd));
+		tr = target_replay_next(trd);
+		if (tr == NULL) {
+			if (trd->trd_replay_stopping)
+				break;
+			continue;
+		}
+
+		DEBUG_REQ(D_HA, tr->tr_req, "replaying t"LPD64" from %s",
+			  lustre_msg_get_transno(tr->tr_req->rq_reqmsg),
+			  libcfs_nid2str(tr->tr_req->rq_peer.nid));
+		OBD_FAIL_TIMEOUT_MS(OBD_FAIL_TGT_REPLAY_DELAY, cfs_fail_val);
+		handle_recovery_req(thread, tr->tr_req,
+				    trd->trd_recovery_handler);
+		target_replay_finish(obd, tr);
+	}
+
+	target_recovery_thread_fini(thread);
+	complete(&trd->trd_replay_finishing);
+	RETURN(0);
+}
+
+static void target_replay_threads_start(struct lu_target *lut)
+{
+	struct target_recovery_data	*trd = &lut->lut_obd->obd_recovery_data;
+	int				 nthreads;
+	int				 i;
+
+	/* a single thread replays in the recovery thread itself */
+	if (recovery_threads <= 1)
+		return;
+
+	nthreads = min(recovery_threads, TGT_REPLAY_THREADS_MAX);
+	for (i = 0; i < nthreads; i++) {
+		if (IS_ERR(kthread_run(target_replay_thread, lut,
+				       "tgt_replay_%02d", i)))
+			break;
+		wait_for_completion(&trd->trd_replay_starting);
+	}
+
+	CDEBUG(D_HA, "%s: started %d replay threads\n",
+	       lut->lut_obd->obd_name, trd->trd_replay_nthreads);
+}
+
+static void target_replay_threads_stop(struct target_recovery_data *trd)
+{
+	int i;
+
+	target_replay_drain(trd);
+
+	spin_lock(&trd->trd_replay_lock);
+	trd->trd_replay_stopping = 1;
+	spin_unlock(&trd->trd_replay_lock);
+	wake_up_all(&trd->trd_replay_waitq);
+
+	for (i = 0; i < trd->trd_replay_nthreads; i++)
+		wait_for_completion(&trd->trd_replay_finishing);
+
+	spin_lock(&trd->trd_replay_lock);
+	trd->trd_replay_nthreads = 0;
+	spin_unlock(&trd->trd_replay_lock);
+}
+
+static int target_recovery_thread(void *arg)
+{
+	struct lu_target *lut = arg;
+	struct obd_device *obd = lut->lut_obd;
+	struct ptlrpc_request *req;
+	struct target_recovery_data *trd = &obd->obd_recovery_data;
+	unsigned long delta;
+	struct ptlrpc_thread *thread = NULL;
+	int rc = 0;
+	ENTRY;
+
+	unshare_fs_struct();
+	rc = target_recovery_thread_init(&thread);
+	if (rc != 0)
+		RETURN(rc);
+
 	CDEBUG(D_HA, "%s: started recovery thread pid %d\n", obd->obd_name,
 	       current_pid());
 	trd->trd_processing_task = current_pid();
@@ -1991,24 +2543,29 @@ static int target_recovery_thread(void *arg)
 	CDEBUG(D_INFO, "1: request replay stage - %d clients from t"LPU64"\n",
 	       atomic_read(&obd->obd_req_replay_clients),
 	       obd->obd_next_recovery_transno);
+	target_replay_threads_start(lut);
 	while ((req = target_next_replay_req(obd))) {
 		LASSERT(trd->trd_processing_task == current_pid());
 		DEBUG_REQ(D_HA, req, "processing t"LPD64" from %s",
 			  lustre_msg_get_transno(req->rq_reqmsg),
 			  libcfs_nid2str(req->rq_peer.nid));
-                handle_recovery_req(thread, req,
-                                    trd->trd_recovery_handler);
-                /**
-                 * bz18031: increase next_recovery_transno before
-                 * target_request_copy_put() will drop exp_rpc reference
-                 */
+		/**
+		 * bz18031: increase next_recovery_transno before
+		 * target_request_copy_put() will drop exp_rpc reference.
+		 * With replay threads it is the dispatch cursor, resends of
+		 * replays still in flight are caught by the export queue.
+		 */
 		spin_lock(&obd->obd_recovery_task_lock);
 		obd->obd_next_recovery_transno++;
 		spin_unlock(&obd->obd_recovery_task_lock);
-                target_exp_dequeue_req_replay(req);
-                target_request_copy_put(req);
-                obd->obd_replayed_requests++;
-        }
+		if (target_replay_dispatch(obd, req) == 0)
+			continue;
+
+		handle_recovery_req(thread, req, trd->trd_recovery_handler);
+		target_replay_complete(obd, req);
+	}
+	/* all request replays have to be done before replaying locks */
+	target_replay_threads_stop(trd);
 
 	/**
 	 * The second stage: replay locks
@@ -2061,15 +2618,11 @@ static int target_recovery_thread(void *arg)
 		libcfs_debug_dumplog();
 	}
 
-        target_finish_recovery(obd);
+	target_finish_recovery(obd);
 
-        lu_context_fini(&env->le_ctx);
-        trd->trd_processing_task = 0;
+	target_recovery_thread_fini(thread);
+	trd->trd_processing_task = 0;
 	complete(&trd->trd_finishing);
-
-	tgt_io_thread_done(thread);
-	OBD_FREE_PTR(thread);
-	OBD_FREE_PTR(env);
 	RETURN(rc);
 }
 
@@ -2084,6 +2637,14 @@ static int target_start_recovery_thread(struct lu_target *lut,
 	init_completion(&trd->trd_starting);
 	init_completion(&trd->trd_finishing);
 	trd->trd_recovery_handler = handler;
+	spin_lock_init(&trd->trd_replay_lock);
+	INIT_LIST_HEAD(&trd->trd_replay_inflight);
+	INIT_LIST_HEAD(&trd->trd_replay_ready);
+	INIT_LIST_HEAD(&trd->trd_replay_uncommitted);
+	init_waitqueue_head(&trd->trd_replay_waitq);
+	init_waitqueue_head(&trd->trd_replay_done_waitq);
+	init_completion(&trd->trd_replay_starting);
+	init_completion(&trd->trd_replay_finishing);
 
 	if (!IS_ERR(kthread_run(target_recovery_thread,
 				lut, "tgt_recov"))) {
@@ -2192,6 +2753,48 @@ static int target_process_req_flags(struct obd_device *obd,
 	return 0;
 }
 
+/** Whether the current thread is the recovery thread or a replay thread. */
+static bool target_recovery_task(struct target_recovery_data *trd)
+{
+	pid_t	pid = current_pid();
+	bool	found = false;
+	int	i;
+
+	if (trd->trd_processing_task == pid)
+		return true;
+
+	spin_lock(&trd->trd_replay_lock);
+	for (i = 0; i < trd->trd_replay_nthreads; i++) {
+		if (trd->trd_replay_tasks[i] == pid) {
+			found = true;
+			break;
+		}
+	}
+	spin_unlock(&trd->trd_replay_lock);
+
+	return found;
+}
+
+/** Whether a replay with the transno of \a req is queued or being handled */
+static bool target_exp_req_replay_inflight(struct ptlrpc_request *req)
+{
+	__u64			 transno = lustre_msg_get_transno(req->rq_reqmsg);
+	struct obd_export	*exp = req->rq_export;
+	struct ptlrpc_request	*reqiter;
+	bool			 found = false;
+
+	spin_lock(&exp->exp_lock);
+	list_for_each_entry(reqiter, &exp->exp_req_replay_queue,
+			    rq_replay_list) {
+		if (lustre_msg_get_transno(reqiter->rq_reqmsg) == transno) {
+			found = true;
+			break;
+		}
+	}
+	spin_unlock(&exp->exp_lock);
+	return found;
+}
+
 int target_queue_recovery_request(struct ptlrpc_request *req,
                                   struct obd_device *obd)
 {
@@ -2200,7 +2803,7 @@ int target_queue_recovery_request(struct ptlrpc_request *req,
 	int inserted = 0;
 	ENTRY;
 
-	if (obd->obd_recovery_data.trd_processing_task == current_pid()) {
+	if (target_recovery_task(&obd->obd_recovery_data)) {
 		/* Processing the queue right now, don't re-add. */
 		RETURN(1);
 	}
@@ -2272,6 +2875,11 @@ int target_queue_recovery_request(struct ptlrpc_request *req,
 		/* Processing the queue right now, don't re-add. */
 		LASSERT(list_empty(&req->rq_list));
 		spin_unlock(&obd->obd_recovery_task_lock);
+		/* the original may still be handled by a replay thread */
+		if (target_exp_req_replay_inflight(req)) {
+			DEBUG_REQ(D_HA, req, "dropping resent in-flight req");
+			RETURN(0);
+		}
 		RETURN(1);
 	}
 	spin_unlock(&obd->obd_recovery_task_lock);
@@ -2316,17 +2924,73 @@ added:
         if (!inserted)
 		list_add_tail(&req->rq_list, &obd->obd_req_replay_queue);
 
-        obd->obd_requests_queued_for_recovery++;
+	target_replay_queued_inc(obd, req->rq_export);
 	spin_unlock(&obd->obd_recovery_task_lock);
 	wake_up(&obd->obd_next_transno_waitq);
 	RETURN(0);
 }
 EXPORT_SYMBOL(target_queue_recovery_request);
 
+/**
+ * Refresh the export of another target on this server that a batched ping
+ * vouches for. Only exports connected from the same peer are refreshed.
+ */
+static __u32 target_handle_ping_export(struct ptlrpc_request *req,
+				       struct lustre_handle *handle)
+{
+	struct obd_export	*exp;
+	__u32			 rc = 0;
+
+	exp = class_conn2export(handle);
+	if (exp == NULL)
+		return -ENOTCONN;
+
+	if (exp->exp_disconnected || exp->exp_failed ||
+	    exp->exp_connection == NULL ||
+	    exp->exp_connection->c_peer.nid != req->rq_peer.nid)
+		rc = -ENOTCONN;
+	else
+		ptlrpc_update_export_timer(exp, 0);
+
+	class_export_put(exp);
+	return rc;
+}
+
 int target_handle_ping(struct ptlrpc_request *req)
 {
-        obd_ping(req->rq_svc_thread->t_env, req->rq_export);
-        return req_capsule_server_pack(&req->rq_pill);
+	struct req_capsule	*pill = &req->rq_pill;
+	struct lustre_handle	*handles = NULL;
+	__u32			*status;
+	int			 count = 0;
+	int			 rc;
+	int			 i;
+
+	obd_ping(req->rq_svc_thread->t_env, req->rq_export);
+
+	/* a batched ping carries the handles of other exports of the client
+	 * on this server, older clients only send the ptlrpc body */
+	if (lustre_msg_bufcount(req->rq_reqmsg) > 1) {
+		req_capsule_extend(pill, &RQF_OBD_PING_BATCH);
+		handles = req_capsule_client_get(pill, &RMF_OBD_PING_HANDLES);
+		if (handles == NULL)
+			return -EPROTO;
+		count = req_capsule_get_size(pill, &RMF_OBD_PING_HANDLES,
+					     RCL_CLIENT) / sizeof(*handles);
+		if (count > PING_BATCH_MAX)
+			return -EPROTO;
+		req_capsule_set_size(pill, &RMF_OBD_PING_STATUS, RCL_SERVER,
+				     count * sizeof(*status));
+	}
+
+	rc = req_capsule_server_pack(pill);
+	if (rc != 0 || count == 0)
+		return rc;
+
+	status = req_capsule_server_get(pill, &RMF_OBD_PING_STATUS);
+	for (i = 0; i < count; i++)
+		status[i] = target_handle_ping_export(req, &handles[i]);
+
+	return 0;
 }
 EXPORT_SYMBOL(target_handle_ping);
 
@@ -2441,6 +3105,7 @@ void target_send_reply(struct ptlrpc_request *req, int rc, int fail_id)
         rs->rs_transno   = req->rq_transno;
         rs->rs_export    = exp;
         rs->rs_opc       = lustre_msg_get_opc(req->rq_reqmsg);
+	do_gettimeofday(&rs->rs_sent_time);
 
 	spin_lock(&exp->exp_uncommitted_replies_lock);
 	CDEBUG(D_NET, "rs transno = "LPU64", last committed = "LPU64"\n",
@@ -2616,6 +3281,8 @@ int target_bulk_io(struct obd_export *exp, struct ptlrpc_bulk_desc *desc,
 	struct ptlrpc_request	*req = desc->bd_req;
 	time_t			 start = cfs_time_current_sec();
 	time_t			 deadline;
+	struct timeval		 bulk_start;
+	struct timeval		 bulk_end;
 	int			 rc = 0;
 
 	ENTRY;
@@ -2629,6 +3296,7 @@ int target_bulk_io(struct obd_export *exp, struct ptlrpc_bulk_desc *desc,
 				  lwi);
 	}
 
+	do_gettimeofday(&bulk_start);
 	/* Check if client was evicted or reconnected already. */
 	if (exp->exp_failed ||
 	    exp->exp_conn_cnt > lustre_msg_get_conn_cnt(req->rq_reqmsg)) {
@@ -2702,8 +3370,14 @@ int target_bulk_io(struct obd_export *exp, struct ptlrpc_bulk_desc *desc,
 			  desc->bd_nob);
 		/* XXX Should this be a different errno? */
 		rc = -ETIMEDOUT;
-	} else if (desc->bd_type == BULK_GET_SINK) {
-		rc = sptlrpc_svc_unwrap_bulk(req, desc);
+	} else {
+		do_gettimeofday(&bulk_end);
+		lprocfs_rpc_lat_tally(
+			req->rq_rqbd->rqbd_svcpt->scp_service->srv_rpc_lat,
+			lustre_msg_get_opc(req->rq_reqmsg), RPC_LAT_BULK,
+			cfs_timeval_sub(&bulk_end, &bulk_start, NULL));
+		if (desc->bd_type == BULK_GET_SINK)
+			rc = sptlrpc_svc_unwrap_bulk(req, desc);
 	}
 
 	RETURN(rc);
@@ -2046,6 +2046,18 @@ static int changelog_kkuc_cb(const struct lu_env *env, struct llog_handle *llh,
         RETURN(rc);
 }
 
+/* changelog records are sent by index, whatever plain log they are in */
+static __u64 changelog_rec_key(struct llog_rec_hdr *hdr)
+{
+	struct llog_changelog_rec *rec = (struct llog_changelog_rec *)hdr;
+
+	/* changelog_kkuc_cb() rejects anything else */
+	if (hdr->lrh_type != CHANGELOG_REC)
+		return 0;
+
+	return rec->cr.cr_index;
+}
+
 static int mdc_changelog_send_thread(void *csdata)
 {
 	struct changelog_show *cs = csdata;
@@ -2078,7 +2090,8 @@ static int mdc_changelog_send_thread(void *csdata)
 		GOTO(out, rc);
 	}
 
-	rc = llog_cat_process(NULL, llh, changelog_kkuc_cb, cs, 0, 0);
+	rc = llog_cat_process_sorted(NULL, llh, changelog_kkuc_cb,
+				     changelog_rec_key, cs);
 
         /* Send EOF no matter what our result */
         if ((kuch = changelog_kuc_hdr(cs->cs_buf, sizeof(*kuch),
@@ -60,6 +60,12 @@ static const char mdd_root_dir_name[] = "ROOT";
 static const char mdd_obf_dir_name[] = "fid";
 static const char mdd_lpf_dir_name[] = "lost+found";
 
+static int changelog_slots = 1;
+CFS_MODULE_PARM(changelog_slots, "i", int, 0444,
+		"# plain llogs changelog records are appended to concurrently, "
+		"0 for one per CPT. With more than one, records are no longer "
+		"stored in index order, readers sort them");
+
 /* Slab for MDD object allocation */
 struct kmem_cache *mdd_object_kmem;
 
@@ -172,7 +178,14 @@ static int changelog_init_cb(const struct lu_env *env, struct llog_handle *llh,
 	       rec->cr.cr_index, rec->cr.cr_type, rec->cr.cr_namelen,
 	       rec->cr.cr_name, POSTID(&llh->lgh_id.lgl_oi));
 
-	mdd->mdd_cl.mc_index = rec->cr.cr_index;
+	if (rec->cr.cr_index > mdd->mdd_cl.mc_index)
+		mdd->mdd_cl.mc_index = rec->cr.cr_index;
+
+	/* with several plain logs appended to concurrently, now or before
+	 * the last restart, the last record of the catalog isn't
+	 * necessarily the last one stored */
+	if (llog_cat_is_multi_slot(llh->u.phd.phd_cat_handle))
+		return 0;
 	return LLOG_PROC_BREAK;
 }
 
@@ -214,9 +227,13 @@ static int llog_changelog_cancel_cb(const struct lu_env *env,
 	/* This is always a (sub)log, not the catalog */
 	LASSERT(llh->lgh_hdr->llh_flags & LLOG_F_IS_PLAIN);
 
-	if (rec->cr.cr_index > endrec)
-		/* records are in order, so we're done */
+	if (rec->cr.cr_index > endrec) {
+		/* records are in order, so we're done, unless they are
+		 * stored in several plain logs */
+		if (llog_cat_is_multi_slot(llh->u.phd.phd_cat_handle))
+			RETURN(0);
 		RETURN(LLOG_PROC_BREAK);
+	}
 
 	cookie.lgc_lgl = llh->lgh_id;
 	cookie.lgc_index = hdr->lrh_index;
@@ -294,6 +311,10 @@ static int mdd_changelog_llog_init(const struct lu_env *env,
 	if (rc)
 		GOTO(out_close, rc);
 
+	rc = llog_cat_set_slots(ctxt->loc_handle, changelog_slots);
+	if (rc)
+		GOTO(out_close, rc);
+
 	rc = llog_cat_reverse_process(env, ctxt->loc_handle,
 				      changelog_init_cb, mdd);
 
@@ -821,6 +821,7 @@ LPROC_SEQ_FOPS_RO_TYPE(mdt, target_instance);
 LPROC_SEQ_FOPS_RO_TYPE(mdt, hash);
 LPROC_SEQ_FOPS_WO_TYPE(mdt, mds_evict_client);
 LPROC_SEQ_FOPS_RW_TYPE(mdt, job_interval);
+LPROC_SEQ_FOPS_RW_TYPE(mdt, job_max_mb);
 LPROC_SEQ_FOPS_RW_TYPE(mdt, ir_factor);
 LPROC_SEQ_FOPS_RW_TYPE(mdt, nid_stats_clear);
 LPROC_SEQ_FOPS(mdt_hsm_cdt_control);
@@ -872,6 +873,8 @@ static struct lprocfs_seq_vars lprocfs_mdt_obd_vars[] = {
 	  .fops =	&mdt_ir_factor_fops			},
 	{ .name =	"job_cleanup_interval",
 	  .fops =	&mdt_job_interval_fops			},
+	{ .name =	"job_stats_max_mb",
+	  .fops =	&mdt_job_max_mb_fops			},
 	{ .name =	"enable_remote_dir",
 	  .fops =	&mdt_enable_remote_dir_fops		},
 	{ .name =	"enable_remote_dir_gid",
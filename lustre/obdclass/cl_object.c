@@ -537,11 +537,20 @@ EXPORT_SYMBOL(cl_site_stats_print);
  * bz20044, bz22683.
  */
 
-static struct list_head cl_envs;
-static unsigned cl_envs_cached_nr  = 0;
+/**
+ * Cache of released environments, one per CPU partition, so that threads
+ * getting and putting environments on different CPTs don't bounce a single
+ * lock and list head between them.
+ */
+struct cl_env_cache {
+	spinlock_t		cec_guard;
+	struct list_head	cec_envs;
+	unsigned		cec_nr;
+};
+
+static struct cl_env_cache **cl_envs;
 static unsigned cl_envs_cached_max = 128; /* XXX: prototype: arbitrary limit
-                                           * for now. */
-static DEFINE_SPINLOCK(cl_envs_guard);
+                                           * for now, per CPT. */
 
 struct cl_env {
         void             *ce_magic;
@@ -571,7 +580,7 @@ struct cl_env {
 	void             *ce_owner;
 
         /*
-         * Linkage into global list of all client environments. Used for
+         * Linkage into per-CPT list of cached client environments. Used for
          * garbage collection.
          */
 	struct list_head  ce_linkage;
@@ -800,19 +809,22 @@ static void cl_env_fini(struct cl_env *cle)
 
 static struct lu_env *cl_env_obtain(void *debug)
 {
+	struct cl_env_cache *cec;
 	struct cl_env *cle;
 	struct lu_env *env;
 
 	ENTRY;
-	spin_lock(&cl_envs_guard);
-	LASSERT(equi(cl_envs_cached_nr == 0, list_empty(&cl_envs)));
-	if (cl_envs_cached_nr > 0) {
+	cec = cl_envs[cfs_cpt_current(cfs_cpt_table, 0)];
+	spin_lock(&cec->cec_guard);
+	LASSERT(equi(cec->cec_nr == 0, list_empty(&cec->cec_envs)));
+	if (cec->cec_nr > 0) {
 		int rc;
 
-		cle = container_of(cl_envs.next, struct cl_env, ce_linkage);
+		cle = container_of(cec->cec_envs.next, struct cl_env,
+				   ce_linkage);
 		list_del_init(&cle->ce_linkage);
-		cl_envs_cached_nr--;
-		spin_unlock(&cl_envs_guard);
+		cec->cec_nr--;
+		spin_unlock(&cec->cec_guard);
 
                 env = &cle->ce_lu;
                 rc = lu_env_refill(env);
@@ -825,7 +837,7 @@ static struct lu_env *cl_env_obtain(void *debug)
                         env = ERR_PTR(rc);
                 }
         } else {
-		spin_unlock(&cl_envs_guard);
+		spin_unlock(&cec->cec_guard);
 		env = cl_env_new(lu_context_tags_default,
 				 lu_session_tags_default, debug);
 	}
@@ -928,22 +940,32 @@ static void cl_env_exit(struct cl_env *cle)
  */
 unsigned cl_env_cache_purge(unsigned nr)
 {
+	struct cl_env_cache *cec;
 	struct cl_env *cle;
+	int i;
 
 	ENTRY;
-	spin_lock(&cl_envs_guard);
-	for (; !list_empty(&cl_envs) && nr > 0; --nr) {
-		cle = container_of(cl_envs.next, struct cl_env, ce_linkage);
-		list_del_init(&cle->ce_linkage);
-		LASSERT(cl_envs_cached_nr > 0);
-		cl_envs_cached_nr--;
-		spin_unlock(&cl_envs_guard);
+	/* keys are also quiesced before cl_global_init() and after
+	 * cl_global_fini() */
+	if (cl_envs == NULL)
+		RETURN(nr);
+
+	cfs_percpt_for_each(cec, i, cl_envs) {
+		spin_lock(&cec->cec_guard);
+		for (; !list_empty(&cec->cec_envs) && nr > 0; --nr) {
+			cle = container_of(cec->cec_envs.next, struct cl_env,
+					   ce_linkage);
+			list_del_init(&cle->ce_linkage);
+			LASSERT(cec->cec_nr > 0);
+			cec->cec_nr--;
+			spin_unlock(&cec->cec_guard);
 
-		cl_env_fini(cle);
-		spin_lock(&cl_envs_guard);
+			cl_env_fini(cle);
+			spin_lock(&cec->cec_guard);
+		}
+		LASSERT(equi(cec->cec_nr == 0, list_empty(&cec->cec_envs)));
+		spin_unlock(&cec->cec_guard);
 	}
-	LASSERT(equi(cl_envs_cached_nr == 0, list_empty(&cl_envs)));
-	spin_unlock(&cl_envs_guard);
 	RETURN(nr);
 }
 EXPORT_SYMBOL(cl_env_cache_purge);
@@ -957,6 +979,7 @@ EXPORT_SYMBOL(cl_env_cache_purge);
  */
 void cl_env_put(struct lu_env *env, int *refcheck)
 {
+	struct cl_env_cache *cec;
         struct cl_env *cle;
 
         cle = cl_env_container(env);
@@ -973,16 +996,17 @@ void cl_env_put(struct lu_env *env, int *refcheck)
                 /*
                  * Don't bother to take a lock here.
                  *
-                 * Return environment to the cache only when it was allocated
-                 * with the standard tags.
+                 * Return environment to the cache of the current CPT only
+                 * when it was allocated with the standard tags.
                  */
-                if (cl_envs_cached_nr < cl_envs_cached_max &&
+		cec = cl_envs[cfs_cpt_current(cfs_cpt_table, 0)];
+		if (cec->cec_nr < cl_envs_cached_max &&
                     (env->le_ctx.lc_tags & ~LCT_HAS_EXIT) == LCT_CL_THREAD &&
                     (env->le_ses->lc_tags & ~LCT_HAS_EXIT) == LCT_SESSION) {
-			spin_lock(&cl_envs_guard);
-			list_add(&cle->ce_linkage, &cl_envs);
-			cl_envs_cached_nr++;
-			spin_unlock(&cl_envs_guard);
+			spin_lock(&cec->cec_guard);
+			list_add(&cle->ce_linkage, &cec->cec_envs);
+			cec->cec_nr++;
+			spin_unlock(&cec->cec_guard);
 		} else
 			cl_env_fini(cle);
 	}
@@ -1340,13 +1364,22 @@ static struct lu_kmem_descr cl_object_caches[] = {
  */
 int cl_global_init(void)
 {
+	struct cl_env_cache *cec;
 	int result;
+	int i;
 
-	INIT_LIST_HEAD(&cl_envs);
+	cl_envs = cfs_percpt_alloc(cfs_cpt_table, sizeof(*cec));
+	if (cl_envs == NULL)
+		return -ENOMEM;
+
+	cfs_percpt_for_each(cec, i, cl_envs) {
+		spin_lock_init(&cec->cec_guard);
+		INIT_LIST_HEAD(&cec->cec_envs);
+	}
 
 	result = cl_env_store_init();
 	if (result)
-		return result;
+		goto out_envs;
 
         result = lu_kmem_init(cl_object_caches);
         if (result)
@@ -1379,6 +1412,9 @@ out_kmem:
         lu_kmem_fini(cl_object_caches);
 out_store:
         cl_env_store_fini();
+out_envs:
+	cfs_percpt_free(cl_envs);
+	cl_envs = NULL;
         return result;
 }
 
@@ -1393,4 +1429,6 @@ void cl_global_fini(void)
         lu_context_key_degister(&cl_key);
         lu_kmem_fini(cl_object_caches);
         cl_env_store_fini();
+	cfs_percpt_free(cl_envs);
+	cl_envs = NULL;
 }
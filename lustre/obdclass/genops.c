@@ -983,6 +983,7 @@ void class_import_destroy(struct obd_import *imp)
         }
 
         LASSERT(imp->imp_sec == NULL);
+	lprocfs_rpc_lat_free(imp->imp_rpc_lat);
         class_decref(imp->imp_obd, "import", imp);
         OBD_FREE_RCU(imp, sizeof(*imp), &imp->imp_handle);
         EXIT;
@@ -1073,6 +1074,8 @@ struct obd_import *class_new_import(struct obd_device *obd)
 	INIT_LIST_HEAD(&imp->imp_handle.h_link);
 	class_handle_hash(&imp->imp_handle, &import_handle_ops);
 	init_imp_at(&imp->imp_at);
+	/* latency histograms are optional, don't fail for them */
+	imp->imp_rpc_lat = lprocfs_rpc_lat_alloc();
 
 	/* the default magic is V2, will be used in connect RPC, and
 	 * then adjusted according to the flags in request/reply. */
@@ -435,6 +435,16 @@ int class_procfs_init(void)
 		GOTO(out_proc, rc);
 	}
 
+#ifdef LPROCFS
+	rc = lprocfs_seq_create(proc_lustre_root, "stats_snapshot", 0444,
+				&lprocfs_stats_snapshot_fops, NULL);
+	if (rc < 0) {
+		CERROR("cannot create '/proc/fs/lustre/stats_snapshot': "
+		       "rc = %d\n", rc);
+		GOTO(out_proc, rc);
+	}
+#endif
+
 	RETURN(rc);
 
 out_proc:
@@ -85,8 +85,13 @@ void llog_free_handle(struct llog_handle *loghandle)
 
 	if (loghandle->lgh_hdr->llh_flags & LLOG_F_IS_PLAIN)
 		LASSERT(list_empty(&loghandle->u.phd.phd_entry));
-	else if (loghandle->lgh_hdr->llh_flags & LLOG_F_IS_CAT)
+	else if (loghandle->lgh_hdr->llh_flags & LLOG_F_IS_CAT) {
 		LASSERT(list_empty(&loghandle->u.chd.chd_head));
+		if (loghandle->u.chd.chd_slots != &loghandle->u.chd.chd_slot)
+			OBD_FREE(loghandle->u.chd.chd_slots,
+				 loghandle->u.chd.chd_nslots *
+				 sizeof(loghandle->u.chd.chd_slots[0]));
+	}
 	LASSERT(sizeof(*(loghandle->lgh_hdr)) == LLOG_CHUNK_SIZE);
 	OBD_FREE(loghandle->lgh_hdr, LLOG_CHUNK_SIZE);
 out:
@@ -251,6 +256,11 @@ int llog_init_handle(const struct lu_env *env, struct llog_handle *handle,
 	if (flags & LLOG_F_IS_CAT) {
 		LASSERT(list_empty(&handle->u.chd.chd_head));
 		INIT_LIST_HEAD(&handle->u.chd.chd_head);
+		memset(&handle->u.chd.chd_slot, 0,
+		       sizeof(handle->u.chd.chd_slot));
+		handle->u.chd.chd_slots = &handle->u.chd.chd_slot;
+		handle->u.chd.chd_nslots = 1;
+		mutex_init(&handle->u.chd.chd_mutex);
 		llh->llh_size = sizeof(struct llog_logid_rec);
 	} else if (!(flags & LLOG_F_IS_PLAIN)) {
 		CERROR("%s: unknown flags: %#x (expected %#x or %#x)\n",
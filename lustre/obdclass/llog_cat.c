@@ -94,9 +94,17 @@ static int llog_cat_new_log(const struct lu_env *env,
 	rec->lid_id = loghandle->lgh_id;
 
 	/* append the new record into catalog. The new index will be
-	 * assigned to the record and updated in rec header */
+	 * assigned to the record and updated in rec header. Plain logs of
+	 * different slots are started concurrently, so do it exclusively */
+	mutex_lock(&cathandle->u.chd.chd_mutex);
+	/* the flag goes to disk with the catalog header, so that records are
+	 * known to be unordered even if the catalog is reopened with a single
+	 * slot */
+	if (cathandle->u.chd.chd_nslots > 1)
+		cathandle->lgh_hdr->llh_flags |= LLOG_F_MULTI_SLOT;
 	rc = llog_write_rec(env, cathandle, &rec->lid_hdr,
 			    &loghandle->u.phd.phd_cookie, LLOG_NEXT_IDX, th);
+	mutex_unlock(&cathandle->u.chd.chd_mutex);
 	if (rc < 0)
 		GOTO(out_destroy, rc);
 
@@ -230,8 +238,87 @@ enum {
         LLOGH_LOG
 };
 
-/** Return the currently active log handle.  If the current log handle doesn't
- * have enough space left for the current record, start a new one.
+/**
+ * Let records be appended to \a nslots plain logs of the catalog
+ * concurrently, instead of all of them going through the lgh_lock of a
+ * single current log. This has to be called before the first record is
+ * added.
+ *
+ * Records added by one transaction always go to the same plain log, in
+ * order, but records of different transactions are no longer ordered
+ * across the catalog: llog_cat_process() walks the plain logs in the order
+ * they were started, each of them from its first record to the last one.
+ * Readers depending on a global order have to use llog_cat_process_sorted()
+ * with some index stored in the records. The catalog header remembers this
+ * with LLOG_F_MULTI_SLOT, see llog_cat_is_multi_slot().
+ *
+ * \param nslots number of plain logs, 0 for one per CPT
+ *
+ * \retval 0 on success
+ * \retval -ENOMEM if the slots can't be allocated
+ */
+int llog_cat_set_slots(struct llog_handle *cathandle, int nslots)
+{
+	struct cat_handle_data	*chd = &cathandle->u.chd;
+	struct llog_cat_slot	*slots;
+
+	LASSERT(cathandle->lgh_hdr->llh_flags & LLOG_F_IS_CAT);
+	LASSERT(chd->chd_slots == &chd->chd_slot);
+	LASSERT(chd->chd_slot.lcs_current_log == NULL);
+
+	if (nslots == 0)
+		nslots = cfs_cpt_number(cfs_cpt_table);
+	if (nslots <= 1)
+		return 0;
+
+	OBD_ALLOC(slots, nslots * sizeof(*slots));
+	if (slots == NULL)
+		return -ENOMEM;
+
+	chd->chd_slots = slots;
+	chd->chd_nslots = nslots;
+	return 0;
+}
+EXPORT_SYMBOL(llog_cat_set_slots);
+
+/**
+ * Return the slot a record of transaction \a th goes to. The declaration
+ * and the addition of a record have to agree on the plain log, which rules
+ * out picking the slot of the current CPT: a thread not bound to a CPT
+ * can migrate in between. The transaction handle is shared by both.
+ */
+static struct llog_cat_slot *llog_cat_slot(struct llog_handle *cathandle,
+					   struct thandle *th)
+{
+	struct cat_handle_data	*chd = &cathandle->u.chd;
+	unsigned long		 hash;
+
+	if (chd->chd_nslots == 1)
+		return chd->chd_slots;
+
+	if (th != NULL)
+		hash = hash_long((unsigned long)th, BITS_PER_LONG);
+	else
+		hash = cfs_cpt_current(cfs_cpt_table, 0);
+	return &chd->chd_slots[hash % chd->chd_nslots];
+}
+
+/* whether records are still being appended to \a loghandle */
+static bool llog_cat_is_current(struct llog_handle *cathandle,
+				struct llog_handle *loghandle)
+{
+	struct cat_handle_data	*chd = &cathandle->u.chd;
+	int			 i;
+
+	for (i = 0; i < chd->chd_nslots; i++)
+		if (chd->chd_slots[i].lcs_current_log == loghandle)
+			return true;
+	return false;
+}
+
+/** Return the currently active log handle of \a slot.  If the current log
+ * handle doesn't have enough space left for the current record, start a new
+ * one.
  *
  * If reclen is 0, we only want to know what the currently active log is,
  * otherwise we get a lock on this log so nobody can steal our space.
@@ -241,13 +328,13 @@ enum {
  * NOTE: loghandle is write-locked upon successful return
  */
 static struct llog_handle *llog_cat_current_log(struct llog_handle *cathandle,
-						struct thandle *th)
+						struct llog_cat_slot *slot)
 {
         struct llog_handle *loghandle = NULL;
         ENTRY;
 
 	down_read_nested(&cathandle->lgh_lock, LLOGH_CAT);
-        loghandle = cathandle->u.chd.chd_current_log;
+	loghandle = slot->lcs_current_log;
         if (loghandle) {
 		struct llog_log_hdr *llh;
 
@@ -267,7 +354,7 @@ static struct llog_handle *llog_cat_current_log(struct llog_handle *cathandle,
 
 	/* first, we have to make sure the state hasn't changed */
 	down_write_nested(&cathandle->lgh_lock, LLOGH_CAT);
-	loghandle = cathandle->u.chd.chd_current_log;
+	loghandle = slot->lcs_current_log;
 	if (loghandle) {
 		struct llog_log_hdr *llh;
 
@@ -284,9 +371,9 @@ static struct llog_handle *llog_cat_current_log(struct llog_handle *cathandle,
 
 	CDEBUG(D_INODE, "use next log\n");
 
-	loghandle = cathandle->u.chd.chd_next_log;
-	cathandle->u.chd.chd_current_log = loghandle;
-	cathandle->u.chd.chd_next_log = NULL;
+	loghandle = slot->lcs_next_log;
+	slot->lcs_current_log = loghandle;
+	slot->lcs_next_log = NULL;
 	down_write_nested(&loghandle->lgh_lock, LLOGH_LOG);
 	up_write(&cathandle->lgh_lock);
 	LASSERT(loghandle);
@@ -302,12 +389,13 @@ int llog_cat_add_rec(const struct lu_env *env, struct llog_handle *cathandle,
 		     struct llog_rec_hdr *rec, struct llog_cookie *reccookie,
 		     struct thandle *th)
 {
+	struct llog_cat_slot *slot = llog_cat_slot(cathandle, th);
         struct llog_handle *loghandle;
         int rc;
         ENTRY;
 
         LASSERT(rec->lrh_len <= LLOG_CHUNK_SIZE);
-	loghandle = llog_cat_current_log(cathandle, th);
+	loghandle = llog_cat_current_log(cathandle, slot);
 	LASSERT(!IS_ERR(loghandle));
 
 	/* loghandle is already locked by llog_cat_current_log() for us */
@@ -326,7 +414,7 @@ int llog_cat_add_rec(const struct lu_env *env, struct llog_handle *cathandle,
 	up_write(&loghandle->lgh_lock);
         if (rc == -ENOSPC) {
 		/* try to use next log */
-		loghandle = llog_cat_current_log(cathandle, th);
+		loghandle = llog_cat_current_log(cathandle, slot);
 		LASSERT(!IS_ERR(loghandle));
 		/* new llog can be created concurrently */
 		if (!llog_exist(loghandle)) {
@@ -354,32 +442,33 @@ int llog_cat_declare_add_rec(const struct lu_env *env,
 {
 	struct llog_thread_info	*lgi = llog_info(env);
 	struct llog_logid_rec	*lirec = &lgi->lgi_logid;
+	struct llog_cat_slot	*slot = llog_cat_slot(cathandle, th);
 	struct llog_handle	*loghandle, *next;
 	int			 rc = 0;
 
 	ENTRY;
 
-	if (cathandle->u.chd.chd_current_log == NULL) {
+	if (slot->lcs_current_log == NULL) {
 		/* declare new plain llog */
 		down_write(&cathandle->lgh_lock);
-		if (cathandle->u.chd.chd_current_log == NULL) {
+		if (slot->lcs_current_log == NULL) {
 			rc = llog_open(env, cathandle->lgh_ctxt, &loghandle,
 				       NULL, NULL, LLOG_OPEN_NEW);
 			if (rc == 0) {
-				cathandle->u.chd.chd_current_log = loghandle;
+				slot->lcs_current_log = loghandle;
 				list_add_tail(&loghandle->u.phd.phd_entry,
 					      &cathandle->u.chd.chd_head);
 			}
 		}
 		up_write(&cathandle->lgh_lock);
-	} else if (cathandle->u.chd.chd_next_log == NULL) {
+	} else if (slot->lcs_next_log == NULL) {
 		/* declare next plain llog */
 		down_write(&cathandle->lgh_lock);
-		if (cathandle->u.chd.chd_next_log == NULL) {
+		if (slot->lcs_next_log == NULL) {
 			rc = llog_open(env, cathandle->lgh_ctxt, &loghandle,
 				       NULL, NULL, LLOG_OPEN_NEW);
 			if (rc == 0) {
-				cathandle->u.chd.chd_next_log = loghandle;
+				slot->lcs_next_log = loghandle;
 				list_add_tail(&loghandle->u.phd.phd_entry,
 					      &cathandle->u.chd.chd_head);
 			}
@@ -391,20 +480,18 @@ int llog_cat_declare_add_rec(const struct lu_env *env,
 
 	lirec->lid_hdr.lrh_len = sizeof(*lirec);
 
-	if (!llog_exist(cathandle->u.chd.chd_current_log)) {
-		rc = llog_declare_create(env, cathandle->u.chd.chd_current_log,
-					 th);
+	if (!llog_exist(slot->lcs_current_log)) {
+		rc = llog_declare_create(env, slot->lcs_current_log, th);
 		if (rc)
 			GOTO(out, rc);
 		llog_declare_write_rec(env, cathandle, &lirec->lid_hdr, -1, th);
 	}
 	/* declare records in the llogs */
-	rc = llog_declare_write_rec(env, cathandle->u.chd.chd_current_log,
-				    rec, -1, th);
+	rc = llog_declare_write_rec(env, slot->lcs_current_log, rec, -1, th);
 	if (rc)
 		GOTO(out, rc);
 
-	next = cathandle->u.chd.chd_next_log;
+	next = slot->lcs_next_log;
 	if (next) {
 		if (!llog_exist(next)) {
 			rc = llog_declare_create(env, next, th);
@@ -550,7 +637,7 @@ int llog_cat_process_cb(const struct lu_env *env, struct llog_handle *cat_llh,
 	hdr = llh->lgh_hdr;
 	if ((hdr->llh_flags & LLOG_F_ZAP_WHEN_EMPTY) &&
 	    hdr->llh_count == 1 &&
-	    llh != cat_llh->u.chd.chd_current_log) {
+	    !llog_cat_is_current(cat_llh, llh)) {
 		rc = llog_destroy(env, llh);
 		if (rc)
 			CERROR("%s: fail to destroy empty log: rc = %d\n",
@@ -585,21 +672,16 @@ out:
 	RETURN(rc);
 }
 
-int llog_cat_process_or_fork(const struct lu_env *env,
-			     struct llog_handle *cat_llh,
-			     llog_cb_t cb, void *data, int startcat,
-			     int startidx, bool fork)
+/* calls \a cat_cb on the records of catalog \a cat_llh, oldest first */
+static int llog_cat_process_common(const struct lu_env *env,
+				   struct llog_handle *cat_llh,
+				   llog_cb_t cat_cb, void *data, bool fork)
 {
-        struct llog_process_data d;
-        struct llog_log_hdr *llh = cat_llh->lgh_hdr;
-        int rc;
-        ENTRY;
+	struct llog_log_hdr *llh = cat_llh->lgh_hdr;
+	int rc;
+	ENTRY;
 
-        LASSERT(llh->llh_flags & LLOG_F_IS_CAT);
-        d.lpd_data = data;
-        d.lpd_cb = cb;
-        d.lpd_startcat = startcat;
-        d.lpd_startidx = startidx;
+	LASSERT(llh->llh_flags & LLOG_F_IS_CAT);
 
         if (llh->llh_cat_idx > cat_llh->lgh_last_idx) {
                 struct llog_process_cat_data cd;
@@ -609,22 +691,38 @@ int llog_cat_process_or_fork(const struct lu_env *env,
 
                 cd.lpcd_first_idx = llh->llh_cat_idx;
                 cd.lpcd_last_idx = 0;
-		rc = llog_process_or_fork(env, cat_llh, llog_cat_process_cb,
-					  &d, &cd, fork);
+		rc = llog_process_or_fork(env, cat_llh, cat_cb, data, &cd,
+					  fork);
 		if (rc != 0)
 			RETURN(rc);
 
 		cd.lpcd_first_idx = 0;
 		cd.lpcd_last_idx = cat_llh->lgh_last_idx;
-		rc = llog_process_or_fork(env, cat_llh, llog_cat_process_cb,
-					  &d, &cd, fork);
+		rc = llog_process_or_fork(env, cat_llh, cat_cb, data, &cd,
+					  fork);
         } else {
-		rc = llog_process_or_fork(env, cat_llh, llog_cat_process_cb,
-					  &d, NULL, fork);
+		rc = llog_process_or_fork(env, cat_llh, cat_cb, data, NULL,
+					  fork);
         }
 
         RETURN(rc);
 }
+
+int llog_cat_process_or_fork(const struct lu_env *env,
+			     struct llog_handle *cat_llh,
+			     llog_cb_t cb, void *data, int startcat,
+			     int startidx, bool fork)
+{
+	struct llog_process_data d;
+
+	d.lpd_data = data;
+	d.lpd_cb = cb;
+	d.lpd_startcat = startcat;
+	d.lpd_startidx = startidx;
+
+	return llog_cat_process_common(env, cat_llh, llog_cat_process_cb, &d,
+				       fork);
+}
 EXPORT_SYMBOL(llog_cat_process_or_fork);
 
 int llog_cat_process(const struct lu_env *env, struct llog_handle *cat_llh,
@@ -635,6 +733,247 @@ int llog_cat_process(const struct lu_env *env, struct llog_handle *cat_llh,
 }
 EXPORT_SYMBOL(llog_cat_process);
 
+/* a plain log being merged by llog_cat_process_sorted() */
+struct llog_cat_cursor {
+	struct list_head	 lcc_list;
+	struct llog_handle	*lcc_llh;
+	/* block of the log holding lcc_rec */
+	char			*lcc_buf;
+	/* current record, and its key and index */
+	struct llog_rec_hdr	*lcc_rec;
+	__u64			 lcc_key;
+	int			 lcc_index;
+	/* where llog_next_block() continues from */
+	__u64			 lcc_offset;
+	int			 lcc_saved_index;
+};
+
+struct llog_sorted_data {
+	/* cursors of the plain logs with records left */
+	struct list_head	 lsd_cursors;
+	llog_cb_t		 lsd_cb;
+	llog_key_cb_t		 lsd_key;
+	void			*lsd_data;
+};
+
+static void llog_cat_cursor_fini(struct llog_cat_cursor *lcc)
+{
+	list_del(&lcc->lcc_list);
+	if (lcc->lcc_llh != NULL)
+		llog_handle_put(lcc->lcc_llh);
+	if (lcc->lcc_buf != NULL)
+		OBD_FREE(lcc->lcc_buf, LLOG_CHUNK_SIZE);
+	OBD_FREE_PTR(lcc);
+}
+
+/**
+ * Moves \a lcc to the next record of its plain log, as llog_process() would
+ * find it.
+ *
+ * \retval 1 if there is one
+ * \retval 0 at the end of the log
+ * \retval negative errno on failure
+ */
+static int llog_cat_cursor_next(const struct lu_env *env,
+				struct llog_cat_cursor *lcc,
+				llog_key_cb_t key)
+{
+	struct llog_log_hdr	*llh = lcc->lcc_llh->lgh_hdr;
+	struct llog_rec_hdr	*rec = lcc->lcc_rec;
+	int			 index = lcc->lcc_index + 1;
+	bool			 fresh = false;
+	int			 rc;
+
+	/* skip records not set in bitmap */
+	while (index < LLOG_BITMAP_BYTES * 8 &&
+	       !ext2_test_bit(index, llh->llh_bitmap))
+		index++;
+	if (index >= LLOG_BITMAP_BYTES * 8)
+		return 0;
+
+	if (rec != NULL)
+		rec = (struct llog_rec_hdr *)((char *)rec + rec->lrh_len);
+
+	for (;;) {
+		if (rec == NULL ||
+		    (char *)rec >= lcc->lcc_buf + LLOG_CHUNK_SIZE ||
+		    rec->lrh_index == 0) {
+			/* the block read for \a index has to hold it */
+			if (fresh)
+				return 0;
+
+			/* get the buf with our target record; avoid old
+			 * garbage */
+			memset(lcc->lcc_buf, 0, LLOG_CHUNK_SIZE);
+			rc = llog_next_block(env, lcc->lcc_llh,
+					     &lcc->lcc_saved_index, index,
+					     &lcc->lcc_offset, lcc->lcc_buf,
+					     LLOG_CHUNK_SIZE);
+			if (rc)
+				return rc;
+			rec = (struct llog_rec_hdr *)lcc->lcc_buf;
+			fresh = true;
+			continue;
+		}
+
+		if (LLOG_REC_HDR_NEEDS_SWABBING(rec))
+			lustre_swab_llog_rec(rec);
+
+		if (rec->lrh_len == 0 || rec->lrh_len > LLOG_CHUNK_SIZE) {
+			CWARN("invalid length %d in llog record for index "
+			      "%d/%d\n", rec->lrh_len, rec->lrh_index, index);
+			return -EINVAL;
+		}
+
+		if (rec->lrh_index >= index &&
+		    ext2_test_bit(rec->lrh_index, llh->llh_bitmap)) {
+			lcc->lcc_rec = rec;
+			lcc->lcc_index = rec->lrh_index;
+			lcc->lcc_key = key(rec);
+			return 1;
+		}
+
+		rec = (struct llog_rec_hdr *)((char *)rec + rec->lrh_len);
+	}
+}
+
+/*
+ * Calls back on the records of all cursors in key order, up to the first
+ * one with a key of \a limit or more, or all of them if \a limit is NULL.
+ * There are at most a few cursors, one per slot the catalog was written
+ * with, so the smallest key is just searched for.
+ */
+static int llog_cat_sorted_emit(const struct lu_env *env,
+				struct llog_sorted_data *lsd, __u64 *limit)
+{
+	struct llog_cat_cursor	*lcc;
+	struct llog_cat_cursor	*min;
+	int			 rc;
+
+	for (;;) {
+		min = NULL;
+		list_for_each_entry(lcc, &lsd->lsd_cursors, lcc_list) {
+			if (min == NULL || lcc->lcc_key < min->lcc_key)
+				min = lcc;
+		}
+		if (min == NULL || (limit != NULL && min->lcc_key >= *limit))
+			return 0;
+
+		min->lcc_llh->lgh_cur_idx = min->lcc_index;
+		rc = lsd->lsd_cb(env, min->lcc_llh, min->lcc_rec,
+				 lsd->lsd_data);
+		if (rc != 0)
+			return rc;
+
+		rc = llog_cat_cursor_next(env, min, lsd->lsd_key);
+		if (rc <= 0) {
+			llog_cat_cursor_fini(min);
+			if (rc < 0)
+				return rc;
+		}
+	}
+}
+
+static int llog_cat_process_sorted_cb(const struct lu_env *env,
+				      struct llog_handle *cat_llh,
+				      struct llog_rec_hdr *rec, void *data)
+{
+	struct llog_sorted_data	*lsd = data;
+	struct llog_logid_rec	*lir = (struct llog_logid_rec *)rec;
+	struct llog_cat_cursor	*lcc;
+	struct llog_handle	*llh;
+	int			 rc;
+	ENTRY;
+
+	if (rec->lrh_type != LLOG_LOGID_MAGIC) {
+		CERROR("invalid record in catalog\n");
+		RETURN(-EINVAL);
+	}
+
+	rc = llog_cat_id2handle(env, cat_llh, &llh, &lir->lid_id);
+	if (rc) {
+		CERROR("%s: cannot find handle for llog "DOSTID": %d\n",
+		       cat_llh->lgh_ctxt->loc_obd->obd_name,
+		       POSTID(&lir->lid_id.lgl_oi), rc);
+		/* stub of a destroyed log, llog_cat_process() cleans it */
+		if (rc == -ENOENT || rc == -ESTALE)
+			rc = 0;
+		RETURN(rc);
+	}
+
+	OBD_ALLOC_PTR(lcc);
+	if (lcc == NULL) {
+		llog_handle_put(llh);
+		RETURN(-ENOMEM);
+	}
+	list_add_tail(&lcc->lcc_list, &lsd->lsd_cursors);
+	lcc->lcc_llh = llh;
+	lcc->lcc_offset = LLOG_CHUNK_SIZE;
+
+	OBD_ALLOC(lcc->lcc_buf, LLOG_CHUNK_SIZE);
+	if (lcc->lcc_buf == NULL) {
+		llog_cat_cursor_fini(lcc);
+		RETURN(-ENOMEM);
+	}
+
+	rc = llog_cat_cursor_next(env, lcc, lsd->lsd_key);
+	if (rc <= 0) {
+		/* empty log */
+		llog_cat_cursor_fini(lcc);
+		RETURN(rc);
+	}
+
+	/* Plain logs are added to the catalog as their first record is
+	 * written, so none of the logs after this one has a record with a
+	 * smaller key than its first one, and all records below it can go */
+	RETURN(llog_cat_sorted_emit(env, lsd, &lcc->lcc_key));
+}
+
+/**
+ * Processes the records of catalog \a cat_llh by increasing \a key, for
+ * catalogs with several slots (see llog_cat_set_slots()). The plain logs are
+ * merged as they are read, only the few written at the same time are open
+ * at once. The merge relies on each plain log being ordered by \a key, as
+ * the records of a single slot catalog are: records of transactions racing
+ * to a plain log stay in the order they were appended in.
+ *
+ * Unlike llog_cat_process(), \a cb can't cancel records, and empty plain
+ * logs are left alone.
+ *
+ * \param cb	called on each record
+ * \param key	returns the key of a record
+ * \param data	passed to \a cb
+ *
+ * \retval 0 if all records were processed
+ * \retval what \a cb returned if it wasn't 0, or a negative errno
+ */
+int llog_cat_process_sorted(const struct lu_env *env,
+			    struct llog_handle *cat_llh, llog_cb_t cb,
+			    llog_key_cb_t key, void *data)
+{
+	struct llog_sorted_data	 lsd;
+	struct llog_cat_cursor	*lcc;
+	struct llog_cat_cursor	*tmp;
+	int			 rc;
+	ENTRY;
+
+	INIT_LIST_HEAD(&lsd.lsd_cursors);
+	lsd.lsd_cb = cb;
+	lsd.lsd_key = key;
+	lsd.lsd_data = data;
+
+	rc = llog_cat_process_common(env, cat_llh, llog_cat_process_sorted_cb,
+				     &lsd, false);
+	if (rc == 0)
+		rc = llog_cat_sorted_emit(env, &lsd, NULL);
+
+	list_for_each_entry_safe(lcc, tmp, &lsd.lsd_cursors, lcc_list)
+		llog_cat_cursor_fini(lcc);
+
+	RETURN(rc);
+}
+EXPORT_SYMBOL(llog_cat_process_sorted);
+
 static int llog_cat_reverse_process_cb(const struct lu_env *env,
 				       struct llog_handle *cat_llh,
 				       struct llog_rec_hdr *rec, void *data)
@@ -676,7 +1015,7 @@ static int llog_cat_reverse_process_cb(const struct lu_env *env,
 	hdr = llh->lgh_hdr;
 	if ((hdr->llh_flags & LLOG_F_ZAP_WHEN_EMPTY) &&
 	    hdr->llh_count == 1 &&
-	    llh != cat_llh->u.chd.chd_current_log) {
+	    !llog_cat_is_current(cat_llh, llh)) {
 		rc = llog_destroy(env, llh);
 		if (rc)
 			CERROR("%s: fail to destroy empty log: rc = %d\n",
@@ -777,11 +1116,15 @@ int llog_cat_cleanup(const struct lu_env *env, struct llog_handle *cathandle,
 
 	LASSERT(index);
 	if (loghandle != NULL) {
+		struct cat_handle_data *chd = &cathandle->u.chd;
+		int			i;
+
 		/* remove destroyed llog from catalog list and
-		 * chd_current_log variable */
+		 * lcs_current_log variable of its slot */
 		down_write(&cathandle->lgh_lock);
-		if (cathandle->u.chd.chd_current_log == loghandle)
-			cathandle->u.chd.chd_current_log = NULL;
+		for (i = 0; i < chd->chd_nslots; i++)
+			if (chd->chd_slots[i].lcs_current_log == loghandle)
+				chd->chd_slots[i].lcs_current_log = NULL;
 		list_del_init(&loghandle->u.phd.phd_entry);
 		up_write(&cathandle->lgh_lock);
 		LASSERT(index == loghandle->u.phd.phd_cookie.lgc_index);
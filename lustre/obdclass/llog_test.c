@@ -43,6 +43,7 @@
 
 #include <linux/module.h>
 #include <linux/init.h>
+#include <linux/kthread.h>
 
 #include <obd_class.h>
 #include <lustre_fid.h>
@@ -339,7 +340,8 @@ static int llog_test_4(const struct lu_env *env, struct obd_device *obd)
 	if (rc)
 		GOTO(out, rc);
 
-	rc = verify_handle("4b", cath->u.chd.chd_current_log, num_recs);
+	rc = verify_handle("4b", cath->u.chd.chd_slot.lcs_current_log,
+			   num_recs);
 	if (rc)
 		GOTO(out, rc);
 
@@ -351,7 +353,8 @@ static int llog_test_4(const struct lu_env *env, struct obd_device *obd)
 	}
 	num_recs--;
 
-	rc = verify_handle("4c", cath->u.chd.chd_current_log, num_recs);
+	rc = verify_handle("4c", cath->u.chd.chd_slot.lcs_current_log,
+			   num_recs);
 	if (rc)
 		GOTO(out, rc);
 
@@ -983,7 +986,7 @@ static int llog_test_8(const struct lu_env *env, struct obd_device *obd)
 	}
 
 	/* grab the current plain llog, we'll corrupt it later */
-	obj = llh->u.chd.chd_current_log->lgh_obj;
+	obj = llh->u.chd.chd_slot.lcs_current_log->lgh_obj;
 	LASSERT(obj);
 	lu_object_get(&obj->do_lu);
 	CWARN("8a: pin llog "DFID"\n", PFID(lu_object_fid(&obj->do_lu)));
@@ -1017,7 +1020,8 @@ static int llog_test_8(const struct lu_env *env, struct obd_device *obd)
 		}
 	}
 	CWARN("8b: second llog "DFID"\n",
-		PFID(lu_object_fid(&llh->u.chd.chd_current_log->lgh_obj->do_lu)));
+	      PFID(lu_object_fid(&llh->u.chd.chd_slot.lcs_current_log->
+				 lgh_obj->do_lu)));
 
 	rc2 = llog_cat_close(env, llh);
 	if (rc2) {
@@ -1073,6 +1077,248 @@ out_put:
 	RETURN(rc);
 }
 
+#define LLOG_TEST_9_THREADS	4
+
+/* record of test 9, with the key it's sorted by */
+struct llog_test_9_rec {
+	struct llog_rec_hdr	lt9_hdr;
+	__u64			lt9_key;
+	__u32			lt9_thread;
+	__u32			lt9_padding;
+	struct llog_rec_tail	lt9_tail;
+} __attribute__((packed));
+
+static atomic_t llog_test_9_key;
+
+static int llog_test_9_add(const struct lu_env *env, struct llog_handle *cath,
+			   int thread)
+{
+	struct llog_test_9_rec rec;
+
+	rec.lt9_hdr.lrh_len = rec.lt9_tail.lrt_len = sizeof(rec);
+	rec.lt9_hdr.lrh_type = 0xf00f00;
+	rec.lt9_key = atomic_inc_return(&llog_test_9_key);
+	rec.lt9_thread = thread;
+	rec.lt9_padding = 0;
+
+	return llog_cat_add(env, cath, &rec.lt9_hdr, NULL);
+}
+
+struct llog_test_9_thread {
+	struct llog_handle	*lt9t_cath;
+	struct completion	 lt9t_done;
+	int			 lt9t_id;
+	int			 lt9t_nrecs;
+	int			 lt9t_rc;
+};
+
+static int llog_test_9_thread(void *arg)
+{
+	struct llog_test_9_thread	*t = arg;
+	struct lu_env			 env;
+	struct lu_context		 session;
+	int				 rc;
+	int				 i;
+
+	rc = lu_env_init(&env, LCT_LOCAL | LCT_MG_THREAD);
+	if (rc)
+		GOTO(out, rc);
+
+	rc = lu_context_init(&session, LCT_SERVER_SESSION);
+	if (rc)
+		GOTO(out_env, rc);
+	session.lc_thread = (struct ptlrpc_thread *)current;
+	lu_context_enter(&session);
+	env.le_ses = &session;
+
+	for (i = 0; i < t->lt9t_nrecs && rc == 0; i++)
+		rc = llog_test_9_add(&env, t->lt9t_cath, t->lt9t_id);
+
+	lu_context_exit(&session);
+	lu_context_fini(&session);
+out_env:
+	lu_env_fini(&env);
+out:
+	t->lt9t_rc = rc;
+	complete(&t->lt9t_done);
+	return 0;
+}
+
+struct llog_test_9_check {
+	/* last key seen of each writer, 0 is the test itself */
+	__u64	lt9c_last[LLOG_TEST_9_THREADS + 1];
+	int	lt9c_count;
+};
+
+static __u64 llog_test_9_key_cb(struct llog_rec_hdr *rec)
+{
+	return ((struct llog_test_9_rec *)rec)->lt9_key;
+}
+
+static int llog_test_9_check_cb(const struct lu_env *env,
+				struct llog_handle *llh,
+				struct llog_rec_hdr *rec, void *data)
+{
+	struct llog_test_9_check	*c = data;
+	struct llog_test_9_rec		*r = (struct llog_test_9_rec *)rec;
+
+	if (rec->lrh_len != sizeof(*r) ||
+	    r->lt9_thread > LLOG_TEST_9_THREADS) {
+		CERROR("9d: bad record at index %d\n", rec->lrh_index);
+		RETURN(-EINVAL);
+	}
+
+	/* the records written before the threads started come first, all
+	 * of them in key order */
+	if (r->lt9_thread == 0 && r->lt9_key != c->lt9c_count + 1) {
+		CERROR("9d: record #%d has key "LPU64"\n",
+		       c->lt9c_count + 1, r->lt9_key);
+		RETURN(-EINVAL);
+	}
+
+	/* the records of each thread come in the order it wrote them */
+	if (r->lt9_key <= c->lt9c_last[r->lt9_thread]) {
+		CERROR("9d: key "LPU64" of thread %u after "LPU64"\n",
+		       r->lt9_key, r->lt9_thread,
+		       c->lt9c_last[r->lt9_thread]);
+		RETURN(-EINVAL);
+	}
+
+	c->lt9c_last[r->lt9_thread] = r->lt9_key;
+	c->lt9c_count++;
+	RETURN(0);
+}
+
+/* Test catalog with several plain logs appended to concurrently */
+static int llog_test_9(const struct lu_env *env, struct obd_device *obd)
+{
+	struct llog_test_9_thread	 threads[LLOG_TEST_9_THREADS];
+	struct llog_test_9_check	 check;
+	struct llog_handle		*cath;
+	struct task_struct		*task;
+	char				 name[10];
+	int				 nthreads;
+	int				 rc, rc2, i;
+	struct llog_ctxt		*ctxt;
+
+	ENTRY;
+
+	ctxt = llog_get_context(obd, LLOG_TEST_ORIG_CTXT);
+	LASSERT(ctxt);
+
+	sprintf(name, "%x", llog_test_rand + 2);
+	CWARN("9a: create a catalog log with 4 slots, name: %s\n", name);
+	rc = llog_open_create(env, ctxt, &cath, NULL, name);
+	if (rc) {
+		CERROR("9a: llog_create with name %s failed: %d\n", name, rc);
+		GOTO(ctxt_release, rc);
+	}
+	rc = llog_init_handle(env, cath, LLOG_F_IS_CAT, &uuid);
+	if (rc) {
+		CERROR("9a: can't init llog handle: %d\n", rc);
+		GOTO(out, rc);
+	}
+	rc = llog_cat_set_slots(cath, 4);
+	if (rc) {
+		CERROR("9a: can't set up slots: %d\n", rc);
+		GOTO(out, rc);
+	}
+
+	atomic_set(&llog_test_9_key, 0);
+
+	CWARN("9b: write %d log records\n", LLOG_TEST_RECNUM / 2);
+	for (i = 0; i < LLOG_TEST_RECNUM / 2; i++) {
+		rc = llog_test_9_add(env, cath, 0);
+		if (rc) {
+			CERROR("9b: write %d records failed at #%d: %d\n",
+			       LLOG_TEST_RECNUM / 2, i + 1, rc);
+			GOTO(out, rc);
+		}
+	}
+
+	CWARN("9c: write %d log records from %d threads\n",
+	      LLOG_TEST_RECNUM / 2, LLOG_TEST_9_THREADS);
+	for (i = 0; i < LLOG_TEST_9_THREADS; i++) {
+		threads[i].lt9t_cath = cath;
+		threads[i].lt9t_id = i + 1;
+		threads[i].lt9t_nrecs = LLOG_TEST_RECNUM /
+					(2 * LLOG_TEST_9_THREADS);
+		threads[i].lt9t_rc = 0;
+		init_completion(&threads[i].lt9t_done);
+
+		task = kthread_run(llog_test_9_thread, &threads[i],
+				   "llog_test_9_%d", i);
+		if (IS_ERR(task)) {
+			rc = PTR_ERR(task);
+			CERROR("9c: cannot start thread: %d\n", rc);
+			break;
+		}
+	}
+	nthreads = i;
+	for (i = 0; i < nthreads; i++) {
+		wait_for_completion(&threads[i].lt9t_done);
+		if (threads[i].lt9t_rc != 0) {
+			CERROR("9c: thread %d failed: %d\n", i + 1,
+			       threads[i].lt9t_rc);
+			if (rc == 0)
+				rc = threads[i].lt9t_rc;
+		}
+	}
+	if (rc)
+		GOTO(out, rc);
+
+	if (!(cath->lgh_hdr->llh_flags & LLOG_F_MULTI_SLOT)) {
+		CERROR("9c: catalog isn't flagged as multi slot\n");
+		GOTO(out, rc = -EINVAL);
+	}
+
+	CWARN("9d: check records are sorted by key\n");
+	memset(&check, 0, sizeof(check));
+	rc = llog_cat_process_sorted(env, cath, llog_test_9_check_cb,
+				     llog_test_9_key_cb, &check);
+	if (rc) {
+		CERROR("9d: sorted process failed: %d\n", rc);
+		GOTO(out, rc);
+	}
+	if (check.lt9c_count != LLOG_TEST_RECNUM) {
+		CERROR("9d: found %d records\n", check.lt9c_count);
+		GOTO(out, rc = -EINVAL);
+	}
+
+	CWARN("9e: print plain log entries.. expect %d\n", LLOG_TEST_RECNUM);
+	plain_counter = 0;
+	rc = llog_cat_process(env, cath, plain_print_cb, "foobar", 0, 0);
+	if (rc) {
+		CERROR("9e: process with plain_print_cb failed: %d\n", rc);
+		GOTO(out, rc);
+	}
+	if (plain_counter != LLOG_TEST_RECNUM) {
+		CERROR("9e: found %d records\n", plain_counter);
+		GOTO(out, rc = -EINVAL);
+	}
+
+	CWARN("9f: cancel all records\n");
+	cancel_count = 0;
+	rc = llog_cat_process(env, cath, llog_cancel_rec_cb, "foobar", 0, 0);
+	if (rc != -LLOG_EEMPTY) {
+		CERROR("9f: process with llog_cancel_rec_cb failed: %d\n", rc);
+		GOTO(out, rc);
+	}
+	rc = 0;
+
+out:
+	CWARN("9g: close catalog\n");
+	rc2 = llog_cat_close(env, cath);
+	if (rc2) {
+		CERROR("9g: close log %s failed: %d\n", name, rc2);
+		if (rc == 0)
+			rc = rc2;
+	}
+ctxt_release:
+	llog_ctxt_put(ctxt);
+	RETURN(rc);
+}
+
 /* -------------------------------------------------------------------------
  * Tests above, boring obd functions below
  * ------------------------------------------------------------------------- */
@@ -1121,6 +1367,10 @@ static int llog_run_tests(const struct lu_env *env, struct obd_device *obd)
 	if (rc)
 		GOTO(cleanup, rc);
 
+	rc = llog_test_9(env, obd);
+	if (rc)
+		GOTO(cleanup, rc);
+
 cleanup:
 	err = llog_destroy(env, llh);
 	if (err)
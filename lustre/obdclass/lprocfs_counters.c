@@ -64,6 +64,10 @@ void lprocfs_counter_add(struct lprocfs_stats *stats, int idx, long amount)
 	percpu_cntr = lprocfs_stats_counter_get(stats, smp_id, idx);
 	percpu_cntr->lc_count++;
 
+	if (header->lc_config & LPROCFS_CNTR_HISTOGRAM)
+		lprocfs_stats_hist_get(stats, smp_id,
+				       idx)[lprocfs_hist_bucket(amount)]++;
+
 	if (header->lc_config & LPROCFS_CNTR_AVGMINMAX) {
 		/*
 		 * lprocfs_counter_add() can be called in interrupt context,
@@ -63,16 +63,41 @@
  *   JobID env var: Same as PBS.
  */
 
+/*
+ * Jobs are hashed by jobid in ojs_hash, and kept on the list of the CPT
+ * which created them, so creating jobs on different CPTs doesn't contend
+ * on a single list lock. Each list is in rough LRU order: jobs are added
+ * to the tail, and job_evict() moves the jobs it finds still in use to the
+ * tail, so the oldest jobs gather at the head.
+ *
+ * Idle jobs are expired by a cleanup thread per obd_job_stats, a batch
+ * at a time, and the thread also trims the lists when the jobs use more
+ * memory than ojs_max_mb. RPC handling only ever evicts a few jobs of its
+ * own CPT, when it has to make room for a new job.
+ */
+struct job_stat_list {
+	rwlock_t		jsl_lock;
+	struct list_head	jsl_list;
+};
+
 struct job_stat {
 	struct hlist_node	js_hash;
-	struct list_head	js_list;
+	struct list_head	js_list;	/* on ojs_lists[js_cpt] */
 	atomic_t		js_refcount;
+	int			js_cpt;
 	char			js_jobid[JOBSTATS_JOBID_SIZE];
 	time_t			js_timestamp; /* seconds */
 	struct lprocfs_stats	*js_stats;
 	struct obd_job_stats	*js_jobstats;
 };
 
+/* max # jobs removed at once, under a list lock */
+#define JOB_EVICT_BATCH		64
+/* max # jobs looked at by job_evict() under a list lock */
+#define JOB_SCAN_MAX		(4 * JOB_EVICT_BATCH)
+/* # jobs RPC handling evicts to make room for a new one */
+#define JOB_EVICT_INLINE	2
+
 static unsigned job_stat_hash(cfs_hash_t *hs, const void *key, unsigned mask)
 {
 	return cfs_hash_djb2_hash(key, strlen(key), mask);
@@ -107,13 +132,18 @@ static void job_stat_get(cfs_hash_t *hs, struct hlist_node *hnode)
 
 static void job_free(struct job_stat *job)
 {
+	struct obd_job_stats	*stats = job->js_jobstats;
+	struct job_stat_list	*jsl;
+
 	LASSERT(atomic_read(&job->js_refcount) == 0);
-	LASSERT(job->js_jobstats);
+	LASSERT(stats);
 
-	write_lock(&job->js_jobstats->ojs_lock);
+	jsl = stats->ojs_lists[job->js_cpt];
+	write_lock(&jsl->jsl_lock);
 	list_del_init(&job->js_list);
-	write_unlock(&job->js_jobstats->ojs_lock);
+	write_unlock(&jsl->jsl_lock);
 
+	atomic_dec(&stats->ojs_nentries);
 	lprocfs_free_stats(&job->js_stats);
 	OBD_FREE_PTR(job);
 }
@@ -150,32 +180,129 @@ static cfs_hash_ops_t job_stats_hash_ops = {
 static int job_iter_callback(cfs_hash_t *hs, cfs_hash_bd_t *bd,
 			     struct hlist_node *hnode, void *data)
 {
-	time_t oldest = *((time_t *)data);
-	struct job_stat *job;
+	cfs_hash_bd_del_locked(hs, bd, hnode);
+	return 0;
+}
 
-	job = hlist_entry(hnode, struct job_stat, js_hash);
-	if (!oldest || job->js_timestamp < oldest)
-		cfs_hash_bd_del_locked(hs, bd, hnode);
+static bool job_stats_full(struct obd_job_stats *stats)
+{
+	return stats->ojs_max_mb != 0 &&
+	       (__u64)atomic_read(&stats->ojs_nentries) *
+	       stats->ojs_entry_size >= (__u64)stats->ojs_max_mb << 20;
+}
 
-	return 0;
+/**
+ * Removes up to \a nr jobs of CPT \a cpt idle since before \a cutoff.
+ * Jobs used since are moved to the tail of the list on the way, so the
+ * next scan starts with jobs it hasn't looked at yet.
+ *
+ * \retval number of removed jobs
+ */
+static int job_evict(struct obd_job_stats *stats, int cpt, time_t cutoff,
+		     int nr)
+{
+	struct job_stat_list	*jsl = stats->ojs_lists[cpt];
+	struct job_stat		*victims[JOB_EVICT_BATCH];
+	struct job_stat		*job;
+	struct job_stat		*tmp;
+	int			 scanned = 0;
+	int			 n = 0;
+	int			 i;
+
+	LASSERT(nr <= JOB_EVICT_BATCH);
+
+	write_lock(&jsl->jsl_lock);
+	list_for_each_entry_safe(job, tmp, &jsl->jsl_list, js_list) {
+		if (n == nr || scanned++ == JOB_SCAN_MAX)
+			break;
+
+		/* already removed from the hash, going away */
+		if (hlist_unhashed(&job->js_hash))
+			continue;
+
+		if (job->js_timestamp >= cutoff) {
+			list_move_tail(&job->js_list, &jsl->jsl_list);
+			continue;
+		}
+
+		atomic_inc(&job->js_refcount);
+		victims[n++] = job;
+	}
+	write_unlock(&jsl->jsl_lock);
+
+	/* the last reference takes the list lock in job_free() */
+	for (i = 0; i < n; i++) {
+		cfs_hash_del(stats->ojs_hash, victims[i]->js_jobid,
+			     &victims[i]->js_hash);
+		job_putref(victims[i]);
+	}
+	return n;
 }
 
-static void lprocfs_job_cleanup(struct obd_job_stats *stats, bool force)
+/**
+ * Expires the jobs idle for more than ojs_cleanup_interval, then evicts
+ * the oldest jobs while over ojs_max_mb. Each pass takes at most a batch
+ * of jobs from every CPT, so no list lock is held for long.
+ */
+static void job_cleanup(struct obd_job_stats *stats)
 {
-	time_t oldest, now;
+	struct job_stat_list	*jsl;
+	time_t			 now = cfs_time_current_sec();
+	time_t			 cutoff;
+	int			 removed;
+	int			 cpt;
+
+	do {
+		removed = 0;
+		cfs_percpt_for_each(jsl, cpt, stats->ojs_lists) {
+			/* keep the jobs used in the last second anyway */
+			if (job_stats_full(stats))
+				cutoff = now;
+			else if (stats->ojs_cleanup_interval != 0)
+				cutoff = now - stats->ojs_cleanup_interval;
+			else
+				continue;
+
+			removed += job_evict(stats, cpt, cutoff,
+					     JOB_EVICT_BATCH);
+		}
+		cond_resched();
+	} while (removed > 0 && !stats->ojs_cleanup_stop);
+}
 
-	if (stats->ojs_cleanup_interval == 0)
-		return;
+static void job_cleanup_kick(struct obd_job_stats *stats)
+{
+	stats->ojs_cleanup_kicked = 1;
+	wake_up(&stats->ojs_cleanup_waitq);
+}
 
-	now = cfs_time_current_sec();
-	if (!force && now < stats->ojs_last_cleanup +
-			    stats->ojs_cleanup_interval)
-		return;
+static int job_cleanup_main(void *arg)
+{
+	struct obd_job_stats	*stats = arg;
+	struct l_wait_info	 lwi;
+
+	while (!stats->ojs_cleanup_stop) {
+		lwi = LWI_TIMEOUT(cfs_time_seconds(1), NULL, NULL);
+		l_wait_event(stats->ojs_cleanup_waitq,
+			     stats->ojs_cleanup_stop ||
+			     stats->ojs_cleanup_kicked, &lwi);
+		stats->ojs_cleanup_kicked = 0;
+
+		job_cleanup(stats);
+	}
 
-	oldest = now - stats->ojs_cleanup_interval;
-	cfs_hash_for_each_safe(stats->ojs_hash, job_iter_callback,
-			       &oldest);
-	stats->ojs_last_cleanup = cfs_time_current_sec();
+	complete(&stats->ojs_cleanup_done);
+	return 0;
+}
+
+/* estimated size of a job, counting a single per-CPU counter area */
+static int job_stat_size(struct lprocfs_stats *stats)
+{
+	return sizeof(struct job_stat) +
+	       offsetof(struct lprocfs_stats,
+			ls_percpu[num_possible_cpus()]) +
+	       stats->ls_num * sizeof(struct lprocfs_counter_header) +
+	       lprocfs_stats_counter_size(stats);
 }
 
 static struct job_stat *job_alloc(char *jobid, struct obd_job_stats *jobs)
@@ -195,13 +322,17 @@ static struct job_stat *job_alloc(char *jobid, struct obd_job_stats *jobs)
 	}
 
 	jobs->ojs_cntr_init_fn(job->js_stats);
+	if (unlikely(jobs->ojs_entry_size == 0))
+		jobs->ojs_entry_size = job_stat_size(job->js_stats);
 
 	memcpy(job->js_jobid, jobid, JOBSTATS_JOBID_SIZE);
 	job->js_timestamp = cfs_time_current_sec();
 	job->js_jobstats = jobs;
+	job->js_cpt = cfs_cpt_current(cfs_cpt_table, 0);
 	INIT_HLIST_NODE(&job->js_hash);
 	INIT_LIST_HEAD(&job->js_list);
 	atomic_set(&job->js_refcount, 1);
+	atomic_inc(&jobs->ojs_nentries);
 
 	return job;
 }
@@ -215,8 +346,6 @@ int lprocfs_job_stats_log(struct obd_device *obd, char *jobid,
 
 	LASSERT(stats && stats->ojs_hash);
 
-	lprocfs_job_cleanup(stats, false);
-
 	if (!jobid || !strlen(jobid))
 		RETURN(-EINVAL);
 
@@ -230,6 +359,12 @@ int lprocfs_job_stats_log(struct obd_device *obd, char *jobid,
 	if (job)
 		goto found;
 
+	if (job_stats_full(stats)) {
+		job_evict(stats, cfs_cpt_current(cfs_cpt_table, 0),
+			  cfs_time_current_sec(), JOB_EVICT_INLINE);
+		job_cleanup_kick(stats);
+	}
+
 	job = job_alloc(jobid, stats);
 	if (job == NULL)
 		RETURN(-ENOMEM);
@@ -241,14 +376,16 @@ int lprocfs_job_stats_log(struct obd_device *obd, char *jobid,
 		job = job2;
 		/* We cannot LASSERT(!list_empty(&job->js_list)) here,
 		 * since we just lost the race for inserting "job" into the
-		 * ojs_list, and some other thread is doing it _right_now_.
+		 * ojs_lists, and some other thread is doing it _right_now_.
 		 * Instead, be content the other thread is doing this, since
 		 * "job2" was initialized in job_alloc() already. LU-2163 */
 	} else {
+		struct job_stat_list *jsl = stats->ojs_lists[job->js_cpt];
+
 		LASSERT(list_empty(&job->js_list));
-		write_lock(&stats->ojs_lock);
-		list_add_tail(&job->js_list, &stats->ojs_list);
-		write_unlock(&stats->ojs_lock);
+		write_lock(&jsl->jsl_lock);
+		list_add_tail(&job->js_list, &jsl->jsl_list);
+		write_unlock(&jsl->jsl_lock);
 	}
 
 found:
@@ -264,58 +401,99 @@ EXPORT_SYMBOL(lprocfs_job_stats_log);
 
 void lprocfs_job_stats_fini(struct obd_device *obd)
 {
-	struct obd_job_stats *stats = &obd->u.obt.obt_jobstats;
-	time_t oldest = 0;
+	struct obd_job_stats	*stats = &obd->u.obt.obt_jobstats;
+	struct job_stat_list	*jsl;
+	int			 i;
 
 	if (stats->ojs_hash == NULL)
 		return;
-	cfs_hash_for_each_safe(stats->ojs_hash, job_iter_callback, &oldest);
+
+	if (stats->ojs_cleanup_started) {
+		stats->ojs_cleanup_stop = 1;
+		wake_up(&stats->ojs_cleanup_waitq);
+		wait_for_completion(&stats->ojs_cleanup_done);
+		stats->ojs_cleanup_started = 0;
+	}
+
+	cfs_hash_for_each_safe(stats->ojs_hash, job_iter_callback, NULL);
 	cfs_hash_putref(stats->ojs_hash);
 	stats->ojs_hash = NULL;
-	LASSERT(list_empty(&stats->ojs_list));
+
+	cfs_percpt_for_each(jsl, i, stats->ojs_lists)
+		LASSERT(list_empty(&jsl->jsl_list));
+	cfs_percpt_free(stats->ojs_lists);
+	stats->ojs_lists = NULL;
 }
 EXPORT_SYMBOL(lprocfs_job_stats_fini);
 
+/**
+ * Returns the first job of the first non-empty list from CPT \a cpt on,
+ * with that list read-locked, or NULL if there's none.
+ */
+static struct job_stat *job_list_first(struct obd_job_stats *stats, int cpt)
+{
+	struct job_stat_list *jsl;
+
+	for (; cpt < cfs_cpt_number(cfs_cpt_table); cpt++) {
+		jsl = stats->ojs_lists[cpt];
+		read_lock(&jsl->jsl_lock);
+		if (!list_empty(&jsl->jsl_list))
+			return list_entry(jsl->jsl_list.next,
+					  struct job_stat, js_list);
+		read_unlock(&jsl->jsl_lock);
+	}
+	return NULL;
+}
+
+/* the job after \a job, moving the read lock to its list if needed */
+static struct job_stat *job_list_next(struct obd_job_stats *stats,
+				      struct job_stat *job)
+{
+	int			 cpt = job->js_cpt;
+	struct job_stat_list	*jsl = stats->ojs_lists[cpt];
+
+	if (job->js_list.next != &jsl->jsl_list)
+		return list_entry(job->js_list.next, struct job_stat, js_list);
+
+	/* job can be freed as soon as the list is unlocked */
+	read_unlock(&jsl->jsl_lock);
+	return job_list_first(stats, cpt + 1);
+}
+
 static void *lprocfs_jobstats_seq_start(struct seq_file *p, loff_t *pos)
 {
 	struct obd_job_stats *stats = p->private;
 	loff_t off = *pos;
 	struct job_stat *job;
 
-	read_lock(&stats->ojs_lock);
 	if (off == 0)
 		return SEQ_START_TOKEN;
 	off--;
-	list_for_each_entry(job, &stats->ojs_list, js_list) {
-		if (!off--)
-			return job;
-	}
-	return NULL;
+	job = job_list_first(stats, 0);
+	while (job != NULL && off-- > 0)
+		job = job_list_next(stats, job);
+	return job;
 }
 
 static void lprocfs_jobstats_seq_stop(struct seq_file *p, void *v)
 {
 	struct obd_job_stats *stats = p->private;
+	struct job_stat *job = v;
 
-	read_unlock(&stats->ojs_lock);
+	/* the list lock is dropped when the last list is done */
+	if (job != NULL && v != SEQ_START_TOKEN)
+		read_unlock(&stats->ojs_lists[job->js_cpt]->jsl_lock);
 }
 
 static void *lprocfs_jobstats_seq_next(struct seq_file *p, void *v, loff_t *pos)
 {
 	struct obd_job_stats *stats = p->private;
-	struct job_stat *job;
-	struct list_head *next;
 
 	++*pos;
-	if (v == SEQ_START_TOKEN) {
-		next = stats->ojs_list.next;
-	} else {
-		job = (struct job_stat *)v;
-		next = job->js_list.next;
-	}
+	if (v == SEQ_START_TOKEN)
+		return job_list_first(stats, 0);
 
-	return next == &stats->ojs_list ? NULL :
-		list_entry(next, struct job_stat, js_list);
+	return job_list_next(stats, v);
 }
 
 /*
@@ -453,9 +631,8 @@ static ssize_t lprocfs_jobstats_seq_write(struct file *file,
 
 	LASSERT(stats->ojs_hash);
 	if (all) {
-		time_t oldest = 0;
 		cfs_hash_for_each_safe(stats->ojs_hash, job_iter_callback,
-				       &oldest);
+				       NULL);
 		return len;
 	}
 
@@ -481,11 +658,181 @@ struct file_operations lprocfs_jobstats_seq_fops = {
 	.release = lprocfs_seq_release,
 };
 
+/*
+ * job_stats_snapshot: binary copy of the jobs used since a cursor, in the
+ * format of /proc/fs/lustre/stats_snapshot, with the jobid as path of each
+ * stats block. A collector writes the lsh_time_sec of its previous
+ * snapshot to the file, and reads back only the jobs used since then;
+ * without a write, all jobs are returned. Jobs used during the second of
+ * the cursor can show up in both snapshots, but none is missed.
+ */
+struct job_snapshot_buf {
+	struct obd_job_stats	*jsb_stats;
+	time_t			 jsb_since;
+	char			*jsb_buf;
+	size_t			 jsb_size;
+	size_t			 jsb_len;
+};
+
+static int job_snapshot_grow(struct job_snapshot_buf *jsb, size_t keep)
+{
+	size_t	 size = max_t(size_t, jsb->jsb_size * 2, PAGE_CACHE_SIZE);
+	char	*buf;
+
+	LIBCFS_ALLOC(buf, size);
+	if (buf == NULL)
+		return -ENOMEM;
+
+	if (jsb->jsb_buf != NULL) {
+		memcpy(buf, jsb->jsb_buf, keep);
+		LIBCFS_FREE(jsb->jsb_buf, jsb->jsb_size);
+	}
+	jsb->jsb_buf = buf;
+	jsb->jsb_size = size;
+	return 0;
+}
+
+static int job_snapshot_build(struct job_snapshot_buf *jsb)
+{
+	struct obd_job_stats	*stats = jsb->jsb_stats;
+	struct job_stat_list	*jsl;
+	struct job_stat		*job;
+	struct timeval		 now;
+	size_t			 len = sizeof(struct lprocfs_snapshot_header);
+	size_t			 size;
+	size_t			 start;
+	int			 nstats = 0;
+	int			 nstart;
+	int			 cpt;
+	int			 rc;
+
+	/* the cursor for the next snapshot, taken before any job is read */
+	do_gettimeofday(&now);
+
+	if (jsb->jsb_size < len) {
+		rc = job_snapshot_grow(jsb, 0);
+		if (rc != 0)
+			return rc;
+	}
+
+	cfs_percpt_for_each(jsl, cpt, stats->ojs_lists) {
+		start = len;
+		nstart = nstats;
+again:
+		read_lock(&jsl->jsl_lock);
+		list_for_each_entry(job, &jsl->jsl_list, js_list) {
+			if (job->js_timestamp < jsb->jsb_since)
+				continue;
+
+			size = lprocfs_stats_snapshot_size(job->js_stats,
+							   job->js_jobid);
+			if (len + size > jsb->jsb_size)
+				break;
+
+			len += lprocfs_stats_snapshot_copy(job->js_stats,
+							   job->js_jobid,
+							   jsb->jsb_buf + len);
+			nstats++;
+		}
+		read_unlock(&jsl->jsl_lock);
+
+		if (&job->js_list != &jsl->jsl_list) {
+			/* out of room, copy this list again */
+			rc = job_snapshot_grow(jsb, start);
+			if (rc != 0)
+				return rc;
+			len = start;
+			nstats = nstart;
+			goto again;
+		}
+	}
+
+	lprocfs_snapshot_header_init((void *)jsb->jsb_buf, nstats, len, &now);
+	jsb->jsb_len = len;
+	return 0;
+}
+
+static int lprocfs_jobstats_snapshot_open(struct inode *inode,
+					  struct file *file)
+{
+	struct job_snapshot_buf *jsb;
+
+	if (LPROCFS_ENTRY_CHECK(PDE(inode)))
+		return -ENOENT;
+
+	LIBCFS_ALLOC(jsb, sizeof(*jsb));
+	if (jsb == NULL)
+		return -ENOMEM;
+
+	jsb->jsb_stats = PDE_DATA(inode);
+	file->private_data = jsb;
+	return 0;
+}
+
+static int lprocfs_jobstats_snapshot_release(struct inode *inode,
+					     struct file *file)
+{
+	struct job_snapshot_buf *jsb = file->private_data;
+
+	if (jsb->jsb_buf != NULL)
+		LIBCFS_FREE(jsb->jsb_buf, jsb->jsb_size);
+	LIBCFS_FREE(jsb, sizeof(*jsb));
+	return 0;
+}
+
+static ssize_t lprocfs_jobstats_snapshot_read(struct file *file,
+					      char __user *buf,
+					      size_t count, loff_t *ppos)
+{
+	struct job_snapshot_buf	*jsb = file->private_data;
+	int			 rc;
+
+	/* taken at the first read, so the cursor can be written first */
+	if (jsb->jsb_len == 0) {
+		rc = job_snapshot_build(jsb);
+		if (rc != 0)
+			return rc;
+	}
+
+	return simple_read_from_buffer(buf, count, ppos, jsb->jsb_buf,
+				       jsb->jsb_len);
+}
+
+static ssize_t lprocfs_jobstats_snapshot_write(struct file *file,
+					       const char __user *buf,
+					       size_t len, loff_t *off)
+{
+	struct job_snapshot_buf	*jsb = file->private_data;
+	__u64			 since;
+	int			 rc;
+
+	rc = lprocfs_write_u64_helper(buf, len, &since);
+	if (rc != 0)
+		return rc;
+
+	jsb->jsb_since = since;
+	/* the next read takes a new snapshot, from its start */
+	jsb->jsb_len = 0;
+	*off = 0;
+	return len;
+}
+
+struct file_operations lprocfs_jobstats_snapshot_fops = {
+	.owner   = THIS_MODULE,
+	.open    = lprocfs_jobstats_snapshot_open,
+	.read    = lprocfs_jobstats_snapshot_read,
+	.write   = lprocfs_jobstats_snapshot_write,
+	.release = lprocfs_jobstats_snapshot_release,
+};
+
 int lprocfs_job_stats_init(struct obd_device *obd, int cntr_num,
 			   cntr_init_callback init_fn)
 {
 	struct proc_dir_entry *entry;
 	struct obd_job_stats *stats;
+	struct job_stat_list *jsl;
+	struct task_struct *task;
+	int i;
 	ENTRY;
 
 	LASSERT(obd->obd_proc_entry != NULL);
@@ -499,6 +846,15 @@ int lprocfs_job_stats_init(struct obd_device *obd, int cntr_num,
 	stats = &obd->u.obt.obt_jobstats;
 
 	LASSERT(stats->ojs_hash == NULL);
+	stats->ojs_lists = cfs_percpt_alloc(cfs_cpt_table, sizeof(*jsl));
+	if (stats->ojs_lists == NULL)
+		RETURN(-ENOMEM);
+
+	cfs_percpt_for_each(jsl, i, stats->ojs_lists) {
+		rwlock_init(&jsl->jsl_lock);
+		INIT_LIST_HEAD(&jsl->jsl_list);
+	}
+
 	stats->ojs_hash = cfs_hash_create("JOB_STATS",
 					  HASH_JOB_STATS_CUR_BITS,
 					  HASH_JOB_STATS_MAX_BITS,
@@ -507,19 +863,41 @@ int lprocfs_job_stats_init(struct obd_device *obd, int cntr_num,
 					  CFS_HASH_MAX_THETA,
 					  &job_stats_hash_ops,
 					  CFS_HASH_DEFAULT);
-	if (stats->ojs_hash == NULL)
+	if (stats->ojs_hash == NULL) {
+		cfs_percpt_free(stats->ojs_lists);
+		stats->ojs_lists = NULL;
 		RETURN(-ENOMEM);
+	}
 
-	INIT_LIST_HEAD(&stats->ojs_list);
-	rwlock_init(&stats->ojs_lock);
 	stats->ojs_cntr_num = cntr_num;
 	stats->ojs_cntr_init_fn = init_fn;
 	stats->ojs_cleanup_interval = 600; /* 10 mins by default */
-	stats->ojs_last_cleanup = cfs_time_current_sec();
+	stats->ojs_max_mb = JOBSTATS_MAX_MB_DEFAULT;
+	stats->ojs_entry_size = 0;
+	atomic_set(&stats->ojs_nentries, 0);
+	init_waitqueue_head(&stats->ojs_cleanup_waitq);
+	init_completion(&stats->ojs_cleanup_done);
+	stats->ojs_cleanup_stop = 0;
+	stats->ojs_cleanup_kicked = 0;
+
+	task = kthread_run(job_cleanup_main, stats, "jobstats_%s",
+			   obd->obd_name);
+	if (IS_ERR(task)) {
+		CERROR("%s: cannot start job stats cleanup thread: rc = %ld\n",
+		       obd->obd_name, PTR_ERR(task));
+		lprocfs_job_stats_fini(obd);
+		RETURN(PTR_ERR(task));
+	}
+	stats->ojs_cleanup_started = 1;
 
 	LPROCFS_WRITE_ENTRY();
 	entry = proc_create_data("job_stats", 0644, obd->obd_proc_entry,
 				&lprocfs_jobstats_seq_fops, stats);
+	if (entry != NULL)
+		entry = proc_create_data("job_stats_snapshot", 0644,
+					 obd->obd_proc_entry,
+					 &lprocfs_jobstats_snapshot_fops,
+					 stats);
 	LPROCFS_WRITE_EXIT();
 	if (entry == NULL) {
 		lprocfs_job_stats_fini(obd);
@@ -556,8 +934,43 @@ lprocfs_job_interval_seq_write(struct file *file, const char *buffer,
 		return rc;
 
 	stats->ojs_cleanup_interval = val;
-	lprocfs_job_cleanup(stats, true);
+	job_cleanup_kick(stats);
 	return count;
 }
 EXPORT_SYMBOL(lprocfs_job_interval_seq_write);
+
+int lprocfs_job_max_mb_seq_show(struct seq_file *m, void *data)
+{
+	struct obd_device *obd = m->private;
+	struct obd_job_stats *stats;
+
+	LASSERT(obd != NULL);
+	stats = &obd->u.obt.obt_jobstats;
+	return seq_printf(m, "%u\n", stats->ojs_max_mb);
+}
+EXPORT_SYMBOL(lprocfs_job_max_mb_seq_show);
+
+ssize_t
+lprocfs_job_max_mb_seq_write(struct file *file, const char *buffer,
+			     size_t count, loff_t *off)
+{
+	struct obd_device *obd = ((struct seq_file *)file->private_data)->private;
+	struct obd_job_stats *stats;
+	int val, rc;
+
+	LASSERT(obd != NULL);
+	stats = &obd->u.obt.obt_jobstats;
+
+	rc = lprocfs_write_helper(buffer, count, &val);
+	if (rc)
+		return rc;
+
+	if (val < 0)
+		return -ERANGE;
+
+	stats->ojs_max_mb = val;
+	job_cleanup_kick(stats);
+	return count;
+}
+EXPORT_SYMBOL(lprocfs_job_max_mb_seq_write);
 #endif /* LPROCFS*/
@@ -781,6 +781,34 @@ void lprocfs_stats_collect(struct lprocfs_stats *stats, int idx,
 
 	lprocfs_stats_unlock(stats, LPROCFS_GET_NUM_CPU, &flags);
 }
+
+/**
+ * Sums the per-CPU histograms of LPROCFS_CNTR_HISTOGRAM counter \a idx into
+ * the OBD_HIST_MAX \a buckets.
+ */
+void lprocfs_stats_collect_hist(struct lprocfs_stats *stats, int idx,
+				__u64 *buckets)
+{
+	unsigned int	num_entry;
+	unsigned long	flags = 0;
+	__u64		*hist;
+	int		i;
+	int		j;
+
+	memset(buckets, 0, OBD_HIST_MAX * sizeof(*buckets));
+
+	num_entry = lprocfs_stats_lock(stats, LPROCFS_GET_NUM_CPU, &flags);
+	for (i = 0; i < num_entry; i++) {
+		if (stats->ls_percpu[i] == NULL)
+			continue;
+
+		hist = lprocfs_stats_hist_get(stats, i, idx);
+		for (j = 0; j < OBD_HIST_MAX; j++)
+			buckets[j] += hist[j];
+	}
+	lprocfs_stats_unlock(stats, LPROCFS_GET_NUM_CPU, &flags);
+}
+EXPORT_SYMBOL(lprocfs_stats_collect_hist);
 EXPORT_SYMBOL(lprocfs_stats_collect);
 
 /**
@@ -1241,6 +1269,314 @@ int lprocfs_obd_cleanup(struct obd_device *obd)
 }
 EXPORT_SYMBOL(lprocfs_obd_cleanup);
 
+/*
+ * /proc/fs/lustre/stats_snapshot: every stats registered with
+ * lprocfs_register_stats() is put on lprocfs_snapshot_stats, and reading
+ * this file returns a binary copy of all their counters at once, in the
+ * format described with struct lprocfs_snapshot_header. Monitoring tools
+ * don't have to open and parse thousands of text files for each poll.
+ */
+/* a mutex, the snapshot copies all stats while holding it */
+static DEFINE_MUTEX(lprocfs_snapshot_lock);
+static LIST_HEAD(lprocfs_snapshot_stats);
+
+#define LPROCFS_SNAPSHOT_ALIGN(n)	(((n) + 7) & ~7)
+#define LPROCFS_SNAPSHOT_DEPTH_MAX	16
+
+/* path of stats file \a name in \a root, relative to /proc */
+static char *lprocfs_stats_snapshot_path(struct proc_dir_entry *root,
+					 const char *name)
+{
+	char			*path;
+	int			 len = strlen(name) + 1;
+#ifndef HAVE_ONLY_PROCFS_SEQ
+	struct proc_dir_entry	*dirs[LPROCFS_SNAPSHOT_DEPTH_MAX];
+	struct proc_dir_entry	*dir;
+	int			 depth = 0;
+
+	for (dir = root; dir != NULL && dir->parent != NULL &&
+			 dir->parent != dir &&
+			 depth < LPROCFS_SNAPSHOT_DEPTH_MAX;
+	     dir = dir->parent) {
+		dirs[depth++] = dir;
+		len += dir->namelen + 1;
+	}
+#else
+	/* proc_dir_entry is opaque, only the file name is known */
+#endif
+
+	LIBCFS_ALLOC(path, len);
+	if (path == NULL)
+		return NULL;
+
+#ifndef HAVE_ONLY_PROCFS_SEQ
+	while (--depth >= 0) {
+		strcat(path, dirs[depth]->name);
+		strcat(path, "/");
+	}
+#endif
+	strcat(path, name);
+	return path;
+}
+
+static void lprocfs_stats_snapshot_add(struct lprocfs_stats *stats,
+				       struct proc_dir_entry *root,
+				       const char *name)
+{
+	char *path = lprocfs_stats_snapshot_path(root, name);
+
+	/* the stats are just missing from the snapshots */
+	if (path == NULL)
+		return;
+
+	mutex_lock(&lprocfs_snapshot_lock);
+	if (list_empty(&stats->ls_snapshot_list)) {
+		stats->ls_snapshot_path = path;
+		list_add_tail(&stats->ls_snapshot_list,
+			      &lprocfs_snapshot_stats);
+		path = NULL;
+	}
+	mutex_unlock(&lprocfs_snapshot_lock);
+
+	/* registered twice, the first path wins */
+	if (path != NULL)
+		LIBCFS_FREE(path, strlen(path) + 1);
+}
+
+static void lprocfs_stats_snapshot_del(struct lprocfs_stats *stats)
+{
+	if (list_empty(&stats->ls_snapshot_list))
+		return;
+
+	mutex_lock(&lprocfs_snapshot_lock);
+	list_del_init(&stats->ls_snapshot_list);
+	mutex_unlock(&lprocfs_snapshot_lock);
+
+	LIBCFS_FREE(stats->ls_snapshot_path,
+		    strlen(stats->ls_snapshot_path) + 1);
+	stats->ls_snapshot_path = NULL;
+}
+
+static inline const char *
+lprocfs_snapshot_units(struct lprocfs_counter_header *hdr)
+{
+	return hdr->lc_units != NULL ? hdr->lc_units : "";
+}
+
+static size_t lprocfs_snapshot_counter_size(struct lprocfs_counter_header *hdr)
+{
+	size_t size = sizeof(struct lprocfs_snapshot_counter);
+
+	if (hdr->lc_config & LPROCFS_CNTR_HISTOGRAM)
+		size += OBD_HIST_MAX * sizeof(__u64);
+
+	return size + LPROCFS_SNAPSHOT_ALIGN(strlen(hdr->lc_name) + 1 +
+			strlen(lprocfs_snapshot_units(hdr)) + 1);
+}
+
+/* copy counter \a idx of \a stats to \a buf, return the size of the copy */
+static size_t lprocfs_snapshot_counter_fill(struct lprocfs_stats *stats,
+					    int idx, char *buf)
+{
+	struct lprocfs_counter_header	*hdr = &stats->ls_cnt_header[idx];
+	struct lprocfs_snapshot_counter	*lsc = (void *)buf;
+	struct lprocfs_counter		 ctr;
+	char				*names = (char *)lsc->lsc_data;
+
+	lprocfs_stats_collect(stats, idx, &ctr);
+
+	lsc->lsc_size	   = lprocfs_snapshot_counter_size(hdr);
+	lsc->lsc_config	   = hdr->lc_config;
+	lsc->lsc_index	   = idx;
+	lsc->lsc_count	   = ctr.lc_count;
+	lsc->lsc_min	   = ctr.lc_min;
+	lsc->lsc_max	   = ctr.lc_max;
+	lsc->lsc_sum	   = ctr.lc_sum;
+	lsc->lsc_sumsquare = ctr.lc_sumsquare;
+
+	if (hdr->lc_config & LPROCFS_CNTR_HISTOGRAM) {
+		lprocfs_stats_collect_hist(stats, idx, lsc->lsc_data);
+		names += OBD_HIST_MAX * sizeof(__u64);
+	}
+
+	lsc->lsc_names_size = buf + lsc->lsc_size - names;
+	strcpy(names, hdr->lc_name);
+	strcpy(names + strlen(hdr->lc_name) + 1,
+	       lprocfs_snapshot_units(hdr));
+
+	return lsc->lsc_size;
+}
+
+/**
+ * Size of the snapshot block of \a stats, stored as \a path.
+ */
+size_t lprocfs_stats_snapshot_size(struct lprocfs_stats *stats,
+				   const char *path)
+{
+	size_t	size = sizeof(struct lprocfs_snapshot_stats) +
+		       LPROCFS_SNAPSHOT_ALIGN(strlen(path) + 1);
+	int	i;
+
+	for (i = 0; i < stats->ls_num; i++) {
+		if (stats->ls_cnt_header[i].lc_name != NULL)
+			size += lprocfs_snapshot_counter_size(
+					&stats->ls_cnt_header[i]);
+	}
+	return size;
+}
+EXPORT_SYMBOL(lprocfs_stats_snapshot_size);
+
+/**
+ * Copies the named counters of \a stats to \a buf, as a snapshot block
+ * for \a path. \a buf must hold lprocfs_stats_snapshot_size() bytes.
+ *
+ * \retval size of the block
+ */
+size_t lprocfs_stats_snapshot_copy(struct lprocfs_stats *stats,
+				   const char *path, char *buf)
+{
+	struct lprocfs_snapshot_stats	*lss = (void *)buf;
+	char				*ptr;
+	int				 i;
+
+	lss->lss_path_size = LPROCFS_SNAPSHOT_ALIGN(strlen(path) + 1);
+	lss->lss_ncounters = 0;
+	lss->lss_padding = 0;
+	strcpy(lss->lss_path, path);
+	ptr = buf + sizeof(*lss) + lss->lss_path_size;
+
+	for (i = 0; i < stats->ls_num; i++) {
+		if (stats->ls_cnt_header[i].lc_name == NULL)
+			continue;
+		ptr += lprocfs_snapshot_counter_fill(stats, i, ptr);
+		lss->lss_ncounters++;
+	}
+	lss->lss_size = ptr - buf;
+	return lss->lss_size;
+}
+EXPORT_SYMBOL(lprocfs_stats_snapshot_copy);
+
+/**
+ * Fills the header of a snapshot of \a nstats blocks and \a size bytes
+ * in all, taken at \a tv.
+ */
+void lprocfs_snapshot_header_init(struct lprocfs_snapshot_header *lsh,
+				  int nstats, size_t size, struct timeval *tv)
+{
+	lsh->lsh_magic	      = LPROCFS_SNAPSHOT_MAGIC;
+	lsh->lsh_version      = LPROCFS_SNAPSHOT_VERSION;
+	lsh->lsh_header_size  = sizeof(*lsh);
+	lsh->lsh_stats_size   = sizeof(struct lprocfs_snapshot_stats);
+	lsh->lsh_counter_size = sizeof(struct lprocfs_snapshot_counter);
+	lsh->lsh_hist_buckets = OBD_HIST_MAX;
+	lsh->lsh_nstats	      = nstats;
+	lsh->lsh_padding      = 0;
+	lsh->lsh_size	      = size;
+	lsh->lsh_time_sec     = tv->tv_sec;
+	lsh->lsh_time_usec    = tv->tv_usec;
+}
+EXPORT_SYMBOL(lprocfs_snapshot_header_init);
+
+/**
+ * Takes a snapshot of all registered stats into \a buf of \a size bytes.
+ *
+ * \retval size of the snapshot, if it's larger than \a size nothing was
+ *	   copied, and it should be retried with a larger buffer
+ */
+static size_t lprocfs_stats_snapshot_fill(char *buf, size_t size)
+{
+	struct lprocfs_stats	*stats;
+	struct timeval		 now;
+	size_t			 total = sizeof(struct lprocfs_snapshot_header);
+	char			*ptr = buf + total;
+	int			 nstats = 0;
+
+	mutex_lock(&lprocfs_snapshot_lock);
+
+	list_for_each_entry(stats, &lprocfs_snapshot_stats, ls_snapshot_list)
+		total += lprocfs_stats_snapshot_size(stats,
+						     stats->ls_snapshot_path);
+	if (total > size)
+		goto out;
+
+	list_for_each_entry(stats, &lprocfs_snapshot_stats, ls_snapshot_list) {
+		ptr += lprocfs_stats_snapshot_copy(stats,
+						   stats->ls_snapshot_path, ptr);
+		nstats++;
+	}
+	LASSERT(ptr - buf == total);
+
+	do_gettimeofday(&now);
+	lprocfs_snapshot_header_init((void *)buf, nstats, total, &now);
+out:
+	mutex_unlock(&lprocfs_snapshot_lock);
+	return total;
+}
+
+struct lprocfs_snapshot_buf {
+	char	*lsb_buf;
+	size_t	 lsb_size;
+	size_t	 lsb_len;
+};
+
+static int lprocfs_stats_snapshot_release(struct inode *inode,
+					  struct file *file)
+{
+	struct lprocfs_snapshot_buf *lsb = file->private_data;
+
+	if (lsb->lsb_buf != NULL)
+		LIBCFS_FREE(lsb->lsb_buf, lsb->lsb_size);
+	LIBCFS_FREE(lsb, sizeof(*lsb));
+	return 0;
+}
+
+/* the snapshot is taken at open, reads return consistent data */
+static int lprocfs_stats_snapshot_open(struct inode *inode, struct file *file)
+{
+	struct lprocfs_snapshot_buf	*lsb;
+	size_t				 len;
+
+	LIBCFS_ALLOC(lsb, sizeof(*lsb));
+	if (lsb == NULL)
+		return -ENOMEM;
+	file->private_data = lsb;
+
+	while ((len = lprocfs_stats_snapshot_fill(lsb->lsb_buf,
+						  lsb->lsb_size)) >
+	       lsb->lsb_size) {
+		if (lsb->lsb_buf != NULL)
+			LIBCFS_FREE(lsb->lsb_buf, lsb->lsb_size);
+
+		/* leave room for stats registered meanwhile */
+		lsb->lsb_size = len + len / 8;
+		LIBCFS_ALLOC(lsb->lsb_buf, lsb->lsb_size);
+		if (lsb->lsb_buf == NULL) {
+			lprocfs_stats_snapshot_release(inode, file);
+			return -ENOMEM;
+		}
+	}
+	lsb->lsb_len = len;
+	return 0;
+}
+
+static ssize_t lprocfs_stats_snapshot_read(struct file *file,
+					   char __user *buf,
+					   size_t count, loff_t *ppos)
+{
+	struct lprocfs_snapshot_buf *lsb = file->private_data;
+
+	return simple_read_from_buffer(buf, count, ppos, lsb->lsb_buf,
+				       lsb->lsb_len);
+}
+
+struct file_operations lprocfs_stats_snapshot_fops = {
+	.owner	 = THIS_MODULE,
+	.open	 = lprocfs_stats_snapshot_open,
+	.read	 = lprocfs_stats_snapshot_read,
+	.release = lprocfs_stats_snapshot_release,
+};
+EXPORT_SYMBOL(lprocfs_stats_snapshot_fops);
+
 int lprocfs_stats_alloc_one(struct lprocfs_stats *stats, unsigned int cpuid)
 {
 	struct lprocfs_counter  *cntr;
@@ -1279,8 +1615,13 @@ int lprocfs_stats_alloc_one(struct lprocfs_stats *stats, unsigned int cpuid)
 }
 EXPORT_SYMBOL(lprocfs_stats_alloc_one);
 
-struct lprocfs_stats *lprocfs_alloc_stats(unsigned int num,
-                                          enum lprocfs_stats_flags flags)
+/**
+ * Allocates stats of \a num counters, \a nhist of which can be
+ * LPROCFS_CNTR_HISTOGRAM counters.
+ */
+struct lprocfs_stats *lprocfs_alloc_stats_hist(unsigned int num,
+					       unsigned int nhist,
+					       enum lprocfs_stats_flags flags)
 {
 	struct lprocfs_stats	*stats;
 	unsigned int		num_entry;
@@ -1290,6 +1631,8 @@ struct lprocfs_stats *lprocfs_alloc_stats(unsigned int num,
         if (num == 0)
                 return NULL;
 
+	LASSERT(nhist <= num);
+
         if (lprocfs_no_percpu_stats != 0)
                 flags |= LPROCFS_STATS_FLAG_NOPERCPU;
 
@@ -1304,8 +1647,10 @@ struct lprocfs_stats *lprocfs_alloc_stats(unsigned int num,
 		return NULL;
 
 	stats->ls_num = num;
+	stats->ls_hist_num = nhist;
 	stats->ls_flags = flags;
 	spin_lock_init(&stats->ls_lock);
+	INIT_LIST_HEAD(&stats->ls_snapshot_list);
 
 	/* alloc num of counter headers */
 	LIBCFS_ALLOC(stats->ls_cnt_header,
@@ -1333,6 +1678,13 @@ fail:
 	lprocfs_free_stats(&stats);
 	return NULL;
 }
+EXPORT_SYMBOL(lprocfs_alloc_stats_hist);
+
+struct lprocfs_stats *lprocfs_alloc_stats(unsigned int num,
+                                          enum lprocfs_stats_flags flags)
+{
+	return lprocfs_alloc_stats_hist(num, 0, flags);
+}
 EXPORT_SYMBOL(lprocfs_alloc_stats);
 
 void lprocfs_free_stats(struct lprocfs_stats **statsh)
@@ -1346,6 +1698,8 @@ void lprocfs_free_stats(struct lprocfs_stats **statsh)
                 return;
         *statsh = NULL;
 
+	lprocfs_stats_snapshot_del(stats);
+
 	if (stats->ls_flags & LPROCFS_STATS_FLAG_NOPERCPU)
 		num_entry = 1;
 	else
@@ -1385,6 +1739,9 @@ void lprocfs_clear_stats(struct lprocfs_stats *stats)
 			if (stats->ls_flags & LPROCFS_STATS_FLAG_IRQ_SAFE)
 				percpu_cntr->lc_sum_irq	= 0;
 		}
+		memset((void *)stats->ls_percpu[i] +
+		       lprocfs_stats_hist_offset(stats), 0,
+		       stats->ls_hist_num * OBD_HIST_MAX * sizeof(__u64));
 	}
 
 	lprocfs_stats_unlock(stats, LPROCFS_GET_NUM_CPU, &flags);
@@ -1461,6 +1818,23 @@ static int lprocfs_stats_seq_show(struct seq_file *p, void *v)
 		if (rc < 0)
 			goto out;
 	}
+	if (hdr->lc_config & LPROCFS_CNTR_HISTOGRAM) {
+		__u64	buckets[OBD_HIST_MAX];
+		int	last;
+		int	i;
+
+		/* log2 buckets, up to the last non-empty one */
+		lprocfs_stats_collect_hist(stats, idx, buckets);
+		for (last = OBD_HIST_MAX - 1; last > 0; last--)
+			if (buckets[last] != 0)
+				break;
+
+		rc = seq_printf(p, " hist");
+		for (i = 0; i <= last && rc >= 0; i++)
+			rc = seq_printf(p, " "LPU64, buckets[i]);
+		if (rc < 0)
+			goto out;
+	}
 	rc = seq_printf(p, "\n");
 out:
 	return (rc < 0) ? rc : 0;
@@ -1509,6 +1883,8 @@ int lprocfs_register_stats(struct proc_dir_entry *root, const char *name,
 				 &lprocfs_stats_seq_fops, stats);
 	if (entry == NULL)
 		return -ENOMEM;
+
+	lprocfs_stats_snapshot_add(stats, root, name);
 	return 0;
 }
 EXPORT_SYMBOL(lprocfs_register_stats);
@@ -1528,6 +1904,13 @@ void lprocfs_counter_init(struct lprocfs_stats *stats, int index,
 	LASSERTF(header != NULL, "Failed to allocate stats header:[%d]%s/%s\n",
 		 index, name, units);
 
+	if ((conf & LPROCFS_CNTR_HISTOGRAM) &&
+	    !(header->lc_config & LPROCFS_CNTR_HISTOGRAM)) {
+		LASSERTF(stats->ls_hist_used < stats->ls_hist_num,
+			 "no histogram slot left for %s\n", name);
+		header->lc_hist = stats->ls_hist_used++;
+	}
+
 	header->lc_config = conf;
 	header->lc_name   = name;
 	header->lc_units  = units;
@@ -1544,6 +1927,9 @@ void lprocfs_counter_init(struct lprocfs_stats *stats, int index,
 		percpu_cntr->lc_sum		= 0;
 		if ((stats->ls_flags & LPROCFS_STATS_FLAG_IRQ_SAFE) != 0)
 			percpu_cntr->lc_sum_irq	= 0;
+		if (conf & LPROCFS_CNTR_HISTOGRAM)
+			memset(lprocfs_stats_hist_get(stats, i, index), 0,
+			       OBD_HIST_MAX * sizeof(__u64));
 	}
 	lprocfs_stats_unlock(stats, LPROCFS_GET_NUM_CPU, &flags);
 }
@@ -2048,6 +2434,167 @@ void lprocfs_oh_clear(struct obd_histogram *oh)
 }
 EXPORT_SYMBOL(lprocfs_oh_clear);
 
+/**
+ * Returns the upper bound of the bucket of log2 histogram \a oh holding the
+ * \a permille / 1000 quantile of its \a tot values, e.g. 999 for p99.9.
+ */
+unsigned long lprocfs_oh_log2_percentile(struct obd_histogram *oh,
+					 unsigned long tot,
+					 unsigned int permille)
+{
+	unsigned long	cum = 0;
+	int		i;
+
+	if (tot == 0)
+		return 0;
+
+	for (i = 0; i < OBD_HIST_MAX - 1; i++) {
+		cum += oh->oh_buckets[i];
+		/* cum / tot >= permille / 1000 */
+		if (cum * 1000 >= (__u64)tot * permille)
+			break;
+	}
+
+	return 1UL << i;
+}
+EXPORT_SYMBOL(lprocfs_oh_log2_percentile);
+
+struct lprocfs_rpc_lat *lprocfs_rpc_lat_alloc(void)
+{
+	struct lprocfs_rpc_lat *lat;
+
+	OBD_ALLOC_PTR(lat);
+	return lat;
+}
+EXPORT_SYMBOL(lprocfs_rpc_lat_alloc);
+
+/* frees the per-CPU histograms \a cpus of one opcode */
+static void lprocfs_rpc_lat_cpus_free(struct lprocfs_rpc_lat_cpu **cpus)
+{
+	int i;
+
+	for (i = 0; i < num_possible_cpus(); i++) {
+		if (cpus[i] != NULL)
+			OBD_FREE_PTR(cpus[i]);
+	}
+	OBD_FREE(cpus, sizeof(*cpus) * num_possible_cpus());
+}
+
+void lprocfs_rpc_lat_free(struct lprocfs_rpc_lat *lat)
+{
+	int i;
+
+	if (lat == NULL)
+		return;
+
+	for (i = 0; i < LUSTRE_MAX_OPCODES; i++) {
+		if (lat->rl_opc[i] != NULL)
+			lprocfs_rpc_lat_cpus_free(lat->rl_opc[i]);
+	}
+	OBD_FREE_PTR(lat);
+}
+EXPORT_SYMBOL(lprocfs_rpc_lat_free);
+
+/**
+ * Resets all histograms of \a lat. Concurrent updates may survive, as for
+ * lprocfs_clear_stats().
+ */
+void lprocfs_rpc_lat_clear(struct lprocfs_rpc_lat *lat)
+{
+	struct lprocfs_rpc_lat_cpu	**cpus;
+	int				  i;
+	int				  j;
+
+	for (i = 0; i < LUSTRE_MAX_OPCODES; i++) {
+		cpus = lat->rl_opc[i];
+		if (cpus == NULL)
+			continue;
+		for (j = 0; j < num_possible_cpus(); j++) {
+			if (cpus[j] != NULL)
+				memset(cpus[j], 0, sizeof(*cpus[j]));
+		}
+	}
+}
+EXPORT_SYMBOL(lprocfs_rpc_lat_clear);
+
+/**
+ * Sums the histograms of all CPUs for opcode index \a idx and \a phase of
+ * \a lat into \a oh.
+ */
+void lprocfs_rpc_lat_collect(struct lprocfs_rpc_lat *lat, int idx,
+			     enum lprocfs_rpc_lat_phase phase,
+			     struct obd_histogram *oh)
+{
+	struct lprocfs_rpc_lat_cpu	**cpus = lat->rl_opc[idx];
+	int				  i;
+	int				  j;
+
+	memset(oh->oh_buckets, 0, sizeof(oh->oh_buckets));
+	if (cpus == NULL)
+		return;
+
+	for (i = 0; i < num_possible_cpus(); i++) {
+		if (cpus[i] == NULL)
+			continue;
+		for (j = 0; j < OBD_HIST_MAX; j++)
+			oh->oh_buckets[j] += cpus[i]->rlc_buckets[phase][j];
+	}
+}
+EXPORT_SYMBOL(lprocfs_rpc_lat_collect);
+
+/**
+ * Accounts \a usec spent by an RPC of opcode \a opc in \a phase; may be
+ * called in atomic context, but not from interrupts. Only the histogram of
+ * the current CPU is updated, with preemption disabled, so no lock is taken.
+ */
+void lprocfs_rpc_lat_tally(struct lprocfs_rpc_lat *lat, __u32 opc,
+			   enum lprocfs_rpc_lat_phase phase, long usec)
+{
+	struct lprocfs_rpc_lat_cpu	**cpus;
+	struct lprocfs_rpc_lat_cpu	 *hist;
+	int				  idx = opcode_offset(opc);
+	unsigned int			  val = 0;
+	unsigned int			  cpu;
+
+	if (lat == NULL || idx < 0 || idx >= LUSTRE_MAX_OPCODES)
+		return;
+
+	LASSERT(phase < RPC_LAT_LAST);
+	cpus = lat->rl_opc[idx];
+	if (unlikely(cpus == NULL)) {
+		OBD_ALLOC_GFP(cpus, sizeof(*cpus) * num_possible_cpus(),
+			      GFP_ATOMIC);
+		if (cpus == NULL)
+			return;
+
+		if (cmpxchg(&lat->rl_opc[idx], NULL, cpus) != NULL) {
+			/* lost the race */
+			OBD_FREE(cpus, sizeof(*cpus) * num_possible_cpus());
+			cpus = lat->rl_opc[idx];
+		}
+	}
+
+	/* same buckets as lprocfs_oh_tally_log2() */
+	if (likely(usec > 0))
+		val = min_t(unsigned int, fls64(usec - 1), OBD_HIST_MAX - 1);
+
+	cpu = get_cpu();
+	hist = cpus[cpu];
+	if (unlikely(hist == NULL)) {
+		/* only this CPU ever sets its own slot */
+		OBD_ALLOC_GFP(hist, sizeof(*hist), GFP_ATOMIC);
+		if (hist == NULL)
+			goto out;
+		/* zeroed buckets before readers can see them */
+		smp_wmb();
+		cpus[cpu] = hist;
+	}
+	hist->rlc_buckets[phase][val]++;
+out:
+	put_cpu();
+}
+EXPORT_SYMBOL(lprocfs_rpc_lat_tally);
+
 int lprocfs_obd_rd_max_pages_per_rpc(char *page, char **start, off_t off,
                                      int count, int *eof, void *data)
 {
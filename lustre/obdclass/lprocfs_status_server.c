@@ -520,6 +520,7 @@ EXPORT_SYMBOL(lprocfs_hash_seq_show);
 int lprocfs_recovery_status_seq_show(struct seq_file *m, void *data)
 {
 	struct obd_device *obd = m->private;
+	struct target_recovery_data *trd = &obd->obd_recovery_data;
 
 	LASSERT(obd != NULL);
 
@@ -544,6 +545,14 @@ int lprocfs_recovery_status_seq_show(struct seq_file *m, void *data)
 			   obd->obd_replayed_requests);
 		seq_printf(m, "last_transno: "LPD64"\n",
 			   obd->obd_next_recovery_transno - 1);
+		seq_printf(m, "replay_rate: %lu\n",
+			   obd->obd_replayed_requests /
+			   max_t(unsigned long, 1, obd->obd_recovery_end -
+						   obd->obd_recovery_start));
+		seq_printf(m, "replay_dep_waits: "LPU64"\n",
+			   trd->trd_replay_dep_waits);
+		seq_printf(m, "replay_barriers: "LPU64"\n",
+			   trd->trd_replay_barriers);
 		seq_printf(m, "VBR: %s\n", obd->obd_version_recov ?
 			   "ENABLED" : "DISABLED");
 		seq_printf(m, "IR: %s\n", obd->obd_no_ir ?
@@ -577,6 +586,17 @@ int lprocfs_recovery_status_seq_show(struct seq_file *m, void *data)
 		   obd->obd_requests_queued_for_recovery);
 	seq_printf(m, "next_transno: "LPD64"\n",
 		   obd->obd_next_recovery_transno);
+	seq_printf(m, "replay_threads: %d\n", trd->trd_replay_nthreads);
+	seq_printf(m, "replay_inflight: %d\n",
+		   trd->trd_replay_inflight_count);
+	seq_printf(m, "replay_dep_waits: "LPU64"\n",
+		   trd->trd_replay_dep_waits);
+	seq_printf(m, "replay_barriers: "LPU64"\n", trd->trd_replay_barriers);
+	if (obd->obd_recovery_start != 0)
+		seq_printf(m, "replay_rate: %lu\n",
+			   obd->obd_replayed_requests /
+			   max_t(unsigned long, 1, cfs_time_current_sec() -
+						   obd->obd_recovery_start));
 out:
 	return 0;
 }
@@ -70,11 +70,24 @@ enum {
 #define LU_SITE_BITS_MIN    12
 #define LU_SITE_BITS_MAX    24
 /**
- * total 256 buckets, we don't want too many buckets because:
- * - consume too much memory
- * - avoid unbalanced LRU list
+ * total 256 buckets, we don't want too many buckets because they consume
+ * too much memory
  */
 #define LU_SITE_BKT_BITS    8
+/**
+ * wait-queues for dying objects, see lu_site_bkt_from_fid()
+ */
+#define LU_SITE_WAITQ_BITS	8
+#define LU_SITE_WAITQ_NR	(1 << LU_SITE_WAITQ_BITS)
+/**
+ * max # objects moved off a LRU list under the LRU lock at once
+ */
+#define LU_SITE_PURGE_BATCH	128
+/**
+ * lu_object_header::loh_ref of an unreferenced object taken off the LRU by
+ * lu_site_purge(), it can't be found in cache anymore
+ */
+#define LU_OBJECT_REF_ISOLATED	(-1)
 
 
 static unsigned int lu_cache_percent = LU_CACHE_PERCENT_DEFAULT;
@@ -87,6 +100,65 @@ CFS_MODULE_PARM(lu_cache_nr, "l", long, 0644,
 
 static void lu_object_free(const struct lu_env *env, struct lu_object *o);
 
+/**
+ * Return the wait-queue signaled when object with fid \a fid is freed.
+ */
+struct lu_site_bkt_data *lu_site_bkt_from_fid(struct lu_site *site,
+					      struct lu_fid *fid)
+{
+	return &site->ls_bkts[hash_long(fid_flatten32(fid),
+					LU_SITE_WAITQ_BITS)];
+}
+EXPORT_SYMBOL(lu_site_bkt_from_fid);
+
+/**
+ * Remove \a h from the object hash, bucket \a bd is locked for write.
+ */
+static void lu_site_hash_del_locked(cfs_hash_t *hs, cfs_hash_bd_t *bd,
+				    struct lu_object_header *h)
+{
+	if (!test_and_set_bit(LU_OBJECT_UNHASHED, &h->loh_flags))
+		cfs_hash_bd_del_locked(hs, bd, &h->loh_hash);
+}
+
+/**
+ * Last reference to \a h has been dropped. Queue the object on its LRU
+ * list if it's to be cached, otherwise take it out of the hash table and
+ * the LRU.
+ *
+ * Called with the hash bucket \a bd locked for write and \a lru locked.
+ * As the only way to get the first reference to an unreferenced object is
+ * the hash table lookup (lu_object_find()), done under the bucket lock, and
+ * the LRU scanning (lu_site_purge()) only takes objects off the list under
+ * the LRU lock, no race with them is possible and the dying object can be
+ * safely destroyed.
+ *
+ * \retval 1 the object is dying and must be freed by the caller
+ * \retval 0 the object is cached
+ */
+static int lu_object_last_ref_locked(cfs_hash_t *hs, cfs_hash_bd_t *bd,
+				     struct lu_site_lru *lru,
+				     struct lu_object_header *h)
+{
+	if (!lu_object_is_dying(h)) {
+		if (list_empty(&h->loh_lru)) {
+			list_add_tail(&h->loh_lru, &lru->lsl_list);
+			lru->lsl_nr++;
+		} else {
+			/* was found in cache while still queued */
+			set_bit(LU_OBJECT_REFERENCED, &h->loh_flags);
+		}
+		return 0;
+	}
+
+	if (!list_empty(&h->loh_lru)) {
+		list_del_init(&h->loh_lru);
+		lru->lsl_nr--;
+	}
+	lu_site_hash_del_locked(hs, bd, h);
+	return 1;
+}
+
 /**
  * Decrease reference counter on object. If last reference is freed, return
  * object to the cache, unless lu_object_is_dying(o) holds. In the latter
@@ -94,12 +166,15 @@ static void lu_object_free(const struct lu_env *env, struct lu_object *o);
  */
 void lu_object_put(const struct lu_env *env, struct lu_object *o)
 {
-        struct lu_site_bkt_data *bkt;
-        struct lu_object_header *top;
-        struct lu_site          *site;
-        struct lu_object        *orig;
-        cfs_hash_bd_t            bd;
+	struct lu_site_bkt_data *bkt;
+	struct lu_object_header *top;
+	struct lu_site_lru	*lru;
+	struct lu_site          *site;
+	struct lu_object        *orig;
+	cfs_hash_t		*hs;
+	cfs_hash_bd_t            bd;
 	const struct lu_fid     *fid;
+	int			 dying;
 
         top  = o->lo_header;
         site = o->lo_dev->ld_site;
@@ -125,10 +200,8 @@ void lu_object_put(const struct lu_env *env, struct lu_object *o)
 		return;
 	}
 
-        cfs_hash_bd_get(site->ls_obj_hash, &top->loh_fid, &bd);
-        bkt = cfs_hash_bd_extra_get(site->ls_obj_hash, &bd);
-
-	if (!cfs_hash_bd_dec_and_lock(site->ls_obj_hash, &bd, &top->loh_ref)) {
+	bkt = lu_site_bkt_from_fid(site, &top->loh_fid);
+	if (atomic_add_unless(&top->loh_ref, -1, 1)) {
 		if (lu_object_is_dying(top)) {
 
 			/*
@@ -140,8 +213,19 @@ void lu_object_put(const struct lu_env *env, struct lu_object *o)
 		return;
 	}
 
-        LASSERT(bkt->lsb_busy > 0);
-        bkt->lsb_busy--;
+	hs  = site->ls_obj_hash;
+	lru = site->ls_lru[top->loh_lru_cpt];
+	cfs_hash_bd_get_and_lock(hs, &top->loh_fid, &bd, 1);
+	spin_lock(&lru->lsl_lock);
+	if (!atomic_dec_and_test(&top->loh_ref)) {
+		/* found in cache meanwhile, that user releases it */
+		spin_unlock(&lru->lsl_lock);
+		cfs_hash_bd_unlock(hs, &bd, 1);
+		if (lu_object_is_dying(top))
+			wake_up_all(&bkt->lsb_marche_funebre);
+		return;
+	}
+
         /*
          * When last reference is released, iterate over object
          * layers, and notify them that object is no longer busy.
@@ -151,32 +235,16 @@ void lu_object_put(const struct lu_env *env, struct lu_object *o)
                         o->lo_ops->loo_object_release(env, o);
         }
 
-        if (!lu_object_is_dying(top)) {
-		LASSERT(list_empty(&top->loh_lru));
-		list_add_tail(&top->loh_lru, &bkt->lsb_lru);
-                cfs_hash_bd_unlock(site->ls_obj_hash, &bd, 1);
-                return;
-        }
+	dying = lu_object_last_ref_locked(hs, &bd, lru, top);
+	spin_unlock(&lru->lsl_lock);
+	cfs_hash_bd_unlock(hs, &bd, 1);
 
-        /*
-         * If object is dying (will not be cached), removed it
-         * from hash table and LRU.
-         *
-         * This is done with hash table and LRU lists locked. As the only
-         * way to acquire first reference to previously unreferenced
-         * object is through hash-table lookup (lu_object_find()),
-         * or LRU scanning (lu_site_purge()), that are done under hash-table
-         * and LRU lock, no race with concurrent object lookup is possible
-         * and we can safely destroy object below.
-         */
-	if (!test_and_set_bit(LU_OBJECT_UNHASHED, &top->loh_flags))
-		cfs_hash_bd_del_locked(site->ls_obj_hash, &bd, &top->loh_hash);
-        cfs_hash_bd_unlock(site->ls_obj_hash, &bd, 1);
         /*
          * Object was already removed from hash and lru above, can
          * kill it.
          */
-        lu_object_free(env, orig);
+	if (dying)
+		lu_object_free(env, orig);
 }
 EXPORT_SYMBOL(lu_object_put);
 
@@ -201,13 +269,17 @@ void lu_object_unhash(const struct lu_env *env, struct lu_object *o)
 
 	top = o->lo_header;
 	set_bit(LU_OBJECT_HEARD_BANSHEE, &top->loh_flags);
-	if (!test_and_set_bit(LU_OBJECT_UNHASHED, &top->loh_flags)) {
+	/*
+	 * The object is referenced by the caller, so it's either off the LRU
+	 * or left there for lu_site_purge() to drop, and the last
+	 * lu_object_put() of the dying object takes it off the LRU anyway.
+	 */
+	if (!test_bit(LU_OBJECT_UNHASHED, &top->loh_flags)) {
 		cfs_hash_t *obj_hash = o->lo_dev->ld_site->ls_obj_hash;
 		cfs_hash_bd_t bd;
 
 		cfs_hash_bd_get_and_lock(obj_hash, &top->loh_fid, &bd, 1);
-		list_del_init(&top->loh_lru);
-		cfs_hash_bd_del_locked(obj_hash, &bd, &top->loh_hash);
+		lu_site_hash_del_locked(obj_hash, &bd, top);
 		cfs_hash_bd_unlock(obj_hash, &bd, 1);
 	}
 }
@@ -333,92 +405,157 @@ static void lu_object_free(const struct lu_env *env, struct lu_object *o)
 }
 
 /**
- * Free \a nr objects from the cold end of the site LRU list.
+ * Move up to \a nr unreferenced objects from the cold end of \a lru to
+ * \a isolated, all if \a nr is negative.
+ *
+ * This is where the LRU is aged: objects found in cache again while queued
+ * are given another round, referenced ones are just dropped from the list,
+ * lu_object_put() queues them again. Isolated objects get a reference count
+ * of LU_OBJECT_REF_ISOLATED, so that lookups wait for them to be freed by
+ * lu_site_lru_dispose() instead of taking a reference: they have no users,
+ * and ->loo_object_release() was called by their last lu_object_put().
+ *
+ * \retval number of objects isolated
+ */
+static int lu_site_lru_isolate(struct lu_site_lru *lru,
+			       struct list_head *isolated, int nr)
+{
+	struct lu_object_header	*h;
+	long			 scan;
+	int			 count = 0;
+
+	spin_lock(&lru->lsl_lock);
+	for (scan = lru->lsl_nr; scan > 0 && count != nr; scan--) {
+		h = list_entry(lru->lsl_list.next, struct lu_object_header,
+			       loh_lru);
+		if (atomic_read(&h->loh_ref) > 0) {
+			list_del_init(&h->loh_lru);
+			lru->lsl_nr--;
+			continue;
+		}
+
+		if (test_and_clear_bit(LU_OBJECT_REFERENCED, &h->loh_flags)) {
+			list_move_tail(&h->loh_lru, &lru->lsl_list);
+			continue;
+		}
+
+		if (atomic_cmpxchg(&h->loh_ref, 0,
+				   LU_OBJECT_REF_ISOLATED) != 0) {
+			/* found in cache just now */
+			list_del_init(&h->loh_lru);
+			lru->lsl_nr--;
+			continue;
+		}
+
+		list_move_tail(&h->loh_lru, isolated);
+		lru->lsl_nr--;
+		count++;
+	}
+	spin_unlock(&lru->lsl_lock);
+
+	return count;
+}
+
+/**
+ * Free the objects isolated by lu_site_lru_isolate().
+ *
+ * \retval number of objects freed
+ */
+static int lu_site_lru_dispose(const struct lu_env *env, struct lu_site *s,
+			       struct list_head *isolated)
+{
+	struct lu_object_header	*h;
+	cfs_hash_t		*hs = s->ls_obj_hash;
+	cfs_hash_bd_t		 bd;
+	int			 count = 0;
+
+	while (!list_empty(isolated)) {
+		h = list_entry(isolated->next, struct lu_object_header,
+			       loh_lru);
+		list_del_init(&h->loh_lru);
+		LASSERT(atomic_read(&h->loh_ref) == LU_OBJECT_REF_ISOLATED);
+
+		cfs_hash_bd_get_and_lock(hs, &h->loh_fid, &bd, 1);
+		lu_site_hash_del_locked(hs, &bd, h);
+		atomic_set(&h->loh_ref, 0);
+		cfs_hash_bd_unlock(hs, &bd, 1);
+
+		/* wakes up the lookups waiting for it */
+		lu_object_free(env, lu_object_top(h));
+		lprocfs_counter_incr(s->ls_stats, LU_SS_LRU_PURGED);
+		count++;
+	}
+
+	return count;
+}
+
+/**
+ * Free up to \a nr objects from the cold end of \a lru, all if \a nr is
+ * negative. The LRU lock is only held to isolate a batch of objects at a
+ * time.
+ *
+ * \retval number of objects freed
+ */
+static int lu_site_lru_purge(const struct lu_env *env, struct lu_site *s,
+			     struct lu_site_lru *lru, int nr)
+{
+	struct list_head isolated;
+	int		 batch;
+	int		 count;
+	int		 freed = 0;
+
+	INIT_LIST_HEAD(&isolated);
+	do {
+		batch = nr < 0 ? LU_SITE_PURGE_BATCH :
+				 min(nr - freed, LU_SITE_PURGE_BATCH);
+		count = lu_site_lru_isolate(lru, &isolated, batch);
+		freed += lu_site_lru_dispose(env, s, &isolated);
+		cond_resched();
+	} while (count == batch && (nr < 0 || freed < nr));
+
+	return freed;
+}
+
+/**
+ * Free \a nr objects from the cold ends of the site LRU lists.
  */
 int lu_site_purge(const struct lu_env *env, struct lu_site *s, int nr)
 {
-        struct lu_object_header *h;
-        struct lu_object_header *temp;
-        struct lu_site_bkt_data *bkt;
-        cfs_hash_bd_t            bd;
-        cfs_hash_bd_t            bd2;
-	struct list_head	 dispose;
-        int                      did_sth;
-        int                      start;
-        int                      count;
-        int                      bnr;
-	unsigned int             i;
+	int	ncpt = cfs_percpt_number(s->ls_lru);
+	int	start;
+	int	quota;
+	int	freed;
+	int	count;
+	int	i;
 
 	if (OBD_FAIL_CHECK(OBD_FAIL_OBD_NO_LRU))
 		RETURN(0);
 
-	INIT_LIST_HEAD(&dispose);
-        /*
-         * Under LRU list lock, scan LRU list and move unreferenced objects to
-         * the dispose list, removing them from LRU and hash table.
-         */
-        start = s->ls_purge_start;
-        bnr = (nr == ~0) ? -1 : nr / CFS_HASH_NBKT(s->ls_obj_hash) + 1;
- again:
 	/*
 	 * It doesn't make any sense to make purge threads parallel, that can
 	 * only bring troubles to us. See LU-5331.
 	 */
 	mutex_lock(&s->ls_purge_mutex);
-        did_sth = 0;
-        cfs_hash_for_each_bucket(s->ls_obj_hash, &bd, i) {
-                if (i < start)
-                        continue;
-                count = bnr;
-                cfs_hash_bd_lock(s->ls_obj_hash, &bd, 1);
-                bkt = cfs_hash_bd_extra_get(s->ls_obj_hash, &bd);
-
-		list_for_each_entry_safe(h, temp, &bkt->lsb_lru, loh_lru) {
-			LASSERT(atomic_read(&h->loh_ref) == 0);
-
-                        cfs_hash_bd_get(s->ls_obj_hash, &h->loh_fid, &bd2);
-                        LASSERT(bd.bd_bucket == bd2.bd_bucket);
-
-                        cfs_hash_bd_del_locked(s->ls_obj_hash,
-                                               &bd2, &h->loh_hash);
-			list_move(&h->loh_lru, &dispose);
-                        if (did_sth == 0)
-                                did_sth = 1;
-
-                        if (nr != ~0 && --nr == 0)
-                                break;
-
-                        if (count > 0 && --count == 0)
-                                break;
-
-		}
-		cfs_hash_bd_unlock(s->ls_obj_hash, &bd, 1);
-		cond_resched();
-		/*
-		 * Free everything on the dispose list. This is safe against
-		 * races due to the reasons described in lu_object_put().
-		 */
-		while (!list_empty(&dispose)) {
-			h = container_of0(dispose.next,
-					  struct lu_object_header, loh_lru);
-			list_del_init(&h->loh_lru);
-			lu_object_free(env, lu_object_top(h));
-			lprocfs_counter_incr(s->ls_stats, LU_SS_LRU_PURGED);
+	start = s->ls_purge_start;
+	do {
+		/* spread the work over the LRU lists */
+		quota = (nr == ~0) ? -1 : nr / ncpt + 1;
+		freed = 0;
+		for (i = 0; i < ncpt && nr != 0; i++) {
+			count = lu_site_lru_purge(env, s,
+						  s->ls_lru[(start + i) % ncpt],
+						  nr == ~0 ? -1 : min(quota, nr));
+			if (nr != ~0)
+				nr -= count;
+			freed += count;
 		}
-
-                if (nr == 0)
-                        break;
-        }
+		/* the next purge goes on after the last list purged */
+		start = (start + i) % ncpt;
+	} while (nr != ~0 && nr != 0 && freed != 0);
+	s->ls_purge_start = start;
 	mutex_unlock(&s->ls_purge_mutex);
 
-        if (nr != 0 && did_sth && start != 0) {
-                start = 0; /* restart from the first bucket */
-                goto again;
-        }
-        /* race on s->ls_purge_start, but nobody cares */
-        s->ls_purge_start = i % CFS_HASH_NBKT(s->ls_obj_hash);
-
-        return nr;
+	return nr;
 }
 EXPORT_SYMBOL(lu_site_purge);
 
@@ -567,22 +704,20 @@ int lu_object_invariant(const struct lu_object *o)
 }
 EXPORT_SYMBOL(lu_object_invariant);
 
+/**
+ * Find the object with fid \a f in hash bucket \a bd, locked for read at
+ * least, and take a reference on it. Cache hits don't touch the LRU lists,
+ * so lookups of cached objects don't need write locks.
+ */
 static struct lu_object *htable_lookup(struct lu_site *s,
 				       cfs_hash_bd_t *bd,
 				       const struct lu_fid *f,
-				       wait_queue_t *waiter,
-				       __u64 *version)
+				       wait_queue_t *waiter)
 {
 	struct lu_site_bkt_data	*bkt;
 	struct lu_object_header	*h;
 	struct hlist_node	*hnode;
-	__u64  ver = cfs_hash_bd_version_get(bd);
-
-        if (*version == ver)
-		return ERR_PTR(-ENOENT);
 
-        *version = ver;
-        bkt = cfs_hash_bd_extra_get(s->ls_obj_hash, bd);
 	/* cfs_hash_bd_peek_locked is a somehow "internal" function
 	 * of cfs_hash, it doesn't add refcount on object. */
 	hnode = cfs_hash_bd_peek_locked(s->ls_obj_hash, bd, (void *)f);
@@ -591,11 +726,11 @@ static struct lu_object *htable_lookup(struct lu_site *s,
 		return ERR_PTR(-ENOENT);
         }
 
-        h = container_of0(hnode, struct lu_object_header, loh_hash);
-        if (likely(!lu_object_is_dying(h))) {
-		cfs_hash_get(s->ls_obj_hash, hnode);
+	/* objects isolated by lu_site_purge() are about to be freed */
+	h = container_of0(hnode, struct lu_object_header, loh_hash);
+	if (likely(!lu_object_is_dying(h) &&
+		   atomic_add_unless(&h->loh_ref, 1, LU_OBJECT_REF_ISOLATED))) {
                 lprocfs_counter_incr(s->ls_stats, LU_SS_CACHE_HIT);
-		list_del_init(&h->loh_lru);
                 return lu_object_top(h);
         }
 
@@ -604,8 +739,8 @@ static struct lu_object *htable_lookup(struct lu_site *s,
          * returned (to assure that references to dying objects are eventually
          * drained), and moreover, lookup has to wait until object is freed.
          */
-
 	if (likely(waiter != NULL)) {
+		bkt = lu_site_bkt_from_fid(s, &h->loh_fid);
 		init_waitqueue_entry_current(waiter);
 		add_wait_queue(&bkt->lsb_marche_funebre, waiter);
 		set_current_state(TASK_UNINTERRUPTIBLE);
@@ -615,31 +750,6 @@ static struct lu_object *htable_lookup(struct lu_site *s,
 	return ERR_PTR(-EAGAIN);
 }
 
-static struct lu_object *htable_lookup_nowait(struct lu_site *s,
-					      cfs_hash_bd_t *bd,
-					      const struct lu_fid *f)
-{
-	struct hlist_node	*hnode;
-	struct lu_object_header *h;
-
-	/* cfs_hash_bd_peek_locked is a somehow "internal" function
-	 * of cfs_hash, it doesn't add refcount on object. */
-	hnode = cfs_hash_bd_peek_locked(s->ls_obj_hash, bd, (void *)f);
-	if (hnode == NULL) {
-		lprocfs_counter_incr(s->ls_stats, LU_SS_CACHE_MISS);
-		return ERR_PTR(-ENOENT);
-	}
-
-	h = container_of0(hnode, struct lu_object_header, loh_hash);
-	if (unlikely(lu_object_is_dying(h)))
-		return ERR_PTR(-ENOENT);
-
-	cfs_hash_get(s->ls_obj_hash, hnode);
-	lprocfs_counter_incr(s->ls_stats, LU_SS_CACHE_HIT);
-	list_del_init(&h->loh_lru);
-	return lu_object_top(h);
-}
-
 /**
  * Search cache for an object with the fid \a f. If such object is found,
  * return it. Otherwise, create new object, insert it into cache and return
@@ -684,19 +794,16 @@ static struct lu_object *lu_object_new(const struct lu_env *env,
 {
         struct lu_object        *o;
         cfs_hash_t              *hs;
-        cfs_hash_bd_t            bd;
-        struct lu_site_bkt_data *bkt;
+	cfs_hash_bd_t		 bd;
 
         o = lu_object_alloc(env, dev, f, conf);
         if (unlikely(IS_ERR(o)))
                 return o;
 
         hs = dev->ld_site->ls_obj_hash;
-        cfs_hash_bd_get_and_lock(hs, (void *)f, &bd, 1);
-        bkt = cfs_hash_bd_extra_get(hs, &bd);
-        cfs_hash_bd_add_locked(hs, &bd, &o->lo_header->loh_hash);
-        bkt->lsb_busy++;
-        cfs_hash_bd_unlock(hs, &bd, 1);
+	cfs_hash_bd_get_and_lock(hs, (void *)f, &bd, 1);
+	cfs_hash_bd_add_locked(hs, &bd, &o->lo_header->loh_hash);
+	cfs_hash_bd_unlock(hs, &bd, 1);
 
 	lu_object_limit(env, dev);
 
@@ -717,14 +824,13 @@ static struct lu_object *lu_object_find_try(const struct lu_env *env,
 	struct lu_site        *s;
 	cfs_hash_t            *hs;
 	cfs_hash_bd_t          bd;
-	__u64                  version = 0;
 
         /*
          * This uses standard index maintenance protocol:
          *
-         *     - search index under lock, and return object if found;
+         *     - search index under read lock, and return object if found;
          *     - otherwise, unlock index, allocate new object;
-         *     - lock index and search again;
+         *     - lock index for write and search again;
          *     - if nothing is found (usual case), insert newly created
          *       object into index;
          *     - otherwise (race: other thread inserted object), free
@@ -744,9 +850,9 @@ static struct lu_object *lu_object_find_try(const struct lu_env *env,
 
         s  = dev->ld_site;
         hs = s->ls_obj_hash;
-        cfs_hash_bd_get_and_lock(hs, (void *)f, &bd, 1);
-        o = htable_lookup(s, &bd, f, waiter, &version);
-        cfs_hash_bd_unlock(hs, &bd, 1);
+	cfs_hash_bd_get_and_lock(hs, (void *)f, &bd, 0);
+	o = htable_lookup(s, &bd, f, waiter);
+	cfs_hash_bd_unlock(hs, &bd, 0);
 	if (!IS_ERR(o) || PTR_ERR(o) != -ENOENT)
                 return o;
 
@@ -760,16 +866,12 @@ static struct lu_object *lu_object_find_try(const struct lu_env *env,
 
         LASSERT(lu_fid_eq(lu_object_fid(o), f));
 
-        cfs_hash_bd_lock(hs, &bd, 1);
+	cfs_hash_bd_lock(hs, &bd, 1);
 
-        shadow = htable_lookup(s, &bd, f, waiter, &version);
+	shadow = htable_lookup(s, &bd, f, waiter);
 	if (likely(IS_ERR(shadow) && PTR_ERR(shadow) == -ENOENT)) {
-                struct lu_site_bkt_data *bkt;
-
-                bkt = cfs_hash_bd_extra_get(hs, &bd);
-                cfs_hash_bd_add_locked(hs, &bd, &o->lo_header->loh_hash);
-                bkt->lsb_busy++;
-                cfs_hash_bd_unlock(hs, &bd, 1);
+		cfs_hash_bd_add_locked(hs, &bd, &o->lo_header->loh_hash);
+		cfs_hash_bd_unlock(hs, &bd, 1);
 
 		lu_object_limit(env, dev);
 
@@ -777,7 +879,7 @@ static struct lu_object *lu_object_find_try(const struct lu_env *env,
         }
 
         lprocfs_counter_incr(s->ls_stats, LU_SS_CACHE_RACE);
-        cfs_hash_bd_unlock(hs, &bd, 1);
+	cfs_hash_bd_unlock(hs, &bd, 1);
         lu_object_free(env, o);
         return shadow;
 }
@@ -831,9 +933,9 @@ void lu_object_purge(const struct lu_env *env, struct lu_device *dev,
 	cfs_hash_bd_t		 bd;
 	struct lu_object	*o;
 
-	cfs_hash_bd_get_and_lock(hs, f, &bd, 1);
-	o = htable_lookup_nowait(s, &bd, f);
-	cfs_hash_bd_unlock(hs, &bd, 1);
+	cfs_hash_bd_get_and_lock(hs, f, &bd, 0);
+	o = htable_lookup(s, &bd, f, NULL);
+	cfs_hash_bd_unlock(hs, &bd, 0);
 	if (!IS_ERR(o)) {
 		set_bit(LU_OBJECT_HEARD_BANSHEE, &o->lo_header->loh_flags);
 		lu_object_put(env, o);
@@ -1049,14 +1151,7 @@ static void lu_obj_hop_get(cfs_hash_t *hs, struct hlist_node *hnode)
 	struct lu_object_header *h;
 
 	h = hlist_entry(hnode, struct lu_object_header, loh_hash);
-	if (atomic_add_return(1, &h->loh_ref) == 1) {
-		struct lu_site_bkt_data *bkt;
-		cfs_hash_bd_t		 bd;
-
-		cfs_hash_bd_get(hs, &h->loh_fid, &bd);
-		bkt = cfs_hash_bd_extra_get(hs, &bd);
-		bkt->lsb_busy++;
-	}
+	atomic_inc(&h->loh_ref);
 }
 
 static void lu_obj_hop_put_locked(cfs_hash_t *hs, struct hlist_node *hnode)
@@ -1095,8 +1190,7 @@ EXPORT_SYMBOL(lu_dev_del_linkage);
   */
 int lu_site_init(struct lu_site *s, struct lu_device *top)
 {
-	struct lu_site_bkt_data *bkt;
-	cfs_hash_bd_t bd;
+	struct lu_site_lru *lru;
 	char name[16];
 	unsigned int bits;
 	unsigned int i;
@@ -1106,14 +1200,18 @@ int lu_site_init(struct lu_site *s, struct lu_device *top)
 	mutex_init(&s->ls_purge_mutex);
 	bits = lu_htable_order(top);
 	snprintf(name, 16, "lu_site_%s", top->ld_type->ldt_name);
+	/*
+	 * Buckets have read-write locks, lookups of cached objects only take
+	 * them for read, see htable_lookup().
+	 */
 	for (bits = clamp_t(typeof(bits), bits,
 			    LU_SITE_BITS_MIN, LU_SITE_BITS_MAX);
 	     bits >= LU_SITE_BITS_MIN; bits--) {
 		s->ls_obj_hash = cfs_hash_create(name, bits, bits,
 						 bits - LU_SITE_BKT_BITS,
-						 sizeof(*bkt), 0, 0,
+						 0, 0, 0,
 						 &lu_site_hash_ops,
-						 CFS_HASH_SPIN_BKTLOCK |
+						 CFS_HASH_RW_BKTLOCK |
 						 CFS_HASH_NO_ITEMREF |
 						 CFS_HASH_DEPTH |
 						 CFS_HASH_ASSERT_EMPTY |
@@ -1127,18 +1225,25 @@ int lu_site_init(struct lu_site *s, struct lu_device *top)
 		return -ENOMEM;
 	}
 
-	cfs_hash_for_each_bucket(s->ls_obj_hash, &bd, i) {
-		bkt = cfs_hash_bd_extra_get(s->ls_obj_hash, &bd);
-		INIT_LIST_HEAD(&bkt->lsb_lru);
-		init_waitqueue_head(&bkt->lsb_marche_funebre);
+	s->ls_lru = cfs_percpt_alloc(cfs_cpt_table, sizeof(*lru));
+	if (s->ls_lru == NULL)
+		GOTO(out_hash, -ENOMEM);
+
+	cfs_percpt_for_each(lru, i, s->ls_lru) {
+		spin_lock_init(&lru->lsl_lock);
+		INIT_LIST_HEAD(&lru->lsl_list);
 	}
 
+	OBD_ALLOC(s->ls_bkts, sizeof(*s->ls_bkts) * LU_SITE_WAITQ_NR);
+	if (s->ls_bkts == NULL)
+		GOTO(out_lru, -ENOMEM);
+
+	for (i = 0; i < LU_SITE_WAITQ_NR; i++)
+		init_waitqueue_head(&s->ls_bkts[i].lsb_marche_funebre);
+
         s->ls_stats = lprocfs_alloc_stats(LU_SS_LAST_STAT, 0);
-        if (s->ls_stats == NULL) {
-                cfs_hash_putref(s->ls_obj_hash);
-                s->ls_obj_hash = NULL;
-                return -ENOMEM;
-        }
+	if (s->ls_stats == NULL)
+		GOTO(out_bkts, -ENOMEM);
 
         lprocfs_counter_init(s->ls_stats, LU_SS_CREATED,
                              0, "created", "created");
@@ -1165,6 +1270,17 @@ int lu_site_init(struct lu_site *s, struct lu_device *top)
 	lu_dev_add_linkage(s, top);
 
 	RETURN(0);
+
+out_bkts:
+	OBD_FREE(s->ls_bkts, sizeof(*s->ls_bkts) * LU_SITE_WAITQ_NR);
+	s->ls_bkts = NULL;
+out_lru:
+	cfs_percpt_free(s->ls_lru);
+	s->ls_lru = NULL;
+out_hash:
+	cfs_hash_putref(s->ls_obj_hash);
+	s->ls_obj_hash = NULL;
+	RETURN(-ENOMEM);
 }
 EXPORT_SYMBOL(lu_site_init);
 
@@ -1182,6 +1298,16 @@ void lu_site_fini(struct lu_site *s)
                 s->ls_obj_hash = NULL;
         }
 
+	if (s->ls_lru != NULL) {
+		cfs_percpt_free(s->ls_lru);
+		s->ls_lru = NULL;
+	}
+
+	if (s->ls_bkts != NULL) {
+		OBD_FREE(s->ls_bkts, sizeof(*s->ls_bkts) * LU_SITE_WAITQ_NR);
+		s->ls_bkts = NULL;
+	}
+
         if (s->ls_top_dev != NULL) {
                 s->ls_top_dev->ld_site = NULL;
                 lu_ref_del(&s->ls_top_dev->ld_reference, "site-top", s);
@@ -1338,6 +1464,7 @@ int lu_object_header_init(struct lu_object_header *h)
 	atomic_set(&h->loh_ref, 1);
 	INIT_HLIST_NODE(&h->loh_hash);
 	INIT_LIST_HEAD(&h->loh_lru);
+	h->loh_lru_cpt = cfs_cpt_current(cfs_cpt_table, 1);
 	INIT_LIST_HEAD(&h->loh_layers);
         lu_ref_init(&h->loh_reference);
         return 0;
@@ -1589,6 +1716,36 @@ void lu_context_key_quiesce_many(struct lu_context_key *k, ...)
 }
 EXPORT_SYMBOL(lu_context_key_quiesce_many);
 
+/**
+ * Create value of \a key, registered at \a index, in \a ctx.
+ */
+static int key_fill(struct lu_context *ctx, struct lu_context_key *key,
+		    unsigned int index)
+{
+	void *value;
+
+	LINVRNT(key->lct_init != NULL);
+	LINVRNT(key->lct_index == index);
+
+	value = key->lct_init(ctx, key);
+	if (unlikely(IS_ERR(value)))
+		return PTR_ERR(value);
+
+	LASSERT(key->lct_owner != NULL);
+	if (!(ctx->lc_tags & LCT_NOREF))
+		try_module_get(key->lct_owner);
+	lu_ref_add_atomic(&key->lct_reference, "ctx", ctx);
+	atomic_inc(&key->lct_used);
+	/*
+	 * This is the only place in the code, where an element of
+	 * ctx->lc_value[] array is set to non-NULL value.
+	 */
+	ctx->lc_value[index] = value;
+	if (key->lct_exit != NULL)
+		ctx->lc_tags |= LCT_HAS_EXIT;
+	return 0;
+}
+
 /**
  * Return value associated with key \a key in context \a ctx.
  */
@@ -1673,28 +1830,11 @@ static int keys_fill(struct lu_context *ctx)
                      * will pin module owning a key.
                      */
                     !(key->lct_tags & LCT_QUIESCENT)) {
-                        void *value;
-
-                        LINVRNT(key->lct_init != NULL);
-                        LINVRNT(key->lct_index == i);
-
-                        value = key->lct_init(ctx, key);
-                        if (unlikely(IS_ERR(value)))
-                                return PTR_ERR(value);
-
-			LASSERT(key->lct_owner != NULL);
-			if (!(ctx->lc_tags & LCT_NOREF))
-				try_module_get(key->lct_owner);
-			lu_ref_add_atomic(&key->lct_reference, "ctx", ctx);
-			atomic_inc(&key->lct_used);
-                        /*
-                         * This is the only place in the code, where an
-                         * element of ctx->lc_value[] array is set to non-NULL
-                         * value.
-                         */
-                        ctx->lc_value[i] = value;
-                        if (key->lct_exit != NULL)
-                                ctx->lc_tags |= LCT_HAS_EXIT;
+			int rc;
+
+			rc = key_fill(ctx, key, i);
+			if (unlikely(rc != 0))
+				return rc;
                 }
                 ctx->lc_version = key_set_version;
         }
@@ -1917,23 +2057,24 @@ typedef struct lu_site_stats{
         unsigned        lss_busy;
 } lu_site_stats_t;
 
-static void lu_site_stats_get(cfs_hash_t *hs,
+static void lu_site_stats_get(struct lu_site *s,
                               lu_site_stats_t *stats, int populated)
 {
-	cfs_hash_bd_t bd;
-	unsigned int  i;
+	cfs_hash_t		*hs = s->ls_obj_hash;
+	struct lu_site_lru	*lru;
+	cfs_hash_bd_t		 bd;
+	unsigned int		 i;
+	long			 queued = 0;
 
         cfs_hash_for_each_bucket(hs, &bd, i) {
-                struct lu_site_bkt_data *bkt = cfs_hash_bd_extra_get(hs, &bd);
 		struct hlist_head	*hhead;
 
-                cfs_hash_bd_lock(hs, &bd, 1);
-                stats->lss_busy  += bkt->lsb_busy;
+                cfs_hash_bd_lock(hs, &bd, 0);
                 stats->lss_total += cfs_hash_bd_count_get(&bd);
                 stats->lss_max_search = max((int)stats->lss_max_search,
                                             cfs_hash_bd_depmax_get(&bd));
                 if (!populated) {
-                        cfs_hash_bd_unlock(hs, &bd, 1);
+                        cfs_hash_bd_unlock(hs, &bd, 0);
                         continue;
                 }
 
@@ -1941,8 +2082,17 @@ static void lu_site_stats_get(cfs_hash_t *hs,
 			if (!hlist_empty(hhead))
                                 stats->lss_populated++;
                 }
-                cfs_hash_bd_unlock(hs, &bd, 1);
+                cfs_hash_bd_unlock(hs, &bd, 0);
         }
+
+	/*
+	 * Objects found in cache are left on the LRU until the next purge,
+	 * so this is an estimate.
+	 */
+	cfs_percpt_for_each(lru, i, s->ls_lru)
+		queued += lru->lsl_nr;
+	stats->lss_busy = stats->lss_total > queued ?
+			  stats->lss_total - queued : 0;
 }
 
 
@@ -1960,7 +2110,7 @@ static unsigned long lu_cache_shrink_count(struct shrinker *sk,
 	mutex_lock(&lu_sites_guard);
 	list_for_each_entry_safe(s, tmp, &lu_sites, ls_linkage) {
 		memset(&stats, 0, sizeof(stats));
-		lu_site_stats_get(s->ls_obj_hash, &stats, 0);
+		lu_site_stats_get(s, &stats, 0);
 		cached += stats.lss_total - stats.lss_busy;
 	}
 	mutex_unlock(&lu_sites_guard);
@@ -2191,7 +2341,7 @@ int lu_site_stats_seq_print(const struct lu_site *s, struct seq_file *m)
 	lu_site_stats_t stats;
 
 	memset(&stats, 0, sizeof(stats));
-	lu_site_stats_get(s->ls_obj_hash, &stats, 1);
+	lu_site_stats_get((struct lu_site *)s, &stats, 1);
 
 	return seq_printf(m, "%d/%d %d/%d %d %d %d %d %d %d %d\n",
 			  stats.lss_busy,
@@ -2213,7 +2363,7 @@ int lu_site_stats_print(const struct lu_site *s, char *page, int count)
         lu_site_stats_t stats;
 
         memset(&stats, 0, sizeof(stats));
-        lu_site_stats_get(s->ls_obj_hash, &stats, 1);
+        lu_site_stats_get((struct lu_site *)s, &stats, 1);
 
         return snprintf(page, count, "%d/%d %d/%d %d %d %d %d %d %d %d\n",
                         stats.lss_busy,
@@ -2277,24 +2427,20 @@ void lu_object_assign_fid(const struct lu_env *env, struct lu_object *o,
 {
 	struct lu_site		*s = o->lo_dev->ld_site;
 	struct lu_fid		*old = &o->lo_header->loh_fid;
-	struct lu_site_bkt_data	*bkt;
 	struct lu_object	*shadow;
 	wait_queue_t		 waiter;
 	cfs_hash_t		*hs;
 	cfs_hash_bd_t		 bd;
-	__u64			 version = 0;
 
 	LASSERT(fid_is_zero(old));
 
 	hs = s->ls_obj_hash;
 	cfs_hash_bd_get_and_lock(hs, (void *)fid, &bd, 1);
-	shadow = htable_lookup(s, &bd, fid, &waiter, &version);
+	shadow = htable_lookup(s, &bd, fid, &waiter);
 	/* supposed to be unique */
 	LASSERT(IS_ERR(shadow) && PTR_ERR(shadow) == -ENOENT);
 	*old = *fid;
-	bkt = cfs_hash_bd_extra_get(hs, &bd);
 	cfs_hash_bd_add_locked(hs, &bd, &o->lo_header->loh_hash);
-	bkt->lsb_busy++;
 	cfs_hash_bd_unlock(hs, &bd, 1);
 }
 EXPORT_SYMBOL(lu_object_assign_fid);
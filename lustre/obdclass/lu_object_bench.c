@@ -0,0 +1,314 @@
+/*
+ * GPL HEADER START
+ *
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License version 2 for more details (a copy is included
+ * in the LICENSE file that accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; If not, see
+ * http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * GPL HEADER END
+ */
+/*
+ * This file is part of Lustre, http://www.lustre.org/
+ *
+ * lustre/obdclass/lu_object_bench.c
+ *
+ * Micro-benchmark of the lu_object cache: sets up a site with a one-layer
+ * device, caches \a nobjs objects, then runs 1, 2, 4, ... threads bound to
+ * different CPUs, up to all online CPUs, each doing \a nlookups
+ * lu_object_find()/lu_object_put() of random cached fids, and reports the
+ * number of lookups per second on the console. Finally the time taken to
+ * purge the cache from the LRU lists is reported.
+ */
+
+#define DEBUG_SUBSYSTEM S_CLASS
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/kthread.h>
+
+#include <obd_class.h>
+#include <obd_support.h>
+#include <lustre_fid.h>
+#include <lu_object.h>
+
+static int nobjs = 262144;
+CFS_MODULE_PARM(nobjs, "i", int, 0444,
+		"# objects in the cache");
+
+static int nlookups = 1000000;
+CFS_MODULE_PARM(nlookups, "i", int, 0444,
+		"# lookups by each thread");
+
+struct lu_bench_object {
+	struct lu_object_header	lbo_header;
+	struct lu_object	lbo_obj;
+};
+
+struct lu_bench_ctx {
+	struct lu_device	*lbc_dev;
+	atomic_t		 lbc_ready;
+	atomic_t		 lbc_running;
+	atomic_t		 lbc_errors;
+	int			 lbc_go;
+	struct completion	 lbc_done;
+};
+
+static void lu_bench_fid(struct lu_fid *fid, int i)
+{
+	fid->f_seq = FID_SEQ_NORMAL;
+	fid->f_oid = i + 1;
+	fid->f_ver = 0;
+}
+
+static int lu_bench_object_init(const struct lu_env *env, struct lu_object *o,
+				const struct lu_object_conf *conf)
+{
+	return 0;
+}
+
+static void lu_bench_object_free(const struct lu_env *env, struct lu_object *o)
+{
+	struct lu_bench_object *lbo;
+
+	lbo = container_of(o, struct lu_bench_object, lbo_obj);
+	lu_object_fini(o);
+	lu_object_header_fini(&lbo->lbo_header);
+	OBD_FREE_PTR(lbo);
+}
+
+static const struct lu_object_operations lu_bench_obj_ops = {
+	.loo_object_init = lu_bench_object_init,
+	.loo_object_free = lu_bench_object_free,
+};
+
+static struct lu_object *lu_bench_object_alloc(const struct lu_env *env,
+					       const struct lu_object_header *h,
+					       struct lu_device *d)
+{
+	struct lu_bench_object *lbo;
+
+	OBD_ALLOC_PTR(lbo);
+	if (lbo == NULL)
+		return NULL;
+
+	lu_object_header_init(&lbo->lbo_header);
+	lu_object_init(&lbo->lbo_obj, &lbo->lbo_header, d);
+	lbo->lbo_obj.lo_ops = &lu_bench_obj_ops;
+	lu_object_add_top(&lbo->lbo_header, &lbo->lbo_obj);
+
+	return &lbo->lbo_obj;
+}
+
+static const struct lu_device_operations lu_bench_dev_ops = {
+	.ldo_object_alloc = lu_bench_object_alloc,
+};
+
+static struct lu_device_type_operations lu_bench_type_ops;
+
+static struct lu_device_type lu_bench_type = {
+	.ldt_tags     = LU_DEVICE_DT,
+	.ldt_name     = "lu_bench",
+	.ldt_ops      = &lu_bench_type_ops,
+	.ldt_ctx_tags = LCT_LOCAL,
+};
+
+static int lu_bench_find(const struct lu_env *env, struct lu_device *dev,
+			 int i)
+{
+	struct lu_object	*o;
+	struct lu_fid		 fid;
+
+	lu_bench_fid(&fid, i);
+	o = lu_object_find(env, dev, &fid, NULL);
+	if (IS_ERR(o))
+		return PTR_ERR(o);
+
+	lu_object_put(env, o);
+	return 0;
+}
+
+static int lu_bench_thread(void *arg)
+{
+	struct lu_bench_ctx	*ctx = arg;
+	struct lu_env		 env;
+	__u64			 rnd = (unsigned long)current;
+	int			 rc;
+	int			 i;
+
+	rc = lu_env_init(&env, LCT_LOCAL);
+
+	atomic_inc(&ctx->lbc_ready);
+	while (!ACCESS_ONCE(ctx->lbc_go))
+		cpu_relax();
+
+	if (rc == 0) {
+		for (i = 0; rc == 0 && i < nlookups; i++) {
+			/* 64-bit LCG, good enough to spread fids */
+			rnd = rnd * 6364136223846793005ULL +
+			      1442695040888963407ULL;
+			rc = lu_bench_find(&env, ctx->lbc_dev,
+					   (rnd >> 32) % nobjs);
+		}
+		lu_env_fini(&env);
+	}
+
+	if (rc != 0)
+		atomic_inc(&ctx->lbc_errors);
+
+	if (atomic_dec_and_test(&ctx->lbc_running))
+		complete(&ctx->lbc_done);
+	return 0;
+}
+
+static int lu_bench_run_threads(struct lu_device *dev, int nthreads)
+{
+	struct lu_bench_ctx	 ctx;
+	struct task_struct	*task;
+	struct timeval		 start;
+	struct timeval		 end;
+	__u64			 usec;
+	__u64			 rate;
+	int			 cpu;
+	int			 n = 0;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.lbc_dev = dev;
+	atomic_set(&ctx.lbc_running, nthreads);
+	init_completion(&ctx.lbc_done);
+
+	for_each_online_cpu(cpu) {
+		if (n == nthreads)
+			break;
+
+		task = kthread_create(lu_bench_thread, &ctx,
+				      "lu_bench_%02d", n);
+		if (IS_ERR(task)) {
+			CERROR("Can't start thread %d: %ld\n", n,
+			       PTR_ERR(task));
+			/* let the started ones run to the end */
+			if (atomic_sub_and_test(nthreads - n,
+						&ctx.lbc_running))
+				complete(&ctx.lbc_done);
+			ctx.lbc_go = 1;
+			wait_for_completion(&ctx.lbc_done);
+			return PTR_ERR(task);
+		}
+		kthread_bind(task, cpu);
+		wake_up_process(task);
+		n++;
+	}
+
+	while (atomic_read(&ctx.lbc_ready) < nthreads)
+		cond_resched();
+
+	do_gettimeofday(&start);
+	smp_mb();
+	ctx.lbc_go = 1;
+	wait_for_completion(&ctx.lbc_done);
+	do_gettimeofday(&end);
+
+	if (atomic_read(&ctx.lbc_errors) != 0) {
+		CERROR("%d threads failed\n", atomic_read(&ctx.lbc_errors));
+		return -EIO;
+	}
+
+	usec = (end.tv_sec - start.tv_sec) * 1000000ULL +
+	       end.tv_usec - start.tv_usec;
+	rate = (__u64)nthreads * nlookups * 1000000ULL;
+	do_div(rate, max_t(__u64, usec, 1));
+
+	LCONSOLE_INFO("%3d threads: "LPU64" lookups/s\n", nthreads, rate);
+	return 0;
+}
+
+static int lu_bench_run(const struct lu_env *env, struct lu_device *dev)
+{
+	struct lu_site	*site = dev->ld_site;
+	struct timeval	 start;
+	struct timeval	 end;
+	__u64		 usec;
+	int		 ncpus = num_online_cpus();
+	int		 rc = 0;
+	int		 i;
+
+	for (i = 0; rc == 0 && i < nobjs; i++)
+		rc = lu_bench_find(env, dev, i);
+	if (rc != 0) {
+		CERROR("Can't cache object %d: %d\n", i - 1, rc);
+		return rc;
+	}
+
+	for (i = 1; rc == 0; i = min(i * 2, ncpus)) {
+		rc = lu_bench_run_threads(dev, i);
+		if (i == ncpus)
+			break;
+	}
+
+	LCONSOLE_INFO("%d objects cached\n",
+		      (int)cfs_hash_size_get(site->ls_obj_hash));
+
+	do_gettimeofday(&start);
+	lu_site_purge(env, site, ~0);
+	do_gettimeofday(&end);
+
+	usec = (end.tv_sec - start.tv_sec) * 1000000ULL +
+	       end.tv_usec - start.tv_usec;
+	LCONSOLE_INFO("purged %d objects in "LPU64" usec\n", nobjs, usec);
+
+	return rc;
+}
+
+static int __init lu_bench_init(void)
+{
+	struct lu_device	dev;
+	struct lu_site		site;
+	struct lu_env		env;
+	int			rc;
+
+	if (nobjs <= 0 || nlookups < 0) {
+		CERROR("Invalid nobjs %d or nlookups %d\n", nobjs, nlookups);
+		return -EINVAL;
+	}
+
+	rc = lu_env_init(&env, LCT_LOCAL);
+	if (rc != 0)
+		return rc;
+
+	lu_device_init(&dev, &lu_bench_type);
+	dev.ld_ops = &lu_bench_dev_ops;
+
+	rc = lu_site_init(&site, &dev);
+	if (rc != 0)
+		GOTO(out_dev, rc);
+
+	rc = lu_bench_run(&env, &dev);
+
+	lu_site_purge(&env, &site, ~0);
+	lu_site_fini(&site);
+out_dev:
+	lu_device_fini(&dev);
+	lu_env_fini(&env);
+	return rc;
+}
+
+static void __exit lu_bench_exit(void)
+{
+}
+
+MODULE_DESCRIPTION("Lustre lu_object cache benchmark");
+MODULE_LICENSE("GPL");
+
+module_init(lu_bench_init);
+module_exit(lu_bench_exit);
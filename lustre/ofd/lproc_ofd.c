@@ -981,6 +981,7 @@ LPROC_SEQ_FOPS_RO_TYPE(ofd, num_exports);
 LPROC_SEQ_FOPS_RO_TYPE(ofd, target_instance);
 LPROC_SEQ_FOPS_RW_TYPE(ofd, ir_factor);
 LPROC_SEQ_FOPS_RW_TYPE(ofd, job_interval);
+LPROC_SEQ_FOPS_RW_TYPE(ofd, job_max_mb);
 
 struct lprocfs_seq_vars lprocfs_ofd_obd_vars[] = {
 	{ .name =	"uuid",
@@ -1047,6 +1048,8 @@ struct lprocfs_seq_vars lprocfs_ofd_obd_vars[] = {
 	  .fops =	&ofd_capa_count_fops		},
 	{ .name =	"job_cleanup_interval",
 	  .fops =	&ofd_job_interval_fops		},
+	{ .name =	"job_stats_max_mb",
+	  .fops =	&ofd_job_max_mb_fops		},
 	{ .name =	"soft_sync_limit",
 	  .fops =	&ofd_soft_sync_limit_fops	},
 	{ .name =	"lfsck_speed_limit",
@@ -409,6 +409,16 @@ struct ptlrpc_request *ptlrpc_request_cache_alloc(gfp_t flags)
 	return req;
 }
 
+struct ptlrpc_request *
+ptlrpc_request_cache_cpt_alloc(struct cfs_cpt_table *cptab, int cpt,
+			       gfp_t flags)
+{
+	struct ptlrpc_request *req;
+
+	OBD_SLAB_CPT_ALLOC_PTR_GFP(req, request_cache, cptab, cpt, flags);
+	return req;
+}
+
 void ptlrpc_request_cache_free(struct ptlrpc_request *req)
 {
 	OBD_SLAB_FREE_PTR(req, request_cache);
@@ -1304,6 +1314,24 @@ static int after_reply(struct ptlrpc_request *req)
 		ptlrpc_lprocfs_rpc_sent(req, timediff);
 	}
 
+	/* replays and recovery RPCs would skew the latencies */
+	if (req->rq_send_state == LUSTRE_IMP_FULL) {
+		__u32 opc = lustre_msg_get_opc(req->rq_reqmsg);
+
+		lprocfs_rpc_lat_tally(imp->imp_rpc_lat, opc, RPC_LAT_SERVICE,
+				      timediff);
+		if (req->rq_lat_stamp.tv_sec != 0)
+			lprocfs_rpc_lat_tally(imp->imp_rpc_lat, opc,
+					      RPC_LAT_WAIT,
+					      cfs_timeval_sub(&req->rq_arrival_time,
+							      &req->rq_lat_stamp,
+							      NULL));
+		/* until committed, see ptlrpc_free_committed() */
+		req->rq_lat_stamp = work_start;
+	} else {
+		req->rq_lat_stamp.tv_sec = 0;
+	}
+
         if (lustre_msg_get_type(req->rq_repmsg) != PTL_RPC_MSG_REPLY &&
             lustre_msg_get_type(req->rq_repmsg) != PTL_RPC_MSG_ERR) {
                 DEBUG_REQ(D_ERROR, req, "invalid packet received (type=%u)",
@@ -1421,6 +1449,7 @@ static int ptlrpc_send_new_req(struct ptlrpc_request *req)
                 RETURN (0);
 
         ptlrpc_rqphase_move(req, RQ_PHASE_RPC);
+	do_gettimeofday(&req->rq_lat_stamp);
 
 	spin_lock(&imp->imp_lock);
 
@@ -2496,6 +2525,7 @@ void ptlrpc_free_committed(struct obd_import *imp)
 	struct ptlrpc_request	*req, *saved;
 	struct ptlrpc_request	*last_req = NULL; /* temporary fire escape */
 	bool			 skip_committed_list = true;
+	struct timeval		 now = { 0 };
 	ENTRY;
 
 	LASSERT(imp != NULL);
@@ -2538,6 +2568,18 @@ void ptlrpc_free_committed(struct obd_import *imp)
                         break;
                 }
 
+		if (req->rq_lat_stamp.tv_sec != 0) {
+			if (now.tv_sec == 0)
+				do_gettimeofday(&now);
+			lprocfs_rpc_lat_tally(imp->imp_rpc_lat,
+					      lustre_msg_get_opc(req->rq_reqmsg),
+					      RPC_LAT_COMMIT,
+					      cfs_timeval_sub(&now,
+							      &req->rq_lat_stamp,
+							      NULL));
+			req->rq_lat_stamp.tv_sec = 0;
+		}
+
 		if (req->rq_replay) {
 			DEBUG_REQ(D_RPCTRACE, req, "keeping (FL_REPLAY)");
 			list_move_tail(&req->rq_replay_list,
@@ -2778,7 +2820,9 @@ static int ptlrpc_replay_interpret(const struct lu_env *env,
 	/** if replays by version then gap occur on server, no trust to locks */
 	if (lustre_msg_get_flags(req->rq_repmsg) & MSG_VERSION_REPLAY)
 		imp->imp_no_lock_replay = 1;
-	imp->imp_last_replay_transno = lustre_msg_get_transno(req->rq_reqmsg);
+	/* replies to a window of replays may be interpreted out of order */
+	imp->imp_last_replay_transno = max(imp->imp_last_replay_transno,
+				lustre_msg_get_transno(req->rq_reqmsg));
 	spin_unlock(&imp->imp_lock);
         LASSERT(imp->imp_last_replay_transno);
 
@@ -2819,9 +2863,16 @@ static int ptlrpc_replay_interpret(const struct lu_env *env,
  out:
         req->rq_send_state = aa->praa_old_state;
 
-        if (rc != 0)
-                /* this replay failed, so restart recovery */
-                ptlrpc_connect_import(imp);
+	if (rc != 0) {
+		if (lustre_msg_get_conn_cnt(req->rq_reqmsg) ==
+		    imp->imp_conn_cnt)
+			/* this replay failed, so restart recovery */
+			ptlrpc_connect_import(imp);
+		else
+			/* sent over a connection which has been re-established
+			 * meanwhile, resume replay once the window drained */
+			ptlrpc_import_recovery_state_machine(imp);
+	}
 
         RETURN(rc);
 }
@@ -45,6 +45,9 @@
 
 lnet_handle_eq_t   ptlrpc_eq_h;
 
+/* # events queued per CPT before LNet delivers them synchronously */
+#define PTLRPC_EQ_RING_SIZE	1024
+
 /*
  *  Client's outgoing request callback
  */
@@ -280,16 +283,16 @@ static void ptlrpc_req_add_history(struct ptlrpc_service_part *svcpt,
 }
 
 /*
- * Server's incoming request callback
+ * Set up the request for the server's incoming request event \a ev, returns
+ * NULL if the request has to be dropped.
  */
-void request_in_callback(lnet_event_t *ev)
+static struct ptlrpc_request *request_in_prep(lnet_event_t *ev)
 {
 	struct ptlrpc_cb_id		  *cbid = ev->md.user_ptr;
 	struct ptlrpc_request_buffer_desc *rqbd = cbid->cbid_arg;
 	struct ptlrpc_service_part	  *svcpt = rqbd->rqbd_svcpt;
 	struct ptlrpc_service             *service = svcpt->scp_service;
         struct ptlrpc_request             *req;
-        ENTRY;
 
         LASSERT (ev->type == LNET_EVENT_PUT ||
                  ev->type == LNET_EVENT_UNLINK);
@@ -313,15 +316,15 @@ void request_in_callback(lnet_event_t *ev)
                 LASSERT (ev->type == LNET_EVENT_PUT);
                 if (ev->status != 0) {
                         /* We moaned above already... */
-                        return;
+			return NULL;
                 }
-		req = ptlrpc_request_cache_alloc(ALLOC_ATOMIC_TRY);
+		req = ptlrpc_svcpt_req_alloc(svcpt);
                 if (req == NULL) {
                         CERROR("Can't allocate incoming request descriptor: "
                                "Dropping %s RPC from %s\n",
                                service->srv_name,
                                libcfs_id2str(ev->initiator));
-                        return;
+			return NULL;
                 }
         }
 
@@ -347,12 +350,26 @@ void request_in_callback(lnet_event_t *ev)
 
 	CDEBUG(D_RPCTRACE, "peer: %s\n", libcfs_id2str(req->rq_peer));
 
-	spin_lock(&svcpt->scp_lock);
+	return req;
+}
+
+/*
+ * Queue the request set up by request_in_prep() for event \a ev on the
+ * incoming list of its service partition, must be called with
+ * svcpt::scp_lock held.
+ */
+static void request_in_queue_locked(lnet_event_t *ev,
+				    struct ptlrpc_request *req)
+{
+	struct ptlrpc_request_buffer_desc *rqbd = req->rq_rqbd;
+	struct ptlrpc_service_part	  *svcpt = rqbd->rqbd_svcpt;
 
 	ptlrpc_req_add_history(svcpt, req);
 
 	if (ev->unlinked) {
 		svcpt->scp_nrqbds_posted--;
+		if (ev->type != LNET_EVENT_UNLINK)
+			svcpt->scp_rqbd_filled++;
 		CDEBUG(D_INFO, "Buffer complete: %d buffers still posted\n",
 		       svcpt->scp_nrqbds_posted);
 
@@ -361,17 +378,39 @@ void request_in_callback(lnet_event_t *ev)
 		if (test_req_buffer_pressure &&
 		    ev->type != LNET_EVENT_UNLINK &&
 		    svcpt->scp_nrqbds_posted == 0)
-                        CWARN("All %s request buffers busy\n",
-                              service->srv_name);
+			CWARN("All %s request buffers busy\n",
+			      svcpt->scp_service->srv_name);
 
-                /* req takes over the network's ref on rqbd */
-        } else {
-                /* req takes a ref on rqbd */
-                rqbd->rqbd_refcount++;
-        }
+		/* req takes over the network's ref on rqbd */
+	} else {
+		/* req takes a ref on rqbd */
+		rqbd->rqbd_refcount++;
+	}
 
 	list_add_tail(&req->rq_list, &svcpt->scp_req_incoming);
 	svcpt->scp_nreqs_incoming++;
+}
+
+/*
+ * Server's incoming request callback
+ */
+void request_in_callback(lnet_event_t *ev)
+{
+	struct ptlrpc_cb_id		  *cbid = ev->md.user_ptr;
+	struct ptlrpc_request_buffer_desc *rqbd = cbid->cbid_arg;
+	struct ptlrpc_service_part	  *svcpt = rqbd->rqbd_svcpt;
+	struct ptlrpc_request		  *req;
+	ENTRY;
+
+	req = request_in_prep(ev);
+	if (req == NULL) {
+		EXIT;
+		return;
+	}
+
+	spin_lock(&svcpt->scp_lock);
+
+	request_in_queue_locked(ev, req);
 
 	/* NB everything can disappear under us once the request
 	 * has been queued and we unlock, so do the wake now... */
@@ -381,6 +420,46 @@ void request_in_callback(lnet_event_t *ev)
 	EXIT;
 }
 
+/*
+ * Server's incoming request callback for a run of \a nevents events of the
+ * same service partition: the requests are queued with a single round of
+ * svcpt::scp_lock and a single wakeup.
+ */
+static void request_in_batch_callback(struct ptlrpc_service_part *svcpt,
+				      lnet_event_t *events, int nevents)
+{
+	struct ptlrpc_request	*reqs[LNET_EQ_BATCH_SIZE];
+	int			 nreqs = 0;
+	int			 i;
+	ENTRY;
+
+	LASSERT(nevents <= LNET_EQ_BATCH_SIZE);
+
+	for (i = 0; i < nevents; i++) {
+		reqs[i] = request_in_prep(&events[i]);
+		if (reqs[i] != NULL)
+			nreqs++;
+	}
+
+	if (nreqs == 0) {
+		EXIT;
+		return;
+	}
+
+	spin_lock(&svcpt->scp_lock);
+
+	for (i = 0; i < nevents; i++) {
+		if (reqs[i] != NULL)
+			request_in_queue_locked(&events[i], reqs[i]);
+	}
+
+	/* service threads wait exclusively, wake one per request */
+	wake_up_nr(&svcpt->scp_waitq, nreqs);
+
+	spin_unlock(&svcpt->scp_lock);
+	EXIT;
+}
+
 /*
  *  Server's outgoing reply callback
  */
@@ -494,6 +573,51 @@ static void ptlrpc_master_callback(lnet_event_t *ev)
         callback (ev);
 }
 
+static struct ptlrpc_service_part *ptlrpc_event_svcpt(lnet_event_t *ev)
+{
+	struct ptlrpc_cb_id			*cbid = ev->md.user_ptr;
+	struct ptlrpc_request_buffer_desc	*rqbd;
+
+	if (cbid->cbid_fn != request_in_callback)
+		return NULL;
+
+	rqbd = cbid->cbid_arg;
+	return rqbd->rqbd_svcpt;
+}
+
+/*
+ * Batched EQ handler: runs of incoming requests to the same service
+ * partition are queued together, other events are passed one by one to
+ * ptlrpc_master_callback(). Client replies and bulk completions are not
+ * coalesced, since the request or bulk descriptor and the wait queue to
+ * wake may go away as soon as the lock of each is dropped.
+ */
+static void ptlrpc_master_batch_callback(lnet_event_t *events, int nevents)
+{
+	struct ptlrpc_service_part	*svcpt;
+	int				 i;
+	int				 j;
+
+	for (i = 0; i < nevents; i = j) {
+		svcpt = ptlrpc_event_svcpt(&events[i]);
+		if (svcpt == NULL) {
+			ptlrpc_master_callback(&events[i]);
+			j = i + 1;
+			continue;
+		}
+
+		for (j = i + 1; j < nevents; j++) {
+			if (ptlrpc_event_svcpt(&events[j]) != svcpt)
+				break;
+		}
+
+		if (j - i == 1)
+			ptlrpc_master_callback(&events[i]);
+		else
+			request_in_batch_callback(svcpt, &events[i], j - i);
+	}
+}
+
 int ptlrpc_uuid_to_peer (struct obd_uuid *uuid,
                          lnet_process_id_t *peer, lnet_nid_t *self)
 {
@@ -609,10 +733,12 @@ int ptlrpc_ni_init(void)
         /* CAVEAT EMPTOR: how we process portals events is _radically_
          * different depending on... */
 	/* kernel LNet calls our master callback when there are new event,
-	 * because we are guaranteed to get every event via callback,
-	 * so we just set EQ size to 0 to avoid overhread of serializing
-	 * enqueue/dequeue operations in LNet. */
-	rc = LNetEQAlloc(0, ptlrpc_master_callback, &ptlrpc_eq_h);
+	 * because we are guaranteed to get every event via callback.
+	 * Events are queued per CPT under the LNet resource lock and passed
+	 * in batches, so a burst of incoming requests costs one round of
+	 * scp_lock and one wakeup. */
+	rc = LNetEQAllocBatch(PTLRPC_EQ_RING_SIZE,
+			      ptlrpc_master_batch_callback, &ptlrpc_eq_h);
         if (rc == 0)
                 return 0;
 
@@ -2600,7 +2600,9 @@ int gss_svc_alloc_rs(struct ptlrpc_request *req, int msglen)
                 /* pre-allocated */
                 LASSERT(rs->rs_size >= rs_size);
         } else {
-                OBD_ALLOC_LARGE(rs, rs_size);
+                rs = lustre_get_pool_rs(req, rs_size);
+                if (rs == NULL)
+                        OBD_ALLOC_LARGE(rs, rs_size);
                 if (rs == NULL)
                         RETURN(-ENOMEM);
 
@@ -662,6 +662,7 @@ int ptlrpc_connect_import(struct obd_import *imp)
 
         imp->imp_conn_cnt++;
         imp->imp_resend_replay = 0;
+	imp->imp_no_ping_batch = 0;
 
         if (!lustre_handle_is_used(&imp->imp_remote_handle))
                 initial_connect = 1;
@@ -987,6 +988,8 @@ static int ptlrpc_connect_interpret(const struct lu_env *env,
                 imp->imp_remote_handle =
                                 *lustre_msg_get_handle(request->rq_repmsg);
                 imp->imp_last_replay_transno = 0;
+		imp->imp_replay_sent_transno = 0;
+		imp->imp_replay_resend_transno = 0;
                 IMPORT_SET_STATE(imp, LUSTRE_IMP_REPLAY);
         } else {
                 DEBUG_REQ(D_HA, request, "%s: evicting (reconnect/recover flags"
@@ -330,6 +330,16 @@ static const struct req_msg_field *obd_connect_server[] = {
         &RMF_CONNECT_DATA
 };
 
+static const struct req_msg_field *obd_ping_batch_client[] = {
+	&RMF_PTLRPC_BODY,
+	&RMF_OBD_PING_HANDLES
+};
+
+static const struct req_msg_field *obd_ping_batch_server[] = {
+	&RMF_PTLRPC_BODY,
+	&RMF_OBD_PING_STATUS
+};
+
 static const struct req_msg_field *obd_set_info_client[] = {
         &RMF_PTLRPC_BODY,
         &RMF_SETINFO_KEY,
@@ -701,6 +711,7 @@ static const struct req_msg_field *obd_lfsck_reply[] = {
 
 static struct req_format *req_formats[] = {
         &RQF_OBD_PING,
+	&RQF_OBD_PING_BATCH,
         &RQF_OBD_SET_INFO,
 	&RQF_OBD_IDX_READ,
         &RQF_SEC_CTX,
@@ -875,6 +886,17 @@ struct req_msg_field RMF_U32 =
                     sizeof(__u32), lustre_swab_generic_32s, NULL);
 EXPORT_SYMBOL(RMF_U32);
 
+struct req_msg_field RMF_OBD_PING_HANDLES =
+	DEFINE_MSGF("obd_ping_handles", RMF_F_STRUCT_ARRAY,
+		    sizeof(struct lustre_handle), lustre_swab_lustre_handle,
+		    NULL);
+EXPORT_SYMBOL(RMF_OBD_PING_HANDLES);
+
+struct req_msg_field RMF_OBD_PING_STATUS =
+	DEFINE_MSGF("obd_ping_status", RMF_F_STRUCT_ARRAY, sizeof(__u32),
+		    lustre_swab_generic_32s, dump_rcs);
+EXPORT_SYMBOL(RMF_OBD_PING_STATUS);
+
 struct req_msg_field RMF_SETINFO_VAL =
         DEFINE_MSGF("setinfo_val", 0, -1, NULL, NULL);
 EXPORT_SYMBOL(RMF_SETINFO_VAL);
@@ -1240,6 +1262,11 @@ struct req_format RQF_OBD_PING =
         DEFINE_REQ_FMT0("OBD_PING", empty, empty);
 EXPORT_SYMBOL(RQF_OBD_PING);
 
+struct req_format RQF_OBD_PING_BATCH =
+	DEFINE_REQ_FMT0("OBD_PING_BATCH", obd_ping_batch_client,
+			obd_ping_batch_server);
+EXPORT_SYMBOL(RQF_OBD_PING_BATCH);
+
 struct req_format RQF_OBD_SET_INFO =
         DEFINE_REQ_FMT0("OBD_SET_INFO", obd_set_info_client, empty);
 EXPORT_SYMBOL(RQF_OBD_SET_INFO);
@@ -178,6 +178,26 @@ const char *ll_opcode2str(__u32 opcode)
         return ll_rpc_opcode_table[offset].opname;
 }
 
+/**
+ * Looks up the opcode whose name in ll_rpc_opcode_table matches \a ops.
+ *
+ * \retval opcode on success
+ * \retval -EINVAL if \a ops is not a known RPC opcode name
+ */
+int ll_str2opcode(const char *ops)
+{
+	int i;
+
+	for (i = 0; i < LUSTRE_MAX_OPCODES; i++) {
+		if (ll_rpc_opcode_table[i].opname != NULL &&
+		    strcmp(ll_rpc_opcode_table[i].opname, ops) == 0)
+			return ll_rpc_opcode_table[i].opcode;
+	}
+
+	return -EINVAL;
+}
+EXPORT_SYMBOL(ll_str2opcode);
+
 const char* ll_eopcode2str(__u32 opcode)
 {
         LASSERT(ll_eopcode_table[opcode].opcode == opcode);
@@ -197,7 +217,9 @@ void ptlrpc_lprocfs_register(struct proc_dir_entry *root, char *dir,
         LASSERT(*procroot_ret == NULL);
         LASSERT(*stats_ret == NULL);
 
-        svc_stats = lprocfs_alloc_stats(EXTRA_MAX_OPCODES+LUSTRE_MAX_OPCODES,0);
+	/* one histogram, of the request queue wait */
+	svc_stats = lprocfs_alloc_stats_hist(EXTRA_MAX_OPCODES +
+					     LUSTRE_MAX_OPCODES, 1, 0);
         if (svc_stats == NULL)
                 return;
 
@@ -211,8 +233,9 @@ void ptlrpc_lprocfs_register(struct proc_dir_entry *root, char *dir,
                 svc_procroot = root;
         }
 
-        lprocfs_counter_init(svc_stats, PTLRPC_REQWAIT_CNTR,
-                             svc_counter_config, "req_waittime", "usec");
+	lprocfs_counter_init(svc_stats, PTLRPC_REQWAIT_CNTR,
+			     svc_counter_config | LPROCFS_CNTR_HISTOGRAM,
+			     "req_waittime", "usec");
         lprocfs_counter_init(svc_stats, PTLRPC_REQQDEPTH_CNTR,
                              svc_counter_config, "req_qdepth", "reqs");
         lprocfs_counter_init(svc_stats, PTLRPC_REQACTIVE_CNTR,
@@ -417,6 +440,308 @@ ptlrpc_lprocfs_threads_max_seq_write(struct file *file,
 }
 LPROC_SEQ_FOPS(ptlrpc_lprocfs_threads_max);
 
+static int
+ptlrpc_lprocfs_threads_ctl_enable_seq_show(struct seq_file *m, void *n)
+{
+	struct ptlrpc_service *svc = m->private;
+
+	return seq_printf(m, "%d\n", svc->srv_thrctl_enable);
+}
+
+static ssize_t
+ptlrpc_lprocfs_threads_ctl_enable_seq_write(struct file *file,
+					    const char __user *buffer,
+					    size_t count, loff_t *off)
+{
+	struct seq_file		*m = file->private_data;
+	struct ptlrpc_service	*svc = m->private;
+	int	val;
+	int	rc = lprocfs_write_helper(buffer, count, &val);
+
+	if (rc < 0)
+		return rc;
+
+	svc->srv_thrctl_enable = !!val;
+
+	return count;
+}
+LPROC_SEQ_FOPS(ptlrpc_lprocfs_threads_ctl_enable);
+
+static int
+ptlrpc_lprocfs_threads_ctl_wait_target_seq_show(struct seq_file *m, void *n)
+{
+	struct ptlrpc_service *svc = m->private;
+
+	return seq_printf(m, "%d\n", svc->srv_thrctl_wait_target);
+}
+
+static ssize_t
+ptlrpc_lprocfs_threads_ctl_wait_target_seq_write(struct file *file,
+						 const char __user *buffer,
+						 size_t count, loff_t *off)
+{
+	struct seq_file		*m = file->private_data;
+	struct ptlrpc_service	*svc = m->private;
+	int	val;
+	int	rc = lprocfs_write_helper(buffer, count, &val);
+
+	if (rc < 0)
+		return rc;
+
+	if (val <= 0)
+		return -ERANGE;
+
+	svc->srv_thrctl_wait_target = val;
+
+	return count;
+}
+LPROC_SEQ_FOPS(ptlrpc_lprocfs_threads_ctl_wait_target);
+
+static const char *ptlrpc_thrctl_decision2str(enum ptlrpc_thrctl_decision d)
+{
+	switch (d) {
+	case PTLRPC_THRCTL_GROW:
+		return "grow";
+	case PTLRPC_THRCTL_SHRINK:
+		return "shrink";
+	case PTLRPC_THRCTL_CPU_BOUND:
+		return "cpu_bound";
+	case PTLRPC_THRCTL_HOLD:
+	default:
+		return "hold";
+	}
+}
+
+/**
+ * Shows the state of the adaptive thread controller of each partition;
+ * busy, oncpu and blocked are average numbers of threads over the last
+ * sampling window.
+ */
+static int
+ptlrpc_lprocfs_threads_ctl_stats_seq_show(struct seq_file *m, void *n)
+{
+	struct ptlrpc_service		*svc = m->private;
+	struct ptlrpc_service_part	*svcpt;
+	struct ptlrpc_thrctl		*tc;
+	int				 i;
+
+	seq_printf(m, "enabled: %d\nwait_target_us: %d\n",
+		   svc->srv_thrctl_enable, svc->srv_thrctl_wait_target);
+
+	ptlrpc_service_for_each_part(svcpt, i, svc) {
+		tc = &svcpt->scp_thrctl;
+
+		spin_lock(&tc->tc_lock);
+		seq_printf(m, "CPT %d:\n"
+			   "  threads: %d\n"
+			   "  target: %d\n"
+			   "  decision: %s\n"
+			   "  req_rate: "LPU64"\n"
+			   "  wait_avg_us: "LPU64"\n"
+			   "  busy: %u.%02u\n"
+			   "  oncpu: %u.%02u\n"
+			   "  blocked: %u.%02u\n"
+			   "  grow: %lu\n"
+			   "  shrink: %lu\n"
+			   "  exited: %lu\n",
+			   svcpt->scp_cpt, svcpt->scp_nthrs_running,
+			   tc->tc_target,
+			   ptlrpc_thrctl_decision2str(tc->tc_last_decision),
+			   tc->tc_last_rate, tc->tc_last_wait,
+			   tc->tc_last_busy / 100, tc->tc_last_busy % 100,
+			   tc->tc_last_oncpu / 100, tc->tc_last_oncpu % 100,
+			   tc->tc_last_blocked / 100, tc->tc_last_blocked % 100,
+			   tc->tc_ngrow, tc->tc_nshrink, tc->tc_nexited);
+		spin_unlock(&tc->tc_lock);
+	}
+
+	return 0;
+}
+LPROC_SEQ_FOPS_RO(ptlrpc_lprocfs_threads_ctl_stats);
+
+/**
+ * Shows the request buffers and the request descriptor and reply state
+ * caches of each partition; rqbd_rate is the # request buffers filled up
+ * per second over the last window.
+ */
+static int
+ptlrpc_lprocfs_req_pools_seq_show(struct seq_file *m, void *n)
+{
+	struct ptlrpc_service		*svc = m->private;
+	struct ptlrpc_service_part	*svcpt;
+	struct ptlrpc_svc_pool		*pool;
+	int				 i;
+
+	ptlrpc_service_for_each_part(svcpt, i, svc) {
+		pool = &svcpt->scp_pool;
+
+		spin_lock(&svcpt->scp_lock);
+		seq_printf(m, "CPT %d:\n"
+			   "  rqbd_total: %d\n"
+			   "  rqbd_posted: %d\n"
+			   "  rqbd_want: %d\n"
+			   "  rqbd_rate: %d\n"
+			   "  rqbd_grow: %lu\n"
+			   "  rqbd_shrink: %lu\n",
+			   svcpt->scp_cpt, svcpt->scp_nrqbds_total,
+			   svcpt->scp_nrqbds_posted, svcpt->scp_rqbd_want,
+			   svcpt->scp_rqbd_rate, svcpt->scp_rqbd_ngrow,
+			   svcpt->scp_rqbd_nshrink);
+		spin_unlock(&svcpt->scp_lock);
+
+		spin_lock(&pool->sp_lock);
+		seq_printf(m, "  req_cached: %d/%d\n"
+			   "  req_hits: %lu\n"
+			   "  req_misses: %lu\n"
+			   "  rs_size: %d\n"
+			   "  rs_cached: %d/%d\n"
+			   "  rs_hits: %lu\n"
+			   "  rs_misses: %lu\n"
+			   "  rs_large: %lu\n",
+			   pool->sp_nreqs, pool->sp_nreqs_max,
+			   pool->sp_req_hits, pool->sp_req_misses,
+			   pool->sp_rs_size, pool->sp_nrss, pool->sp_nrss_max,
+			   pool->sp_rs_hits, pool->sp_rs_misses,
+			   pool->sp_rs_large);
+		spin_unlock(&pool->sp_lock);
+	}
+
+	return 0;
+}
+LPROC_SEQ_FOPS_RO(ptlrpc_lprocfs_req_pools);
+
+static const char *ptlrpc_rpc_lat_svc_phases[RPC_LAT_LAST] = {
+	[RPC_LAT_WAIT]		= "wait",
+	[RPC_LAT_SERVICE]	= "service",
+	[RPC_LAT_BULK]		= "bulk",
+	[RPC_LAT_COMMIT]	= "commit",
+};
+
+static const char *ptlrpc_rpc_lat_cli_phases[RPC_LAT_LAST] = {
+	[RPC_LAT_WAIT]		= "wait",
+	[RPC_LAT_SERVICE]	= "rtt",
+	[RPC_LAT_BULK]		= "bulk",
+	[RPC_LAT_COMMIT]	= "commit",
+};
+
+/**
+ * Prints the latency percentiles of each opcode and phase seen in \a lat,
+ * one line each. Latencies are in usec and are the upper bounds of the log2
+ * histogram buckets the percentiles fall in.
+ */
+static int
+ptlrpc_rpc_lat_seq_show(struct seq_file *m, struct lprocfs_rpc_lat *lat,
+			const char **phases)
+{
+	struct obd_histogram	 oh;
+	unsigned long		 tot;
+	int			 last;
+	int			 i;
+	int			 j;
+	int			 k;
+
+	seq_printf(m, "%-20s %-8s %10s %10s %10s %10s %10s %10s\n",
+		   "opcode", "phase", "count", "p50_us", "p90_us", "p99_us",
+		   "p999_us", "max_us");
+	if (lat == NULL)
+		return 0;
+
+	for (i = 0; i < LUSTRE_MAX_OPCODES; i++) {
+		if (lat->rl_opc[i] == NULL)
+			continue;
+
+		for (j = 0; j < RPC_LAT_LAST; j++) {
+			lprocfs_rpc_lat_collect(lat, i, j, &oh);
+			tot = lprocfs_oh_sum(&oh);
+			if (tot == 0)
+				continue;
+
+			for (last = 0, k = 0; k < OBD_HIST_MAX; k++)
+				if (oh.oh_buckets[k] != 0)
+					last = k;
+
+			seq_printf(m, "%-20s %-8s %10lu %10lu %10lu %10lu "
+				   "%10lu %10lu\n",
+				   ll_opcode2str(ll_rpc_opcode_table[i].opcode),
+				   phases[j], tot,
+				   lprocfs_oh_log2_percentile(&oh, tot, 500),
+				   lprocfs_oh_log2_percentile(&oh, tot, 900),
+				   lprocfs_oh_log2_percentile(&oh, tot, 990),
+				   lprocfs_oh_log2_percentile(&oh, tot, 999),
+				   1UL << last);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Per-opcode latency percentiles of a service, split into request queue
+ * wait, handling, bulk transfer and commit wait. Writing anything clears
+ * the histograms.
+ */
+static int
+ptlrpc_lprocfs_rpc_latency_seq_show(struct seq_file *m, void *n)
+{
+	struct ptlrpc_service *svc = m->private;
+
+	return ptlrpc_rpc_lat_seq_show(m, svc->srv_rpc_lat,
+				       ptlrpc_rpc_lat_svc_phases);
+}
+
+static ssize_t
+ptlrpc_lprocfs_rpc_latency_seq_write(struct file *file,
+				     const char __user *buffer,
+				     size_t count, loff_t *off)
+{
+	struct seq_file		*m = file->private_data;
+	struct ptlrpc_service	*svc = m->private;
+
+	if (svc->srv_rpc_lat != NULL)
+		lprocfs_rpc_lat_clear(svc->srv_rpc_lat);
+
+	return count;
+}
+LPROC_SEQ_FOPS(ptlrpc_lprocfs_rpc_latency);
+
+/**
+ * Per-opcode latency percentiles of the import of a client device, split
+ * into the wait before sending, the round trip and commit wait. Writing
+ * anything clears the histograms.
+ */
+static int
+ptlrpc_lprocfs_imp_rpc_latency_seq_show(struct seq_file *m, void *n)
+{
+	struct obd_device	*obd = m->private;
+	int			 rc;
+
+	LPROCFS_CLIMP_CHECK(obd);
+	rc = ptlrpc_rpc_lat_seq_show(m, obd->u.cli.cl_import->imp_rpc_lat,
+				     ptlrpc_rpc_lat_cli_phases);
+	LPROCFS_CLIMP_EXIT(obd);
+
+	return rc;
+}
+
+static ssize_t
+ptlrpc_lprocfs_imp_rpc_latency_seq_write(struct file *file,
+					 const char __user *buffer,
+					 size_t count, loff_t *off)
+{
+	struct seq_file		*m = file->private_data;
+	struct obd_device	*obd = m->private;
+	struct obd_import	*imp;
+
+	LPROCFS_CLIMP_CHECK(obd);
+	imp = obd->u.cli.cl_import;
+	if (imp->imp_rpc_lat != NULL)
+		lprocfs_rpc_lat_clear(imp->imp_rpc_lat);
+	LPROCFS_CLIMP_EXIT(obd);
+
+	return count;
+}
+LPROC_SEQ_FOPS(ptlrpc_lprocfs_imp_rpc_latency);
+
 /**
  * \addtogoup nrs
  * @{
@@ -1081,6 +1406,21 @@ void ptlrpc_lprocfs_register_service(struct proc_dir_entry *entry,
 		{ .name = "threads_started",
 		  .fops = &ptlrpc_lprocfs_threads_started_fops,
 		  .data = svc },
+		{ .name = "threads_ctl_enable",
+		  .fops = &ptlrpc_lprocfs_threads_ctl_enable_fops,
+		  .data = svc },
+		{ .name = "threads_ctl_wait_target",
+		  .fops = &ptlrpc_lprocfs_threads_ctl_wait_target_fops,
+		  .data = svc },
+		{ .name = "threads_ctl_stats",
+		  .fops = &ptlrpc_lprocfs_threads_ctl_stats_fops,
+		  .data = svc },
+		{ .name = "req_buffer_pools",
+		  .fops = &ptlrpc_lprocfs_req_pools_fops,
+		  .data = svc },
+		{ .name = "rpc_latency",
+		  .fops = &ptlrpc_lprocfs_rpc_latency_fops,
+		  .data = svc },
 		{ .name = "timeouts",
 		  .fops = &ptlrpc_lprocfs_timeouts_fops,
 		  .data = svc },
@@ -1105,6 +1445,7 @@ void ptlrpc_lprocfs_register_service(struct proc_dir_entry *entry,
 	if (svc->srv_procroot == NULL)
 		return;
 
+	svc->srv_rpc_lat = lprocfs_rpc_lat_alloc();
 	lprocfs_seq_add_vars(svc->srv_procroot, lproc_vars, NULL);
 
 	rc = lprocfs_seq_create(svc->srv_procroot, "req_history",
@@ -1115,9 +1456,19 @@ void ptlrpc_lprocfs_register_service(struct proc_dir_entry *entry,
 
 void ptlrpc_lprocfs_register_obd(struct obd_device *obddev)
 {
+	int rc;
+
         ptlrpc_lprocfs_register(obddev->obd_proc_entry, NULL, "stats",
                                 &obddev->obd_svc_procroot,
                                 &obddev->obd_svc_stats);
+	if (obddev->obd_svc_procroot == NULL)
+		return;
+
+	rc = lprocfs_seq_create(obddev->obd_svc_procroot, "rpc_latency", 0644,
+				&ptlrpc_lprocfs_imp_rpc_latency_fops, obddev);
+	if (rc)
+		CWARN("%s: error adding the rpc_latency file: rc = %d\n",
+		      obddev->obd_name, rc);
 }
 EXPORT_SYMBOL(ptlrpc_lprocfs_register_obd);
 
@@ -1170,6 +1521,9 @@ void ptlrpc_lprocfs_unregister_service(struct ptlrpc_service *svc)
 
         if (svc->srv_stats)
                 lprocfs_free_stats(&svc->srv_stats);
+
+	lprocfs_rpc_lat_free(svc->srv_rpc_lat);
+	svc->srv_rpc_lat = NULL;
 }
 
 void ptlrpc_lprocfs_unregister_obd(struct obd_device *obd)
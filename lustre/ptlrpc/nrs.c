@@ -1766,6 +1766,8 @@ extern struct ptlrpc_nrs_pol_conf nrs_conf_crrn;
 extern struct ptlrpc_nrs_pol_conf nrs_conf_orr;
 extern struct ptlrpc_nrs_pol_conf nrs_conf_trr;
 extern struct ptlrpc_nrs_pol_conf nrs_conf_tbf;
+/* ptlrpc/nrs_edf.c */
+extern struct ptlrpc_nrs_pol_conf nrs_conf_edf;
 #endif /* HAVE_SERVER_SUPPORT */
 
 /**
@@ -1802,6 +1804,10 @@ int ptlrpc_nrs_init(void)
 	rc = ptlrpc_nrs_policy_register(&nrs_conf_tbf);
 	if (rc != 0)
 		GOTO(fail, rc);
+
+	rc = ptlrpc_nrs_policy_register(&nrs_conf_edf);
+	if (rc != 0)
+		GOTO(fail, rc);
 #endif /* HAVE_SERVER_SUPPORT */
 
 	RETURN(rc);
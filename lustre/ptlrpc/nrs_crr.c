@@ -88,10 +88,21 @@ static int crrn_req_compare(cfs_binheap_node_t *e1, cfs_binheap_node_t *e2)
 	return nrq1->nr_u.crr.cr_sequence < nrq2->nr_u.crr.cr_sequence;
 }
 
+/**
+ * Binary heap key, the round of the request; crrn_req_compare() orders
+ * requests of the same round.
+ */
+static __u64 crrn_req_key(cfs_binheap_node_t *e)
+{
+	return container_of(e, struct ptlrpc_nrs_request,
+			    nr_node)->nr_u.crr.cr_round;
+}
+
 static cfs_binheap_ops_t nrs_crrn_heap_ops = {
 	.hop_enter	= NULL,
 	.hop_exit	= NULL,
 	.hop_compare	= crrn_req_compare,
+	.hop_key	= crrn_req_key,
 };
 
 /**
@@ -189,7 +200,8 @@ static int nrs_crrn_start(struct ptlrpc_nrs_policy *policy, char *arg)
 		RETURN(-ENOMEM);
 
 	net->cn_binheap = cfs_binheap_create(&nrs_crrn_heap_ops,
-					     CBH_FLAG_ATOMIC_GROW, 4096, NULL,
+					     CBH_FLAG_ATOMIC_GROW |
+					     CBH_FLAG_DARY, 4096, NULL,
 					     nrs_pol2cptab(policy),
 					     nrs_pol2cptid(policy));
 	if (net->cn_binheap == NULL)
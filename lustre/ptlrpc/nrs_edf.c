@@ -0,0 +1,1290 @@
+/*
+ * GPL HEADER START
+ *
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 only,
+ * as published by the Free Software Foundation.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.  A copy is
+ * included in the COPYING file that accompanied this code.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * GPL HEADER END
+ */
+/*
+ * lustre/ptlrpc/nrs_edf.c
+ *
+ * Network Request Scheduler (NRS) Earliest Deadline First (EDF) policy
+ *
+ * Requests are classified into latency classes by jobid, uid, client NID or
+ * opcode. Each class has a queueing latency target; a request's deadline is
+ * its arrival time plus the target of its class, and requests are handled in
+ * deadline order. Interactive traffic given a short target is thus served
+ * ahead of bulk traffic with a long target, while the latter is still handled
+ * once its own (later) deadline comes up, so no class is starved.
+ */
+
+#ifdef HAVE_SERVER_SUPPORT
+
+/**
+ * \addtogoup nrs
+ * @{
+ */
+
+#define DEBUG_SUBSYSTEM S_RPC
+#include <obd_support.h>
+#include <obd_class.h>
+#include <libcfs/libcfs.h>
+#include "ptlrpc_internal.h"
+
+/**
+ * \name edf
+ *
+ * Earliest Deadline First over latency classes
+ *
+ * @{
+ */
+
+#define NRS_POL_NAME_EDF	"edf"
+
+static int edf_default_target = 1000;
+CFS_MODULE_PARM(edf_default_target, "i", int, 0644,
+		"Default queueing latency target of EDF classes in ms");
+
+#define NRS_EDF_DEFAULT_CLASS	"default"
+
+static inline __u64 nrs_edf_tv2us(const struct timeval *tv)
+{
+	return (__u64)tv->tv_sec * USEC_PER_SEC + tv->tv_usec;
+}
+
+static void nrs_edf_id_list_free(struct list_head *id_list)
+{
+	struct nrs_edf_id *id, *n;
+
+	list_for_each_entry_safe(id, n, id_list, ei_linkage) {
+		if (id->ei_str != NULL)
+			OBD_FREE(id->ei_str, strlen(id->ei_str) + 1);
+		list_del(&id->ei_linkage);
+		OBD_FREE_PTR(id);
+	}
+}
+
+static int nrs_edf_id_list_add(enum nrs_edf_key key, const struct cfs_lstr *tok,
+			       struct list_head *id_list)
+{
+	struct nrs_edf_id	*id;
+	char			 buf[MAX_OBD_NAME];
+	int			 rc = 0;
+
+	OBD_ALLOC_PTR(id);
+	if (id == NULL)
+		return -ENOMEM;
+
+	switch (key) {
+	case NRS_EDF_KEY_JOBID:
+		if (tok->ls_len >= JOBSTATS_JOBID_SIZE)
+			GOTO(out, rc = -EINVAL);
+		OBD_ALLOC(id->ei_str, tok->ls_len + 1);
+		if (id->ei_str == NULL)
+			GOTO(out, rc = -ENOMEM);
+		memcpy(id->ei_str, tok->ls_str, tok->ls_len);
+		break;
+	case NRS_EDF_KEY_UID:
+		if (!cfs_str2num_check(tok->ls_str, tok->ls_len, &id->ei_num,
+				       0, (unsigned)-1))
+			GOTO(out, rc = -EINVAL);
+		break;
+	case NRS_EDF_KEY_OPCODE:
+		if (tok->ls_len >= sizeof(buf))
+			GOTO(out, rc = -EINVAL);
+		memcpy(buf, tok->ls_str, tok->ls_len);
+		buf[tok->ls_len] = '\0';
+		rc = ll_str2opcode(buf);
+		if (rc < 0)
+			GOTO(out, rc);
+		id->ei_num = rc;
+		rc = 0;
+		break;
+	default:
+		GOTO(out, rc = -EINVAL);
+	}
+
+	list_add_tail(&id->ei_linkage, id_list);
+out:
+	if (rc != 0)
+		OBD_FREE_PTR(id);
+	return rc;
+}
+
+static int nrs_edf_id_list_parse(enum nrs_edf_key key, char *str, int len,
+				 struct list_head *id_list)
+{
+	struct cfs_lstr src;
+	struct cfs_lstr res;
+	int		rc = 0;
+
+	src.ls_str = str;
+	src.ls_len = len;
+	INIT_LIST_HEAD(id_list);
+	while (src.ls_str) {
+		if (cfs_gettok(&src, ' ', &res) == 0)
+			GOTO(out, rc = -EINVAL);
+		rc = nrs_edf_id_list_add(key, &res, id_list);
+		if (rc)
+			GOTO(out, rc);
+	}
+	if (list_empty(id_list))
+		rc = -EINVAL;
+out:
+	if (rc)
+		nrs_edf_id_list_free(id_list);
+	return rc;
+}
+
+static void nrs_edf_class_fini(struct nrs_edf_class *class)
+{
+	LASSERT(atomic_read(&class->ec_ref) == 0);
+	LASSERT(list_empty(&class->ec_linkage));
+
+	if (!list_empty(&class->ec_ids))
+		nrs_edf_id_list_free(&class->ec_ids);
+	if (!list_empty(&class->ec_nids))
+		cfs_free_nidlist(&class->ec_nids);
+	if (class->ec_ids_str != NULL)
+		OBD_FREE(class->ec_ids_str, strlen(class->ec_ids_str) + 1);
+	OBD_FREE_PTR(class);
+}
+
+/**
+ * Decreases the class's usage reference count, and frees the class once it
+ * has been stopped and the last request classified into it is gone.
+ */
+static void nrs_edf_class_put(struct nrs_edf_class *class)
+{
+	if (atomic_dec_and_test(&class->ec_ref))
+		nrs_edf_class_fini(class);
+}
+
+static inline void nrs_edf_class_get(struct nrs_edf_class *class)
+{
+	atomic_inc(&class->ec_ref);
+}
+
+static struct nrs_edf_class *
+nrs_edf_class_find_nolock(struct nrs_edf_head *head, const char *name)
+{
+	struct nrs_edf_class *class;
+
+	list_for_each_entry(class, &head->eh_list, ec_linkage) {
+		LASSERT((class->ec_flags & NEC_STOPPING) == 0);
+		if (strcmp(class->ec_name, name) == 0) {
+			nrs_edf_class_get(class);
+			return class;
+		}
+	}
+	return NULL;
+}
+
+static struct nrs_edf_class *
+nrs_edf_class_find(struct nrs_edf_head *head, const char *name)
+{
+	struct nrs_edf_class *class;
+
+	spin_lock(&head->eh_class_lock);
+	class = nrs_edf_class_find_nolock(head, name);
+	spin_unlock(&head->eh_class_lock);
+	return class;
+}
+
+/**
+ * Request attributes a class may match on; filled in lazily, as looking up
+ * the uid means peeking into the request body.
+ */
+struct nrs_edf_req_info {
+	struct ptlrpc_request	*ri_req;
+	char			*ri_jobid;
+	__u32			 ri_uid;
+	__u32			 ri_opc;
+	unsigned		 ri_jobid_set:1,
+				 ri_uid_set:1,
+				 ri_uid_valid:1;
+};
+
+static int nrs_edf_id_match(struct nrs_edf_class *class,
+			    struct nrs_edf_req_info *info)
+{
+	struct nrs_edf_id *id;
+	__u32		   gid;
+	__u32		   num;
+
+	switch (class->ec_key) {
+	case NRS_EDF_KEY_ANY:
+		return 1;
+	case NRS_EDF_KEY_NID:
+		return cfs_match_nid(info->ri_req->rq_peer.nid,
+				     &class->ec_nids);
+	case NRS_EDF_KEY_JOBID:
+		if (!info->ri_jobid_set) {
+			info->ri_jobid =
+				lustre_msg_get_jobid(info->ri_req->rq_reqmsg);
+			info->ri_jobid_set = 1;
+		}
+		if (info->ri_jobid == NULL)
+			return 0;
+		list_for_each_entry(id, &class->ec_ids, ei_linkage) {
+			if (strcmp(id->ei_str, info->ri_jobid) == 0)
+				return 1;
+		}
+		return 0;
+	case NRS_EDF_KEY_UID:
+		if (!info->ri_uid_set) {
+			info->ri_uid_valid =
+				ptlrpc_req_get_ugid(info->ri_req,
+						    &info->ri_uid, &gid) == 0;
+			info->ri_uid_set = 1;
+		}
+		if (!info->ri_uid_valid)
+			return 0;
+		num = info->ri_uid;
+		break;
+	case NRS_EDF_KEY_OPCODE:
+		num = info->ri_opc;
+		break;
+	default:
+		LBUG();
+	}
+
+	list_for_each_entry(id, &class->ec_ids, ei_linkage) {
+		if (id->ei_num == num)
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Finds the newest class matching \a req, falling back to the default class,
+ * and takes a reference on it.
+ */
+static struct nrs_edf_class *
+nrs_edf_class_match(struct nrs_edf_head *head, struct ptlrpc_request *req)
+{
+	struct nrs_edf_req_info	 info = { .ri_req = req };
+	struct nrs_edf_class	*class = NULL;
+	struct nrs_edf_class	*tmp;
+
+	info.ri_opc = lustre_msg_get_opc(req->rq_reqmsg);
+
+	spin_lock(&head->eh_class_lock);
+	list_for_each_entry(tmp, &head->eh_list, ec_linkage) {
+		LASSERT((tmp->ec_flags & NEC_STOPPING) == 0);
+		if (nrs_edf_id_match(tmp, &info)) {
+			class = tmp;
+			break;
+		}
+	}
+	if (class == NULL)
+		class = head->eh_default;
+	nrs_edf_class_get(class);
+	spin_unlock(&head->eh_class_lock);
+
+	return class;
+}
+
+static int
+nrs_edf_class_start(struct ptlrpc_nrs_policy *policy,
+		    struct nrs_edf_head *head,
+		    struct nrs_edf_cmd *start)
+{
+	struct nrs_edf_class	*class;
+	struct nrs_edf_class	*tmp;
+	int			 rc = 0;
+
+	class = nrs_edf_class_find(head, start->ec_name);
+	if (class != NULL) {
+		nrs_edf_class_put(class);
+		return -EEXIST;
+	}
+
+	OBD_CPT_ALLOC_PTR(class, nrs_pol2cptab(policy), nrs_pol2cptid(policy));
+	if (class == NULL)
+		return -ENOMEM;
+
+	strlcpy(class->ec_name, start->ec_name, sizeof(class->ec_name));
+	class->ec_key = start->ec_key;
+	class->ec_target = start->ec_target;
+	atomic_set(&class->ec_ref, 1);
+	INIT_LIST_HEAD(&class->ec_linkage);
+	INIT_LIST_HEAD(&class->ec_ids);
+	INIT_LIST_HEAD(&class->ec_nids);
+	spin_lock_init(&class->ec_delay_hist.oh_lock);
+
+	if (start->ec_ids_str != NULL) {
+		OBD_ALLOC(class->ec_ids_str, strlen(start->ec_ids_str) + 1);
+		if (class->ec_ids_str == NULL)
+			GOTO(out, rc = -ENOMEM);
+		memcpy(class->ec_ids_str, start->ec_ids_str,
+		       strlen(start->ec_ids_str));
+	}
+
+	/* Each policy instance keeps its own copy of the parsed id list */
+	switch (class->ec_key) {
+	case NRS_EDF_KEY_ANY:
+		break;
+	case NRS_EDF_KEY_NID:
+		if (cfs_parse_nidlist(class->ec_ids_str,
+				      strlen(class->ec_ids_str),
+				      &class->ec_nids) <= 0)
+			GOTO(out, rc = -EINVAL);
+		break;
+	default:
+		rc = nrs_edf_id_list_parse(class->ec_key, class->ec_ids_str,
+					   strlen(class->ec_ids_str),
+					   &class->ec_ids);
+		if (rc)
+			GOTO(out, rc);
+		break;
+	}
+
+	/* Add as the newest class */
+	spin_lock(&head->eh_class_lock);
+	tmp = nrs_edf_class_find_nolock(head, start->ec_name);
+	if (tmp != NULL) {
+		spin_unlock(&head->eh_class_lock);
+		nrs_edf_class_put(tmp);
+		GOTO(out, rc = -EEXIST);
+	}
+	list_add(&class->ec_linkage, &head->eh_list);
+	class->ec_head = head;
+	if (start->ec_class_flags & NEC_DEFAULT) {
+		class->ec_flags |= NEC_DEFAULT;
+		LASSERT(head->eh_default == NULL);
+		head->eh_default = class;
+	}
+	spin_unlock(&head->eh_class_lock);
+
+	return 0;
+out:
+	nrs_edf_class_put(class);
+	return rc;
+}
+
+static int
+nrs_edf_class_change(struct ptlrpc_nrs_policy *policy,
+		     struct nrs_edf_head *head,
+		     struct nrs_edf_cmd *change)
+{
+	struct nrs_edf_class *class;
+
+	assert_spin_locked(&policy->pol_nrs->nrs_lock);
+
+	class = nrs_edf_class_find(head, change->ec_name);
+	if (class == NULL)
+		return -ENOENT;
+
+	/* Applies to requests enqueued from now on */
+	spin_lock(&head->eh_class_lock);
+	class->ec_target = change->ec_target;
+	spin_unlock(&head->eh_class_lock);
+	nrs_edf_class_put(class);
+
+	return 0;
+}
+
+static int
+nrs_edf_class_stop(struct ptlrpc_nrs_policy *policy,
+		   struct nrs_edf_head *head,
+		   struct nrs_edf_cmd *stop)
+{
+	struct nrs_edf_class *class;
+
+	assert_spin_locked(&policy->pol_nrs->nrs_lock);
+
+	if (strcmp(stop->ec_name, NRS_EDF_DEFAULT_CLASS) == 0)
+		return -EPERM;
+
+	spin_lock(&head->eh_class_lock);
+	class = nrs_edf_class_find_nolock(head, stop->ec_name);
+	if (class == NULL) {
+		spin_unlock(&head->eh_class_lock);
+		return -ENOENT;
+	}
+	list_del_init(&class->ec_linkage);
+	class->ec_flags |= NEC_STOPPING;
+	spin_unlock(&head->eh_class_lock);
+
+	/* Drop the reference from find, and the one held by the list */
+	nrs_edf_class_put(class);
+	nrs_edf_class_put(class);
+
+	return 0;
+}
+
+static int
+nrs_edf_command(struct ptlrpc_nrs_policy *policy,
+		struct nrs_edf_head *head,
+		struct nrs_edf_cmd *cmd)
+{
+	int rc;
+
+	assert_spin_locked(&policy->pol_nrs->nrs_lock);
+
+	switch (cmd->ec_cmd) {
+	case NRS_CTL_EDF_START_CLASS:
+		spin_unlock(&policy->pol_nrs->nrs_lock);
+		rc = nrs_edf_class_start(policy, head, cmd);
+		spin_lock(&policy->pol_nrs->nrs_lock);
+		return rc;
+	case NRS_CTL_EDF_CHANGE_TARGET:
+		return nrs_edf_class_change(policy, head, cmd);
+	case NRS_CTL_EDF_STOP_CLASS:
+		rc = nrs_edf_class_stop(policy, head, cmd);
+		/* Take it as a success, if not exists at all */
+		return rc == -ENOENT ? 0 : rc;
+	default:
+		return -EFAULT;
+	}
+}
+
+static const char *nrs_edf_key2str(enum nrs_edf_key key)
+{
+	switch (key) {
+	case NRS_EDF_KEY_JOBID:
+		return NRS_EDF_KEY_JOBID_STR;
+	case NRS_EDF_KEY_NID:
+		return NRS_EDF_KEY_NID_STR;
+	case NRS_EDF_KEY_UID:
+		return NRS_EDF_KEY_UID_STR;
+	case NRS_EDF_KEY_OPCODE:
+		return NRS_EDF_KEY_OPCODE_STR;
+	default:
+		return "*";
+	}
+}
+
+static int
+nrs_edf_class_dump_all(struct nrs_edf_head *head, struct seq_file *m)
+{
+	struct nrs_edf_class	*class;
+	int			 rc = 0;
+
+	spin_lock(&head->eh_class_lock);
+	/* List the classes from newest to oldest */
+	list_for_each_entry(class, &head->eh_list, ec_linkage) {
+		if (class->ec_key == NRS_EDF_KEY_ANY)
+			rc = seq_printf(m, "%s {*} %llu, ", class->ec_name,
+					class->ec_target / USEC_PER_MSEC);
+		else
+			rc = seq_printf(m, "%s %s={%s} %llu, ",
+					class->ec_name,
+					nrs_edf_key2str(class->ec_key),
+					class->ec_ids_str,
+					class->ec_target / USEC_PER_MSEC);
+		if (rc == 0)
+			rc = seq_printf(m, "queued %lu, dispatched %lu, "
+					"missed %lu, ref %d\n",
+					class->ec_queued, class->ec_dispatched,
+					class->ec_missed,
+					atomic_read(&class->ec_ref) - 1);
+		if (rc) {
+			rc = -ENOSPC;
+			break;
+		}
+	}
+	spin_unlock(&head->eh_class_lock);
+
+	return rc;
+}
+
+#define pct(a, b) (b ? a * 100 / b : 0)
+
+static int
+nrs_edf_stats_dump_all(struct nrs_edf_head *head, struct seq_file *m)
+{
+	struct nrs_edf_class	*class;
+	struct obd_histogram	*oh;
+	unsigned long		 tot;
+	unsigned long		 cum;
+	unsigned long		 n;
+	int			 rc = 0;
+	int			 i;
+
+	spin_lock(&head->eh_class_lock);
+	list_for_each_entry(class, &head->eh_list, ec_linkage) {
+		oh = &class->ec_delay_hist;
+		tot = lprocfs_oh_sum(oh);
+		cum = 0;
+		rc = seq_printf(m, "%s: target %llu ms, missed %lu/%lu\n"
+				"%-12s %10s %4s %5s\n", class->ec_name,
+				class->ec_target / USEC_PER_MSEC,
+				class->ec_missed, tot,
+				"delay(us)", "rpcs", "%", "cum %");
+		for (i = 0; i < OBD_HIST_MAX && rc == 0 && cum < tot; i++) {
+			n = oh->oh_buckets[i];
+			cum += n;
+			if (cum == 0)
+				continue;
+			rc = seq_printf(m, "%-12lu %10lu %4lu %5lu\n",
+					1UL << i, n, pct(n, tot),
+					pct(cum, tot));
+		}
+		if (rc) {
+			rc = -ENOSPC;
+			break;
+		}
+	}
+	spin_unlock(&head->eh_class_lock);
+
+	return rc;
+}
+
+/**
+ * Binary heap predicate.
+ *
+ * Orders requests by deadline, and by arrival sequence for requests with the
+ * same deadline.
+ *
+ * \param[in] e1 the first binheap node to compare
+ * \param[in] e2 the second binheap node to compare
+ *
+ * \retval 0 e1 > e2
+ * \retval 1 e1 <= e2
+ */
+static int edf_req_compare(cfs_binheap_node_t *e1, cfs_binheap_node_t *e2)
+{
+	struct ptlrpc_nrs_request *nrq1;
+	struct ptlrpc_nrs_request *nrq2;
+
+	nrq1 = container_of(e1, struct ptlrpc_nrs_request, nr_node);
+	nrq2 = container_of(e2, struct ptlrpc_nrs_request, nr_node);
+
+	if (nrq1->nr_u.edf.er_deadline < nrq2->nr_u.edf.er_deadline)
+		return 1;
+	else if (nrq1->nr_u.edf.er_deadline > nrq2->nr_u.edf.er_deadline)
+		return 0;
+
+	return nrq1->nr_u.edf.er_sequence < nrq2->nr_u.edf.er_sequence;
+}
+
+static cfs_binheap_ops_t nrs_edf_heap_ops = {
+	.hop_enter	= NULL,
+	.hop_exit	= NULL,
+	.hop_compare	= edf_req_compare,
+};
+
+/**
+ * Is called before the policy transitions into
+ * ptlrpc_nrs_pol_state::NRS_POL_STATE_STARTED; allocates and initializes a
+ * policy-specific private data structure, and starts the default class.
+ *
+ * \param[in] policy The policy to start
+ *
+ * \retval -ENOMEM OOM error
+ * \retval  0	   success
+ *
+ * \see nrs_policy_register()
+ * \see nrs_policy_ctl()
+ */
+static int nrs_edf_start(struct ptlrpc_nrs_policy *policy, char *arg)
+{
+	struct nrs_edf_head	*head;
+	struct nrs_edf_cmd	 start;
+	int			 rc;
+
+	OBD_CPT_ALLOC_PTR(head, nrs_pol2cptab(policy), nrs_pol2cptid(policy));
+	if (head == NULL)
+		return -ENOMEM;
+
+	head->eh_binheap = cfs_binheap_create(&nrs_edf_heap_ops,
+					      CBH_FLAG_ATOMIC_GROW, 4096, NULL,
+					      nrs_pol2cptab(policy),
+					      nrs_pol2cptid(policy));
+	if (head->eh_binheap == NULL)
+		GOTO(out_free_head, rc = -ENOMEM);
+
+	spin_lock_init(&head->eh_class_lock);
+	INIT_LIST_HEAD(&head->eh_list);
+
+	memset(&start, 0, sizeof(start));
+	start.ec_name = NRS_EDF_DEFAULT_CLASS;
+	start.ec_key = NRS_EDF_KEY_ANY;
+	start.ec_target = (__u64)edf_default_target * USEC_PER_MSEC;
+	start.ec_class_flags = NEC_DEFAULT;
+	rc = nrs_edf_class_start(policy, head, &start);
+	if (rc)
+		GOTO(out_free_heap, rc);
+
+	policy->pol_private = head;
+	return 0;
+
+out_free_heap:
+	cfs_binheap_destroy(head->eh_binheap);
+out_free_head:
+	OBD_FREE_PTR(head);
+	return rc;
+}
+
+/**
+ * Is called before the policy transitions into
+ * ptlrpc_nrs_pol_state::NRS_POL_STATE_STOPPED; deallocates the policy-specific
+ * private data structure.
+ *
+ * \param[in] policy The policy to stop
+ *
+ * \see nrs_policy_stop0()
+ */
+static void nrs_edf_stop(struct ptlrpc_nrs_policy *policy)
+{
+	struct nrs_edf_head	*head = policy->pol_private;
+	struct nrs_edf_class	*class;
+	struct nrs_edf_class	*n;
+
+	LASSERT(head != NULL);
+	LASSERT(head->eh_binheap != NULL);
+	LASSERT(cfs_binheap_is_empty(head->eh_binheap));
+
+	list_for_each_entry_safe(class, n, &head->eh_list, ec_linkage) {
+		list_del_init(&class->ec_linkage);
+		nrs_edf_class_put(class);
+	}
+	cfs_binheap_destroy(head->eh_binheap);
+	OBD_FREE_PTR(head);
+}
+
+/**
+ * Performs a policy-specific ctl function on EDF policy instances; similar
+ * to ioctl.
+ *
+ * \param[in]	  policy the policy instance
+ * \param[in]	  opc	 the opcode
+ * \param[in,out] arg	 used for passing parameters and information
+ *
+ * \pre assert_spin_locked(&policy->pol_nrs->->nrs_lock)
+ * \post assert_spin_locked(&policy->pol_nrs->->nrs_lock)
+ *
+ * \retval 0   operation carried out successfully
+ * \retval -ve error
+ */
+int nrs_edf_ctl(struct ptlrpc_nrs_policy *policy, enum ptlrpc_nrs_ctl opc,
+		void *arg)
+{
+	struct nrs_edf_head	*head = policy->pol_private;
+	int			 rc = 0;
+	ENTRY;
+
+	assert_spin_locked(&policy->pol_nrs->nrs_lock);
+
+	switch ((enum nrs_ctl_edf)opc) {
+	default:
+		RETURN(-EINVAL);
+
+	/**
+	 * Read the classes of a policy instance.
+	 */
+	case NRS_CTL_EDF_RD_CLASS: {
+		struct seq_file *m = (struct seq_file *)arg;
+
+		seq_printf(m, "CPT %d:\n", nrs_pol2cptid(policy));
+		rc = nrs_edf_class_dump_all(head, m);
+		break;
+	}
+
+	/**
+	 * Read the queue delay histograms of a policy instance.
+	 */
+	case NRS_CTL_EDF_RD_STATS: {
+		struct seq_file *m = (struct seq_file *)arg;
+
+		seq_printf(m, "CPT %d:\n", nrs_pol2cptid(policy));
+		rc = nrs_edf_stats_dump_all(head, m);
+		break;
+	}
+
+	/**
+	 * Start, stop or change a class of a policy instance.
+	 */
+	case NRS_CTL_EDF_WR_CLASS:
+		rc = nrs_edf_command(policy, head, (struct nrs_edf_cmd *)arg);
+		break;
+	}
+
+	RETURN(rc);
+}
+
+/**
+ * Is called for obtaining an EDF policy resource; classifies the request.
+ *
+ * \param[in]  policy	  The policy on which the request is being asked for
+ * \param[in]  nrq	  The request for which resources are being taken
+ * \param[in]  parent	  Parent resource, embedded in nrs_edf_head for the
+ *			  EDF policy
+ * \param[out] resp	  Resources references are placed in this array
+ * \param[in]  moving_req Signifies limited caller context; unused in this
+ *			  policy, as classification does not allocate
+ *
+ * \retval 0 we are returning a top-level, parent resource, one that is
+ *	     embedded in an nrs_edf_head object
+ * \retval 1 we are returning a bottom-level resource, one that is embedded
+ *	     in an nrs_edf_class object
+ *
+ * \see nrs_resource_get_safe()
+ */
+static int nrs_edf_res_get(struct ptlrpc_nrs_policy *policy,
+			   struct ptlrpc_nrs_request *nrq,
+			   const struct ptlrpc_nrs_resource *parent,
+			   struct ptlrpc_nrs_resource **resp,
+			   bool moving_req)
+{
+	struct nrs_edf_head	*head;
+	struct nrs_edf_class	*class;
+	struct ptlrpc_request	*req;
+
+	if (parent == NULL) {
+		*resp = &((struct nrs_edf_head *)policy->pol_private)->eh_res;
+		return 0;
+	}
+
+	head = container_of(parent, struct nrs_edf_head, eh_res);
+	req = container_of(nrq, struct ptlrpc_request, rq_nrq);
+	class = nrs_edf_class_match(head, req);
+
+	*resp = &class->ec_res;
+	return 1;
+}
+
+/**
+ * Called when releasing references to the resource hierachy obtained for a
+ * request for scheduling using the EDF policy.
+ *
+ * \param[in] policy   the policy the resource belongs to
+ * \param[in] res      the resource to be released
+ */
+static void nrs_edf_res_put(struct ptlrpc_nrs_policy *policy,
+			    const struct ptlrpc_nrs_resource *res)
+{
+	/**
+	 * Do nothing for freeing parent, nrs_edf_head resources
+	 */
+	if (res->res_parent == NULL)
+		return;
+
+	nrs_edf_class_put(container_of(res, struct nrs_edf_class, ec_res));
+}
+
+/**
+ * Called when getting a request from the EDF policy for handling, or just
+ * peeking; removes the request from the policy when it is to be handled, and
+ * accounts its queue delay to its class.
+ *
+ * \param[in] policy The policy
+ * \param[in] peek   When set, signifies that we just want to examine the
+ *		     request, and not handle it, so the request is not removed
+ *		     from the policy.
+ * \param[in] force  Force the policy to return a request; unused in this
+ *		     policy
+ *
+ * \retval The request to be handled; this is the request with the earliest
+ *	   deadline
+ *
+ * \see ptlrpc_nrs_req_get_nolock()
+ * \see nrs_request_get()
+ */
+static
+struct ptlrpc_nrs_request *nrs_edf_req_get(struct ptlrpc_nrs_policy *policy,
+					   bool peek, bool force)
+{
+	struct nrs_edf_head		*head = policy->pol_private;
+	struct ptlrpc_nrs_request	*nrq;
+	struct ptlrpc_request		*req;
+	struct nrs_edf_class		*class;
+	cfs_binheap_node_t		*node;
+	struct timeval			 now;
+	long				 delay;
+
+	assert_spin_locked(&policy->pol_nrs->nrs_svcpt->scp_req_lock);
+
+	node = cfs_binheap_root(head->eh_binheap);
+	if (unlikely(node == NULL))
+		return NULL;
+
+	nrq = container_of(node, struct ptlrpc_nrs_request, nr_node);
+	if (peek)
+		return nrq;
+
+	cfs_binheap_remove(head->eh_binheap, &nrq->nr_node);
+
+	req = container_of(nrq, struct ptlrpc_request, rq_nrq);
+	class = container_of(nrs_request_resource(nrq), struct nrs_edf_class,
+			     ec_res);
+	class->ec_queued--;
+	class->ec_dispatched++;
+
+	do_gettimeofday(&now);
+	if (nrs_edf_tv2us(&now) > nrq->nr_u.edf.er_deadline)
+		class->ec_missed++;
+	delay = cfs_timeval_sub(&now, &req->rq_arrival_time, NULL);
+	lprocfs_oh_tally_log2(&class->ec_delay_hist, max(delay, 0L));
+
+	CDEBUG(D_RPCTRACE,
+	       "NRS start %s request from %s, class %s, delay %ldus, "
+	       "seq: "LPU64"\n", policy->pol_desc->pd_name,
+	       libcfs_id2str(req->rq_peer), class->ec_name, delay,
+	       nrq->nr_u.edf.er_sequence);
+
+	return nrq;
+}
+
+/**
+ * Adds request \a nrq to \a policy's heap of queued requests, with a deadline
+ * of its arrival time plus the latency target of its class.
+ *
+ * \param[in] policy The policy
+ * \param[in] nrq    The request to add
+ *
+ * \retval 0	success
+ * \retval != 0	error; the request will be handled by the fallback policy
+ */
+static int nrs_edf_req_add(struct ptlrpc_nrs_policy *policy,
+			   struct ptlrpc_nrs_request *nrq)
+{
+	struct nrs_edf_head	*head;
+	struct nrs_edf_class	*class;
+	struct ptlrpc_request	*req;
+	int			 rc;
+
+	assert_spin_locked(&policy->pol_nrs->nrs_svcpt->scp_req_lock);
+
+	class = container_of(nrs_request_resource(nrq), struct nrs_edf_class,
+			     ec_res);
+	head = container_of(nrs_request_resource(nrq)->res_parent,
+			    struct nrs_edf_head, eh_res);
+	req = container_of(nrq, struct ptlrpc_request, rq_nrq);
+
+	nrq->nr_u.edf.er_deadline = nrs_edf_tv2us(&req->rq_arrival_time) +
+				    class->ec_target;
+	nrq->nr_u.edf.er_sequence = head->eh_sequence++;
+
+	rc = cfs_binheap_insert(head->eh_binheap, &nrq->nr_node);
+	if (rc == 0)
+		class->ec_queued++;
+
+	return rc;
+}
+
+/**
+ * Removes request \a nrq from \a policy's heap of queued requests.
+ *
+ * \param[in] policy The policy
+ * \param[in] nrq    The request to remove
+ */
+static void nrs_edf_req_del(struct ptlrpc_nrs_policy *policy,
+			    struct ptlrpc_nrs_request *nrq)
+{
+	struct nrs_edf_head	*head = policy->pol_private;
+	struct nrs_edf_class	*class;
+
+	assert_spin_locked(&policy->pol_nrs->nrs_svcpt->scp_req_lock);
+
+	class = container_of(nrs_request_resource(nrq), struct nrs_edf_class,
+			     ec_res);
+	cfs_binheap_remove(head->eh_binheap, &nrq->nr_node);
+	class->ec_queued--;
+}
+
+/**
+ * Prints a debug statement right before the request \a nrq stops being
+ * handled.
+ *
+ * \param[in] policy The policy handling the request
+ * \param[in] nrq    The request being handled
+ *
+ * \see ptlrpc_server_finish_request()
+ * \see ptlrpc_nrs_req_stop_nolock()
+ */
+static void nrs_edf_req_stop(struct ptlrpc_nrs_policy *policy,
+			     struct ptlrpc_nrs_request *nrq)
+{
+	struct ptlrpc_request *req = container_of(nrq, struct ptlrpc_request,
+						  rq_nrq);
+
+	assert_spin_locked(&policy->pol_nrs->nrs_svcpt->scp_req_lock);
+
+	CDEBUG(D_RPCTRACE, "NRS stop %s request from %s, seq: "LPU64"\n",
+	       policy->pol_desc->pd_name, libcfs_id2str(req->rq_peer),
+	       nrq->nr_u.edf.er_sequence);
+}
+
+#ifdef LPROCFS
+
+/**
+ * lprocfs interface
+ */
+
+/**
+ * The maximum latency target, in ms.
+ */
+#define LPROCFS_NRS_EDF_TARGET_MAX	3600000
+
+/**
+ * Dumps the output of the EDF read control operation \a opc of the regular
+ * and the high priority NRS heads of \a svc to \a m.
+ */
+static int nrs_edf_seq_show(struct seq_file *m, enum nrs_ctl_edf opc)
+{
+	struct ptlrpc_service	*svc = m->private;
+	int			 rc;
+
+	seq_printf(m, "regular_requests:\n");
+	/**
+	 * Perform two separate calls to this as only one of the NRS heads'
+	 * policies may be in the ptlrpc_nrs_pol_state::NRS_POL_STATE_STARTED or
+	 * ptlrpc_nrs_pol_state::NRS_POL_STATE_STOPPING state.
+	 */
+	rc = ptlrpc_nrs_policy_control(svc, PTLRPC_NRS_QUEUE_REG,
+				       NRS_POL_NAME_EDF, opc, false, m);
+	/**
+	 * -ENOSPC means buf in the parameter m is overflow, return 0 here to
+	 * let upper layer function seq_read alloc a larger memory area and do
+	 * this process again.
+	 */
+	if (rc == -ENOSPC)
+		return 0;
+	/**
+	 * Ignore -ENODEV as the regular NRS head's policy may be in the
+	 * ptlrpc_nrs_pol_state::NRS_POL_STATE_STOPPED state.
+	 */
+	if (rc != 0 && rc != -ENODEV)
+		return rc;
+
+	if (!nrs_svc_has_hp(svc))
+		return rc;
+
+	seq_printf(m, "high_priority_requests:\n");
+	rc = ptlrpc_nrs_policy_control(svc, PTLRPC_NRS_QUEUE_HP,
+				       NRS_POL_NAME_EDF, opc, false, m);
+	if (rc == -ENOSPC)
+		return 0;
+
+	return rc;
+}
+
+/**
+ * Lists the latency classes of EDF policy instances of a service, together
+ * with the number of RPCs queued, dispatched and dispatched after their
+ * deadline for each class, e.g.:
+ *
+ *	regular_requests:
+ *	CPT 0:
+ *	ls opcode={mds_getattr mds_getattr_lock} 10, queued 0, ...
+ *	default {*} 1000, queued 3, dispatched 1234, missed 12, ref 3
+ */
+static int
+ptlrpc_lprocfs_nrs_edf_class_seq_show(struct seq_file *m, void *data)
+{
+	return nrs_edf_seq_show(m, NRS_CTL_EDF_RD_CLASS);
+}
+
+static int nrs_edf_key_parse(struct nrs_edf_cmd *cmd, char **val)
+{
+	char	*token;
+	char	*key;
+
+	token = strsep(val, "}");
+	if (*val == NULL)
+		return -EINVAL;
+
+	/* Should be followed by ' ' or nothing */
+	if ((*val)[0] == '\0')
+		*val = NULL;
+	else if ((*val)[0] == ' ')
+		(*val)++;
+	else
+		return -EINVAL;
+
+	key = strsep(&token, "=");
+	if (token == NULL || strlen(token) <= 1 || token[0] != '{')
+		return -EINVAL;
+	/* Skip '{' */
+	token++;
+
+	if (strcmp(key, NRS_EDF_KEY_JOBID_STR) == 0)
+		cmd->ec_key = NRS_EDF_KEY_JOBID;
+	else if (strcmp(key, NRS_EDF_KEY_NID_STR) == 0)
+		cmd->ec_key = NRS_EDF_KEY_NID;
+	else if (strcmp(key, NRS_EDF_KEY_UID_STR) == 0)
+		cmd->ec_key = NRS_EDF_KEY_UID;
+	else if (strcmp(key, NRS_EDF_KEY_OPCODE_STR) == 0)
+		cmd->ec_key = NRS_EDF_KEY_OPCODE;
+	else
+		return -EINVAL;
+
+	cmd->ec_ids_str = token;
+
+	return 0;
+}
+
+/**
+ * Parses a class command of the following forms:
+ *
+ *	start <name> <jobid|nid|uid|opcode>={<list>} [target_ms]
+ *	change <name> <target_ms>
+ *	stop <name>
+ *
+ * The id list is only checked for syntax here; it is parsed again by each
+ * policy instance in nrs_edf_class_start().
+ */
+static int nrs_edf_parse_cmd(char *buffer, struct nrs_edf_cmd *cmd)
+{
+	struct list_head	 ids;
+	char			*token;
+	char			*val;
+	int			 i;
+	int			 rc;
+
+	val = buffer;
+	token = strsep(&val, " ");
+	if (val == NULL || strlen(val) == 0)
+		return -EINVAL;
+
+	/* Type of the command */
+	if (strcmp(token, "start") == 0)
+		cmd->ec_cmd = NRS_CTL_EDF_START_CLASS;
+	else if (strcmp(token, "stop") == 0)
+		cmd->ec_cmd = NRS_CTL_EDF_STOP_CLASS;
+	else if (strcmp(token, "change") == 0)
+		cmd->ec_cmd = NRS_CTL_EDF_CHANGE_TARGET;
+	else
+		return -EINVAL;
+
+	/* Name of the class */
+	token = strsep(&val, " ");
+	if (val == NULL && cmd->ec_cmd != NRS_CTL_EDF_STOP_CLASS)
+		return -EINVAL;
+
+	if (strlen(token) == 0 || strlen(token) >= MAX_EDF_NAME)
+		return -EINVAL;
+	for (i = 0; i < strlen(token); i++) {
+		if (!isalnum(token[i]) && token[i] != '_')
+			return -EINVAL;
+	}
+	cmd->ec_name = token;
+
+	if (cmd->ec_cmd == NRS_CTL_EDF_START_CLASS) {
+		rc = nrs_edf_key_parse(cmd, &val);
+		if (rc)
+			return rc;
+
+		if (cmd->ec_key == NRS_EDF_KEY_NID) {
+			rc = cfs_parse_nidlist(cmd->ec_ids_str,
+					       strlen(cmd->ec_ids_str), &ids);
+			if (rc <= 0)
+				return -EINVAL;
+			cfs_free_nidlist(&ids);
+		} else {
+			rc = nrs_edf_id_list_parse(cmd->ec_key,
+						   cmd->ec_ids_str,
+						   strlen(cmd->ec_ids_str),
+						   &ids);
+			if (rc)
+				return rc;
+			nrs_edf_id_list_free(&ids);
+		}
+	}
+
+	if (val != NULL) {
+		unsigned long target;
+
+		if (cmd->ec_cmd == NRS_CTL_EDF_STOP_CLASS ||
+		    strlen(val) == 0 || !isdigit(val[0]))
+			return -EINVAL;
+
+		target = simple_strtoul(val, NULL, 10);
+		if (target == 0 || target > LPROCFS_NRS_EDF_TARGET_MAX)
+			return -EINVAL;
+		cmd->ec_target = (__u64)target * USEC_PER_MSEC;
+	} else {
+		if (cmd->ec_cmd == NRS_CTL_EDF_CHANGE_TARGET)
+			return -EINVAL;
+		/* No target given */
+		cmd->ec_target = (__u64)edf_default_target * USEC_PER_MSEC;
+	}
+
+	return 0;
+}
+
+extern struct nrs_core nrs_core;
+#define LPROCFS_WR_NRS_EDF_MAX_CMD (4096)
+
+/**
+ * Starts, changes or stops latency classes of the EDF policy instances of a
+ * service. A leading "reg" or "hp" applies the command to the regular or the
+ * high priority NRS heads only. For example:
+ *
+ * lctl set_param mds.MDS.mdt.nrs_edf_class=
+ *	"start ls opcode={mds_getattr mds_getattr_lock ldlm_enqueue} 10"
+ *
+ * lctl set_param ost.OSS.ost_io.nrs_edf_class="start batch jobid={dd.0} 5000"
+ *
+ * lctl set_param mds.MDS.mdt.nrs_edf_class="change ls 20"
+ */
+static ssize_t
+ptlrpc_lprocfs_nrs_edf_class_seq_write(struct file *file, const char *buffer,
+				       size_t count, loff_t *off)
+{
+	struct seq_file			*m = file->private_data;
+	struct ptlrpc_service		*svc = m->private;
+	enum ptlrpc_nrs_queue_type	 queue = PTLRPC_NRS_QUEUE_BOTH;
+	struct nrs_edf_cmd		 cmd;
+	char				*kernbuf;
+	char				*val;
+	char				*token;
+	int				 rc;
+
+	if (count > LPROCFS_WR_NRS_EDF_MAX_CMD - 1)
+		return -EINVAL;
+
+	OBD_ALLOC(kernbuf, LPROCFS_WR_NRS_EDF_MAX_CMD);
+	if (kernbuf == NULL)
+		return -ENOMEM;
+
+	if (copy_from_user(kernbuf, buffer, count))
+		GOTO(out, rc = -EFAULT);
+
+	/* Strip the trailing newline added by echo */
+	if (count > 0 && kernbuf[count - 1] == '\n')
+		kernbuf[count - 1] = '\0';
+
+	val = kernbuf;
+	token = strsep(&val, " ");
+	if (val == NULL)
+		GOTO(out, rc = -EINVAL);
+
+	if (strcmp(token, "reg") == 0) {
+		queue = PTLRPC_NRS_QUEUE_REG;
+	} else if (strcmp(token, "hp") == 0) {
+		queue = PTLRPC_NRS_QUEUE_HP;
+	} else {
+		kernbuf[strlen(token)] = ' ';
+		val = kernbuf;
+	}
+
+	if (queue == PTLRPC_NRS_QUEUE_HP && !nrs_svc_has_hp(svc))
+		GOTO(out, rc = -ENODEV);
+	else if (queue == PTLRPC_NRS_QUEUE_BOTH && !nrs_svc_has_hp(svc))
+		queue = PTLRPC_NRS_QUEUE_REG;
+
+	memset(&cmd, 0, sizeof(cmd));
+	rc = nrs_edf_parse_cmd(val, &cmd);
+	if (rc)
+		GOTO(out, rc);
+
+	/**
+	 * Serialize NRS core lprocfs operations with policy registration/
+	 * unregistration.
+	 */
+	mutex_lock(&nrs_core.nrs_mutex);
+	rc = ptlrpc_nrs_policy_control(svc, queue, NRS_POL_NAME_EDF,
+				       NRS_CTL_EDF_WR_CLASS, false, &cmd);
+	mutex_unlock(&nrs_core.nrs_mutex);
+out:
+	OBD_FREE(kernbuf, LPROCFS_WR_NRS_EDF_MAX_CMD);
+	return rc ? rc : count;
+}
+LPROC_SEQ_FOPS(ptlrpc_lprocfs_nrs_edf_class);
+
+/**
+ * Shows per-class queue delay histograms of EDF policy instances of a
+ * service; buckets are log2 of the delay between RPC arrival and dispatch in
+ * microseconds.
+ */
+static int
+ptlrpc_lprocfs_nrs_edf_stats_seq_show(struct seq_file *m, void *data)
+{
+	return nrs_edf_seq_show(m, NRS_CTL_EDF_RD_STATS);
+}
+LPROC_SEQ_FOPS_RO(ptlrpc_lprocfs_nrs_edf_stats);
+
+/**
+ * Initializes an EDF policy's lprocfs interface for service \a svc
+ *
+ * \param[in] svc the service
+ *
+ * \retval 0	success
+ * \retval != 0	error
+ */
+int nrs_edf_lprocfs_init(struct ptlrpc_service *svc)
+{
+	struct lprocfs_seq_vars nrs_edf_lprocfs_vars[] = {
+		{ .name		= "nrs_edf_class",
+		  .fops		= &ptlrpc_lprocfs_nrs_edf_class_fops,
+		  .data = svc },
+		{ .name		= "nrs_edf_stats",
+		  .fops		= &ptlrpc_lprocfs_nrs_edf_stats_fops,
+		  .data = svc },
+		{ NULL }
+	};
+
+	if (svc->srv_procroot == NULL)
+		return 0;
+
+	return lprocfs_seq_add_vars(svc->srv_procroot, nrs_edf_lprocfs_vars,
+				    NULL);
+}
+
+/**
+ * Cleans up an EDF policy's lprocfs interface for service \a svc
+ *
+ * \param[in] svc the service
+ */
+void nrs_edf_lprocfs_fini(struct ptlrpc_service *svc)
+{
+	if (svc->srv_procroot == NULL)
+		return;
+
+	lprocfs_remove_proc_entry("nrs_edf_class", svc->srv_procroot);
+	lprocfs_remove_proc_entry("nrs_edf_stats", svc->srv_procroot);
+}
+
+#endif /* LPROCFS */
+
+/**
+ * EDF policy operations
+ */
+static const struct ptlrpc_nrs_pol_ops nrs_edf_ops = {
+	.op_policy_start	= nrs_edf_start,
+	.op_policy_stop		= nrs_edf_stop,
+	.op_policy_ctl		= nrs_edf_ctl,
+	.op_res_get		= nrs_edf_res_get,
+	.op_res_put		= nrs_edf_res_put,
+	.op_req_get		= nrs_edf_req_get,
+	.op_req_enqueue		= nrs_edf_req_add,
+	.op_req_dequeue		= nrs_edf_req_del,
+	.op_req_stop		= nrs_edf_req_stop,
+#ifdef LPROCFS
+	.op_lprocfs_init	= nrs_edf_lprocfs_init,
+	.op_lprocfs_fini	= nrs_edf_lprocfs_fini,
+#endif
+};
+
+/**
+ * EDF policy configuration
+ */
+struct ptlrpc_nrs_pol_conf nrs_conf_edf = {
+	.nc_name		= NRS_POL_NAME_EDF,
+	.nc_ops			= &nrs_edf_ops,
+	.nc_compat		= nrs_policy_compat_all,
+};
+
+/** @} edf */
+
+/** @} nrs */
+
+#endif /* HAVE_SERVER_SUPPORT */
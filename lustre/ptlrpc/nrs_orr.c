@@ -571,6 +571,16 @@ static int orr_req_compare(cfs_binheap_node_t *e1, cfs_binheap_node_t *e2)
 	}
 }
 
+/**
+ * Binary heap key, the round of the request; orr_req_compare() orders
+ * requests of the same round.
+ */
+static __u64 orr_req_key(cfs_binheap_node_t *e)
+{
+	return container_of(e, struct ptlrpc_nrs_request,
+			    nr_node)->nr_u.orr.or_round;
+}
+
 /**
  * ORR binary heap operations
  */
@@ -578,6 +588,7 @@ static cfs_binheap_ops_t nrs_orr_heap_ops = {
 	.hop_enter	= NULL,
 	.hop_exit	= NULL,
 	.hop_compare	= orr_req_compare,
+	.hop_key	= orr_req_key,
 };
 
 /**
@@ -628,7 +639,8 @@ static int nrs_orr_start(struct ptlrpc_nrs_policy *policy, char *arg)
 	 * Binary heap instance for sorted incoming requests.
 	 */
 	orrd->od_binheap = cfs_binheap_create(&nrs_orr_heap_ops,
-					      CBH_FLAG_ATOMIC_GROW, 4096, NULL,
+					      CBH_FLAG_ATOMIC_GROW |
+					      CBH_FLAG_DARY, 4096, NULL,
 					      nrs_pol2cptab(policy),
 					      nrs_pol2cptid(policy));
 	if (orrd->od_binheap == NULL)
@@ -82,13 +82,19 @@ static enum hrtimer_restart nrs_tbf_timer_cb(struct hrtimer *timer)
 
 #define NRS_TBF_DEFAULT_RULE "default"
 
+static void nrs_tbf_rule_put(struct nrs_tbf_rule *rule);
+
 static void nrs_tbf_rule_fini(struct nrs_tbf_rule *rule)
 {
 	LASSERT(atomic_read(&rule->tr_ref) == 0);
 	LASSERT(list_empty(&rule->tr_cli_list));
 	LASSERT(list_empty(&rule->tr_linkage));
+	LASSERT(atomic_read(&rule->tr_nchildren) == 0);
 
 	rule->tr_head->th_ops->o_rule_fini(rule);
+	/* Children pin their parent until they are freed */
+	if (rule->tr_parent != NULL)
+		nrs_tbf_rule_put(rule->tr_parent);
 	OBD_FREE_PTR(rule);
 }
 
@@ -134,6 +140,7 @@ nrs_tbf_cli_reset_value(struct nrs_tbf_head *head,
 	cli->tc_depth = rule->tr_depth;
 	cli->tc_ntoken = rule->tr_depth;
 	cli->tc_check_time = ktime_to_ns(ktime_get());
+	cli->tc_defer_until = 0;
 	cli->tc_rule_sequence = atomic_read(&head->th_rule_sequence);
 	cli->tc_rule_generation = rule->tr_generation;
 
@@ -149,12 +156,15 @@ nrs_tbf_cli_reset(struct nrs_tbf_head *head,
 {
 	if (!list_empty(&cli->tc_linkage)) {
 		LASSERT(rule != cli->tc_rule);
+		/* Queued requests are accounted to the new rule from now on */
+		cli->tc_rule->tr_nqueued -= cli->tc_nqueued;
 		nrs_tbf_cli_rule_put(cli);
 	}
 	LASSERT(cli->tc_rule == NULL);
 	LASSERT(list_empty(&cli->tc_linkage));
 	/* Rule's ref is added before called */
 	cli->tc_rule = rule;
+	rule->tr_nqueued += cli->tc_nqueued;
 	list_add_tail(&cli->tc_linkage, &rule->tr_cli_list);
 	nrs_tbf_cli_reset_value(head, cli);
 }
@@ -162,7 +172,24 @@ nrs_tbf_cli_reset(struct nrs_tbf_head *head,
 static int
 nrs_tbf_rule_dump(struct nrs_tbf_rule *rule, struct seq_file *m)
 {
-	return rule->tr_head->th_ops->o_rule_dump(rule, m);
+	int nchildren = atomic_read(&rule->tr_nchildren);
+	int rc;
+
+	rc = rule->tr_head->th_ops->o_rule_dump(rule, m);
+	if (rc)
+		return rc;
+
+	return seq_printf(m, ", ref %d, parent %s, children %d, "
+			  "tokens %ld, queued %lu, dispatched %lu, "
+			  "borrowed %lu, deferred %lu\n",
+			  atomic_read(&rule->tr_ref) - 1 - nchildren,
+			  rule->tr_parent != NULL ?
+			  rule->tr_parent->tr_name : "-",
+			  nchildren,
+			  nchildren > 0 ?
+			  atomic_long_read(&rule->tr_agg_ntoken) : 0,
+			  rule->tr_nqueued, rule->tr_dispatched,
+			  rule->tr_borrowed, rule->tr_deferred);
 }
 
 static int
@@ -274,6 +301,7 @@ nrs_tbf_rule_start(struct ptlrpc_nrs_policy *policy,
 		   struct nrs_tbf_cmd *start)
 {
 	struct nrs_tbf_rule *rule, *tmp_rule;
+	struct nrs_tbf_rule *parent = NULL;
 	int rc;
 
 	rule = nrs_tbf_rule_find(head, start->tc_name);
@@ -282,23 +310,42 @@ nrs_tbf_rule_start(struct ptlrpc_nrs_policy *policy,
 		return -EEXIST;
 	}
 
+	if (start->tc_parent != NULL) {
+		/* The reference is kept by the new rule until it is freed */
+		parent = nrs_tbf_rule_find(head, start->tc_parent);
+		if (parent == NULL)
+			return -ENOENT;
+	}
+
 	OBD_CPT_ALLOC_PTR(rule, nrs_pol2cptab(policy), nrs_pol2cptid(policy));
-	if (rule == NULL)
+	if (rule == NULL) {
+		if (parent != NULL)
+			nrs_tbf_rule_put(parent);
 		return -ENOMEM;
+	}
 
 	memcpy(rule->tr_name, start->tc_name, strlen(start->tc_name));
 	rule->tr_rpc_rate = start->tc_rpc_rate;
 	rule->tr_nsecs = NSEC_PER_SEC / rule->tr_rpc_rate;
 	rule->tr_depth = tbf_depth;
+	atomic_long_set(&rule->tr_agg_ntoken, rule->tr_depth);
+	rule->tr_agg_check_time = ktime_to_ns(ktime_get());
 	atomic_set(&rule->tr_ref, 1);
 	INIT_LIST_HEAD(&rule->tr_cli_list);
+	INIT_LIST_HEAD(&rule->tr_linkage);
 	INIT_LIST_HEAD(&rule->tr_nids);
+	INIT_LIST_HEAD(&rule->tr_jobids);
+	INIT_LIST_HEAD(&rule->tr_conds);
 
 	rc = head->th_ops->o_rule_init(policy, rule, start);
 	if (rc) {
+		if (parent != NULL)
+			nrs_tbf_rule_put(parent);
 		OBD_FREE_PTR(rule);
 		return rc;
 	}
+	rule->tr_head = head;
+	rule->tr_parent = parent;
 
 	/* Add as the newest rule */
 	spin_lock(&head->th_rule_lock);
@@ -309,8 +356,14 @@ nrs_tbf_rule_start(struct ptlrpc_nrs_policy *policy,
 		nrs_tbf_rule_put(rule);
 		return -EEXIST;
 	}
+	if (parent != NULL && parent->tr_flags & NTRS_STOPPING) {
+		spin_unlock(&head->th_rule_lock);
+		nrs_tbf_rule_put(rule);
+		return -ENOENT;
+	}
+	if (parent != NULL)
+		atomic_inc(&parent->tr_nchildren);
 	list_add(&rule->tr_linkage, &head->th_list);
-	rule->tr_head = head;
 	spin_unlock(&head->th_rule_lock);
 	atomic_inc(&head->th_rule_sequence);
 	if (start->tc_rule_flags & NTRS_DEFAULT) {
@@ -355,12 +408,25 @@ nrs_tbf_rule_stop(struct ptlrpc_nrs_policy *policy,
 	if (strcmp(stop->tc_name, NRS_TBF_DEFAULT_RULE) == 0)
 		return -EPERM;
 
-	rule = nrs_tbf_rule_find(head, stop->tc_name);
-	if (rule == NULL)
+	spin_lock(&head->th_rule_lock);
+	rule = nrs_tbf_rule_find_nolock(head, stop->tc_name);
+	if (rule == NULL) {
+		spin_unlock(&head->th_rule_lock);
 		return -ENOENT;
+	}
+
+	/* Children have to be stopped first */
+	if (atomic_read(&rule->tr_nchildren) > 0) {
+		spin_unlock(&head->th_rule_lock);
+		nrs_tbf_rule_put(rule);
+		return -EBUSY;
+	}
 
 	list_del_init(&rule->tr_linkage);
 	rule->tr_flags |= NTRS_STOPPING;
+	if (rule->tr_parent != NULL)
+		atomic_dec(&rule->tr_parent->tr_nchildren);
+	spin_unlock(&head->th_rule_lock);
 	nrs_tbf_rule_put(rule);
 	nrs_tbf_rule_put(rule);
 
@@ -397,6 +463,18 @@ nrs_tbf_command(struct ptlrpc_nrs_policy *policy,
 	}
 }
 
+/**
+ * Returns the time at which client \a cli may be served next, i.e. when it
+ * will get its next token, or when its ancestors will have aggregate tokens
+ * again if it was held back by them.
+ */
+static inline __u64 nrs_tbf_cli_deadline(struct nrs_tbf_client *cli)
+{
+	__u64 deadline = cli->tc_check_time + cli->tc_nsecs;
+
+	return max(deadline, cli->tc_defer_until);
+}
+
 /**
  * Binary heap predicate.
  *
@@ -414,11 +492,9 @@ static int tbf_cli_compare(cfs_binheap_node_t *e1, cfs_binheap_node_t *e2)
 	cli1 = container_of(e1, struct nrs_tbf_client, tc_node);
 	cli2 = container_of(e2, struct nrs_tbf_client, tc_node);
 
-	if (cli1->tc_check_time + cli1->tc_nsecs <
-	    cli2->tc_check_time + cli2->tc_nsecs)
+	if (nrs_tbf_cli_deadline(cli1) < nrs_tbf_cli_deadline(cli2))
 		return 1;
-	else if (cli1->tc_check_time + cli1->tc_nsecs >
-		 cli2->tc_check_time + cli2->tc_nsecs)
+	else if (nrs_tbf_cli_deadline(cli1) > nrs_tbf_cli_deadline(cli2))
 		return 0;
 
 	if (cli1->tc_check_time < cli2->tc_check_time)
@@ -430,6 +506,16 @@ static int tbf_cli_compare(cfs_binheap_node_t *e1, cfs_binheap_node_t *e2)
 	return 1;
 }
 
+/**
+ * Binary heap key, the deadline of the client; tbf_cli_compare() orders
+ * clients with the same deadline.
+ */
+static __u64 tbf_cli_key(cfs_binheap_node_t *e)
+{
+	return nrs_tbf_cli_deadline(container_of(e, struct nrs_tbf_client,
+						 tc_node));
+}
+
 /**
  * TBF binary heap operations
  */
@@ -437,6 +523,7 @@ static cfs_binheap_ops_t nrs_tbf_heap_ops = {
 	.hop_enter	= NULL,
 	.hop_exit	= NULL,
 	.hop_compare	= tbf_cli_compare,
+	.hop_key	= tbf_cli_key,
 };
 
 static unsigned nrs_tbf_jobid_hop_hash(cfs_hash_t *hs, const void *key,
@@ -512,17 +599,18 @@ static cfs_hash_ops_t nrs_tbf_jobid_hash_ops = {
 				  CFS_HASH_NO_ITEMREF | \
 				  CFS_HASH_DEPTH)
 
+/* The jobid hash and LRU helpers are shared with the generic type */
 static struct nrs_tbf_client *
 nrs_tbf_jobid_hash_lookup(cfs_hash_t *hs,
 			  cfs_hash_bd_t *bd,
-			  const char *jobid)
+			  const void *key)
 {
 	struct hlist_node *hnode;
 	struct nrs_tbf_client *cli;
 
 	/* cfs_hash_bd_peek_locked is a somehow "internal" function
 	 * of cfs_hash, it doesn't add refcount on object. */
-	hnode = cfs_hash_bd_peek_locked(hs, bd, (void *)jobid);
+	hnode = cfs_hash_bd_peek_locked(hs, bd, (void *)key);
 	if (hnode == NULL)
 		return NULL;
 
@@ -586,7 +674,7 @@ nrs_tbf_jobid_cli_put(struct nrs_tbf_head *head,
 	struct list_head	zombies;
 
 	INIT_LIST_HEAD(&zombies);
-	cfs_hash_bd_get(hs, &cli->tc_jobid, &bd);
+	cfs_hash_bd_get(hs, cfs_hash_key(hs, &cli->tc_hnode), &bd);
 	bkt = cfs_hash_bd_extra_get(hs, &bd);
 	if (!cfs_hash_bd_dec_and_lock(hs, &bd, &cli->tc_ref))
 		return;
@@ -644,14 +732,11 @@ static int nrs_tbf_jobid_hash_order(void)
 #define NRS_TBF_JOBID_BKT_BITS 10
 
 static int
-nrs_tbf_jobid_startup(struct ptlrpc_nrs_policy *policy,
-		      struct nrs_tbf_head *head)
+nrs_tbf_jobid_hash_init(struct nrs_tbf_head *head, cfs_hash_ops_t *ops)
 {
-	struct nrs_tbf_cmd	 start;
 	struct nrs_tbf_bucket	*bkt;
 	int			 bits;
 	int			 i;
-	int			 rc;
 	cfs_hash_bd_t		 bd;
 
 	bits = nrs_tbf_jobid_hash_order();
@@ -664,7 +749,7 @@ nrs_tbf_jobid_startup(struct ptlrpc_nrs_policy *policy,
 					    sizeof(*bkt),
 					    0,
 					    0,
-					    &nrs_tbf_jobid_hash_ops,
+					    ops,
 					    NRS_TBF_JOBID_HASH_FLAGS);
 	if (head->th_cli_hash == NULL)
 		return -ENOMEM;
@@ -674,6 +759,20 @@ nrs_tbf_jobid_startup(struct ptlrpc_nrs_policy *policy,
 		INIT_LIST_HEAD(&bkt->ntb_lru);
 	}
 
+	return 0;
+}
+
+static int
+nrs_tbf_jobid_startup(struct ptlrpc_nrs_policy *policy,
+		      struct nrs_tbf_head *head)
+{
+	struct nrs_tbf_cmd	 start;
+	int			 rc;
+
+	rc = nrs_tbf_jobid_hash_init(head, &nrs_tbf_jobid_hash_ops);
+	if (rc)
+		return rc;
+
 	memset(&start, 0, sizeof(start));
 	start.tc_jobids_str = "*";
 
@@ -821,9 +920,8 @@ static int nrs_tbf_jobid_rule_init(struct ptlrpc_nrs_policy *policy,
 static int
 nrs_tbf_jobid_rule_dump(struct nrs_tbf_rule *rule, struct seq_file *m)
 {
-	return seq_printf(m, "%s {%s} %llu, ref %d\n", rule->tr_name,
-			  rule->tr_jobids_str, rule->tr_rpc_rate,
-			  atomic_read(&rule->tr_ref) - 1);
+	return seq_printf(m, "%s {%s} %llu", rule->tr_name,
+			  rule->tr_jobids_str, rule->tr_rpc_rate);
 }
 
 static int
@@ -1026,9 +1124,8 @@ static int nrs_tbf_nid_rule_init(struct ptlrpc_nrs_policy *policy,
 static int
 nrs_tbf_nid_rule_dump(struct nrs_tbf_rule *rule, struct seq_file *m)
 {
-	return seq_printf(m, "%s {%s} %llu, ref %d\n", rule->tr_name,
-			  rule->tr_nids_str, rule->tr_rpc_rate,
-			  atomic_read(&rule->tr_ref) - 1);
+	return seq_printf(m, "%s {%s} %llu", rule->tr_name,
+			  rule->tr_nids_str, rule->tr_rpc_rate);
 }
 
 static int
@@ -1086,6 +1183,420 @@ struct nrs_tbf_ops nrs_tbf_nid_ops = {
 	.o_rule_fini = nrs_tbf_nid_rule_fini,
 };
 
+/**
+ * Generic TBF type
+ *
+ * Rules are expressions of conditions on the NID, jobid, opcode, uid and gid
+ * of requests, e.g. "opcode={mds_reint ldlm_enqueue}&uid={500}"; a request
+ * matches a rule if it matches all conditions of the rule. Clients are
+ * distinguished by the whole tuple of these fields and are kept in an LRU
+ * like in the jobid type.
+ */
+#define NRS_TBF_ID_NONE		((__u32)-1)
+
+static unsigned nrs_tbf_generic_hop_hash(cfs_hash_t *hs, const void *key,
+					 unsigned mask)
+{
+	return cfs_hash_djb2_hash(key, sizeof(struct nrs_tbf_key), mask);
+}
+
+static int nrs_tbf_generic_hop_keycmp(const void *key,
+				      struct hlist_node *hnode)
+{
+	struct nrs_tbf_client *cli = hlist_entry(hnode,
+						 struct nrs_tbf_client,
+						 tc_hnode);
+
+	return memcmp(&cli->tc_key, key, sizeof(struct nrs_tbf_key)) == 0;
+}
+
+static void *nrs_tbf_generic_hop_key(struct hlist_node *hnode)
+{
+	struct nrs_tbf_client *cli = hlist_entry(hnode,
+						 struct nrs_tbf_client,
+						 tc_hnode);
+
+	return &cli->tc_key;
+}
+
+static cfs_hash_ops_t nrs_tbf_generic_hash_ops = {
+	.hs_hash	= nrs_tbf_generic_hop_hash,
+	.hs_keycmp	= nrs_tbf_generic_hop_keycmp,
+	.hs_key		= nrs_tbf_generic_hop_key,
+	.hs_object	= nrs_tbf_jobid_hop_object,
+	.hs_get		= nrs_tbf_jobid_hop_get,
+	.hs_put		= nrs_tbf_jobid_hop_put,
+	.hs_put_locked	= nrs_tbf_jobid_hop_put,
+	.hs_exit	= nrs_tbf_jobid_hop_exit,
+};
+
+/**
+ * Fills key \a key from the fields of request \a req; the key is compared
+ * as a whole, so unused bytes are zeroed.
+ */
+static void nrs_tbf_generic_key_init(struct nrs_tbf_key *key,
+				     struct ptlrpc_request *req)
+{
+	char *jobid = lustre_msg_get_jobid(req->rq_reqmsg);
+
+	memset(key, 0, sizeof(*key));
+	key->tk_nid = req->rq_peer.nid;
+	key->tk_opcode = lustre_msg_get_opc(req->rq_reqmsg);
+	if (ptlrpc_req_get_ugid(req, &key->tk_uid, &key->tk_gid) != 0) {
+		key->tk_uid = NRS_TBF_ID_NONE;
+		key->tk_gid = NRS_TBF_ID_NONE;
+	}
+	if (jobid != NULL) {
+		LASSERT(strlen(jobid) < JOBSTATS_JOBID_SIZE);
+		memcpy(key->tk_jobid, jobid, strlen(jobid));
+	}
+}
+
+static struct nrs_tbf_client *
+nrs_tbf_generic_cli_find(struct nrs_tbf_head *head,
+			 struct ptlrpc_request *req)
+{
+	struct nrs_tbf_key	 key;
+	struct nrs_tbf_client	*cli;
+	cfs_hash_t		*hs = head->th_cli_hash;
+	cfs_hash_bd_t		 bd;
+
+	nrs_tbf_generic_key_init(&key, req);
+	cfs_hash_bd_get_and_lock(hs, &key, &bd, 1);
+	cli = nrs_tbf_jobid_hash_lookup(hs, &bd, &key);
+	cfs_hash_bd_unlock(hs, &bd, 1);
+
+	return cli;
+}
+
+static struct nrs_tbf_client *
+nrs_tbf_generic_cli_findadd(struct nrs_tbf_head *head,
+			    struct nrs_tbf_client *cli)
+{
+	struct nrs_tbf_client	*ret;
+	cfs_hash_t		*hs = head->th_cli_hash;
+	cfs_hash_bd_t		 bd;
+
+	cfs_hash_bd_get_and_lock(hs, &cli->tc_key, &bd, 1);
+	ret = nrs_tbf_jobid_hash_lookup(hs, &bd, &cli->tc_key);
+	if (ret == NULL) {
+		cfs_hash_bd_add_locked(hs, &bd, &cli->tc_hnode);
+		ret = cli;
+	}
+	cfs_hash_bd_unlock(hs, &bd, 1);
+
+	return ret;
+}
+
+static void
+nrs_tbf_generic_cli_init(struct nrs_tbf_client *cli,
+			 struct ptlrpc_request *req)
+{
+	INIT_LIST_HEAD(&cli->tc_lru);
+	nrs_tbf_generic_key_init(&cli->tc_key, req);
+	cli->tc_nid = cli->tc_key.tk_nid;
+	memcpy(cli->tc_jobid, cli->tc_key.tk_jobid, sizeof(cli->tc_jobid));
+}
+
+static void nrs_tbf_num_list_free(struct list_head *num_list)
+{
+	struct nrs_tbf_num *num, *n;
+
+	list_for_each_entry_safe(num, n, num_list, tn_linkage) {
+		list_del(&num->tn_linkage);
+		OBD_FREE_PTR(num);
+	}
+}
+
+static int nrs_tbf_num_list_match(struct list_head *num_list, __u32 id)
+{
+	struct nrs_tbf_num *num;
+
+	list_for_each_entry(num, num_list, tn_linkage) {
+		if (num->tn_num == id)
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Parses a list of opcode names, or of uids or gids, separated by spaces.
+ */
+static int nrs_tbf_num_list_parse(char *str, int len,
+				  struct list_head *num_list,
+				  enum nrs_tbf_field field)
+{
+	struct nrs_tbf_num *num;
+	struct cfs_lstr	    src;
+	struct cfs_lstr	    res;
+	char		    buf[64];
+	int		    rc = 0;
+
+	src.ls_str = str;
+	src.ls_len = len;
+	INIT_LIST_HEAD(num_list);
+	while (src.ls_str) {
+		if (cfs_gettok(&src, ' ', &res) == 0)
+			GOTO(out, rc = -EINVAL);
+
+		OBD_ALLOC_PTR(num);
+		if (num == NULL)
+			GOTO(out, rc = -ENOMEM);
+		list_add_tail(&num->tn_linkage, num_list);
+
+		if (field != NRS_TBF_FIELD_OPCODE) {
+			if (!cfs_str2num_check(res.ls_str, res.ls_len,
+					       &num->tn_num, 0, (unsigned)-1))
+				GOTO(out, rc = -EINVAL);
+			continue;
+		}
+
+		if (res.ls_len >= sizeof(buf))
+			GOTO(out, rc = -EINVAL);
+		memcpy(buf, res.ls_str, res.ls_len);
+		buf[res.ls_len] = '\0';
+		rc = ll_str2opcode(buf);
+		if (rc < 0)
+			GOTO(out, rc);
+		num->tn_num = rc;
+		rc = 0;
+	}
+out:
+	if (rc)
+		nrs_tbf_num_list_free(num_list);
+	return rc;
+}
+
+static void nrs_tbf_conds_free(struct list_head *conds)
+{
+	struct nrs_tbf_cond *cond, *n;
+
+	list_for_each_entry_safe(cond, n, conds, tc_linkage) {
+		switch (cond->tc_field) {
+		case NRS_TBF_FIELD_NID:
+			cfs_free_nidlist(&cond->tc_list);
+			break;
+		case NRS_TBF_FIELD_JOBID:
+			nrs_tbf_jobid_list_free(&cond->tc_list);
+			break;
+		default:
+			nrs_tbf_num_list_free(&cond->tc_list);
+			break;
+		}
+		list_del(&cond->tc_linkage);
+		OBD_FREE_PTR(cond);
+	}
+}
+
+/**
+ * Parses a single condition of the form <field>={<list>}.
+ */
+static int nrs_tbf_cond_parse(char *str, struct list_head *conds)
+{
+	struct nrs_tbf_cond *cond;
+	char		    *list;
+	char		    *end;
+	int		     rc;
+
+	list = strchr(str, '=');
+	if (list == NULL || list[1] != '{')
+		return -EINVAL;
+	*list = '\0';
+	list += 2;
+
+	end = strchr(list, '}');
+	if (end == NULL || end == list || end[1] != '\0')
+		return -EINVAL;
+	*end = '\0';
+
+	OBD_ALLOC_PTR(cond);
+	if (cond == NULL)
+		return -ENOMEM;
+
+	if (strcmp(str, "nid") == 0) {
+		cond->tc_field = NRS_TBF_FIELD_NID;
+		rc = cfs_parse_nidlist(list, strlen(list), &cond->tc_list) <= 0 ?
+		     -EINVAL : 0;
+	} else if (strcmp(str, "jobid") == 0) {
+		cond->tc_field = NRS_TBF_FIELD_JOBID;
+		rc = nrs_tbf_jobid_list_parse(list, strlen(list),
+					      &cond->tc_list);
+	} else if (strcmp(str, "opcode") == 0) {
+		cond->tc_field = NRS_TBF_FIELD_OPCODE;
+		rc = nrs_tbf_num_list_parse(list, strlen(list), &cond->tc_list,
+					    cond->tc_field);
+	} else if (strcmp(str, "uid") == 0) {
+		cond->tc_field = NRS_TBF_FIELD_UID;
+		rc = nrs_tbf_num_list_parse(list, strlen(list), &cond->tc_list,
+					    cond->tc_field);
+	} else if (strcmp(str, "gid") == 0) {
+		cond->tc_field = NRS_TBF_FIELD_GID;
+		rc = nrs_tbf_num_list_parse(list, strlen(list), &cond->tc_list,
+					    cond->tc_field);
+	} else {
+		rc = -EINVAL;
+	}
+
+	if (rc) {
+		OBD_FREE_PTR(cond);
+		return rc;
+	}
+
+	list_add_tail(&cond->tc_linkage, conds);
+	return 0;
+}
+
+/**
+ * Parses the conditions of expression \a expr, which are separated by '&'.
+ */
+static int nrs_tbf_conds_parse(const char *expr, struct list_head *conds)
+{
+	char *buf;
+	char *str;
+	char *token;
+	int   rc = 0;
+
+	OBD_ALLOC(buf, strlen(expr) + 1);
+	if (buf == NULL)
+		return -ENOMEM;
+	memcpy(buf, expr, strlen(expr));
+
+	INIT_LIST_HEAD(conds);
+	str = buf;
+	while (str != NULL) {
+		token = strsep(&str, "&");
+		rc = nrs_tbf_cond_parse(token, conds);
+		if (rc)
+			break;
+	}
+	if (rc)
+		nrs_tbf_conds_free(conds);
+
+	OBD_FREE(buf, strlen(expr) + 1);
+	return rc;
+}
+
+static int
+nrs_tbf_generic_startup(struct ptlrpc_nrs_policy *policy,
+			struct nrs_tbf_head *head)
+{
+	struct nrs_tbf_cmd	 start;
+	int			 rc;
+
+	rc = nrs_tbf_jobid_hash_init(head, &nrs_tbf_generic_hash_ops);
+	if (rc)
+		return rc;
+
+	memset(&start, 0, sizeof(start));
+	start.tc_conds_str = "*";
+
+	start.tc_rpc_rate = tbf_rate;
+	start.tc_rule_flags = NTRS_DEFAULT;
+	start.tc_name = NRS_TBF_DEFAULT_RULE;
+	rc = nrs_tbf_rule_start(policy, head, &start);
+
+	return rc;
+}
+
+static int nrs_tbf_generic_rule_init(struct ptlrpc_nrs_policy *policy,
+				     struct nrs_tbf_rule *rule,
+				     struct nrs_tbf_cmd *start)
+{
+	int rc = 0;
+
+	LASSERT(start->tc_conds_str);
+	OBD_ALLOC(rule->tr_conds_str, strlen(start->tc_conds_str) + 1);
+	if (rule->tr_conds_str == NULL)
+		return -ENOMEM;
+
+	memcpy(rule->tr_conds_str, start->tc_conds_str,
+	       strlen(start->tc_conds_str));
+
+	/* The default rule has no conditions and matches everything */
+	INIT_LIST_HEAD(&rule->tr_conds);
+	if (strcmp(start->tc_conds_str, "*") != 0) {
+		rc = nrs_tbf_conds_parse(rule->tr_conds_str, &rule->tr_conds);
+		if (rc) {
+			CERROR("conditions %s illegal\n", rule->tr_conds_str);
+			OBD_FREE(rule->tr_conds_str,
+				 strlen(start->tc_conds_str) + 1);
+		}
+	}
+	return rc;
+}
+
+static int
+nrs_tbf_generic_rule_dump(struct nrs_tbf_rule *rule, struct seq_file *m)
+{
+	return seq_printf(m, "%s %s %llu", rule->tr_name,
+			  rule->tr_conds_str, rule->tr_rpc_rate);
+}
+
+static int
+nrs_tbf_generic_rule_match(struct nrs_tbf_rule *rule,
+			   struct nrs_tbf_client *cli)
+{
+	struct nrs_tbf_key  *key = &cli->tc_key;
+	struct nrs_tbf_cond *cond;
+	int		     rc;
+
+	list_for_each_entry(cond, &rule->tr_conds, tc_linkage) {
+		switch (cond->tc_field) {
+		case NRS_TBF_FIELD_NID:
+			rc = cfs_match_nid(key->tk_nid, &cond->tc_list);
+			break;
+		case NRS_TBF_FIELD_JOBID:
+			rc = nrs_tbf_jobid_list_match(&cond->tc_list,
+						      key->tk_jobid);
+			break;
+		case NRS_TBF_FIELD_OPCODE:
+			rc = nrs_tbf_num_list_match(&cond->tc_list,
+						    key->tk_opcode);
+			break;
+		case NRS_TBF_FIELD_UID:
+			rc = nrs_tbf_num_list_match(&cond->tc_list,
+						    key->tk_uid);
+			break;
+		case NRS_TBF_FIELD_GID:
+			rc = nrs_tbf_num_list_match(&cond->tc_list,
+						    key->tk_gid);
+			break;
+		default:
+			rc = 0;
+			break;
+		}
+		if (!rc)
+			return 0;
+	}
+	return 1;
+}
+
+static void nrs_tbf_generic_rule_fini(struct nrs_tbf_rule *rule)
+{
+	nrs_tbf_conds_free(&rule->tr_conds);
+	LASSERT(rule->tr_conds_str != NULL);
+	OBD_FREE(rule->tr_conds_str, strlen(rule->tr_conds_str) + 1);
+}
+
+static void nrs_tbf_generic_cmd_fini(struct nrs_tbf_cmd *cmd)
+{
+	if (cmd->tc_conds_str)
+		OBD_FREE(cmd->tc_conds_str, strlen(cmd->tc_conds_str) + 1);
+}
+
+struct nrs_tbf_ops nrs_tbf_generic_ops = {
+	.o_name = NRS_TBF_TYPE_GENERIC,
+	.o_startup = nrs_tbf_generic_startup,
+	.o_cli_find = nrs_tbf_generic_cli_find,
+	.o_cli_findadd = nrs_tbf_generic_cli_findadd,
+	.o_cli_put = nrs_tbf_jobid_cli_put,
+	.o_cli_init = nrs_tbf_generic_cli_init,
+	.o_rule_init = nrs_tbf_generic_rule_init,
+	.o_rule_dump = nrs_tbf_generic_rule_dump,
+	.o_rule_match = nrs_tbf_generic_rule_match,
+	.o_rule_fini = nrs_tbf_generic_rule_fini,
+};
+
 /**
  * Is called before the policy transitions into
  * ptlrpc_nrs_pol_state::NRS_POL_STATE_STARTED; allocates and initializes a
@@ -1115,6 +1626,9 @@ static int nrs_tbf_start(struct ptlrpc_nrs_policy *policy, char *arg)
 	} else if (strcmp(arg, NRS_TBF_TYPE_JOBID) == 0) {
 		ops = &nrs_tbf_jobid_ops;
 		type = NRS_TBF_FLAG_JOBID;
+	} else if (strcmp(arg, NRS_TBF_TYPE_GENERIC) == 0) {
+		ops = &nrs_tbf_generic_ops;
+		type = NRS_TBF_FLAG_GENERIC;
 	} else
 		GOTO(out, rc = -ENOTSUPP);
 
@@ -1128,7 +1642,8 @@ static int nrs_tbf_start(struct ptlrpc_nrs_policy *policy, char *arg)
 	head->th_type_flag = type;
 
 	head->th_binheap = cfs_binheap_create(&nrs_tbf_heap_ops,
-					      CBH_FLAG_ATOMIC_GROW, 4096, NULL,
+					      CBH_FLAG_ATOMIC_GROW |
+					      CBH_FLAG_DARY, 4096, NULL,
 					      nrs_pol2cptab(policy),
 					      nrs_pol2cptid(policy));
 	if (head->th_binheap == NULL)
@@ -1175,6 +1690,8 @@ static void nrs_tbf_stop(struct ptlrpc_nrs_policy *policy)
 	cfs_hash_putref(head->th_cli_hash);
 	list_for_each_entry_safe(rule, n, &head->th_list, tr_linkage) {
 		list_del_init(&rule->tr_linkage);
+		if (rule->tr_parent != NULL)
+			atomic_dec(&rule->tr_parent->tr_nchildren);
 		nrs_tbf_rule_put(rule);
 	}
 	LASSERT(list_empty(&head->th_list));
@@ -1342,10 +1859,196 @@ static void nrs_tbf_res_put(struct ptlrpc_nrs_policy *policy,
 	head->th_ops->o_cli_put(head, cli);
 }
 
+/**
+ * Maximum number of queued clients examined when looking for one that may
+ * borrow tokens from the aggregate buckets of its ancestors.
+ */
+#define NRS_TBF_BORROW_SCAN	32
+/**
+ * Maximum number of clients which are held back by their ancestors within
+ * one call of nrs_tbf_req_get().
+ */
+#define NRS_TBF_DEFER_MAX	8
+
+/**
+ * Returns the number of tokens client \a cli has at time \a now.
+ */
+static long nrs_tbf_cli_ntoken(struct nrs_tbf_client *cli, __u64 now)
+{
+	__u64 passed;
+	long  ntoken;
+
+	LASSERT(now >= cli->tc_check_time);
+	passed = now - cli->tc_check_time;
+	ntoken = (passed * cli->tc_rpc_rate) / NSEC_PER_SEC;
+	ntoken += cli->tc_ntoken;
+	if (ntoken > cli->tc_depth)
+		ntoken = cli->tc_depth;
+
+	return ntoken;
+}
+
+/**
+ * Refills the aggregate token bucket of \a rule up to time \a now.
+ */
+static void nrs_tbf_rule_refill(struct nrs_tbf_rule *rule, __u64 now)
+{
+	__u64 ntoken;
+
+	if (now <= rule->tr_agg_check_time)
+		return;
+
+	ntoken = (now - rule->tr_agg_check_time) / rule->tr_nsecs;
+	if (ntoken == 0)
+		return;
+
+	/* Only account whole tokens, so that no fraction of them is lost */
+	rule->tr_agg_check_time += ntoken * rule->tr_nsecs;
+	ntoken += atomic_long_read(&rule->tr_agg_ntoken);
+	if (ntoken >= rule->tr_depth) {
+		ntoken = rule->tr_depth;
+		rule->tr_agg_check_time = now;
+	}
+	atomic_long_set(&rule->tr_agg_ntoken, ntoken);
+}
+
+/**
+ * Checks whether every rule above the clients of \a rule which has children,
+ * including \a rule itself, has an aggregate token left.
+ *
+ * \param[in]  rule  the rule of the client
+ * \param[in]  now   current time
+ * \param[out] until when not ready, the time all the rules get a token
+ *
+ * \retval true  the client may be served
+ * \retval false the client has to wait until \a until
+ */
+static bool nrs_tbf_rule_ancestors_ready(struct nrs_tbf_rule *rule,
+					 __u64 now, __u64 *until)
+{
+	bool ready = true;
+
+	*until = 0;
+	for (; rule != NULL; rule = rule->tr_parent) {
+		if (atomic_read(&rule->tr_nchildren) == 0)
+			continue;
+
+		nrs_tbf_rule_refill(rule, now);
+		if (atomic_long_read(&rule->tr_agg_ntoken) == 0) {
+			ready = false;
+			*until = max(*until,
+				     rule->tr_agg_check_time + rule->tr_nsecs);
+		}
+	}
+
+	return ready;
+}
+
+static void nrs_tbf_rule_ancestors_consume(struct nrs_tbf_rule *rule)
+{
+	for (; rule != NULL; rule = rule->tr_parent) {
+		if (atomic_read(&rule->tr_nchildren) > 0 &&
+		    atomic_long_read(&rule->tr_agg_ntoken) > 0)
+			atomic_long_dec(&rule->tr_agg_ntoken);
+	}
+}
+
+/**
+ * Looks for a queued client which has run out of tokens of its own, but may
+ * borrow the unused ones of its ancestors; only clients of rules with a
+ * parent may borrow. Clients are examined in deadline order, by taking them
+ * off the heap, and are put back afterwards; removals never shrink the
+ * heap, so putting them back cannot fail.
+ */
+static struct nrs_tbf_client *
+nrs_tbf_borrower_find(struct nrs_tbf_head *head, __u64 now)
+{
+	struct nrs_tbf_client *scanned[NRS_TBF_BORROW_SCAN];
+	struct nrs_tbf_client *borrower = NULL;
+	struct nrs_tbf_client *cli;
+	cfs_binheap_node_t    *node;
+	__u64		       until;
+	int		       nscanned;
+	int		       rc;
+
+	nscanned = 0;
+	while (borrower == NULL && nscanned < NRS_TBF_BORROW_SCAN) {
+		node = cfs_binheap_remove_root(head->th_binheap);
+		if (node == NULL)
+			break;
+
+		cli = container_of(node, struct nrs_tbf_client, tc_node);
+		scanned[nscanned++] = cli;
+		if (cli->tc_rule->tr_parent == NULL ||
+		    cli->tc_defer_until > now)
+			continue;
+
+		if (nrs_tbf_rule_ancestors_ready(cli->tc_rule, now, &until))
+			borrower = cli;
+	}
+
+	while (nscanned-- > 0) {
+		rc = cfs_binheap_insert(head->th_binheap,
+					&scanned[nscanned]->tc_node);
+		LASSERT(rc == 0);
+	}
+
+	return borrower;
+}
+
+/**
+ * Removes the first queued request of client \a cli for handling; the token
+ * of the client itself has already been taken by the caller unless
+ * \a borrowed is set.
+ */
+static struct ptlrpc_nrs_request *
+nrs_tbf_cli_dispatch(struct ptlrpc_nrs_policy *policy,
+		     struct nrs_tbf_head *head,
+		     struct nrs_tbf_client *cli,
+		     bool borrowed)
+{
+	struct nrs_tbf_rule	  *rule = cli->tc_rule;
+	struct ptlrpc_nrs_request *nrq;
+	struct ptlrpc_request	  *req;
+
+	nrq = list_entry(cli->tc_list.next, struct ptlrpc_nrs_request,
+			 nr_u.tbf.tr_list);
+	req = container_of(nrq, struct ptlrpc_request, rq_nrq);
+
+	nrs_tbf_rule_ancestors_consume(rule);
+	cli->tc_defer_until = 0;
+	cli->tc_nqueued--;
+	rule->tr_nqueued--;
+	if (borrowed)
+		rule->tr_borrowed++;
+	else
+		rule->tr_dispatched++;
+
+	list_del_init(&nrq->nr_u.tbf.tr_list);
+	if (list_empty(&cli->tc_list)) {
+		cfs_binheap_remove(head->th_binheap, &cli->tc_node);
+		cli->tc_in_heap = false;
+	} else {
+		cfs_binheap_relocate(head->th_binheap, &cli->tc_node);
+	}
+
+	CDEBUG(D_RPCTRACE,
+	       "NRS start %s request from %s, seq: "LPU64"%s\n",
+	       policy->pol_desc->pd_name, libcfs_id2str(req->rq_peer),
+	       nrq->nr_u.tbf.tr_sequence, borrowed ? ", borrowed" : "");
+
+	return nrq;
+}
+
 /**
  * Called when getting a request from the TBF policy for handling, or just
  * peeking; removes the request from the policy when it is to be handled.
  *
+ * The client with the earliest next token is served if it has a token and
+ * all its ancestor rules have aggregate tokens; if an ancestor is exhausted,
+ * the client is held back until that ancestor refills. When no client has
+ * tokens of its own, one whose ancestors have tokens left may borrow them.
+ *
  * \param[in] policy The policy
  * \param[in] peek   When set, signifies that we just want to examine the
  *		     request, and not handle it, so the request is not removed
@@ -1385,46 +2088,60 @@ struct ptlrpc_nrs_request *nrs_tbf_req_get(struct ptlrpc_nrs_policy *policy,
 				     nr_u.tbf.tr_list);
 	} else {
 		__u64 now = ktime_to_ns(ktime_get());
-		__u64 passed;
+		__u64 until;
 		long  ntoken;
-		__u64 deadline;
-
-		deadline = cli->tc_check_time +
-			  cli->tc_nsecs;
-		LASSERT(now >= cli->tc_check_time);
-		passed = now - cli->tc_check_time;
-		ntoken = (passed * cli->tc_rpc_rate) / NSEC_PER_SEC;
-		ntoken += cli->tc_ntoken;
-		if (ntoken > cli->tc_depth)
-			ntoken = cli->tc_depth;
-		if (ntoken > 0) {
-			struct ptlrpc_request *req;
-			nrq = list_entry(cli->tc_list.next,
-					     struct ptlrpc_nrs_request,
-					     nr_u.tbf.tr_list);
-			req = container_of(nrq,
-					   struct ptlrpc_request,
-					   rq_nrq);
-			ntoken--;
-			cli->tc_ntoken = ntoken;
-			cli->tc_check_time = now;
-			list_del_init(&nrq->nr_u.tbf.tr_list);
-			if (list_empty(&cli->tc_list)) {
-				cfs_binheap_remove(head->th_binheap,
-						   &cli->tc_node);
-				cli->tc_in_heap = false;
-			} else {
-				cfs_binheap_relocate(head->th_binheap,
-						     &cli->tc_node);
+		int   i;
+
+		for (i = 0; i < NRS_TBF_DEFER_MAX; i++) {
+			/* Every client left is waiting for a token, or has
+			 * already been held back, maybe in this very loop */
+			if (cli->tc_defer_until > now)
+				break;
+
+			ntoken = nrs_tbf_cli_ntoken(cli, now);
+			if (ntoken <= 0)
+				break;
+
+			if (nrs_tbf_rule_ancestors_ready(cli->tc_rule, now,
+							 &until)) {
+				ntoken--;
+				cli->tc_ntoken = ntoken;
+				cli->tc_check_time = now;
+				nrq = nrs_tbf_cli_dispatch(policy, head, cli,
+							   false);
+				break;
+			}
+
+			/* Held back by an ancestor, let the others go first */
+			cli->tc_defer_until = until;
+			cli->tc_rule->tr_deferred++;
+			cfs_binheap_relocate(head->th_binheap, &cli->tc_node);
+			node = cfs_binheap_root(head->th_binheap);
+			cli = container_of(node, struct nrs_tbf_client,
+					   tc_node);
+		}
+
+		if (nrq == NULL) {
+			cli = nrs_tbf_borrower_find(head, now);
+			if (cli != NULL) {
+				ntoken = nrs_tbf_cli_ntoken(cli, now);
+				if (ntoken > 0) {
+					cli->tc_ntoken = ntoken - 1;
+					cli->tc_check_time = now;
+				}
+				nrq = nrs_tbf_cli_dispatch(policy, head, cli,
+							   ntoken <= 0);
 			}
-			CDEBUG(D_RPCTRACE,
-			       "NRS start %s request from %s, "
-			       "seq: "LPU64"\n",
-			       policy->pol_desc->pd_name,
-			       libcfs_id2str(req->rq_peer),
-			       nrq->nr_u.tbf.tr_sequence);
-		} else {
+		}
+
+		if (nrq == NULL) {
 			ktime_t time;
+			__u64	deadline;
+
+			node = cfs_binheap_root(head->th_binheap);
+			cli = container_of(node, struct nrs_tbf_client,
+					   tc_node);
+			deadline = nrs_tbf_cli_deadline(cli);
 
 			spin_lock(&policy->pol_nrs->nrs_lock);
 			policy->pol_nrs->nrs_throttling = 1;
@@ -1463,15 +2180,17 @@ static int nrs_tbf_req_add(struct ptlrpc_nrs_policy *policy,
 			    struct nrs_tbf_head, th_res);
 	if (list_empty(&cli->tc_list)) {
 		LASSERT(!cli->tc_in_heap);
+		cli->tc_defer_until = 0;
 		rc = cfs_binheap_insert(head->th_binheap, &cli->tc_node);
 		if (rc == 0) {
 			cli->tc_in_heap = true;
+			cli->tc_nqueued++;
+			cli->tc_rule->tr_nqueued++;
 			nrq->nr_u.tbf.tr_sequence = head->th_sequence++;
 			list_add_tail(&nrq->nr_u.tbf.tr_list,
 					  &cli->tc_list);
 			if (policy->pol_nrs->nrs_throttling) {
-				__u64 deadline = cli->tc_check_time +
-						 cli->tc_nsecs;
+				__u64 deadline = nrs_tbf_cli_deadline(cli);
 				if ((head->th_deadline > deadline) &&
 				    (hrtimer_try_to_cancel(&head->th_timer)
 				     >= 0)) {
@@ -1486,6 +2205,8 @@ static int nrs_tbf_req_add(struct ptlrpc_nrs_policy *policy,
 		}
 	} else {
 		LASSERT(cli->tc_in_heap);
+		cli->tc_nqueued++;
+		cli->tc_rule->tr_nqueued++;
 		nrq->nr_u.tbf.tr_sequence = head->th_sequence++;
 		list_add_tail(&nrq->nr_u.tbf.tr_list,
 				  &cli->tc_list);
@@ -1514,6 +2235,8 @@ static void nrs_tbf_req_del(struct ptlrpc_nrs_policy *policy,
 
 	LASSERT(!list_empty(&nrq->nr_u.tbf.tr_list));
 	list_del_init(&nrq->nr_u.tbf.tr_list);
+	cli->tc_nqueued--;
+	cli->tc_rule->tr_nqueued--;
 	if (list_empty(&cli->tc_list)) {
 		cfs_binheap_remove(head->th_binheap,
 				   &cli->tc_node);
@@ -1653,6 +2376,51 @@ out:
 	return rc;
 }
 
+/**
+ * Parses a rule expression of the generic type, e.g.
+ * "opcode={ost_read ost_write}&uid={500}"; braces may contain spaces, the
+ * expression ends at the first space outside of them.
+ */
+static int nrs_tbf_expr_parse(struct nrs_tbf_cmd *cmd, char **val)
+{
+	struct list_head  conds;
+	char		 *str = *val;
+	char		 *p;
+	int		  depth = 0;
+	int		  rc;
+
+	for (p = str; *p != '\0'; p++) {
+		if (*p == '{')
+			depth++;
+		else if (*p == '}' && --depth < 0)
+			return -EINVAL;
+		else if (*p == ' ' && depth == 0)
+			break;
+	}
+	if (depth != 0 || p == str)
+		return -EINVAL;
+
+	if (*p == ' ') {
+		*p = '\0';
+		*val = p + 1;
+	} else {
+		*val = NULL;
+	}
+
+	/* Only validate here, the rule parses its own copy */
+	rc = nrs_tbf_conds_parse(str, &conds);
+	if (rc)
+		return rc;
+	nrs_tbf_conds_free(&conds);
+
+	OBD_ALLOC(cmd->tc_conds_str, strlen(str) + 1);
+	if (cmd->tc_conds_str == NULL)
+		return -ENOMEM;
+	memcpy(cmd->tc_conds_str, str, strlen(str));
+	cmd->tc_valid_types |= NRS_TBF_FLAG_GENERIC;
+
+	return 0;
+}
 
 static void nrs_tbf_cmd_fini(struct nrs_tbf_cmd *cmd)
 {
@@ -1660,6 +2428,23 @@ static void nrs_tbf_cmd_fini(struct nrs_tbf_cmd *cmd)
 		nrs_tbf_jobid_cmd_fini(cmd);
 	if (cmd->tc_valid_types & NRS_TBF_FLAG_NID)
 		nrs_tbf_nid_cmd_fini(cmd);
+	if (cmd->tc_valid_types & NRS_TBF_FLAG_GENERIC)
+		nrs_tbf_generic_cmd_fini(cmd);
+}
+
+static int nrs_tbf_name_check(const char *name)
+{
+	int i;
+
+	if (strlen(name) == 0 || strlen(name) >= MAX_TBF_NAME)
+		return -EINVAL;
+
+	for (i = 0; i < strlen(name); i++) {
+		if ((!isalnum(name[i])) &&
+		    (name[i] != '_'))
+			return -EINVAL;
+	}
+	return 0;
 }
 
 static struct nrs_tbf_cmd *
@@ -1668,7 +2453,7 @@ nrs_tbf_parse_cmd(char *buffer, unsigned long count)
 	static struct nrs_tbf_cmd *cmd;
 	char			  *token;
 	char			  *val;
-	int			   i;
+	bool			   has_rate = false;
 	int			   rc = 0;
 
 	OBD_ALLOC_PTR(cmd);
@@ -1701,31 +2486,51 @@ nrs_tbf_parse_cmd(char *buffer, unsigned long count)
 			GOTO(out_free_cmd, rc = -EINVAL);
 	}
 
-	for (i = 0; i < strlen(token); i++) {
-		if ((!isalnum(token[i])) &&
-		    (token[i] != '_'))
-			GOTO(out_free_cmd, rc = -EINVAL);
-	}
+	if (nrs_tbf_name_check(token))
+		GOTO(out_free_cmd, rc = -EINVAL);
 	cmd->tc_name = token;
 
 	if (cmd->tc_cmd == NRS_CTL_TBF_START_RULE) {
-		/* List of ID */
+		/* List of ID, or expression of the generic type */
 		LASSERT(val);
-		rc = nrs_tbf_id_parse(cmd, &val);
+		if (val[0] == '{')
+			rc = nrs_tbf_id_parse(cmd, &val);
+		else
+			rc = nrs_tbf_expr_parse(cmd, &val);
 		if (rc)
-			GOTO(out_free_cmd, rc);
+			GOTO(out_free_nid, rc);
 	}
 
-	if (val != NULL) {
+	/* Optional "[rate=]<rate>" and, for start, "parent=<rule>" */
+	while (val != NULL) {
+		token = strsep(&val, " ");
+		if (strlen(token) == 0)
+			continue;
+
+		if (strncmp(token, "parent=", 7) == 0) {
+			token += 7;
+			if (cmd->tc_cmd != NRS_CTL_TBF_START_RULE ||
+			    nrs_tbf_name_check(token) ||
+			    strcmp(token, cmd->tc_name) == 0)
+				GOTO(out_free_nid, rc = -EINVAL);
+			cmd->tc_parent = token;
+			continue;
+		}
+
+		if (strncmp(token, "rate=", 5) == 0)
+			token += 5;
 		if (cmd->tc_cmd == NRS_CTL_TBF_STOP_RULE ||
-		    strlen(val) == 0 || !isdigit(val[0]))
+		    has_rate || !isdigit(token[0]))
 			GOTO(out_free_nid, rc = -EINVAL);
 
-		cmd->tc_rpc_rate = simple_strtoull(val, NULL, 10);
+		cmd->tc_rpc_rate = simple_strtoull(token, NULL, 10);
 		if (cmd->tc_rpc_rate <= 0 ||
 		    cmd->tc_rpc_rate >= LPROCFS_NRS_RATE_MAX)
 			GOTO(out_free_nid, rc = -EINVAL);
-	} else {
+		has_rate = true;
+	}
+
+	if (!has_rate) {
 		if (cmd->tc_cmd == NRS_CTL_TBF_CHANGE_RATE)
 			GOTO(out_free_nid, rc = -EINVAL);
 		/* No RPC rate given */
@@ -1767,6 +2572,8 @@ ptlrpc_lprocfs_nrs_tbf_rule_seq_write(struct file *file, const char *buffer,
 
 	if (copy_from_user(kernbuf, buffer, count))
 		GOTO(out_free_kernbuff, rc = -EFAULT);
+	if (count > 0 && kernbuf[count - 1] == '\n')
+		kernbuf[count - 1] = '\0';
 
 	val = kernbuf;
 	token = strsep(&val, " ");
@@ -326,6 +326,82 @@ void lustre_put_emerg_rs(struct ptlrpc_reply_state *rs)
 	wake_up(&svcpt->scp_rep_waitq);
 }
 
+/**
+ * Takes a reply state of at least \a rs_size bytes for \a req from the reply
+ * state cache of its service partition, or allocates one of the cached size
+ * on the CPT of the partition if the cache is empty.
+ *
+ * \retval NULL if \a rs_size is too large for the cache or out of memory, the
+ *	       caller then allocates the reply state itself.
+ */
+struct ptlrpc_reply_state *
+lustre_get_pool_rs(struct ptlrpc_request *req, int rs_size)
+{
+	struct ptlrpc_service_part	*svcpt;
+	struct ptlrpc_svc_pool		*pool;
+	struct ptlrpc_reply_state	*rs = NULL;
+
+	if (req->rq_rqbd == NULL)
+		return NULL;
+
+	svcpt = req->rq_rqbd->rqbd_svcpt;
+	pool = &svcpt->scp_pool;
+
+	spin_lock(&pool->sp_lock);
+	if (rs_size > pool->sp_rs_size) {
+		pool->sp_rs_large++;
+		spin_unlock(&pool->sp_lock);
+		return NULL;
+	}
+
+	if (list_empty(&pool->sp_rss)) {
+		pool->sp_rs_misses++;
+	} else {
+		rs = list_entry(pool->sp_rss.next, struct ptlrpc_reply_state,
+				rs_list);
+		list_del(&rs->rs_list);
+		pool->sp_nrss--;
+		pool->sp_rs_hits++;
+	}
+	spin_unlock(&pool->sp_lock);
+
+	if (rs != NULL) {
+		memset(rs, 0, rs_size);
+	} else {
+		OBD_CPT_ALLOC_LARGE(rs, svcpt->scp_service->srv_cptable,
+				    svcpt->scp_cpt, pool->sp_rs_size);
+		if (rs == NULL)
+			return NULL;
+	}
+
+	rs->rs_svcpt = svcpt;
+	/* keeps the policy from freeing it */
+	rs->rs_prealloc = 1;
+	rs->rs_pooled = 1;
+	return rs;
+}
+EXPORT_SYMBOL(lustre_get_pool_rs);
+
+/**
+ * Returns reply state \a rs taken by lustre_get_pool_rs() to the cache, or
+ * frees it if the cache is full.
+ */
+void lustre_put_pool_rs(struct ptlrpc_reply_state *rs)
+{
+	struct ptlrpc_svc_pool *pool = &rs->rs_svcpt->scp_pool;
+
+	spin_lock(&pool->sp_lock);
+	if (pool->sp_nrss < pool->sp_nrss_max) {
+		list_add(&rs->rs_list, &pool->sp_rss);
+		pool->sp_nrss++;
+		rs = NULL;
+	}
+	spin_unlock(&pool->sp_lock);
+
+	if (rs != NULL)
+		OBD_FREE_LARGE(rs, pool->sp_rs_size);
+}
+
 int lustre_pack_reply_v2(struct ptlrpc_request *req, int count,
                          __u32 *lens, char **bufs, int flags)
 {
@@ -1112,6 +1188,24 @@ __u64 lustre_msg_get_transno(struct lustre_msg *msg)
 }
 EXPORT_SYMBOL(lustre_msg_get_transno);
 
+__u64 lustre_msg_get_prev_transno(struct lustre_msg *msg)
+{
+	switch (msg->lm_magic) {
+	case LUSTRE_MSG_MAGIC_V2: {
+		struct ptlrpc_body *pb = lustre_msg_ptlrpc_body(msg);
+		if (!pb) {
+			CERROR("invalid msg %p: no ptlrpc body!\n", msg);
+			return 0;
+		}
+		return pb->pb_prev_transno;
+	}
+	default:
+		CERROR("incorrect message magic: %08x\n", msg->lm_magic);
+		return 0;
+	}
+}
+EXPORT_SYMBOL(lustre_msg_get_prev_transno);
+
 int lustre_msg_get_status(struct lustre_msg *msg)
 {
         switch (msg->lm_magic) {
@@ -1313,6 +1407,111 @@ char *lustre_msg_get_jobid(struct lustre_msg *msg)
 }
 EXPORT_SYMBOL(lustre_msg_get_jobid);
 
+static int ptlrpc_req_ugid_reint(struct lustre_msg *msg, int offset, int swab,
+				 __u32 *uid, __u32 *gid)
+{
+	struct mdt_rec_reint *rec;
+
+	if (lustre_msg_buflen(msg, offset) < sizeof(*rec))
+		return -ENODATA;
+
+	rec = lustre_msg_buf(msg, offset, sizeof(*rec));
+	*uid = swab ? __swab32(rec->rr_fsuid) : rec->rr_fsuid;
+	*gid = swab ? __swab32(rec->rr_fsgid) : rec->rr_fsgid;
+	return 0;
+}
+
+static int ptlrpc_req_ugid_body(struct lustre_msg *msg, int offset, int swab,
+				__u32 *uid, __u32 *gid)
+{
+	struct mdt_body *b;
+
+	if (lustre_msg_buflen(msg, offset) < sizeof(*b))
+		return -ENODATA;
+
+	b = lustre_msg_buf(msg, offset, sizeof(*b));
+	*uid = swab ? __swab32(b->mbo_fsuid) : b->mbo_fsuid;
+	*gid = swab ? __swab32(b->mbo_fsgid) : b->mbo_fsgid;
+	return 0;
+}
+
+/**
+ * Finds out which user an incoming RPC is issued on behalf of, by peeking at
+ * the request record of the opcodes that carry credentials. This is meant for
+ * classifying requests (e.g. by NRS policies) before they are unpacked by the
+ * service handler, so buffers other than the ptlrpc_body are still in sender
+ * byte order.
+ *
+ * \param[in]  req the incoming request
+ * \param[out] uid the fsuid of the caller
+ * \param[out] gid the fsgid of the caller
+ *
+ * \retval 0	    uid and gid have been filled in
+ * \retval -ENODATA the request carries no credentials
+ */
+int ptlrpc_req_get_ugid(struct ptlrpc_request *req, __u32 *uid, __u32 *gid)
+{
+	struct lustre_msg	*msg = req->rq_reqmsg;
+	int			 swab = ptlrpc_req_need_swab(req);
+
+	if (msg->lm_magic != LUSTRE_MSG_MAGIC_V2)
+		return -ENODATA;
+
+	switch (lustre_msg_get_opc(msg)) {
+	case LDLM_ENQUEUE: {
+		struct ldlm_intent	*it;
+		__u64			 it_opc;
+
+		if (lustre_msg_bufcount(msg) <= DLM_INTENT_REC_OFF ||
+		    lustre_msg_buflen(msg, DLM_INTENT_IT_OFF) < sizeof(*it))
+			return -ENODATA;
+
+		it = lustre_msg_buf(msg, DLM_INTENT_IT_OFF, sizeof(*it));
+		it_opc = swab ? __swab64(it->opc) : it->opc;
+		if (it_opc & (IT_OPEN | IT_CREAT))
+			return ptlrpc_req_ugid_reint(msg, DLM_INTENT_REC_OFF,
+						     swab, uid, gid);
+		if (it_opc & (IT_GETATTR | IT_LOOKUP))
+			return ptlrpc_req_ugid_body(msg, DLM_INTENT_REC_OFF,
+						    swab, uid, gid);
+		return -ENODATA;
+	}
+	case MDS_REINT:
+		return ptlrpc_req_ugid_reint(msg, REQ_REC_OFF, swab, uid, gid);
+	case MDS_GETATTR:
+	case MDS_GETATTR_NAME:
+	case MDS_GETXATTR:
+	case MDS_READPAGE:
+	case MDS_SYNC:
+		return ptlrpc_req_ugid_body(msg, REQ_REC_OFF, swab, uid, gid);
+	case OST_READ:
+	case OST_WRITE:
+	case OST_PUNCH:
+	case OST_SETATTR:
+	case OST_GETATTR:
+	case OST_SYNC: {
+		struct ost_body	*b;
+		obd_valid	 valid;
+
+		if (lustre_msg_buflen(msg, REQ_REC_OFF) < sizeof(*b))
+			return -ENODATA;
+
+		b = lustre_msg_buf(msg, REQ_REC_OFF, sizeof(*b));
+		valid = swab ? __swab64(b->oa.o_valid) : b->oa.o_valid;
+		if ((valid & (OBD_MD_FLUID | OBD_MD_FLGID)) !=
+		    (OBD_MD_FLUID | OBD_MD_FLGID))
+			return -ENODATA;
+
+		*uid = swab ? __swab32(b->oa.o_uid) : b->oa.o_uid;
+		*gid = swab ? __swab32(b->oa.o_gid) : b->oa.o_gid;
+		return 0;
+	}
+	default:
+		return -ENODATA;
+	}
+}
+EXPORT_SYMBOL(ptlrpc_req_get_ugid);
+
 __u32 lustre_msg_get_cksum(struct lustre_msg *msg)
 {
         switch (msg->lm_magic) {
@@ -1472,6 +1671,21 @@ void lustre_msg_set_transno(struct lustre_msg *msg, __u64 transno)
 }
 EXPORT_SYMBOL(lustre_msg_set_transno);
 
+void lustre_msg_set_prev_transno(struct lustre_msg *msg, __u64 transno)
+{
+	switch (msg->lm_magic) {
+	case LUSTRE_MSG_MAGIC_V2: {
+		struct ptlrpc_body *pb = lustre_msg_ptlrpc_body(msg);
+		LASSERTF(pb, "invalid msg %p: no ptlrpc body!\n", msg);
+		pb->pb_prev_transno = transno;
+		return;
+	}
+	default:
+		LASSERTF(0, "incorrect message magic: %08x\n", msg->lm_magic);
+	}
+}
+EXPORT_SYMBOL(lustre_msg_set_prev_transno);
+
 void lustre_msg_set_status(struct lustre_msg *msg, __u32 status)
 {
         switch (msg->lm_magic) {
@@ -1650,6 +1864,12 @@ EXPORT_SYMBOL(do_set_info_async);
 /* byte flipping routines for all wire types declared in
  * lustre_idl.h implemented here.
  */
+void lustre_swab_lustre_handle(struct lustre_handle *lh)
+{
+	__swab64s(&lh->cookie);
+}
+EXPORT_SYMBOL(lustre_swab_lustre_handle);
+
 void lustre_swab_ptlrpc_body(struct ptlrpc_body *b)
 {
         __swab32s (&b->pb_type);
@@ -1671,6 +1891,7 @@ void lustre_swab_ptlrpc_body(struct ptlrpc_body *b)
         __swab64s (&b->pb_pre_versions[1]);
         __swab64s (&b->pb_pre_versions[2]);
         __swab64s (&b->pb_pre_versions[3]);
+	__swab64s(&b->pb_prev_transno);
         CLASSERT(offsetof(typeof(*b), pb_padding) != 0);
 	/* While we need to maintain compatibility between
 	 * clients and servers without ptlrpc_body_v2 (< 2.3)
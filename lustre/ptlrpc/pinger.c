@@ -113,6 +113,150 @@ int ptlrpc_ping(struct obd_import *imp)
         RETURN(0);
 }
 
+/**
+ * Imports due for a ping which share a connection to the same server. One
+ * ping is sent on behalf of all of them.
+ */
+struct ptlrpc_ping_batch {
+	struct list_head	 pb_linkage;
+	/** the import sending the ping comes first */
+	struct obd_import	*pb_imps[PING_BATCH_MAX + 1];
+	int			 pb_count;
+};
+
+struct ptlrpc_ping_batch_args {
+	struct ptlrpc_ping_batch *pba_batch;
+};
+
+static void ptlrpc_ping_batch_free(struct ptlrpc_ping_batch *pb)
+{
+	int i;
+
+	for (i = 0; i < pb->pb_count; i++)
+		class_import_put(pb->pb_imps[i]);
+	OBD_FREE_PTR(pb);
+}
+
+/**
+ * Add \a imp to the batch of pings to its server, or ping it right away if
+ * it can't be batched.
+ */
+static void ptlrpc_ping_batch_add(struct list_head *batches,
+				  struct obd_import *imp)
+{
+	struct ptlrpc_ping_batch *pb;
+
+	list_for_each_entry(pb, batches, pb_linkage) {
+		if (pb->pb_imps[0]->imp_connection == imp->imp_connection &&
+		    pb->pb_count <= PING_BATCH_MAX)
+			goto add;
+	}
+
+	OBD_ALLOC_PTR(pb);
+	if (pb == NULL) {
+		ptlrpc_ping(imp);
+		return;
+	}
+	list_add_tail(&pb->pb_linkage, batches);
+add:
+	pb->pb_imps[pb->pb_count++] = class_import_get(imp);
+}
+
+static int ptlrpc_ping_batch_interpret(const struct lu_env *env,
+				       struct ptlrpc_request *req,
+				       void *data, int rc)
+{
+	struct ptlrpc_ping_batch_args	*aa = data;
+	struct ptlrpc_ping_batch	*pb = aa->pba_batch;
+	struct obd_import		*imp;
+	__u32				*status = NULL;
+	bool				 wake = false;
+	int				 i;
+
+	if (rc == 0 &&
+	    req_capsule_get_size(&req->rq_pill, &RMF_OBD_PING_STATUS,
+				 RCL_SERVER) >=
+	    (pb->pb_count - 1) * sizeof(*status))
+		status = req_capsule_server_get(&req->rq_pill,
+						&RMF_OBD_PING_STATUS);
+
+	for (i = 0; i < pb->pb_count; i++) {
+		imp = pb->pb_imps[i];
+		spin_lock(&imp->imp_lock);
+		/* an old server ignores the batched handles */
+		if (rc == 0 && status == NULL)
+			imp->imp_no_ping_batch = 1;
+		/* the server didn't vouch for this import, it has to ping on
+		 * its own */
+		if (i > 0 && (status == NULL || status[i - 1] != 0)) {
+			imp->imp_force_verify = 1;
+			wake = true;
+		}
+		spin_unlock(&imp->imp_lock);
+	}
+
+	if (wake)
+		ptlrpc_pinger_wake_up();
+
+	ptlrpc_ping_batch_free(pb);
+	return 0;
+}
+
+/**
+ * Send one ping for all the imports of a batch. The server refreshes its
+ * exports for the other imports and tells which of them it doesn't know.
+ */
+static void ptlrpc_ping_batch_send(struct ptlrpc_ping_batch *pb)
+{
+	struct ptlrpc_ping_batch_args	*aa;
+	struct ptlrpc_request		*req;
+	struct lustre_handle		*handles;
+	struct obd_import		*imp = pb->pb_imps[0];
+	int				 i;
+
+	if (pb->pb_count == 1)
+		goto fallback;
+
+	req = ptlrpc_request_alloc(imp, &RQF_OBD_PING_BATCH);
+	if (req == NULL)
+		goto fallback;
+
+	req_capsule_set_size(&req->rq_pill, &RMF_OBD_PING_HANDLES, RCL_CLIENT,
+			     (pb->pb_count - 1) * sizeof(*handles));
+	if (ptlrpc_request_pack(req, LUSTRE_OBD_VERSION, OBD_PING) != 0) {
+		ptlrpc_request_free(req);
+		goto fallback;
+	}
+
+	handles = req_capsule_client_get(&req->rq_pill, &RMF_OBD_PING_HANDLES);
+	for (i = 1; i < pb->pb_count; i++) {
+		lustre_handle_copy(&handles[i - 1],
+				   &pb->pb_imps[i]->imp_remote_handle);
+		/* covered by this ping */
+		ptlrpc_update_next_ping(pb->pb_imps[i], 0);
+	}
+
+	req_capsule_set_size(&req->rq_pill, &RMF_OBD_PING_STATUS, RCL_SERVER,
+			     (pb->pb_count - 1) * sizeof(__u32));
+	ptlrpc_request_set_replen(req);
+	req->rq_no_resend = req->rq_no_delay = 1;
+	req->rq_interpret_reply = ptlrpc_ping_batch_interpret;
+	CLASSERT(sizeof(*aa) <= sizeof(req->rq_async_args));
+	aa = ptlrpc_req_async_args(req);
+	aa->pba_batch = pb;
+
+	DEBUG_REQ(D_INFO, req, "pinging %s->%s for %d imports",
+		  imp->imp_obd->obd_uuid.uuid, obd2cli_tgt(imp->imp_obd),
+		  pb->pb_count);
+	ptlrpcd_add_req(req, PDL_POLICY_ROUND, -1);
+	return;
+
+fallback:
+	for (i = 0; i < pb->pb_count; i++)
+		ptlrpc_ping(pb->pb_imps[i]);
+	ptlrpc_ping_batch_free(pb);
+}
+
 void ptlrpc_update_next_ping(struct obd_import *imp, int soon)
 {
 #ifdef ENABLE_PINGER
@@ -182,13 +326,21 @@ void ptlrpc_pinger_ir_down(void)
 }
 EXPORT_SYMBOL(ptlrpc_pinger_ir_down);
 
-static void ptlrpc_pinger_process_import(struct obd_import *imp,
-                                         unsigned long this_ping)
+/**
+ * Check if \a imp needs to be pinged, or to be recovered.
+ *
+ * \retval 1 a regular ping is due, which may be batched with pings of other
+ *	     imports to the same server
+ * \retval 0 otherwise
+ */
+static int ptlrpc_pinger_process_import(struct obd_import *imp,
+					unsigned long this_ping)
 {
 	int level;
 	int force;
 	int force_next;
 	int suppress;
+	int no_batch;
 
 	spin_lock(&imp->imp_lock);
 
@@ -199,13 +351,14 @@ static void ptlrpc_pinger_process_import(struct obd_import *imp,
 	 * This will be used below only if the import is "FULL".
 	 */
 	suppress = ir_up && OCD_HAS_FLAG(&imp->imp_connect_data, PINGLESS);
+	no_batch = imp->imp_no_ping_batch;
 
 	imp->imp_force_verify = 0;
 
 	if (cfs_time_aftereq(imp->imp_next_ping - 5 * CFS_TICK, this_ping) &&
 	    !force) {
 		spin_unlock(&imp->imp_lock);
-		return;
+		return 0;
 	}
 
 	imp->imp_force_next_verify = 0;
@@ -235,9 +388,17 @@ static void ptlrpc_pinger_process_import(struct obd_import *imp,
 			imp->imp_force_verify = 1;
 			spin_unlock(&imp->imp_lock);
 		}
-	} else if ((imp->imp_pingable && !suppress) || force_next || force) {
+	} else if (force_next || force) {
+		/* forced pings are meant for this very import, e.g. to learn
+		 * its last committed transno, don't batch them */
 		ptlrpc_ping(imp);
+	} else if (imp->imp_pingable && !suppress) {
+		if (no_batch)
+			ptlrpc_ping(imp);
+		else
+			return 1;
 	}
+	return 0;
 }
 
 static int ptlrpc_pinger_main(void *arg)
@@ -256,6 +417,9 @@ static int ptlrpc_pinger_main(void *arg)
 		cfs_duration_t time_to_next_wake;
 		struct timeout_item *item;
 		struct list_head *iter;
+		struct ptlrpc_ping_batch *pb;
+		struct ptlrpc_ping_batch *pb_next;
+		struct list_head batches = LIST_HEAD_INIT(batches);
 
 		mutex_lock(&pinger_mutex);
 		list_for_each_entry(item, &timeout_list, ti_chain)
@@ -266,7 +430,8 @@ static int ptlrpc_pinger_main(void *arg)
 							    struct obd_import,
 							    imp_pinger_chain);
 
-                        ptlrpc_pinger_process_import(imp, this_ping);
+			if (ptlrpc_pinger_process_import(imp, this_ping))
+				ptlrpc_ping_batch_add(&batches, imp);
                         /* obd_timeout might have changed */
                         if (imp->imp_pingable && imp->imp_next_ping &&
                             cfs_time_after(imp->imp_next_ping,
@@ -274,6 +439,10 @@ static int ptlrpc_pinger_main(void *arg)
                                                         cfs_time_seconds(PING_INTERVAL))))
                                 ptlrpc_update_next_ping(imp, 0);
                 }
+		list_for_each_entry_safe(pb, pb_next, &batches, pb_linkage) {
+			list_del(&pb->pb_linkage);
+			ptlrpc_ping_batch_send(pb);
+		}
 		mutex_unlock(&pinger_mutex);
                 /* update memory usage info */
                 obd_update_maxusage();
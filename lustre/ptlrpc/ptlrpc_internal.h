@@ -50,6 +50,8 @@ extern struct list_head ptlrpc_all_services;
 extern struct mutex ptlrpc_all_services_mutex;
 
 int ptlrpc_start_thread(struct ptlrpc_service_part *svcpt, int wait);
+struct ptlrpc_request *
+ptlrpc_svcpt_req_alloc(struct ptlrpc_service_part *svcpt);
 /* ptlrpcd.c */
 int ptlrpcd_start(int index, int max, const char *name, struct ptlrpcd_ctl *pc);
 
@@ -59,6 +61,9 @@ struct ptlrpc_bulk_desc *ptlrpc_new_bulk(unsigned npages, unsigned max_brw,
 int ptlrpc_request_cache_init(void);
 void ptlrpc_request_cache_fini(void);
 struct ptlrpc_request *ptlrpc_request_cache_alloc(gfp_t flags);
+struct ptlrpc_request *
+ptlrpc_request_cache_cpt_alloc(struct cfs_cpt_table *cptab, int cpt,
+			       gfp_t flags);
 void ptlrpc_request_cache_free(struct ptlrpc_request *req);
 void ptlrpc_init_xid(void);
 
@@ -239,6 +244,7 @@ void ptlrpc_add_bulk_page(struct ptlrpc_bulk_desc *desc, struct page *page,
 struct ptlrpc_reply_state *
 lustre_get_emerg_rs(struct ptlrpc_service_part *svcpt);
 void lustre_put_emerg_rs(struct ptlrpc_reply_state *rs);
+void lustre_put_pool_rs(struct ptlrpc_reply_state *rs);
 
 /* pinger.c */
 int ptlrpc_start_pinger(void);
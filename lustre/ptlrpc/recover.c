@@ -65,48 +65,21 @@ void ptlrpc_initiate_recovery(struct obd_import *imp)
         EXIT;
 }
 
+static int replay_window = 1;
+CFS_MODULE_PARM(replay_window, "i", int, 0644,
+		"number of replayed requests a client keeps in flight; "
+		"values above 1 need servers which look at the previous "
+		"transno sent with each replay to detect transno gaps");
+
 /**
- * Identify what request from replay list needs to be replayed next
- * (based on what we have already replayed) and send it to server.
+ * Find the first request which has not been sent for replay yet, i.e. with
+ * a transno above \a last_transno. Called with imp_lock held.
  */
-int ptlrpc_replay_next(struct obd_import *imp, int *inflight)
+static struct ptlrpc_request *ptlrpc_replay_find(struct obd_import *imp,
+						 __u64 last_transno)
 {
-        int rc = 0;
-	struct list_head *tmp, *pos;
-        struct ptlrpc_request *req = NULL;
-        __u64 last_transno;
-        ENTRY;
-
-        *inflight = 0;
-
-        /* It might have committed some after we last spoke, so make sure we
-         * get rid of them now.
-         */
-	spin_lock(&imp->imp_lock);
-	imp->imp_last_transno_checked = 0;
-	ptlrpc_free_committed(imp);
-	last_transno = imp->imp_last_replay_transno;
-	spin_unlock(&imp->imp_lock);
-
-        CDEBUG(D_HA, "import %p from %s committed "LPU64" last "LPU64"\n",
-               imp, obd2cli_tgt(imp->imp_obd),
-               imp->imp_peer_committed_transno, last_transno);
-
-        /* Do I need to hold a lock across this iteration?  We shouldn't be
-         * racing with any additions to the list, because we're in recovery
-         * and are therefore not processing additional requests to add.  Calls
-         * to ptlrpc_free_committed might commit requests, but nothing "newer"
-         * than the one we're replaying (it can't be committed until it's
-         * replayed, and we're doing that here).  l_f_e_safe protects against
-         * problems with the current request being committed, in the unlikely
-         * event of that race.  So, in conclusion, I think that it's safe to
-         * perform this list-walk without the imp_lock held.
-         *
-         * But, the {mdc,osc}_replay_open callbacks both iterate
-         * request lists, and have comments saying they assume the
-         * imp_lock is being held by ptlrpc_replay, but it's not. it's
-         * just a little race...
-         */
+	struct ptlrpc_request *req = NULL;
+	struct list_head *tmp;
 
 	/* Replay all the committed open requests on committed_list first */
 	if (!list_empty(&imp->imp_committed_list)) {
@@ -143,7 +116,7 @@ int ptlrpc_replay_next(struct obd_import *imp, int *inflight)
 	/* All the requests in committed list have been replayed, let's replay
 	 * the imp_replay_list */
 	if (req == NULL) {
-		list_for_each_safe(tmp, pos, &imp->imp_replay_list) {
+		list_for_each(tmp, &imp->imp_replay_list) {
 			req = list_entry(tmp, struct ptlrpc_request,
 					     rq_replay_list);
 
@@ -153,18 +126,82 @@ int ptlrpc_replay_next(struct obd_import *imp, int *inflight)
 		}
 	}
 
-	/* If need to resend the last sent transno (because a reconnect
-	 * has occurred), then stop on the matching req and send it again.
-	 * If, however, the last sent transno has been committed then we 
-	 * continue replay from the next request. */
-	if (req != NULL && imp->imp_resend_replay)
-		lustre_msg_add_flags(req->rq_reqmsg, MSG_RESENT);
+	return req;
+}
+
+/**
+ * Identify what requests from replay list need to be replayed next
+ * (based on what we have already sent) and send them to server, keeping
+ * up to replay_window of them in flight. The server still handles them in
+ * transno order.
+ */
+int ptlrpc_replay_next(struct obd_import *imp, int *inflight)
+{
+        int rc = 0;
+        struct ptlrpc_request *req = NULL;
+	__u64 prev;
+	int resent;
+        ENTRY;
+
+        *inflight = 0;
 
+        /* It might have committed some after we last spoke, so make sure we
+         * get rid of them now.
+         */
 	spin_lock(&imp->imp_lock);
-	imp->imp_resend_replay = 0;
+	imp->imp_last_transno_checked = 0;
+	ptlrpc_free_committed(imp);
+
+	/* If need to resend the replays sent before a reconnect, wait for all
+	 * of them to come back and restart from the last replayed transno.
+	 * Replays which have been committed meanwhile are skipped. */
+	if (imp->imp_resend_replay) {
+		if (atomic_read(&imp->imp_replay_inflight) > 0) {
+			spin_unlock(&imp->imp_lock);
+			RETURN(0);
+		}
+		imp->imp_replay_resend_transno = imp->imp_replay_sent_transno;
+		imp->imp_replay_sent_transno = imp->imp_last_replay_transno;
+		imp->imp_replay_cursor = &imp->imp_committed_list;
+		imp->imp_resend_replay = 0;
+	}
+	if (imp->imp_replay_sent_transno < imp->imp_last_replay_transno)
+		imp->imp_replay_sent_transno = imp->imp_last_replay_transno;
 	spin_unlock(&imp->imp_lock);
 
-        if (req != NULL) {
+        CDEBUG(D_HA, "import %p from %s committed "LPU64" last "LPU64
+	       " sent "LPU64"\n", imp, obd2cli_tgt(imp->imp_obd),
+	       imp->imp_peer_committed_transno, imp->imp_last_replay_transno,
+	       imp->imp_replay_sent_transno);
+
+	/* The {mdc,osc}_replay_open callbacks iterate request lists and
+	 * assume the imp_lock is held by ptlrpc_replay, which it is not;
+	 * pick the requests under imp_lock, so that concurrent callers don't
+	 * send the same request twice, but send them without it. */
+	while (1) {
+		spin_lock(&imp->imp_lock);
+		if (atomic_read(&imp->imp_replay_inflight) >=
+		    max(replay_window, 1)) {
+			spin_unlock(&imp->imp_lock);
+			*inflight = 1;
+			break;
+		}
+		req = ptlrpc_replay_find(imp, imp->imp_replay_sent_transno);
+		if (req == NULL) {
+			spin_unlock(&imp->imp_lock);
+			break;
+		}
+		prev = imp->imp_replay_sent_transno;
+		imp->imp_replay_sent_transno = req->rq_transno;
+		resent = req->rq_transno <= imp->imp_replay_resend_transno;
+		spin_unlock(&imp->imp_lock);
+
+		if (resent)
+			lustre_msg_add_flags(req->rq_reqmsg, MSG_RESENT);
+		/* lets the server tell a gap in transnos from a replay of
+		 * ours which is still on its way */
+		lustre_msg_set_prev_transno(req->rq_reqmsg, prev);
+
                 rc = ptlrpc_replay_req(req);
                 if (rc) {
                         CERROR("recovery replay error %d for req "
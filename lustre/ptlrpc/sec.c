@@ -2175,6 +2175,7 @@ void sptlrpc_svc_free_rs(struct ptlrpc_reply_state *rs)
 {
         struct ptlrpc_sec_policy *policy;
         unsigned int prealloc;
+        unsigned int pooled;
         ENTRY;
 
         LASSERT(rs->rs_svc_ctx);
@@ -2184,9 +2185,12 @@ void sptlrpc_svc_free_rs(struct ptlrpc_reply_state *rs)
         LASSERT(policy->sp_sops->free_rs);
 
         prealloc = rs->rs_prealloc;
+        pooled = rs->rs_pooled;
         policy->sp_sops->free_rs(rs);
 
-        if (prealloc)
+        if (pooled)
+                lustre_put_pool_rs(rs);
+        else if (prealloc)
                 lustre_put_emerg_rs(rs);
         EXIT;
 }
@@ -324,7 +324,9 @@ int null_alloc_rs(struct ptlrpc_request *req, int msgsize)
                 /* pre-allocated */
                 LASSERT(rs->rs_size >= rs_size);
         } else {
-                OBD_ALLOC_LARGE(rs, rs_size);
+                rs = lustre_get_pool_rs(req, rs_size);
+                if (rs == NULL)
+                        OBD_ALLOC_LARGE(rs, rs_size);
                 if (rs == NULL)
                         return -ENOMEM;
 
@@ -58,6 +58,29 @@ CFS_MODULE_PARM(at_early_margin, "i", int, 0644,
 CFS_MODULE_PARM(at_extra, "i", int, 0644,
                 "How much extra time to give with each early reply");
 
+static int thread_ctl_enable = 0;
+CFS_MODULE_PARM(thread_ctl_enable, "i", int, 0644,
+		"Default for adaptive service thread control (1 to enable)");
+
+static int thread_ctl_wait_us = 5000;
+CFS_MODULE_PARM(thread_ctl_wait_us, "i", int, 0644,
+		"Default request queue wait target of adaptive service "
+		"thread control (usec)");
+
+/** sampling window of the thread controller */
+#define PTLRPC_THRCTL_WINDOW	NSEC_PER_SEC
+
+/** arrival rate window of the request buffers, in seconds */
+#define PTLRPC_RQBD_WINDOW	1
+/** keep enough request buffers posted to absorb this much arrivals, in msec */
+#define PTLRPC_RQBD_ABSORB_MS	100
+/** never keep more than this many groups of request buffers posted */
+#define PTLRPC_RQBD_GROUPS_MAX	16
+/** # request descriptors cached per service thread */
+#define PTLRPC_POOL_REQS_PER_THR	8
+/** # reply states cached per service thread */
+#define PTLRPC_POOL_RSS_PER_THR		2
+
 
 /* forward ref */
 static int ptlrpc_server_post_idle_rqbds(struct ptlrpc_service_part *svcpt);
@@ -99,6 +122,116 @@ ptlrpc_alloc_rqbd(struct ptlrpc_service_part *svcpt)
 	return rqbd;
 }
 
+/**
+ * Takes a descriptor for an incoming request from the request cache of
+ * \a svcpt, or allocates one on the CPT of \a svcpt if the cache is empty.
+ * Called from the LNet event callback, so it must not sleep.
+ */
+struct ptlrpc_request *
+ptlrpc_svcpt_req_alloc(struct ptlrpc_service_part *svcpt)
+{
+	struct ptlrpc_svc_pool	*pool = &svcpt->scp_pool;
+	struct ptlrpc_request	*req = NULL;
+
+	spin_lock(&pool->sp_lock);
+	if (!list_empty(&pool->sp_reqs)) {
+		req = list_entry(pool->sp_reqs.next, struct ptlrpc_request,
+				 rq_list);
+		list_del(&req->rq_list);
+		pool->sp_nreqs--;
+		pool->sp_req_hits++;
+	} else {
+		pool->sp_req_misses++;
+	}
+	spin_unlock(&pool->sp_lock);
+
+	if (req != NULL) {
+		memset(req, 0, sizeof(*req));
+		return req;
+	}
+
+	return ptlrpc_request_cache_cpt_alloc(svcpt->scp_service->srv_cptable,
+					      svcpt->scp_cpt,
+					      ALLOC_ATOMIC_TRY);
+}
+
+/**
+ * Returns request descriptor \a req to the request cache of \a svcpt, or to
+ * the slab if the cache is full.
+ */
+static void
+ptlrpc_svcpt_req_free(struct ptlrpc_service_part *svcpt,
+		      struct ptlrpc_request *req)
+{
+	struct ptlrpc_svc_pool *pool = &svcpt->scp_pool;
+
+	spin_lock(&pool->sp_lock);
+	if (pool->sp_nreqs < pool->sp_nreqs_max) {
+		list_add(&req->rq_list, &pool->sp_reqs);
+		pool->sp_nreqs++;
+		req = NULL;
+	}
+	spin_unlock(&pool->sp_lock);
+
+	if (req != NULL)
+		ptlrpc_request_cache_free(req);
+}
+
+static void
+ptlrpc_svcpt_pool_init(struct ptlrpc_service_part *svcpt)
+{
+	struct ptlrpc_service	*svc = svcpt->scp_service;
+	struct ptlrpc_svc_pool	*pool = &svcpt->scp_pool;
+
+	spin_lock_init(&pool->sp_lock);
+	INIT_LIST_HEAD(&pool->sp_reqs);
+	INIT_LIST_HEAD(&pool->sp_rss);
+	/* large replies are rare, only cache the common small ones */
+	pool->sp_rs_size = min_t(int, svc->srv_max_reply_size,
+				 PAGE_CACHE_SIZE);
+}
+
+/**
+ * Sizes the caches of \a svcpt from the thread limit of the service, which
+ * is only known once all partitions are set up.
+ */
+static void
+ptlrpc_svcpt_pool_size(struct ptlrpc_service_part *svcpt)
+{
+	struct ptlrpc_service	*svc = svcpt->scp_service;
+	struct ptlrpc_svc_pool	*pool = &svcpt->scp_pool;
+
+	spin_lock(&pool->sp_lock);
+	pool->sp_nreqs_max = svc->srv_nthrs_cpt_limit *
+			     PTLRPC_POOL_REQS_PER_THR;
+	pool->sp_nrss_max = svc->srv_nthrs_cpt_limit * PTLRPC_POOL_RSS_PER_THR;
+	spin_unlock(&pool->sp_lock);
+}
+
+static void
+ptlrpc_svcpt_pool_fini(struct ptlrpc_service_part *svcpt)
+{
+	struct ptlrpc_svc_pool		*pool = &svcpt->scp_pool;
+	struct ptlrpc_request		*req;
+	struct ptlrpc_reply_state	*rs;
+
+	while (!list_empty(&pool->sp_reqs)) {
+		req = list_entry(pool->sp_reqs.next, struct ptlrpc_request,
+				 rq_list);
+		list_del(&req->rq_list);
+		pool->sp_nreqs--;
+		ptlrpc_request_cache_free(req);
+	}
+
+	while (!list_empty(&pool->sp_rss)) {
+		rs = list_entry(pool->sp_rss.next, struct ptlrpc_reply_state,
+				rs_list);
+		list_del(&rs->rs_list);
+		pool->sp_nrss--;
+		OBD_FREE_LARGE(rs, pool->sp_rs_size);
+	}
+}
+
 void
 ptlrpc_free_rqbd(struct ptlrpc_request_buffer_desc *rqbd)
 {
@@ -140,10 +273,10 @@ ptlrpc_grow_req_bufs(struct ptlrpc_service_part *svcpt, int post)
 	spin_unlock(&svcpt->scp_lock);
 
 
-        for (i = 0; i < svc->srv_nbuf_per_group; i++) {
+	for (i = 0; i < svcpt->scp_rqbd_want; i++) {
                 /* NB: another thread might have recycled enough rqbds, we
 		 * need to make sure it wouldn't over-allocate, see LU-1212. */
-		if (svcpt->scp_nrqbds_posted >= svc->srv_nbuf_per_group)
+		if (svcpt->scp_nrqbds_posted >= svcpt->scp_rqbd_want)
 			break;
 
 		rqbd = ptlrpc_alloc_rqbd(svcpt);
@@ -160,6 +293,7 @@ ptlrpc_grow_req_bufs(struct ptlrpc_service_part *svcpt, int post)
 
 	LASSERT(svcpt->scp_rqbd_allocating == 1);
 	svcpt->scp_rqbd_allocating--;
+	svcpt->scp_rqbd_ngrow += i;
 
 	spin_unlock(&svcpt->scp_lock);
 
@@ -408,10 +542,12 @@ EXPORT_SYMBOL(ptlrpc_schedule_difficult_reply);
 void ptlrpc_commit_replies(struct obd_export *exp)
 {
         struct ptlrpc_reply_state *rs, *nxt;
+	struct timeval		   now;
         DECLARE_RS_BATCH(batch);
         ENTRY;
 
         rs_batch_init(&batch);
+	do_gettimeofday(&now);
         /* Find any replies that have been committed and get their service
          * to attend to complete them. */
 
@@ -424,6 +560,10 @@ void ptlrpc_commit_replies(struct obd_export *exp)
                 LASSERT(rs->rs_export);
                 if (rs->rs_transno <= exp->exp_last_committed) {
 			list_del_init(&rs->rs_obd_list);
+			lprocfs_rpc_lat_tally(
+				rs->rs_svcpt->scp_service->srv_rpc_lat,
+				rs->rs_opc, RPC_LAT_COMMIT,
+				cfs_timeval_sub(&now, &rs->rs_sent_time, NULL));
                         rs_batch_add(&batch, rs);
                 }
         }
@@ -608,6 +748,10 @@ ptlrpc_service_part_init(struct ptlrpc_service *svc,
 	svcpt->scp_cpt = cpt;
 	INIT_LIST_HEAD(&svcpt->scp_threads);
 
+	/* adaptive thread control */
+	spin_lock_init(&svcpt->scp_thrctl.tc_lock);
+	svcpt->scp_thrctl.tc_window_start = ktime_to_ns(ktime_get());
+
 	/* rqbd and incoming request queue */
 	spin_lock_init(&svcpt->scp_lock);
 	INIT_LIST_HEAD(&svcpt->scp_rqbd_idle);
@@ -658,6 +802,9 @@ ptlrpc_service_part_init(struct ptlrpc_service *svc,
 
 	/* assign this before call ptlrpc_grow_req_bufs */
 	svcpt->scp_service = svc;
+	ptlrpc_svcpt_pool_init(svcpt);
+	svcpt->scp_rqbd_want = svc->srv_nbuf_per_group;
+	svcpt->scp_rqbd_window = cfs_time_current_sec();
 	/* Now allocate the request buffers, but don't post them now */
 	rc = ptlrpc_grow_req_bufs(svcpt, 0);
 	/* We shouldn't be under memory pressure at startup, so
@@ -780,6 +927,8 @@ ptlrpc_register_service(struct ptlrpc_service_conf *conf,
 	service->srv_ctx_tags		= conf->psc_thr.tc_ctx_tags;
 	service->srv_hpreq_ratio	= PTLRPC_SVC_HP_RATIO;
 	service->srv_ops		= conf->psc_ops;
+	service->srv_thrctl_enable	= thread_ctl_enable;
+	service->srv_thrctl_wait_target	= thread_ctl_wait_us;
 
 	for (i = 0; i < ncpts; i++) {
 		if (!conf->psc_thr.tc_cpu_affinity)
@@ -799,6 +948,9 @@ ptlrpc_register_service(struct ptlrpc_service_conf *conf,
 
 	ptlrpc_server_nthreads_check(service, conf);
 
+	ptlrpc_service_for_each_part(svcpt, i, service)
+		ptlrpc_svcpt_pool_size(svcpt);
+
 	rc = LNetSetLazyPortal(service->srv_req_portal);
 	LASSERT(rc == 0);
 
@@ -849,7 +1001,7 @@ static void ptlrpc_server_free_request(struct ptlrpc_request *req)
 		/* NB request buffers use an embedded
 		 * req if the incoming req unlinked the
 		 * MD; this isn't one of them! */
-		ptlrpc_request_cache_free(req);
+		ptlrpc_svcpt_req_free(req->rq_rqbd->rqbd_svcpt, req);
 	}
 }
 
@@ -943,11 +1095,28 @@ void ptlrpc_server_drop_request(struct ptlrpc_request *req)
 			 * disposed, schedule request buffer for re-use.
 			 */
 			LASSERT(atomic_read(&rqbd->rqbd_req.rq_refcount) == 0);
-			list_add_tail(&rqbd->rqbd_list, &svcpt->scp_rqbd_idle);
+
+			/* the arrival rate dropped since a burst grew the
+			 * pool; leave enough for the requests in flight and
+			 * free the rest */
+			if (svcpt->scp_nrqbds_total <=
+			    2 * svcpt->scp_rqbd_want +
+			    svc->srv_hist_nrqbds_cpt_max) {
+				list_add_tail(&rqbd->rqbd_list,
+					      &svcpt->scp_rqbd_idle);
+				continue;
+			}
+
+			INIT_LIST_HEAD(&rqbd->rqbd_list);
+			svcpt->scp_rqbd_nshrink++;
+			spin_unlock(&svcpt->scp_lock);
+			ptlrpc_free_rqbd(rqbd);
+			spin_lock(&svcpt->scp_lock);
 		}
 
 		spin_unlock(&svcpt->scp_lock);
-	} else if (req->rq_reply_state && req->rq_reply_state->rs_prealloc) {
+	} else if (req->rq_reply_state && req->rq_reply_state->rs_prealloc &&
+		   !req->rq_reply_state->rs_pooled) {
 		/* If we are low on memory, we are not interested in history */
 		list_del(&req->rq_list);
 		list_del_init(&req->rq_history_list);
@@ -1980,6 +2149,130 @@ err_req:
 	RETURN(1);
 }
 
+/**
+ * CPU time used by the current thread so far, in usec.
+ */
+static inline __u64
+ptlrpc_thrctl_cputime(void)
+{
+	__u64 runtime = cfs_current_runtime_ns();
+
+	do_div(runtime, NSEC_PER_USEC);
+	return runtime;
+}
+
+/**
+ * Accounts a handled request to the thread controller of \a svcpt.
+ *
+ * \param[in] wait   time the request waited in queue, in usec
+ * \param[in] handle wall-clock time spent handling it, in usec
+ * \param[in] cpu    CPU time spent handling it, in usec
+ */
+static void
+ptlrpc_thrctl_account(struct ptlrpc_service_part *svcpt, long wait,
+		      long handle, __u64 cpu)
+{
+	struct ptlrpc_thrctl *tc = &svcpt->scp_thrctl;
+
+	spin_lock(&tc->tc_lock);
+	tc->tc_nreqs++;
+	tc->tc_wait_sum += wait > 0 ? wait : 0;
+	tc->tc_handle_sum += handle > 0 ? handle : 0;
+	tc->tc_cpu_sum += cpu;
+	spin_unlock(&tc->tc_lock);
+}
+
+/**
+ * Closes the sampling window of the thread controller of \a svcpt once it
+ * has expired, and sets a new target number of threads from it:
+ *
+ * - requests wait longer than the target: grow, by half the number of
+ *   threads blocked in I/O or journal waits but at least by one, unless
+ *   the handlers already keep all CPUs of the partition busy;
+ * - requests wait less than a quarter of the target and at least two
+ *   threads idle: shrink by a quarter of the idle threads;
+ * - otherwise hold the current number of threads.
+ *
+ * The target never leaves [threads_min, threads_max].
+ */
+static void
+ptlrpc_thrctl_check(struct ptlrpc_service_part *svcpt)
+{
+	struct ptlrpc_service	*svc = svcpt->scp_service;
+	struct ptlrpc_thrctl	*tc = &svcpt->scp_thrctl;
+	__u64			 now = ktime_to_ns(ktime_get());
+	__u64			 window;
+	__u64			 wait;
+	unsigned int		 busy;
+	unsigned int		 oncpu;
+	unsigned int		 blocked;
+	unsigned int		 ncpus;
+	int			 running;
+	int			 target;
+	int			 step;
+
+	/* NB I'm not locking; just looking. */
+	if (now < tc->tc_window_start + PTLRPC_THRCTL_WINDOW)
+		return;
+
+	spin_lock(&tc->tc_lock);
+	if (now < tc->tc_window_start + PTLRPC_THRCTL_WINDOW) {
+		spin_unlock(&tc->tc_lock);
+		return;
+	}
+
+	window = (now - tc->tc_window_start) / NSEC_PER_USEC;
+	wait = tc->tc_nreqs > 0 ? tc->tc_wait_sum / tc->tc_nreqs : 0;
+	busy = tc->tc_handle_sum * 100 / window;
+	oncpu = min(tc->tc_cpu_sum * 100 / window, (__u64)busy);
+	blocked = busy - oncpu;
+	ncpus = cfs_cpt_weight(svc->srv_cptable, svcpt->scp_cpt);
+	running = svcpt->scp_nthrs_running;
+
+	tc->tc_last_wait = wait;
+	tc->tc_last_busy = busy;
+	tc->tc_last_oncpu = oncpu;
+	tc->tc_last_blocked = blocked;
+	tc->tc_last_rate = tc->tc_nreqs * USEC_PER_SEC / window;
+
+	if (tc->tc_nreqs > 0 && wait > svc->srv_thrctl_wait_target) {
+		if (oncpu >= ncpus * 90 && blocked < 100) {
+			/* more threads would only fight for the CPUs */
+			target = running;
+			tc->tc_last_decision = PTLRPC_THRCTL_CPU_BOUND;
+		} else {
+			step = max_t(int, 1, blocked / 200);
+			target = running + step;
+			tc->tc_last_decision = PTLRPC_THRCTL_GROW;
+			tc->tc_ngrow++;
+		}
+	} else if (wait * 4 < svc->srv_thrctl_wait_target &&
+		   (busy + 99) / 100 + 2 <= running) {
+		step = max_t(int, 1, (running - (busy + 99) / 100) / 4);
+		target = running - step;
+		tc->tc_last_decision = PTLRPC_THRCTL_SHRINK;
+		tc->tc_nshrink++;
+	} else {
+		target = running;
+		tc->tc_last_decision = PTLRPC_THRCTL_HOLD;
+	}
+
+	target = max(target, svc->srv_nthrs_cpt_init);
+	target = min(target, svc->srv_nthrs_cpt_limit);
+	tc->tc_target = target;
+
+	tc->tc_window_start = now;
+	tc->tc_nreqs = 0;
+	tc->tc_wait_sum = 0;
+	tc->tc_handle_sum = 0;
+	tc->tc_cpu_sum = 0;
+	spin_unlock(&tc->tc_lock);
+
+	CDEBUG(D_RPCTRACE, "%s[%d]: threads %d target %d, wait "LPU64"us "
+	       "busy %u oncpu %u blocked %u (x100)\n", svc->srv_name,
+	       svcpt->scp_cpt, running, target, wait, busy, oncpu, blocked);
+}
+
 /**
  * Main incoming request handling logic.
  * Calls handler function from service to do actual processing.
@@ -1993,6 +2286,8 @@ ptlrpc_server_handle_request(struct ptlrpc_service_part *svcpt,
 	struct timeval		 work_start;
 	struct timeval		 work_end;
 	long			 timediff;
+	long			 waittime;
+	__u64			 cpu_start;
 	int			 fail_opc = 0;
 
 	ENTRY;
@@ -2017,7 +2312,9 @@ ptlrpc_server_handle_request(struct ptlrpc_service_part *svcpt,
 		libcfs_debug_dumplog();
 
 	do_gettimeofday(&work_start);
+	cpu_start = ptlrpc_thrctl_cputime();
 	timediff = cfs_timeval_sub(&work_start, &request->rq_arrival_time,NULL);
+	waittime = timediff;
 	if (likely(svc->srv_stats != NULL)) {
                 lprocfs_counter_add(svc->srv_stats, PTLRPC_REQWAIT_CNTR,
                                     timediff);
@@ -2087,6 +2384,8 @@ put_conn:
 
 	do_gettimeofday(&work_end);
 	timediff = cfs_timeval_sub(&work_end, &work_start, NULL);
+	ptlrpc_thrctl_account(svcpt, waittime, timediff,
+			      ptlrpc_thrctl_cputime() - cpu_start);
 	CDEBUG(D_RPCTRACE, "Handled RPC pname:cluuid+ref:pid:xid:nid:opc "
 	       "%s:%s+%d:%d:x"LPU64":%s:%d Request procesed in "
 	       "%ldus (%ldus total) trans "LPU64" rc %d/%d\n",
@@ -2110,6 +2409,11 @@ put_conn:
         if (likely(svc->srv_stats != NULL && request->rq_reqmsg != NULL)) {
                 __u32 op = lustre_msg_get_opc(request->rq_reqmsg);
                 int opc = opcode_offset(op);
+
+		lprocfs_rpc_lat_tally(svc->srv_rpc_lat, op, RPC_LAT_WAIT,
+				      waittime);
+		lprocfs_rpc_lat_tally(svc->srv_rpc_lat, op, RPC_LAT_SERVICE,
+				      timediff);
                 if (opc > 0 && !(op == LDLM_ENQUEUE || op == MDS_REINT)) {
                         LASSERT(opc < LUSTRE_MAX_OPCODES);
                         lprocfs_counter_add(svc->srv_stats,
@@ -2237,12 +2541,50 @@ ptlrpc_handle_rs(struct ptlrpc_reply_state *rs)
 }
 
 
+/**
+ * Updates the # request buffers \a svcpt keeps posted from the rate request
+ * buffers were filled up at over the last window, so that a burst of
+ * arrivals does not run the portal out of buffers before they are reposted.
+ */
+static void
+ptlrpc_rqbd_rate_check(struct ptlrpc_service_part *svcpt)
+{
+	struct ptlrpc_service	*svc = svcpt->scp_service;
+	cfs_time_t		 now = cfs_time_current_sec();
+	cfs_duration_t		 elapsed;
+	int			 want;
+
+	/* NB I'm not locking; just looking. */
+	if (cfs_time_before(now, cfs_time_add(svcpt->scp_rqbd_window,
+					      PTLRPC_RQBD_WINDOW)))
+		return;
+
+	spin_lock(&svcpt->scp_lock);
+	elapsed = cfs_time_sub(now, svcpt->scp_rqbd_window);
+	if (elapsed < PTLRPC_RQBD_WINDOW) {
+		spin_unlock(&svcpt->scp_lock);
+		return;
+	}
+
+	svcpt->scp_rqbd_rate = svcpt->scp_rqbd_filled / elapsed;
+	svcpt->scp_rqbd_filled = 0;
+	svcpt->scp_rqbd_window = now;
+
+	want = svcpt->scp_rqbd_rate * PTLRPC_RQBD_ABSORB_MS / MSEC_PER_SEC;
+	svcpt->scp_rqbd_want = clamp_t(int, want, svc->srv_nbuf_per_group,
+				       svc->srv_nbuf_per_group *
+				       PTLRPC_RQBD_GROUPS_MAX);
+	spin_unlock(&svcpt->scp_lock);
+}
+
 static void
 ptlrpc_check_rqbd_pool(struct ptlrpc_service_part *svcpt)
 {
 	int avail = svcpt->scp_nrqbds_posted;
-	int low_water = test_req_buffer_pressure ? 0 :
-			svcpt->scp_service->srv_nbuf_per_group / 2;
+	int low_water;
+
+	ptlrpc_rqbd_rate_check(svcpt);
+	low_water = test_req_buffer_pressure ? 0 : svcpt->scp_rqbd_want / 2;
 
         /* NB I'm not locking; just looking. */
 
@@ -2290,16 +2632,53 @@ ptlrpc_threads_increasable(struct ptlrpc_service_part *svcpt)
 	       svcpt->scp_service->srv_nthrs_cpt_limit;
 }
 
+/**
+ * fewer threads than the thread controller asks for
+ */
+static inline int
+ptlrpc_threads_below_target(struct ptlrpc_service_part *svcpt)
+{
+	return svcpt->scp_service->srv_thrctl_enable &&
+	       svcpt->scp_nthrs_running + svcpt->scp_nthrs_starting <
+	       svcpt->scp_thrctl.tc_target;
+}
+
 /**
  * too many requests and allowed to create more threads
  */
 static inline int
 ptlrpc_threads_need_create(struct ptlrpc_service_part *svcpt)
 {
-	return !ptlrpc_threads_enough(svcpt) &&
+	return (!ptlrpc_threads_enough(svcpt) ||
+		ptlrpc_threads_below_target(svcpt)) &&
 		ptlrpc_threads_increasable(svcpt);
 }
 
+/**
+ * the thread controller decided to shrink and there are still more threads
+ * than it asks for; reserves the exit of the caller if so.
+ */
+static int
+ptlrpc_threads_need_stop(struct ptlrpc_service_part *svcpt)
+{
+	struct ptlrpc_service	*svc = svcpt->scp_service;
+	int			 rc = 0;
+
+	if (!svc->srv_thrctl_enable ||
+	    svcpt->scp_thrctl.tc_last_decision != PTLRPC_THRCTL_SHRINK)
+		return 0;
+
+	spin_lock(&svcpt->scp_lock);
+	if (svcpt->scp_nthrs_running - svcpt->scp_nthrs_stopping >
+	    max(svcpt->scp_thrctl.tc_target, svc->srv_nthrs_cpt_init)) {
+		svcpt->scp_nthrs_stopping++;
+		rc = 1;
+	}
+	spin_unlock(&svcpt->scp_lock);
+
+	return rc;
+}
+
 static inline int
 ptlrpc_thread_stopping(struct ptlrpc_thread *thread)
 {
@@ -2336,8 +2715,15 @@ ptlrpc_wait_event(struct ptlrpc_service_part *svcpt,
 		  struct ptlrpc_thread *thread)
 {
 	/* Don't exit while there are replies to be handled */
-	struct l_wait_info lwi = LWI_TIMEOUT(svcpt->scp_rqbd_timeout,
-					     ptlrpc_retry_rqbds, svcpt);
+	struct l_wait_info lwi;
+	cfs_duration_t	   timeout = svcpt->scp_rqbd_timeout;
+
+	/* Wake up now and then while the pool may shrink, so that idle
+	 * threads get the chance to exit */
+	if (timeout == 0 && svcpt->scp_service->srv_thrctl_enable &&
+	    svcpt->scp_nthrs_running > svcpt->scp_service->srv_nthrs_cpt_init)
+		timeout = cfs_time_seconds(1);
+	lwi = LWI_TIMEOUT(timeout, ptlrpc_retry_rqbds, svcpt);
 
 	lc_watchdog_disable(thread->t_watchdog);
 
@@ -2358,6 +2744,27 @@ ptlrpc_wait_event(struct ptlrpc_service_part *svcpt,
 	return 0;
 }
 
+/**
+ * Frees the reply state an exiting thread brought into the idle pool of
+ * \a svcpt, if it is idle at the moment.
+ */
+static void
+ptlrpc_thread_free_rs(struct ptlrpc_service_part *svcpt)
+{
+	struct ptlrpc_reply_state *rs = NULL;
+
+	spin_lock(&svcpt->scp_rep_lock);
+	if (!list_empty(&svcpt->scp_rep_idle)) {
+		rs = list_entry(svcpt->scp_rep_idle.next,
+				struct ptlrpc_reply_state, rs_list);
+		list_del(&rs->rs_list);
+	}
+	spin_unlock(&svcpt->scp_rep_lock);
+
+	if (rs != NULL)
+		OBD_FREE_LARGE(rs, svcpt->scp_service->srv_max_reply_size);
+}
+
 /**
  * Main thread body for service threads.
  * Waits in a loop waiting for new requests to process to appear.
@@ -2373,6 +2780,7 @@ static int ptlrpc_main(void *arg)
 	struct group_info *ginfo = NULL;
 	struct lu_env *env;
 	int counter = 0, rc = 0;
+	int shrink = 0;
 	ENTRY;
 
 	thread->t_pid = current_pid();
@@ -2470,11 +2878,18 @@ static int ptlrpc_main(void *arg)
 			break;
 
 		ptlrpc_check_rqbd_pool(svcpt);
+		ptlrpc_thrctl_check(svcpt);
 
 		if (ptlrpc_threads_need_create(svcpt)) {
 			/* Ignore return code - we tried... */
 			ptlrpc_start_thread(svcpt, 0);
-                }
+		} else if (!ptlrpc_server_request_incoming(svcpt) &&
+			   !ptlrpc_server_request_pending(svcpt, false) &&
+			   ptlrpc_threads_need_stop(svcpt)) {
+			/* idle and over the target, leave */
+			shrink = 1;
+			break;
+		}
 
 		/* reset le_ses to initial state */
 		env->le_ses = NULL;
@@ -2528,6 +2943,10 @@ out:
         CDEBUG(D_RPCTRACE, "service thread [ %p : %u ] %d exiting: rc %d\n",
                thread, thread->t_pid, thread->t_id, rc);
 
+	/* still on scp_threads, so the service can't go away under us */
+	if (shrink)
+		ptlrpc_thread_free_rs(svcpt);
+
 	spin_lock(&svcpt->scp_lock);
 	if (thread_test_and_clear_flags(thread, SVC_STARTING))
 		svcpt->scp_nthrs_starting--;
@@ -2540,6 +2959,19 @@ out:
 	thread->t_id = rc;
 	thread_add_flags(thread, SVC_STOPPED);
 
+	if (shrink) {
+		svcpt->scp_nthrs_stopping--;
+		svcpt->scp_thrctl.tc_nexited++;
+		/* nobody waits for us unless the service is stopping,
+		 * otherwise reap ourselves */
+		if (!thread_is_stopping(thread)) {
+			list_del(&thread->t_link);
+			spin_unlock(&svcpt->scp_lock);
+			OBD_FREE_PTR(thread);
+			return rc;
+		}
+	}
+
 	wake_up(&thread->t_ctl_waitq);
 	spin_unlock(&svcpt->scp_lock);
 
@@ -3104,6 +3536,8 @@ ptlrpc_service_purge_all(struct ptlrpc_service *svc)
 			list_del(&rs->rs_list);
 			OBD_FREE_LARGE(rs, svc->srv_max_reply_size);
 		}
+
+		ptlrpc_svcpt_pool_fini(svcpt);
 	}
 }
 
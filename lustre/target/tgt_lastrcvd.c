@@ -410,19 +410,26 @@ void tgt_cb_last_committed(struct lu_env *env, struct thandle *th,
 			   struct dt_txn_commit_cb *cb, int err)
 {
 	struct tgt_last_committed_callback *ccb;
+	__u64				    committed;
 
 	ccb = container_of0(cb, struct tgt_last_committed_callback, llcc_cb);
 
 	LASSERT(ccb->llcc_tgt != NULL);
 	LASSERT(ccb->llcc_exp->exp_obd == ccb->llcc_tgt->lut_obd);
 
+	/* replays done in parallel commit out of order, don't report
+	 * anything past a replay which is not committed yet */
+	committed = target_replay_committed(ccb->llcc_tgt->lut_obd,
+					    ccb->llcc_transno);
+
 	spin_lock(&ccb->llcc_tgt->lut_translock);
-	if (ccb->llcc_transno > ccb->llcc_tgt->lut_obd->obd_last_committed)
-		ccb->llcc_tgt->lut_obd->obd_last_committed = ccb->llcc_transno;
+	if (committed > ccb->llcc_tgt->lut_obd->obd_last_committed)
+		ccb->llcc_tgt->lut_obd->obd_last_committed = committed;
 
+	committed = min(committed, ccb->llcc_transno);
 	LASSERT(ccb->llcc_exp);
-	if (ccb->llcc_transno > ccb->llcc_exp->exp_last_committed) {
-		ccb->llcc_exp->exp_last_committed = ccb->llcc_transno;
+	if (committed > ccb->llcc_exp->exp_last_committed) {
+		ccb->llcc_exp->exp_last_committed = committed;
 		spin_unlock(&ccb->llcc_tgt->lut_translock);
 		ptlrpc_commit_replies(ccb->llcc_exp);
 	} else {
@@ -459,6 +466,8 @@ int tgt_last_commit_cb_add(struct thandle *th, struct lu_target *tgt,
 	if (rc) {
 		class_export_cb_put(exp);
 		OBD_FREE_PTR(ccb);
+	} else {
+		target_replay_commit_add(tgt->lut_obd, transno);
 	}
 
 	if (exp_connect_flags(exp) & OBD_CONNECT_LIGHTWEIGHT)
@@ -521,6 +530,8 @@ int tgt_new_client_cb_add(struct thandle *th, struct obd_export *exp)
 	if (rc) {
 		class_export_cb_put(exp);
 		OBD_FREE_PTR(ccb);
+	} else {
+		target_replay_commit_add(tgt->lut_obd, transno);
 	}
 	return rc;
 }
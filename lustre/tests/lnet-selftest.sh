@@ -162,6 +162,152 @@ test_smoke () {
 }
 run_test smoke "lst regression test"
 
+test_eq_batch() {
+	load_module ../lnet/lnet/lnet
+	# the test runs when the module is loaded, loading fails if it does
+	load_module ../lnet/lnet/lnet_eq_test ||
+		error "batched EQ test failed, see console log"
+	rmmod lnet_eq_test
+}
+run_test eq_batch "concurrent batched EQ delivery and MD unlink"
+
+# the IPv4 address of interface $2 on node $1
+mr_iface_ip() {
+	do_node $1 "ip -o -4 addr show dev $2" |
+		awk '{ sub("/.*", "", $4); print $4; exit }'
+}
+
+# the interface carrying IPv4 address $2 on node $1
+mr_ip_iface() {
+	do_node $1 "ip -o -4 addr show" |
+		awk -v ip=$2 '{ sub("/.*", "", $4) } $4 == ip { print $2; exit }'
+}
+
+# print the LNet networks option and the two rail NIDs of node $1, the
+# rails are on networks $mr_NETS over interfaces $mr_IFACES; both share
+# the interface LNet uses now if only one or none is given
+mr_node_rails() {
+	local node=$1
+	local nets=(${mr_NETS:-tcp tcp1})
+	local iface=(${mr_IFACES})
+	local nids
+	local ip
+	local i
+
+	[ ${#iface[@]} -eq 0 ] &&
+		iface=($(mr_ip_iface $node $(host_nids_address $node $NETTYPE)))
+	[ ${#iface[@]} -eq 1 ] && iface=(${iface[0]} ${iface[0]})
+	[ -n "${iface[0]}" ] || return 1
+
+	for i in 0 1; do
+		ip=$(mr_iface_ip $node ${iface[$i]})
+		[ -n "$ip" ] || return 1
+		nids="$nids $ip@${nets[$i]}"
+	done
+
+	echo "${nets[0]}(${iface[0]}),${nets[1]}(${iface[1]})$nids"
+}
+
+# load LNet on node $1 with networks $2 and multi-rail peer $3
+mr_lnet_up() {
+	do_node $1 "$LUSTRE_RMMOD; modprobe lnet 'networks=$2' \
+		'peer_rails=\"$3\"' accept=all && $LCTL network up"
+}
+
+# check every rail of peer $2 on node $1 carried at least 1/4 of the sends
+mr_check_spread() {
+	local node=$1
+	local peer=$2
+	local rails
+
+	rails=$(do_node $node cat /proc/sys/lnet/rails)
+	echo "$node:"
+	echo "$rails"
+
+	echo "$rails" | awk -v peer=$peer '
+		$1 == peer { n++; sent[n] = $5; total += $5 }
+		END {
+			if (n < 2) {
+				print "only " n + 0 " rails to " peer
+				exit 1
+			}
+			for (i = 1; i <= n; i++) {
+				if (sent[i] * 4 < total) {
+					print "rail " i " sent " sent[i] \
+					      " of " total " messages to " peer
+					exit 1
+				}
+			}
+		}' || error "$node: traffic to $peer not spread over its rails"
+}
+
+test_multirail() {
+	[[ $NETTYPE = tcp* ]] ||
+		{ skip_env "multi-rail test needs socklnd, NETTYPE=$NETTYPE" &&
+			return 0; }
+
+	local server=${nodes%%,*}
+	local client=$HOSTNAME
+
+	[ $server != $client ] && ! local_mode ||
+		{ skip_env "multi-rail test needs two nodes" && return 0; }
+
+	local srails
+	local crails
+
+	srails=($(mr_node_rails $server)) ||
+		error "can't find the rail interfaces of $server"
+	crails=($(mr_node_rails $client)) ||
+		error "can't find the rail interfaces of $client"
+
+	lst_cleanup_all
+
+	# each end knows the other by its NID on the first network
+	mr_lnet_up $server ${srails[0]} "${crails[*]:1}" ||
+		error "can't start LNet on $server"
+	mr_lnet_up $client ${crails[0]} "${srails[*]:1}" ||
+		error "can't start LNet on $client"
+
+	lst_setup_all
+
+	local runlst=$TMP/multirail.sh
+	local log=$TMP/$tfile.log
+
+	cat > $runlst <<EOF
+#!/bin/bash
+set -e
+$LST new_session --timeo 100000 mr
+$LST add_group c ${crails[1]}
+$LST add_group s ${srails[1]}
+$LST add_batch b
+$LST add_test --batch b --loop ${mr_LOOP:-2000} --concurrency 8 \
+	--from c --to s brw write check=simple size=1M
+$LST add_test --batch b --loop ${mr_LOOP:-2000} --concurrency 8 \
+	--from c --to s brw read check=simple size=1M
+$LST run b
+sleep 1
+$LST stat --delay 5 --timeout 10 c s &
+pid=\$!
+sleep ${mr_DURATION:-30}
+kill -9 \$pid || true
+EOF
+	cat $runlst
+
+	run_lst $runlst | tee $log
+	[ ${PIPESTATUS[0]} = 0 ] || error "$runlst failed"
+	lst_end_session --verbose | tee -a $log
+	check_lst_err $log
+
+	mr_check_spread $client ${srails[1]}
+	mr_check_spread $server ${crails[1]}
+
+	# back to the usual LNet configuration
+	lst_cleanup_all
+	do_nodes $(comma_list $server $client) $LUSTRE_RMMOD
+	load_modules
+}
+run_test multirail "traffic to a multi-rail peer is spread over its rails"
+
 complete $SECONDS
 if [ "$RESTORE_MOUNT" = yes ]; then
     setupall
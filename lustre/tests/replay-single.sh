@@ -2893,6 +2893,98 @@ test_100b() {
 }
 run_test 100b "DNE: create striped dir, fail MDT0"
 
+test_101() {
+	local param=/sys/module/ptlrpc/parameters/recovery_threads
+	local old=$(do_facet $SINGLEMDS "cat $param" 2>/dev/null)
+	local i
+
+	[ -z "$old" ] && skip "no recovery_threads on $SINGLEMDS" && return 0
+
+	do_facet $SINGLEMDS "echo 4 > $param"
+
+	for i in $(seq 4); do
+		mkdir -p $DIR/$tdir/d$i || error "mkdir d$i failed"
+		createmany -o $DIR/$tdir/d$i/f 50 >/dev/null ||
+			error "createmany d$i failed"
+	done
+
+	replay_barrier $SINGLEMDS
+	# independent updates in several directories, mixed with updates of
+	# the same files and renames, which have to replay in transno order
+	for i in $(seq 4); do
+		(createmany -o $DIR/$tdir/d$i/g 100 >/dev/null &&
+		 unlinkmany $DIR/$tdir/d$i/f 25 >/dev/null &&
+		 chmod 0600 $DIR/$tdir/d$i/f49 &&
+		 mv $DIR/$tdir/d$i/g0 $DIR/$tdir/d$i/h0 &&
+		 mv $DIR/$tdir/d$i/h0 $DIR/$tdir/d$i/g0) &
+	done
+	wait
+	fail $SINGLEMDS
+
+	do_facet $SINGLEMDS "echo $old > $param"
+
+	for i in $(seq 4); do
+		$CHECKSTAT -a $DIR/$tdir/d$i/f0 ||
+			error "d$i/f0 should be unlinked"
+		$CHECKSTAT -t file $DIR/$tdir/d$i/f25 ||
+			error "d$i/f25 missing"
+		$CHECKSTAT -p 0600 $DIR/$tdir/d$i/f49 ||
+			error "d$i/f49 has wrong mode"
+		$CHECKSTAT -a $DIR/$tdir/d$i/h0 ||
+			error "d$i/h0 should be renamed back"
+		[ $(ls $DIR/$tdir/d$i | wc -l) -eq 125 ] ||
+			error "d$i has $(ls $DIR/$tdir/d$i | wc -l) entries"
+	done
+	rm -rf $DIR/$tdir || error "rmdir failed"
+}
+run_test 101 "parallel replay with recovery_threads > 1"
+
+test_102() {
+	local param=/sys/module/ptlrpc/parameters/recovery_threads
+	local old=$(do_facet $SINGLEMDS "cat $param" 2>/dev/null)
+	local n=0
+	local i
+
+	[ -z "$old" ] && skip "no recovery_threads on $SINGLEMDS" && return 0
+
+	# two mounts are two exports, whose replays run in parallel
+	zconf_mount $HOSTNAME $MOUNT2 || error "mount $MOUNT2 failed"
+	do_facet $SINGLEMDS "echo 4 > $param"
+
+	mkdir -p $DIR/$tdir/d1 $DIR/$tdir/d2 || error "mkdir failed"
+	replay_barrier $SINGLEMDS
+	createmany -o $DIR/$tdir/d1/f 200 >/dev/null &
+	createmany -o $DIR2/$tdir/d2/f 200 >/dev/null &
+	wait
+
+	# slow down replays, and fail again with part of them on disk
+	#define OBD_FAIL_TGT_REPLAY_DELAY	0x709
+	do_facet $SINGLEMDS "$LCTL set_param fail_loc=0x709 fail_val=20"
+	fail_nodf $SINGLEMDS
+	for i in $(seq 120); do
+		n=$(do_facet $SINGLEMDS "$LCTL get_param -n \
+			mdt.${mds1_svc}.recovery_status" |
+			awk '/^replayed_requests:/ { print $2 }')
+		[ ${n:-0} -ge 100 ] && break
+		sleep 1
+	done
+	[ ${n:-0} -ge 100 ] || error "only ${n:-0} requests replayed"
+	replay_barrier_nodf $SINGLEMDS
+	do_facet $SINGLEMDS "$LCTL set_param fail_loc=0 fail_val=0"
+	fail $SINGLEMDS
+
+	do_facet $SINGLEMDS "echo $old > $param"
+
+	# clients must have kept every replay which was not committed
+	for i in 1 2; do
+		[ $(ls $DIR/$tdir/d$i | wc -l) -eq 200 ] ||
+			error "d$i has $(ls $DIR/$tdir/d$i | wc -l) entries"
+	done
+	zconf_umount $HOSTNAME $MOUNT2 || error "umount $MOUNT2 failed"
+	rm -rf $DIR/$tdir || error "rmdir failed"
+}
+run_test 102 "fail again during parallel replay"
+
 complete $SECONDS
 check_and_cleanup_lustre
 exit_status
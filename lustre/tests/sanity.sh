@@ -5103,6 +5103,27 @@ test_60d() {
 }
 run_test 60d "test printk console message masking"
 
+test_60e() {
+	[ $PARALLEL == "yes" ] && skip "skip parallel run" && return
+	local save_debug=$($LCTL get_param -n debug)
+	local save_deferred=$($LCTL get_param -n debug_deferred)
+
+	$LCTL set_param debug=+vfstrace debug_deferred=vfstrace ||
+		error "set lnet.debug_deferred failed"
+	$LCTL clear
+	touch $DIR/$tfile || error "touch $DIR/$tfile failed"
+	$LCTL dk > $TMP/$tfile.log
+	$LCTL set_param -n debug="$save_debug"
+	$LCTL set_param -n debug_deferred="$save_deferred"
+
+	grep -q "VFS Op:name=$tfile, dir=" $TMP/$tfile.log ||
+		error "deferred message not decoded by lctl dk"
+	grep -q "undecodable trace record" $TMP/$tfile.log &&
+		error "undecodable deferred message"
+	rm -f $TMP/$tfile.log
+}
+run_test 60e "deferred debug messages are formatted at dump time"
+
 test_61() {
 	[ $PARALLEL == "yes" ] && skip "skip parallel run" && return
 	f="$DIR/f61"
@@ -9272,6 +9293,59 @@ test_133g() {
 }
 run_test 133g "Check for Oopses on bad io area writes/reads in /proc"
 
+test_133h() {
+	local snap=/proc/fs/lustre/stats_snapshot
+	local copy=$TMP/$tfile.snapshot
+
+	[ -f $snap ] || { skip "no $snap" && return 0; }
+
+	# each open takes a new snapshot, check a single copy of it
+	cat $snap > $copy || error "cannot read $snap"
+
+	# lsh_magic, "LPSS"
+	local magic=$(od -A n -t x4 -N 4 $copy | tr -d ' ')
+	[ "$magic" == "4c505353" ] || error "bad snapshot magic '$magic'"
+
+	local size=$(od -A n -t u8 -j 32 -N 8 $copy | tr -d ' ')
+	[ $(stat -c %s $copy) -eq $size ] ||
+		error "snapshot size $(stat -c %s $copy) != lsh_size $size"
+
+	strings $copy | grep -q "stats$" || error "no stats in snapshot"
+
+	# walk the snapshot as 32-bit words, see struct lprocfs_snapshot_*
+	# in lustre_user.h; every histogram must account for all samples of
+	# its counter, give or take the updates racing with the copy
+	local w=($(od -A n -t u4 -v $copy))
+	local nstats=${w[6]}
+	local nhist=0
+	local pos=14
+	local s c n j
+
+	for ((s = 0; s < nstats; s++)); do
+		c=$((pos + 4 + ${w[pos + 2]} / 4))
+		for ((n = 0; n < ${w[pos + 1]}; n++)); do
+			if (( ${w[c + 1]} & 0x8 )); then
+				local count=${w[c + 4]}
+				local sum=0
+
+				for ((j = 0; j < ${w[5]}; j++)); do
+					sum=$((sum + ${w[c + 14 + 2 * j]}))
+				done
+				(( sum - count <= 8 && count - sum <= 8 )) ||
+					error "counter $n of stats $s:" \
+					      "buckets hold $sum of $count"
+				nhist=$((nhist + 1))
+			fi
+			c=$((c + ${w[c]} / 4))
+		done
+		pos=$((pos + ${w[pos]} / 4))
+	done
+	[ $pos -eq $((size / 4)) ] || error "stats blocks end at $((pos * 4))"
+	[ $nhist -gt 0 ] || error "no histogram counter in snapshot"
+	rm -f $copy
+}
+run_test 133h "Binary snapshot of all stats"
+
 test_140() { #bug-17379
 	[ $PARALLEL == "yes" ] && skip "skip parallel run" && return
         test_mkdir -p $DIR/$tdir || error "Creating dir $DIR/$tdir"
@@ -11222,12 +11296,18 @@ jobstats_set() {
 	wait_update $HOSTNAME "$LCTL get_param -n jobid_var" $NEW_JOBENV
 }
 
-test_205() { # Job stats
-	[ $PARALLEL == "yes" ] && skip "skip parallel run" && return
-	remote_mgs_nodsh && skip "remote MGS with nodsh" && return
+# skip the test unless job stats can be used
+jobstats_check() {
+	[ $PARALLEL == "yes" ] && skip "skip parallel run" && return 1
+	remote_mgs_nodsh && skip "remote MGS with nodsh" && return 1
 	[ -z "$(lctl get_param -n mdc.*.connect_flags | grep jobstats)" ] &&
-		skip "Server doesn't support jobstats" && return 0
-	[[ $JOBID_VAR = disable ]] && skip "jobstats is disabled" && return
+		skip "Server doesn't support jobstats" && return 1
+	[[ $JOBID_VAR = disable ]] && skip "jobstats is disabled" && return 1
+	return 0
+}
+
+test_205a() { # Job stats
+	jobstats_check || return 0
 
 	local cmd
 	OLD_JOBENV=$($LCTL get_param -n jobid_var)
@@ -11267,12 +11347,103 @@ test_205() { # Job stats
 	cmd="mv -f $DIR/$tfile $DIR/jobstats_test_rename"
 	verify_jobstats "$cmd" "mdt"
 
+	# binary export of the jobs
+	do_facet $SINGLEMDS lctl get_param -n mdt.*.job_stats_snapshot |
+		strings | grep -q $JOBVAL ||
+		error "No job found in MDT job_stats_snapshot"
+
 	# cleanup
 	rm -f $DIR/jobstats_test_rename
 
 	[ $OLD_JOBENV != $JOBENV ] && jobstats_set $OLD_JOBENV
 }
-run_test 205 "Verify job stats"
+run_test 205a "Verify job stats"
+
+# names of the jobs in the MDT job_stats
+mdt_jobs() {
+	do_facet $SINGLEMDS "$LCTL get_param -n mdt.$FSNAME-MDT0000.job_stats" |
+		awk '/job_id:/ { print $3 }'
+}
+
+test_205b() { # job_stats_max_mb and LRU eviction
+	jobstats_check || return 0
+
+	local param=mdt.$FSNAME-MDT0000.job_stats_max_mb
+	local old_max=$(do_facet $SINGLEMDS "$LCTL get_param -n $param")
+	local njobs=2000
+	local jobs
+	local n
+	local i
+
+	OLD_JOBENV=$($LCTL get_param -n jobid_var)
+	jobstats_set FAKE_JOBID
+	trap jobstats_set EXIT
+
+	mkdir -p $DIR/$tdir || error "mkdir failed"
+	do_facet $SINGLEMDS "$LCTL set_param mdt.*.job_stats=clear"
+	do_facet $SINGLEMDS "$LCTL set_param $param=1"
+
+	# a job takes a couple of KB, 1MB holds a few hundred of them
+	for i in $(seq $njobs); do
+		FAKE_JOBID=$tdir.$i touch $DIR/$tdir/f$i ||
+			error "touch f$i failed"
+	done
+	# the cleanup thread trims what was kept over the cap
+	sleep 3
+
+	jobs=$(mdt_jobs)
+	n=$(echo "$jobs" | grep -c "^$tdir\.")
+	echo "$n of $njobs jobs kept with job_stats_max_mb=1"
+	do_facet $SINGLEMDS "$LCTL set_param $param=$old_max"
+
+	[ $n -gt 0 ] || error "no job left"
+	[ $n -lt $((njobs / 2)) ] || error "$n jobs kept over the cap"
+	# old jobs are evicted first
+	echo "$jobs" | grep -qx "$tdir\.1" && error "oldest job not evicted"
+	echo "$jobs" | grep -qx "$tdir\.$njobs" || error "newest job evicted"
+
+	rm -rf $DIR/$tdir
+	jobstats_set $OLD_JOBENV
+}
+run_test 205b "job stats are kept within job_stats_max_mb, oldest evicted"
+
+test_205c() { # job_stats_snapshot cursor
+	jobstats_check || return 0
+
+	local path=/proc/fs/lustre/mdt/$FSNAME-MDT0000/job_stats_snapshot
+	local cursor
+	local snap
+
+	OLD_JOBENV=$($LCTL get_param -n jobid_var)
+	jobstats_set FAKE_JOBID
+	trap jobstats_set EXIT
+
+	mkdir -p $DIR/$tdir || error "mkdir failed"
+	do_facet $SINGLEMDS "$LCTL set_param mdt.*.job_stats=clear"
+
+	FAKE_JOBID=$tdir.before touch $DIR/$tdir/f1 || error "touch f1 failed"
+	sleep 2
+	cursor=$(do_facet $SINGLEMDS "date +%s")
+	sleep 2
+	FAKE_JOBID=$tdir.after touch $DIR/$tdir/f2 || error "touch f2 failed"
+
+	# all jobs without a cursor
+	snap=$(do_facet $SINGLEMDS "cat $path" | strings)
+	echo "$snap" | grep -q "$tdir\.before" || error "no job before cursor"
+	echo "$snap" | grep -q "$tdir\.after" || error "no job after cursor"
+
+	# only the jobs used since the cursor written to the same file
+	snap=$(do_facet $SINGLEMDS "exec 3<>$path; echo $cursor >&3; cat <&3" |
+		strings)
+	echo "$snap" | grep -q "$tdir\.after" ||
+		error "job used since $cursor missing"
+	echo "$snap" | grep -q "$tdir\.before" &&
+		error "job idle since before $cursor returned"
+
+	rm -rf $DIR/$tdir
+	jobstats_set $OLD_JOBENV
+}
+run_test 205c "job_stats_snapshot returns the jobs used since a cursor"
 
 # LU-1480, LU-1773 and LU-1657
 test_206() {
@@ -11520,12 +11691,12 @@ test_215() { # for bugs 18102, 21079, 21517
 	remove_lnet_proc_files "routers"
 
 	# lnet.peers should look like this:
-	# nid refs state last max rtr min tx min queue
+	# nid refs state last max rtr min tx min queue cwnd rtt(us)
 	# where nid is a string like 192.168.1.1@tcp2, refs > 0,
 	# state is up/down/NA, max >= 0. last, rtr, min, tx, min are
-	# numeric (0 or >0 or <0), queue >= 0.
-	L1="^nid +refs +state +last +max +rtr +min +tx +min +queue$"
-	BR="^$NID +$P +(up|down|NA) +$I +$N +$I +$I +$I +$I +$N$"
+	# numeric (0 or >0 or <0), queue, cwnd and rtt >= 0.
+	L1="^nid +refs +state +last +max +rtr +min +tx +min +queue +cwnd +rtt\\(us\\)$"
+	BR="^$NID +$P +(up|down|NA) +$I +$N +$I +$I +$I +$I +$N +$N +$N$"
 	create_lnet_proc_files "peers"
 	check_lnet_proc_entry "peers.sys" "lnet.peers" "$BR" "$L1"
 	remove_lnet_proc_files "peers"
@@ -11539,6 +11710,15 @@ test_215() { # for bugs 18102, 21079, 21517
 	check_lnet_proc_entry "buffers.sys" "lnet.buffers" "$BR" "$L1"
 	remove_lnet_proc_files "buffers"
 
+	# lnet.buffer_qtime should look like this:
+	# pool usec wait hold
+	# where pool is tiny/small/large, usec, wait and hold >= 0
+	L1="^pool +usec +wait +hold$"
+	BR="^(tiny|small|large) +$N +$N +$N$"
+	create_lnet_proc_files "buffer_qtime"
+	check_lnet_proc_entry "buffer_qtime.sys" "lnet.buffer_qtime" "$BR" "$L1"
+	remove_lnet_proc_files "buffer_qtime"
+
 	# lnet.nis should look like this:
 	# nid status alive refs peer rtr max tx min
 	# where nid is a string like 192.168.1.1@tcp2, status is up/down,
@@ -12613,6 +12793,166 @@ test_241() {
 }
 run_test 241 "bio vs dio"
 
+# sum of the "$2 <n>," fields of TBF rule $1 over all CPTs
+tbf_rule_field() {
+	do_facet ost1 $LCTL get_param -n ost.OSS.ost_io.nrs_tbf_rule |
+		awk '/^high_priority_requests:/ { exit }
+		     $1 == "'$1'" { for (i = 2; i < NF; i++)
+					if ($i == "'$2'") n += $(i + 1) }
+		     END { print n + 0 }'
+}
+
+cleanup_242() {
+	trap 0
+	do_facet ost1 $LCTL set_param \
+		ost.OSS.ost_io.nrs_tbf_rule="stop\ tbf_cli"
+	do_facet ost1 $LCTL set_param \
+		ost.OSS.ost_io.nrs_tbf_rule="stop\ tbf_agg"
+	do_facet ost1 $LCTL set_param ost.OSS.ost_io.nrs_policies="fifo"
+}
+
+test_242() {
+	remote_ost_nodsh && skip "remote OST with nodsh" && return
+
+	local param=ost.OSS.ost_io
+	local agg_rate=100
+	local cli_rate=10
+	local count=500
+	local ncpts
+	local nid
+	local start
+	local elapsed
+	local ndispatched
+	local depth
+	local borrowed
+	local max
+
+	if remote_ost; then
+		nid=$($LCTL list_nids | head -n 1)
+	else
+		nid="0@lo"
+	fi
+
+	$LFS setstripe -c 1 -i 0 $DIR/$tfile || error "setstripe failed"
+
+	do_facet ost1 $LCTL set_param $param.nrs_policies="tbf\ nid" ||
+		error "enable TBF failed"
+	trap cleanup_242 EXIT
+	# the parent matches no client, it only holds the aggregate bucket
+	do_facet ost1 $LCTL set_param $param.nrs_tbf_rule=\
+"start\ tbf_agg\ {192.0.2.1@tcp}\ rate=$agg_rate" ||
+		error "start tbf_agg failed"
+	do_facet ost1 $LCTL set_param $param.nrs_tbf_rule=\
+"start\ tbf_cli\ {$nid}\ rate=$cli_rate\ parent=tbf_agg" ||
+		error "start tbf_cli failed"
+	do_facet ost1 $LCTL get_param -n $param.nrs_tbf_rule
+
+	depth=$(do_facet ost1 cat /sys/module/ptlrpc/parameters/tbf_depth)
+	ncpts=$(do_facet ost1 $LCTL get_param -n $param.nrs_tbf_rule |
+		awk '/^high_priority_requests:/ { exit } /^CPT/ { n++ }
+		     END { print n }')
+
+	start=$(date +%s.%N)
+	dd if=/dev/zero of=$DIR/$tfile bs=4k count=$count oflag=direct ||
+		error "dd failed"
+	elapsed=$(echo "$(date +%s.%N) - $start" | bc)
+
+	do_facet ost1 $LCTL get_param -n $param.nrs_tbf_rule
+	ndispatched=$(tbf_rule_field tbf_cli dispatched)
+	borrowed=$(tbf_rule_field tbf_cli borrowed)
+	echo "dispatched $ndispatched, borrowed $borrowed in ${elapsed}s"
+
+	# without borrowing, the writes would run at cli_rate
+	(( borrowed > 0 )) || error "tbf_cli borrowed no token"
+	# each CPT lets through at most its bucket depth, then agg_rate
+	max=$(echo "($agg_rate * $elapsed + $depth) * $ncpts" | bc)
+	max=${max%.*}
+	(( ndispatched + borrowed <= max )) ||
+		error "$((ndispatched + borrowed)) RPCs above the limit $max"
+
+	cleanup_242
+	rm -f $DIR/$tfile
+}
+run_test 242 "TBF child rule borrows within the parent's limit"
+
+# number of CPTs of the regular NRS heads listing EDF class line $1
+edf_class_count() {
+	do_facet $SINGLEMDS $LCTL get_param -n mds.MDS.mdt.nrs_edf_class |
+		awk '/^high_priority_requests:/ { exit }
+		     index($0, "'"$1"'") == 1 { n++ } END { print n + 0 }'
+}
+
+cleanup_243() {
+	trap 0
+	do_facet $SINGLEMDS $LCTL set_param \
+		mds.MDS.mdt.nrs_edf_class="stop\ ls"
+	do_facet $SINGLEMDS $LCTL set_param mds.MDS.mdt.nrs_policies="fifo"
+}
+
+test_243() {
+	remote_mds_nodsh && skip "remote MDS with nodsh" && return
+
+	local param=mds.MDS.mdt
+	local ncpts
+	local n
+	local i
+
+	do_facet $SINGLEMDS $LCTL set_param $param.nrs_policies="edf" ||
+		error "enable EDF failed"
+	trap cleanup_243 EXIT
+
+	ncpts=$(do_facet $SINGLEMDS $LCTL get_param -n $param.nrs_edf_class |
+		awk '/^high_priority_requests:/ { exit } /^CPT/ { n++ }
+		     END { print n }')
+	n=$(edf_class_count "default {*} ")
+	[ $n -eq $ncpts ] || error "default class in $n of $ncpts CPTs"
+
+	do_facet $SINGLEMDS $LCTL set_param $param.nrs_edf_class=\
+"start\ ls\ opcode={mds_getattr\ ldlm_enqueue}\ 10" ||
+		error "start ls failed"
+	n=$(edf_class_count "ls opcode={mds_getattr ldlm_enqueue} 10,")
+	[ $n -eq $ncpts ] || error "class ls in $n of $ncpts CPTs"
+
+	# names are unique, targets are positive, the default class stays
+	do_facet $SINGLEMDS $LCTL set_param $param.nrs_edf_class=\
+"start\ ls\ uid={0}\ 10" && error "started ls twice"
+	do_facet $SINGLEMDS $LCTL set_param \
+		$param.nrs_edf_class="change\ ls\ 0" &&
+		error "changed ls to target 0"
+	do_facet $SINGLEMDS $LCTL set_param \
+		$param.nrs_edf_class="stop\ default" &&
+		error "stopped the default class"
+
+	do_facet $SINGLEMDS $LCTL set_param \
+		$param.nrs_edf_class="change\ ls\ 20" ||
+		error "change ls failed"
+	n=$(edf_class_count "ls opcode={mds_getattr ldlm_enqueue} 20,")
+	[ $n -eq $ncpts ] || error "ls changed in $n of $ncpts CPTs"
+
+	# getattr RPCs are put in class ls
+	test_mkdir -p $DIR/$tdir
+	for i in $(seq 10); do
+		touch $DIR/$tdir/f$i
+	done
+	cancel_lru_locks mdc
+	ls -l $DIR/$tdir > /dev/null
+	do_facet $SINGLEMDS $LCTL get_param -n $param.nrs_edf_class
+	n=$(do_facet $SINGLEMDS $LCTL get_param -n $param.nrs_edf_class |
+		awk '$1 == "ls" { for (i = 2; i < NF; i++)
+					if ($i == "dispatched") n += $(i + 1) }
+		     END { print n + 0 }')
+	[ $n -gt 0 ] || error "no RPC dispatched in class ls"
+
+	do_facet $SINGLEMDS $LCTL set_param \
+		$param.nrs_edf_class="stop\ ls" || error "stop ls failed"
+	n=$(edf_class_count "ls ")
+	[ $n -eq 0 ] || error "class ls left in $n CPTs"
+
+	cleanup_243
+	rm -rf $DIR/$tdir
+}
+run_test 243 "EDF classes set through lprocfs"
+
 cleanup_test_300() {
 	trap 0
 	umask $SAVE_UMASK
@@ -96,6 +96,7 @@
 #define lustre_swab_object_update_result NULL
 #define lustre_swab_object_update_reply NULL
 #define lustre_swab_object_update_request NULL
+#define lustre_swab_lustre_handle NULL
 
 #define dump_rniobuf NULL
 #define dump_ioo NULL